@@ -0,0 +1,21 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Counts calls to the global operator new made by the current thread.
+// alloc_counter.cpp replaces operator new for the whole benchmark binary.
+uint64_t allocationCount();
+
+// Records the count at construction; allocations() is the number of heap
+// allocations the thread made since.
+class AllocationScope {
+public:
+    AllocationScope() : start_(allocationCount()) {}
+    uint64_t allocations() const { return allocationCount() - start_; }
+
+private:
+    uint64_t start_;
+};
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,91 @@
+#include <benchmark/benchmark.h>
+#include "calculator.h"
+#include "column_evaluator.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// One formula over many rows: Calculator::evaluate once per row versus the
+// vectorized ColumnEvaluator over whole columns.
+
+namespace {
+
+const char* kFormula = "price * qty - fee";
+
+struct Columns {
+    explicit Columns(size_t rows) : price(rows), qty(rows), fee(rows) {
+        for (size_t i = 0; i < rows; ++i) {
+            price[i] = 10.0 + static_cast<double>(i % 100) * 0.25;
+            qty[i] = static_cast<double>(i % 13 + 1);
+            fee[i] = 0.5 + static_cast<double>(i % 3);
+        }
+    }
+    std::vector<double> price, qty, fee;
+};
+
+// The baseline callers have today: parse and evaluate every row.
+void BM_EvaluatePerRow(benchmark::State& state) {
+    const size_t rows = static_cast<size_t>(state.range(0));
+    Columns columns(rows);
+    Calculator calc;
+    std::map<std::string, double> vars;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < rows; ++i) {
+            vars["price"] = columns.price[i];
+            vars["qty"] = columns.qty[i];
+            vars["fee"] = columns.fee[i];
+            benchmark::DoNotOptimize(calc.evaluate(kFormula, vars));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+// Compiled once, evaluated per row against a slot store.
+void BM_ExecutePerRowCompiled(benchmark::State& state) {
+    const size_t rows = static_cast<size_t>(state.range(0));
+    Columns columns(rows);
+    Calculator calc;
+    auto compiled = calc.compile(kFormula);
+    const Calculator::Program& program = compiled.statements[0];
+    VariableStore store;
+    uint32_t price = 0, qty = 0, fee = 0;
+    calc.symbols().find("price", price);
+    calc.symbols().find("qty", qty);
+    calc.symbols().find("fee", fee);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < rows; ++i) {
+            store.set(price, columns.price[i]);
+            store.set(qty, columns.qty[i]);
+            store.set(fee, columns.fee[i]);
+            benchmark::DoNotOptimize(calc.execute(program, store));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+void BM_ColumnEvaluator(benchmark::State& state) {
+    const size_t rows = static_cast<size_t>(state.range(0));
+    Columns columns(rows);
+    Calculator calc;
+    auto compiled = calc.compile(kFormula);
+    ColumnEvaluator evaluator(calc, compiled.statements[0]);
+    evaluator.bindColumn("price", columns.price.data());
+    evaluator.bindColumn("qty", columns.qty.data());
+    evaluator.bindColumn("fee", columns.fee.data());
+    std::vector<double> out(rows);
+
+    for (auto _ : state) {
+        evaluator.evaluate(rows, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+} // namespace
+
+BENCHMARK(BM_EvaluatePerRow)->Arg(10000);
+BENCHMARK(BM_ExecutePerRowCompiled)->Arg(10000);
+BENCHMARK(BM_ColumnEvaluator)->Arg(10000)->Arg(100000);
@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+#include "calculator.h"
+#include "request_arena.h"
+#include <stdexcept>
+#include <string>
+
+// Cost of an invalid expression through the throwing API (compile() and
+// evaluate() throw std::runtime_error, the caller reads what()) and
+// through tryCompile()/tryEvaluate(), with and without formatting the
+// message. Each benchmark takes the index of the failure below.
+
+namespace {
+
+struct Failure {
+    const char* name;
+    const char* expression;
+};
+
+const Failure kFailures[] = {
+    {"compile_error", "x = (2 + 3 * 4"},
+    {"unknown_variable", "rate * 12 + fee"},
+    {"division_by_zero", "total = 10; total / 0"},
+};
+
+void BM_InvalidThrowing(benchmark::State& state) {
+    const Failure& failure = kFailures[state.range(0)];
+    const std::string expression = failure.expression;
+    Calculator calc;
+    VariableStore vars;
+    for (auto _ : state) {
+        RequestArena::Scope request;
+        try {
+            benchmark::DoNotOptimize(calc.evaluate(calc.compile(expression), vars));
+        } catch (const std::runtime_error& e) {
+            benchmark::DoNotOptimize(e.what());
+        }
+    }
+    state.SetLabel(failure.name);
+}
+
+template <bool kFormat>
+void BM_InvalidTry(benchmark::State& state) {
+    const Failure& failure = kFailures[state.range(0)];
+    const std::string expression = failure.expression;
+    Calculator calc;
+    VariableStore vars;
+    Calculator::CompiledExpression compiled;
+    for (auto _ : state) {
+        RequestArena::Scope request;
+        CalcError error;
+        double result = 0.0;
+        if (!calc.tryCompile(expression, compiled, error) || !calc.tryEvaluate(compiled, vars, result, error)) {
+            if (kFormat) {
+                benchmark::DoNotOptimize(error.message());
+            } else {
+                benchmark::DoNotOptimize(error.code);
+            }
+        }
+    }
+    state.SetLabel(failure.name);
+}
+
+void BM_InvalidTryCode(benchmark::State& state) {
+    BM_InvalidTry<false>(state);
+}
+
+void BM_InvalidTryMessage(benchmark::State& state) {
+    BM_InvalidTry<true>(state);
+}
+
+} // namespace
+
+BENCHMARK(BM_InvalidThrowing)->DenseRange(0, 2);
+BENCHMARK(BM_InvalidTryCode)->DenseRange(0, 2);
+BENCHMARK(BM_InvalidTryMessage)->DenseRange(0, 2);
@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+#include "calculator.h"
+#include "function_table.h"
+#include <memory>
+#include <string>
+
+// The same arithmetic written inline versus called as a defined function:
+// the call should cost about as much as running the body as a program.
+
+namespace {
+
+struct Fixture {
+    Fixture() {
+        calc.evaluate("price = 12.5; qty = 4", vars);
+        table.define(std::make_shared<const Function>(
+            calc.compileFunction("total(p, q, tax) = p * q * (1 + tax) + p / q")));
+        inlined = calc.compile("price * qty * (1 + 0.2) + price / qty");
+        called = calc.compile("total(price, qty, 0.2)");
+    }
+    Calculator calc;
+    VariableStore vars;
+    FunctionTable table;
+    FunctionScope scope{&table, nullptr};
+    Calculator::CompiledExpression inlined;
+    Calculator::CompiledExpression called;
+};
+
+void BM_Function_Inline(benchmark::State& state) {
+    Fixture f;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.calc.evaluate(f.inlined, f.vars, &f.scope));
+    }
+}
+
+void BM_Function_Call(benchmark::State& state) {
+    Fixture f;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.calc.evaluate(f.called, f.vars, &f.scope));
+    }
+}
+
+} // namespace
+
+BENCHMARK(BM_Function_Inline);
+BENCHMARK(BM_Function_Call);
@@ -0,0 +1,206 @@
+#include <benchmark/benchmark.h>
+#include "alloc_counter.h"
+#include "calculator.h"
+#include "optimizer.h"
+#include "request_arena.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Each stage of the pipeline timed on its own over a fixed corpus:
+//   tokenize -> shuntingYard -> compileRPN -> optimize -> execute,
+// plus the end-to-end Calculator::evaluate. Every benchmark takes the
+// corpus index as its argument and reports ns/op, allocs/op and
+// throughput (bytes of expression text and statements per second).
+
+namespace {
+
+struct CorpusEntry {
+    const char* name;
+    std::string prelude;    // defines the variables the expression reads
+    std::string expression;
+};
+
+std::string longExpression() {
+    std::string e = "1";
+    for (int i = 2; i <= 200; ++i) {
+        e += (i % 2 ? " + " : " - ") + std::to_string(i) + (i % 3 ? " * 1.5" : " / 2");
+    }
+    return e;
+}
+
+std::string nestedExpression() {
+    std::string e = "x";
+    for (int i = 0; i < 50; ++i) {
+        e = "(" + e + " + " + std::to_string(i) + ") * 0.5";
+    }
+    return e;
+}
+
+std::string variableHeavyExpression(std::string& prelude) {
+    std::string e;
+    for (int i = 0; i < 40; ++i) {
+        std::string name = "v" + std::to_string(i);
+        prelude += name + " = " + std::to_string(i + 1) + "; ";
+        if (i > 0) e += i % 2 ? " + " : " * ";
+        e += name;
+    }
+    return e;
+}
+
+std::string multiStatementExpression() {
+    std::string e = "a = 1; b = a + 2";
+    for (int i = 0; i < 20; ++i) {
+        e += "; a = a + b * 2; b = (b - a) / 3";
+    }
+    return e + "; a + b";
+}
+
+const std::vector<CorpusEntry>& corpus() {
+    static const std::vector<CorpusEntry> entries = [] {
+        std::vector<CorpusEntry> c;
+        c.push_back({"short", "", "2 + 3 * 4"});
+        c.push_back({"long", "", longExpression()});
+        c.push_back({"nested", "x = 3", nestedExpression()});
+        std::string prelude;
+        std::string heavy = variableHeavyExpression(prelude);
+        c.push_back({"variable_heavy", prelude, heavy});
+        c.push_back({"multi_statement", "", multiStatementExpression()});
+        return c;
+    }();
+    return entries;
+}
+
+// The ';'-separated statements of an expression, as compile() sees them.
+std::vector<std::string_view> statementsOf(const std::string& expression) {
+    std::vector<std::string_view> statements;
+    std::string_view rest(expression);
+    while (!rest.empty()) {
+        size_t end = rest.find(';');
+        std::string_view statement = rest.substr(0, end);
+        size_t first = statement.find_first_not_of(' ');
+        if (first != std::string_view::npos) {
+            statements.push_back(statement.substr(first));
+        }
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+    }
+    return statements;
+}
+
+// Token lists copied out of the arena, so they survive between iterations.
+using HeapTokens = std::vector<Calculator::TokenList>;
+
+HeapTokens tokenized(const Calculator& calc, const std::vector<std::string_view>& statements, bool rpn) {
+    HeapTokens lists;
+    for (auto statement : statements) {
+        RequestArena::Scope scope;
+        auto tokens = calc.tokenize(statement);
+        if (rpn) tokens = calc.shuntingYard(tokens);
+        lists.emplace_back(tokens, std::pmr::new_delete_resource());
+    }
+    return lists;
+}
+
+// Runs one stage per iteration and fills in the common counters.
+template <typename Stage>
+void runStage(benchmark::State& state, const CorpusEntry& entry, size_t statementCount, Stage&& stage) {
+    {
+        RequestArena::Scope warmUp; // sizes the arena, fills the symbol table
+        stage();
+    }
+    uint64_t allocations = 0;
+    for (auto _ : state) {
+        RequestArena::Scope request;
+        AllocationScope counter;
+        stage();
+        allocations += counter.allocations();
+    }
+    state.SetLabel(entry.name);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * entry.expression.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * statementCount));
+    state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations),
+                                                     benchmark::Counter::kAvgIterations);
+}
+
+void BM_Tokenize(benchmark::State& state) {
+    const CorpusEntry& entry = corpus()[state.range(0)];
+    Calculator calc;
+    auto statements = statementsOf(entry.expression);
+    runStage(state, entry, statements.size(), [&] {
+        for (auto statement : statements) {
+            benchmark::DoNotOptimize(calc.tokenize(statement));
+        }
+    });
+}
+
+void BM_ShuntingYard(benchmark::State& state) {
+    const CorpusEntry& entry = corpus()[state.range(0)];
+    Calculator calc;
+    auto statements = statementsOf(entry.expression);
+    HeapTokens tokens = tokenized(calc, statements, false);
+    runStage(state, entry, statements.size(), [&] {
+        for (const auto& list : tokens) {
+            benchmark::DoNotOptimize(calc.shuntingYard(list));
+        }
+    });
+}
+
+void BM_CompileRPN(benchmark::State& state) {
+    const CorpusEntry& entry = corpus()[state.range(0)];
+    Calculator calc;
+    auto statements = statementsOf(entry.expression);
+    HeapTokens rpn = tokenized(calc, statements, true);
+    runStage(state, entry, statements.size(), [&] {
+        for (const auto& list : rpn) {
+            benchmark::DoNotOptimize(calc.compileRPN(list));
+        }
+    });
+}
+
+void BM_Optimize(benchmark::State& state) {
+    const CorpusEntry& entry = corpus()[state.range(0)];
+    Calculator calc;
+    calc.setOptimizationEnabled(false);
+    auto compiled = calc.compile(entry.expression);
+    runStage(state, entry, compiled.statements.size(), [&] {
+        for (const auto& program : compiled.statements) {
+            benchmark::DoNotOptimize(optimizeProgram(program));
+        }
+    });
+}
+
+// The VM on its own; this used to be evaluateRPN.
+void BM_Execute(benchmark::State& state) {
+    const CorpusEntry& entry = corpus()[state.range(0)];
+    Calculator calc;
+    VariableStore store;
+    if (!entry.prelude.empty()) calc.evaluate(entry.prelude, store);
+    auto compiled = calc.compile(entry.expression);
+    runStage(state, entry, compiled.statements.size(), [&] {
+        benchmark::DoNotOptimize(calc.evaluate(compiled, store));
+    });
+}
+
+void BM_Evaluate(benchmark::State& state) {
+    const CorpusEntry& entry = corpus()[state.range(0)];
+    Calculator calc;
+    VariableStore store;
+    if (!entry.prelude.empty()) calc.evaluate(entry.prelude, store);
+    size_t statementCount = statementsOf(entry.expression).size();
+    runStage(state, entry, statementCount, [&] {
+        benchmark::DoNotOptimize(calc.evaluate(entry.expression, store));
+    });
+}
+
+void corpusArgs(benchmark::internal::Benchmark* b) {
+    b->DenseRange(0, static_cast<int>(corpus().size()) - 1);
+}
+
+} // namespace
+
+BENCHMARK(BM_Tokenize)->Apply(corpusArgs);
+BENCHMARK(BM_ShuntingYard)->Apply(corpusArgs);
+BENCHMARK(BM_CompileRPN)->Apply(corpusArgs);
+BENCHMARK(BM_Optimize)->Apply(corpusArgs);
+BENCHMARK(BM_Execute)->Apply(corpusArgs);
+BENCHMARK(BM_Evaluate)->Apply(corpusArgs);
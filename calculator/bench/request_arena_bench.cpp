@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+#include "alloc_counter.h"
+#include "calculator.h"
+#include "expression_cache.h"
+#include "request_arena.h"
+#include <string>
+
+// Heap allocations per request. Scratch data of the pipeline comes from
+// the RequestArena, so once a thread is warm only the compiled program
+// itself allocates, and a request served from the expression cache does
+// not allocate at all.
+
+namespace {
+
+const char* kRequest = "total = (price * qty - discount) * (1 + tax); total / qty";
+
+// A request whose expression is not cached: the full
+// tokenize -> shuntingYard -> compileRPN -> optimize -> execute pipeline.
+void BM_UncachedRequestAllocations(benchmark::State& state) {
+    Calculator calc;
+    VariableStore store;
+    calc.evaluate("price = 12.5; qty = 4; discount = 3; tax = 0.2", store);
+    calc.evaluate(kRequest, store); // warm up the thread's arena
+
+    uint64_t allocations = 0;
+    for (auto _ : state) {
+        RequestArena::Scope request;
+        AllocationScope counter;
+        benchmark::DoNotOptimize(calc.evaluate(kRequest, store));
+        allocations += counter.allocations();
+    }
+    state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations),
+                                                     benchmark::Counter::kAvgIterations);
+}
+
+// The server's steady state: the compiled expression comes from the cache.
+void BM_CachedRequestAllocations(benchmark::State& state) {
+    Calculator calc;
+    ExpressionCache cache(calc);
+    VariableStore store;
+    calc.evaluate("price = 12.5; qty = 4; discount = 3; tax = 0.2", store);
+    const std::string expression = kRequest;
+    calc.evaluate(*cache.getOrCompile(expression), store);
+
+    uint64_t allocations = 0;
+    for (auto _ : state) {
+        RequestArena::Scope request;
+        AllocationScope counter;
+        auto compiled = cache.getOrCompile(expression);
+        benchmark::DoNotOptimize(calc.evaluate(*compiled, store));
+        allocations += counter.allocations();
+    }
+    state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations),
+                                                     benchmark::Counter::kAvgIterations);
+}
+
+} // namespace
+
+BENCHMARK(BM_UncachedRequestAllocations);
+BENCHMARK(BM_CachedRequestAllocations);
@@ -0,0 +1,58 @@
+#include <benchmark/benchmark.h>
+#include "calculator.h"
+#include "result_cache.h"
+#include <memory>
+#include <string>
+
+// A read-only expression re-evaluated while its inputs stay the same:
+// executing it every time versus answering from a ResultCache.
+
+namespace {
+
+const char* kExpression = "(price * qty - fee) * (1 + tax) / (qty + 1) + (price - fee) * (price + fee) / 2";
+
+struct Fixture {
+    Fixture() {
+        calc.evaluate("price = 12.5; qty = 4; fee = 1.25; tax = 0.2", vars);
+        compiled = std::make_shared<const Calculator::CompiledExpression>(calc.compile(kExpression));
+    }
+    Calculator calc;
+    VariableStore vars;
+    ResultCache::CompiledPtr compiled;
+};
+
+void BM_ReadOnly_Execute(benchmark::State& state) {
+    Fixture f;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.calc.evaluate(*f.compiled, f.vars));
+    }
+}
+
+void BM_ReadOnly_Memoized(benchmark::State& state) {
+    Fixture f;
+    ResultCache cache;
+    cache.insert(f.compiled, f.vars, f.calc.evaluate(*f.compiled, f.vars), 1 << 20);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.lookup(f.compiled, f.vars));
+    }
+}
+
+// Worst case: an input changes before every evaluation, so each lookup
+// misses and the result is inserted again.
+void BM_ReadOnly_MemoizedMiss(benchmark::State& state) {
+    Fixture f;
+    ResultCache cache;
+    uint32_t qty = f.calc.intern("qty");
+    for (auto _ : state) {
+        f.vars.set(qty, 4);
+        if (!cache.lookup(f.compiled, f.vars)) {
+            cache.insert(f.compiled, f.vars, f.calc.evaluate(*f.compiled, f.vars), 1 << 20);
+        }
+    }
+}
+
+} // namespace
+
+BENCHMARK(BM_ReadOnly_Execute);
+BENCHMARK(BM_ReadOnly_Memoized);
+BENCHMARK(BM_ReadOnly_MemoizedMiss);
@@ -0,0 +1,67 @@
+#include <benchmark/benchmark.h>
+#include "calculator.h"
+#include "script_scheduler.h"
+#include <string>
+
+// A long script of mostly independent statements: sequential evaluate()
+// versus the dependency-DAG scheduler on a work-stealing pool.
+
+namespace {
+
+// `lanes` independent accumulators, each updated `statements / lanes`
+// times with a longer expression, so statements of different lanes can
+// run side by side.
+std::string makeScript(size_t statements, size_t lanes) {
+    std::string script;
+    for (size_t i = 0; i < lanes; ++i) {
+        script += "a" + std::to_string(i) + " = " + std::to_string(i + 1) + "; ";
+    }
+    for (size_t i = lanes; i < statements; ++i) {
+        std::string lane = "a" + std::to_string(i % lanes);
+        script += lane + " = (" + lane + " * 0.5 + 3) * (" + lane + " - 1.5) / (" + lane + " * " + lane +
+                  " + 1) + (" + lane + " + 2) * 0.25; ";
+    }
+    script += "a0";
+    return script;
+}
+
+void BM_Script_Sequential(benchmark::State& state) {
+    Calculator calc;
+    auto compiled = calc.compile(makeScript(static_cast<size_t>(state.range(0)), 16));
+    for (auto _ : state) {
+        VariableStore vars;
+        benchmark::DoNotOptimize(calc.evaluate(compiled, vars));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_Script_Parallel(benchmark::State& state) {
+    WorkStealingPool pool(static_cast<size_t>(state.range(1)));
+    Calculator calc;
+    calc.setScriptPool(&pool);
+    auto compiled = calc.compile(makeScript(static_cast<size_t>(state.range(0)), 16));
+    if (!compiled.plan) {
+        state.SkipWithError("script was not planned");
+        return;
+    }
+    for (auto _ : state) {
+        VariableStore vars;
+        benchmark::DoNotOptimize(calc.evaluate(compiled, vars));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Planning cost, paid once per compile() of a long script.
+void BM_Script_BuildPlan(benchmark::State& state) {
+    Calculator calc;
+    auto compiled = calc.compile(makeScript(static_cast<size_t>(state.range(0)), 16));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buildScriptPlan(compiled));
+    }
+}
+
+} // namespace
+
+BENCHMARK(BM_Script_Sequential)->Arg(128)->Arg(1024);
+BENCHMARK(BM_Script_Parallel)->Args({128, 1})->Args({128, 4})->Args({1024, 1})->Args({1024, 4})->UseRealTime();
+BENCHMARK(BM_Script_BuildPlan)->Arg(128)->Arg(1024);
@@ -0,0 +1,56 @@
+#ifndef CALC_ERROR_H
+#define CALC_ERROR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Why an expression failed to compile or run, as reported by the
+// non-throwing Calculator API (tryCompile(), tryEvaluate()).
+enum class CalcErrc : uint8_t {
+    OK = 0,
+    // compile
+    INVALID_VARIABLE_NAME,      // "1var"
+    INVALID_NUMBER,             // "1.2.3"
+    INVALID_CHARACTER,
+    MISMATCHED_PARENTHESES,
+    UNEXPECTED_COMMA,           // ',' outside a call
+    INVALID_ARGUMENTS,          // "f(1 +, 2)"
+    MISSING_OPERANDS,           // "2 +"
+    UNKNOWN_OPERATOR,
+    MISSING_ASSIGNMENT_OPERANDS,
+    INVALID_ASSIGNMENT_TARGET,  // "2 = 3"
+    UNEXPECTED_TOKEN,
+    NOT_A_SINGLE_VALUE,         // "2 3"
+    TOO_MANY_SYMBOLS,           // a new name past Calculator::setSymbolLimit()
+    // run, and compile for unknown names with UnknownNames::REJECT
+    UNKNOWN_VARIABLE,
+    DIVISION_BY_ZERO,
+    UNKNOWN_FUNCTION,
+    ARGUMENT_COUNT,
+    CALL_DEPTH,
+};
+
+// A failure with just enough data to describe it. Nothing is formatted or
+// allocated until message() is called, so callers that only look at the
+// code pay no more for an error than for a result.
+struct CalcError {
+    CalcErrc code = CalcErrc::OK;
+    // Byte offset into the compiled expression: of the offending token for
+    // compile errors, of the failing statement for runtime errors (bytecode
+    // keeps no positions).
+    uint32_t offset = 0;
+    // What the message quotes: a token of the source expression or a name
+    // from the Calculator's symbol table. Both must still be alive when
+    // message() is called.
+    std::string_view subject;
+    uint32_t expected = 0; // ARGUMENT_COUNT: parameters of the function
+    uint32_t actual = 0;   // ARGUMENT_COUNT: arguments passed; UNEXPECTED_TOKEN: token type
+
+    explicit operator bool() const { return code != CalcErrc::OK; }
+
+    // The text the throwing API puts into its std::runtime_error.
+    std::string message() const;
+};
+
+#endif // CALC_ERROR_H
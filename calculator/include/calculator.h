@@ -2,34 +2,221 @@
 #define CALCULATOR_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
+#include <chrono>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <stdexcept>
+#include <cstdint>
+#include "calc_error.h"
+#include "symbol_table.h"
+
+struct ScriptPlan;
+struct Function;
+struct FunctionScope;
+class WorkStealingPool;
 
 class Calculator {
 public:
-    enum class TokenType { NUMBER, OPERATOR, LEFT_PAREN, RIGHT_PAREN, VARIABLE, ASSIGNMENT };
+    // FUNCTION is a name directly followed by '(', as in "f(2, x)".
+    enum class TokenType { NUMBER, OPERATOR, LEFT_PAREN, RIGHT_PAREN, VARIABLE, ASSIGNMENT, FUNCTION, COMMA };
+    // Tokens point into the source expression, which must outlive them.
     struct Token {
         TokenType type;
-        std::string value;
+        std::string_view text;  // lexeme, e.g. "12.5", "rate", "+"
+        double number = 0.0;    // value of NUMBER tokens, parsed once while lexing
         int precedence = -1;
         bool isLeftAssociative = true;
-        std::string variableName; // Used for variable tokens
+        uint32_t argCount = 0;  // FUNCTION tokens in RPN: arguments of the call
+    };
+
+    // Bytecode for the stack VM. Operands index Program::constants for
+    // PUSH_CONST, Program::symbols for LOAD_VAR/STORE, temporary
+    // indices for SAVE_TEMP (copy top of stack) / LOAD_TEMP, Program::calls
+    // for CALL and parameter indices for LOAD_ARG (function bodies only).
+    enum class OpCode : uint8_t { PUSH_CONST, LOAD_VAR, ADD, SUB, MUL, DIV, STORE, SAVE_TEMP, LOAD_TEMP, CALL, LOAD_ARG };
+    struct Instruction {
+        OpCode op;
+        uint32_t operand = 0;
+    };
+
+    // A call site: the function is named by its SymbolTable slot and
+    // looked up when the call runs, so it may be defined after the caller
+    // was compiled.
+    struct Call {
+        uint32_t function;
+        uint32_t argCount;
+    };
+
+    // One statement compiled from RPN. Operand counts and assignment targets
+    // are checked at compile time, so execution only has to deal with
+    // unknown variables and functions, arity mismatches and division by zero.
+    struct Program {
+        std::vector<Instruction> code;
+        std::vector<double> constants;
+        std::vector<uint32_t> symbols; // SymbolTable slots of the LOAD_VAR/STORE operands
+        size_t maxStackDepth = 0;
+        uint32_t tempCount = 0;        // temporaries used by SAVE_TEMP/LOAD_TEMP
+        std::vector<Call> calls;       // CALL operands
+        uint32_t offset = 0;           // where the statement starts in the source expression
+    };
+
+    // An expression already run through tokenize + shuntingYard + compileRPN:
+    // one program per ';'-separated statement.
+    struct CompiledExpression {
+        std::vector<Program> statements;
+        bool assigns = false; // some statement has a STORE
+        // Some statement calls a function, which may read variables the
+        // statement does not name; plans and memoization leave it alone.
+        bool calls = false;
+        // Statement dependencies, for scripts compiled while a script pool
+        // was set and worth running in parallel (see setScriptPool()).
+        std::shared_ptr<const ScriptPlan> plan;
+    };
+
+    // What compiling does with a name that a statement only reads (never
+    // assigns) and symbols() does not know. No session can hold a value
+    // for it, so REJECT fails with UNKNOWN_VARIABLE (UNKNOWN_FUNCTION for
+    // calls) instead of interning a name nothing will ever use. INTERN
+    // keeps it, for callers that supply variables by name afterwards:
+    // bound formulas, columns, the std::map adapter.
+    enum class UnknownNames : uint8_t { INTERN, REJECT };
+
+    // Pipeline stages reported to a StageObserver.
+    enum class Stage { TOKENIZE, SHUNTING_YARD, COMPILE, OPTIMIZE, EXECUTE };
+    static constexpr size_t kStageCount = 5;
+    using StageClock = std::chrono::steady_clock;
+
+    // Receives the duration of every stage: once per statement for the
+    // compile stages, once per evaluate() of a compiled expression for
+    // EXECUTE. Called from whichever thread runs the stage, so
+    // implementations must be thread-safe.
+    class StageObserver {
+    public:
+        virtual ~StageObserver() = default;
+        virtual void onStage(Stage stage, StageClock::duration elapsed) = 0;
     };
 
-    double evaluate(const std::string& expression, std::map<std::string, double>& variables);
+    double evaluate(const std::string& expression, std::map<std::string, double>& variables) const;
+    double evaluate(const std::string& expression, VariableStore& variables) const;
+
+    // Split into two steps so callers can compile once and evaluate many times.
+    // Lexing/parsing errors are reported by compile(), before any statement runs.
+    // Variable names are interned into symbols() here, once their statement
+    // has compiled, so a compiled expression may only be run by the
+    // Calculator that compiled it.
+    CompiledExpression compile(const std::string& expression) const;
+    // CALL instructions find their functions in `functions`; without one
+    // every call fails with "Unknown function".
+    double evaluate(const CompiledExpression& compiled, VariableStore& variables,
+                    const FunctionScope* functions = nullptr) const;
+
+    // Compatibility adapter: copies the referenced variables into a slot
+    // store, runs the program and writes assigned values back to the map.
+    double evaluate(const CompiledExpression& compiled, std::map<std::string, double>& variables) const;
+
+    // Runs a single statement on a flat double stack.
+    double execute(const Program& program, VariableStore& variables,
+                   const FunctionScope* functions = nullptr) const;
+
+    // Non-throwing counterparts of compile(), evaluate() and execute() for
+    // callers that see many invalid expressions. A failure is returned as a
+    // CalcError instead of thrown, and its message is only built if the
+    // caller asks for it; the throwing versions are wrappers that throw
+    // that message. Variables assigned before a runtime error stay
+    // assigned either way.
+    bool tryCompile(std::string_view expression, CompiledExpression& compiled, CalcError& error,
+                    UnknownNames unknown = UnknownNames::INTERN) const;
+    bool tryEvaluate(const CompiledExpression& compiled, VariableStore& variables, double& result,
+                     CalcError& error, const FunctionScope* functions = nullptr) const;
+    bool tryExecute(const Program& program, VariableStore& variables, double& result,
+                    CalcError& error, const FunctionScope* functions = nullptr) const;
+
+    // Compiles a definition "name(a, b) = body" (see function_table.h).
+    // Parameters are read with LOAD_ARG; other names in the body are
+    // session variables, read when the function is called. The body may
+    // call functions but not assign. Throws std::runtime_error.
+    Function compileFunction(const std::string& definition) const;
+
+    // Calls nested deeper than this fail, which also stops recursion.
+    static constexpr int kMaxCallDepth = 64;
+
+    const SymbolTable& symbols() const { return symbols_; }
+
+    // Interns a variable name as compile() would. Used to map variables
+    // restored from elsewhere (e.g. a session snapshot) onto this
+    // Calculator's slots.
+    uint32_t intern(std::string_view name) const { return symbols_.intern(name); }
+
+    // Caps the names compile() may add to symbols(); past it, statements
+    // with new names fail with TOO_MANY_SYMBOLS. 0 (the default) means no
+    // limit. intern() is not capped: what it restores was admitted before.
+    void setSymbolLimit(size_t limit) { symbols_.setLimit(limit); }
+
+    // Runs optimizeProgram() on every statement in compile(). On by default.
+    void setOptimizationEnabled(bool enabled) { optimize_ = enabled; }
+
+    // Stage timing is off (nullptr) by default and costs nothing then.
+    // The observer must outlive the Calculator or be reset first.
+    void setStageObserver(StageObserver* observer) { observer_ = observer; }
+
+    // Runs long scripts with independent statements on the pool (see
+    // script_scheduler.h). compile() plans scripts of at least
+    // minStatements statements, and keeps the plan if the longest
+    // dependency chain is at most half of them; evaluate() runs planned
+    // scripts in parallel. Off (nullptr) by default. The pool must outlive
+    // the Calculator or be reset first.
+    static constexpr size_t kDefaultParallelStatements = 64;
+    void setScriptPool(WorkStealingPool* pool, size_t minStatements = kDefaultParallelStatements) {
+        scriptPool_ = pool;
+        parallelStatements_ = minStatements;
+    }
+
+    // Human-readable listing of the compiled (and optimized) bytecode.
+    std::string disassemble(const CompiledExpression& compiled) const;
+
+    // Heap bytes held by compiled code: instructions, constants, symbol
+    // and call lists. Feeds the session memory estimate (session_store.h).
+    static size_t estimateBytes(const Program& program);
+    static size_t estimateBytes(const CompiledExpression& compiled);
+
+    // The individual stages of compile(), one statement at a time. Public
+    // so calculator_bench can time them separately.
+    // Token lists are scratch data and live in the RequestArena, so they
+    // must be used inside a RequestArena::Scope.
+    using TokenList = std::pmr::vector<Token>;
+    TokenList tokenize(std::string_view expression) const;
+    TokenList shuntingYard(const TokenList& tokens) const;
+    // Names listed in `parameters` compile to LOAD_ARG instead of LOAD_VAR.
+    Program compileRPN(const TokenList& rpnTokens,
+                       const std::vector<std::string>& parameters = {}) const;
 
 private:
-    std::vector<Token> tokenize(const std::string& expression);
-    std::vector<Token> shuntingYard(const std::vector<Token>& tokens);
-    double evaluateRPN(std::vector<Token> rpnTokens, std::map<std::string, double>& variables);
-
-    bool isOperator(char c);
-    int getPrecedence(char op);
-    bool isLeftAssociative(char op);
-    bool isAlpha(char c);
-    bool isValidVariableName(const std::string& name);
+    // The stages behind the throwing versions above.
+    bool tokenize(std::string_view expression, TokenList& tokens, CalcError& error) const;
+    bool shuntingYard(const TokenList& tokens, TokenList& rpn, CalcError& error) const;
+    bool compileRPN(const TokenList& rpnTokens, const std::vector<std::string>& parameters,
+                    UnknownNames unknown, Program& program, CalcError& error) const;
+
+    bool run(const Program& program, VariableStore& variables, const FunctionScope* functions,
+             const double* args, int depth, double& result, CalcError& error) const;
+
+    bool isOperator(char c) const;
+    int getPrecedence(char op) const;
+    bool isLeftAssociative(char op) const;
+    bool isAlpha(char c) const;
+    bool isValidVariableName(const std::string& name) const;
+
+    // Interning new names is not an observable state change, so compile()
+    // stays const and a single Calculator can be shared between threads.
+    mutable SymbolTable symbols_;
+    bool optimize_ = true;
+    StageObserver* observer_ = nullptr;
+    WorkStealingPool* scriptPool_ = nullptr;
+    size_t parallelStatements_ = kDefaultParallelStatements;
 };
 
 #endif // CALCULATOR_H
\ No newline at end of file
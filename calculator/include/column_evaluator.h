@@ -0,0 +1,46 @@
+#ifndef COLUMN_EVALUATOR_H
+#define COLUMN_EVALUATOR_H
+
+#include "calculator.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Evaluates one compiled statement over many rows of variable values, e.g.
+// "price * qty - fee" over whole columns. Rows are processed in blocks of
+// kBlockSize; every instruction becomes a plain loop over a block of
+// doubles, which the compiler auto-vectorizes.
+class ColumnEvaluator {
+public:
+    static constexpr size_t kBlockSize = 256;
+
+    // The program must not assign variables or call functions. Throws
+    // std::runtime_error.
+    ColumnEvaluator(const Calculator& calculator, const Calculator::Program& program);
+
+    // Binds a variable to an array with one value per row. The array must
+    // stay alive until evaluate() returns.
+    void bindColumn(const std::string& name, const double* values);
+    // Binds a variable to a value shared by all rows.
+    void bindScalar(const std::string& name, double value);
+
+    // Writes one result per row to out. Throws for unbound variables and
+    // for division by zero (naming the first offending row).
+    void evaluate(size_t rows, double* out) const;
+    std::vector<double> evaluate(size_t rows) const;
+
+private:
+    struct Binding {
+        bool bound = false;
+        const double* column = nullptr; // nullptr: use scalar
+        double scalar = 0.0;
+    };
+
+    Binding* bindingFor(const std::string& name);
+
+    const Calculator& calculator_;
+    Calculator::Program program_;
+    std::vector<Binding> bindings_; // parallel to program_.symbols
+};
+
+#endif // COLUMN_EVALUATOR_H
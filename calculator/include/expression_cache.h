@@ -0,0 +1,74 @@
+#ifndef EXPRESSION_CACHE_H
+#define EXPRESSION_CACHE_H
+
+#include "calculator.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Bounded LRU cache of compiled expressions keyed by the expression text.
+// Thread-safe: the key space is split into independently locked shards,
+// and compilation of a missing entry happens outside of any lock.
+class ExpressionCache {
+public:
+    using CompiledPtr = std::shared_ptr<const Calculator::CompiledExpression>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+    };
+
+    static constexpr size_t kDefaultCapacity = 4096;
+    static constexpr size_t kDefaultShardCount = 16;
+
+    explicit ExpressionCache(const Calculator& calculator,
+                             size_t capacity = kDefaultCapacity,
+                             size_t shardCount = kDefaultShardCount);
+
+    // Returns the cached program for the expression, compiling and inserting
+    // it on a miss. Compilation errors are thrown and never cached.
+    CompiledPtr getOrCompile(const std::string& expression);
+
+    // Same, but a compilation error is returned as nullptr and `error`
+    // instead of thrown. `unknown` is passed on to Calculator::tryCompile()
+    // on a miss; a hit is returned whichever mode compiled it.
+    CompiledPtr tryGetOrCompile(const std::string& expression, CalcError& error,
+                                Calculator::UnknownNames unknown = Calculator::UnknownNames::INTERN);
+
+    // Returns the cached program or nullptr, without compiling.
+    CompiledPtr lookup(const std::string& expression);
+
+    void setCapacity(size_t capacity);
+    void clear();
+    Stats stats() const;
+
+private:
+    struct Shard {
+        using Entry = std::pair<std::string, CompiledPtr>;
+
+        mutable std::mutex mutex;
+        std::list<Entry> lru; // most recently used at the front
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t capacity = 0;
+    };
+
+    Shard& shardFor(const std::string& expression);
+    CompiledPtr findLocked(Shard& shard, const std::string& expression);
+    void evictLocked(Shard& shard);
+
+    const Calculator& calculator_;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
+
+#endif // EXPRESSION_CACHE_H
@@ -0,0 +1,74 @@
+#ifndef FORMULA_GRAPH_H
+#define FORMULA_GRAPH_H
+
+#include "calculator.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Bound formulas of one variable store: a variable defined by an
+// expression ("y = x * 2") instead of a value. The graph tracks which
+// variables every formula reads; when inputs change, propagate()
+// recomputes only the formulas downstream of them, in topological order.
+// Cycles are rejected when a formula is bound.
+//
+// A formula whose evaluation fails (unknown input, division by zero)
+// leaves its variable undefined and remembers the error, so everything
+// downstream of it becomes undefined too, until the inputs are fixed.
+// Not thread-safe; lives next to the VariableStore it updates.
+class FormulaGraph {
+public:
+    using FormulaPtr = std::shared_ptr<const Calculator::CompiledExpression>;
+
+    struct Binding {
+        uint32_t slot = 0;
+        std::string source; // the bound "target = expression" text
+        std::string error;  // of the last evaluation, empty if it succeeded
+    };
+
+    // Binds the target of a single "target = expression" statement and
+    // evaluates it and everything downstream. Replaces an existing binding
+    // of the same target. Throws std::runtime_error for other statement
+    // shapes, function calls and cycles, leaving the graph unchanged. Returns whether
+    // the target has a value.
+    bool bind(const Calculator& calculator, FormulaPtr formula, std::string source, VariableStore& variables);
+
+    // The variable keeps its current value as a plain variable.
+    bool unbind(uint32_t slot);
+    void clear();
+
+    bool empty() const { return formulas_.empty(); }
+    bool isBound(uint32_t slot) const { return formulas_.count(slot) > 0; }
+    std::vector<Binding> bindings() const;
+
+    // Heap bytes held by the bindings: compiled formulas, sources, errors
+    // and the edges in both directions.
+    size_t estimateBytes() const;
+
+    // Bound variables are only written by their formulas. Throws
+    // std::runtime_error if `compiled` assigns one; call before running it.
+    void checkAssignments(const Calculator& calculator, const Calculator::CompiledExpression& compiled) const;
+
+    // Recomputes the formulas downstream of the variables assigned by
+    // `compiled`, or of the `changed` slots.
+    void propagate(const Calculator& calculator, const Calculator::CompiledExpression& compiled, VariableStore& variables);
+    void propagate(const Calculator& calculator, const std::vector<uint32_t>& changed, VariableStore& variables);
+
+private:
+    struct Formula {
+        FormulaPtr compiled;
+        std::string source;
+        std::vector<uint32_t> inputs; // distinct LOAD_VAR slots
+        std::string error;
+    };
+
+    void recompute(const Calculator& calculator, uint32_t slot, Formula& formula, VariableStore& variables);
+    void unlink(uint32_t slot, const Formula& formula);
+
+    std::unordered_map<uint32_t, Formula> formulas_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> dependents_; // input -> formulas reading it
+};
+
+#endif // FORMULA_GRAPH_H
@@ -0,0 +1,63 @@
+#ifndef FUNCTION_TABLE_H
+#define FUNCTION_TABLE_H
+
+#include "calculator.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A named function with parameters, "f(a, b) = a * b + 3", compiled once
+// by Calculator::compileFunction(). A call pushes its arguments and runs
+// the body like any other program, reading parameter i with LOAD_ARG i.
+struct Function {
+    std::string name;
+    uint32_t slot = 0;               // of the name, in the Calculator's SymbolTable
+    std::vector<std::string> parameters;
+    std::string source;              // the definition as given
+    Calculator::Program body;
+};
+
+// Functions by name slot, for O(1) lookup from CALL. Not thread-safe;
+// a table shared between threads must not change while it is read
+// (CalcService swaps in a new copy instead).
+class FunctionTable {
+public:
+    using FunctionPtr = std::shared_ptr<const Function>;
+
+    // Replaces an existing function of the same name.
+    void define(FunctionPtr function);
+    bool remove(uint32_t slot);
+    void clear();
+
+    const Function* find(uint32_t slot) const {
+        return slot < functions_.size() ? functions_[slot].get() : nullptr;
+    }
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+    std::vector<FunctionPtr> functions() const; // in slot order
+    // Heap bytes held by the table and its functions: names, parameters,
+    // sources and compiled bodies.
+    size_t estimateBytes() const;
+
+private:
+    std::vector<FunctionPtr> functions_; // indexed by slot
+    size_t count_ = 0;
+};
+
+// Where CALL instructions look functions up: the session's own first,
+// then the global ones. Either table may be missing.
+struct FunctionScope {
+    const FunctionTable* local = nullptr;
+    const FunctionTable* global = nullptr;
+
+    const Function* find(uint32_t slot) const {
+        const Function* function = local ? local->find(slot) : nullptr;
+        if (!function && global) {
+            function = global->find(slot);
+        }
+        return function;
+    }
+};
+
+#endif // FUNCTION_TABLE_H
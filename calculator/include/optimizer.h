@@ -0,0 +1,18 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "calculator.h"
+
+// Optimization pass over one compiled statement, run between compileRPN
+// and execution:
+//  - constant subexpressions are folded ((2*3600) -> 7200);
+//  - x*1, 1*x, x/1, x+0, 0+x and x-0 are reduced to x;
+//  - a repeated subexpression is computed once, kept in a temporary
+//    (SAVE_TEMP) and reused (LOAD_TEMP).
+// Divisions by a constant zero are never folded, so "Division by zero" is
+// still raised at run time, by the same statement as before. Subexpressions
+// that assign, call a function, or read a variable the statement assigns,
+// are not shared.
+Calculator::Program optimizeProgram(const Calculator::Program& program);
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,40 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+// Per-thread scratch memory for one request. Data that only lives while an
+// expression is compiled or evaluated (tokens, the shunting-yard queues,
+// the optimizer's DAG, oversized VM stacks) is carved from a monotonic
+// buffer and released all at once when the outermost Scope on the thread
+// ends. The buffer grows to the thread's high-water mark, up to
+// kMaxCapacity, after which scratch allocations no longer reach the heap;
+// bigger outliers take the rest from the heap. A buffer that has not
+// overflowed for kShrinkAfter requests is halved, down to
+// kInitialCapacity, so one large request does not pin memory on the
+// thread for good.
+//
+// Nothing allocated from resource() may outlive the Scope it was made in.
+class RequestArena {
+public:
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // The calling thread's arena. Only valid inside a Scope.
+    static std::pmr::memory_resource* resource();
+
+    // Size of the calling thread's preallocated buffer, in bytes.
+    static size_t capacity();
+
+    static constexpr size_t kInitialCapacity = 16 * 1024;
+    static constexpr size_t kMaxCapacity = 1024 * 1024;
+    static constexpr size_t kShrinkAfter = 1024;
+};
+
+#endif // REQUEST_ARENA_H
@@ -0,0 +1,58 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "calculator.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Memoized results of read-only expressions (no assignment) for one
+// VariableStore, i.e. one session. An entry is keyed by the compiled
+// expression and remembers the version of every variable it read; it is
+// used only while none of them has been written since. Any write -- an
+// assignment by a script, a recomputed bound formula, clean -- therefore
+// makes exactly the expressions reading that variable recompute.
+//
+// Bounded by an estimated byte budget, least recently used entries go
+// first. Not thread-safe: guarded like the VariableStore it describes.
+class ResultCache {
+public:
+    using CompiledPtr = std::shared_ptr<const Calculator::CompiledExpression>;
+
+    // Only expressions that assign nothing can be memoized, and only if
+    // they call no function: its body may read variables the expression
+    // does not name, and it may be redefined.
+    static bool cacheable(const Calculator::CompiledExpression& compiled) {
+        return !compiled.assigns && !compiled.calls;
+    }
+
+    // The memoized result, if all inputs are unchanged.
+    std::optional<double> lookup(const CompiledPtr& compiled, const VariableStore& variables);
+
+    // Remembers the result of a successful evaluation against the current
+    // variables, then evicts down to maxBytes. Returns the number of
+    // entries evicted.
+    size_t insert(const CompiledPtr& compiled, const VariableStore& variables, double result, size_t maxBytes);
+
+    void clear();
+    size_t size() const { return lru_.size(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Entry {
+        CompiledPtr compiled; // keeps the key's address from being reused
+        std::vector<std::pair<uint32_t, uint32_t>> inputs; // slot, version
+        double result = 0.0;
+        size_t bytes = 0;
+    };
+
+    std::list<Entry> lru_; // most recently used at the front
+    std::unordered_map<const Calculator::CompiledExpression*, std::list<Entry>::iterator> index_;
+    size_t bytes_ = 0;
+};
+
+#endif // RESULT_CACHE_H
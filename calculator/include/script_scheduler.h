@@ -0,0 +1,40 @@
+#ifndef SCRIPT_SCHEDULER_H
+#define SCRIPT_SCHEDULER_H
+
+#include "calculator.h"
+#include "work_stealing_pool.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Read/write dependencies between the statements of a script. Statement j
+// depends on an earlier statement i when j reads a variable i assigns
+// (read after write), assigns a variable i reads (write after read) or
+// assigns one i assigns too (write after write). Statements without a
+// path between them touch disjoint data and may run in any order, so
+// running the DAG leaves the same variables as running the statements
+// one after another.
+struct ScriptPlan {
+    std::vector<std::vector<uint32_t>> dependents; // per statement
+    std::vector<uint32_t> dependencyCount;         // per statement
+    std::vector<uint32_t> roots;                   // statements without dependencies
+    std::vector<uint32_t> writes;                  // distinct slots assigned by the script
+    size_t depth = 0;                              // statements on the longest chain
+};
+
+ScriptPlan buildScriptPlan(const Calculator::CompiledExpression& compiled);
+
+// Runs the script on the pool along its plan and stores the result of the
+// last statement in `result`. Independent statements run concurrently on the shared
+// store, which is safe because they touch different slots.
+//
+// Errors have sequential semantics: when a statement fails, nothing new
+// is started, the assigned variables are restored and the script is run
+// again one statement at a time, which stops at the statement sequential
+// execution would have stopped at, leaves the same variables and returns
+// false with the same error. Only failing scripts pay for the replay.
+bool runScript(const Calculator& calculator, const Calculator::CompiledExpression& compiled,
+               const ScriptPlan& plan, VariableStore& variables, WorkStealingPool& pool,
+               double& result, CalcError& error);
+
+#endif // SCRIPT_SCHEDULER_H
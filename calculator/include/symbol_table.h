@@ -0,0 +1,136 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Interns variable names into dense integer slots. Compiled programs refer
+// to variables by slot only, so the name lookup is paid once at compile time.
+// Slots are never reused or removed, so the table can be capped: tryIntern()
+// refuses new names beyond the limit. Thread-safe.
+class SymbolTable {
+public:
+    uint32_t intern(std::string_view name); // ignores the limit
+    bool tryIntern(std::string_view name, uint32_t& slot) { return tryIntern(name, slot, true); }
+    bool find(std::string_view name, uint32_t& slot) const;
+    const std::string& name(uint32_t slot) const;
+    size_t size() const;
+
+    void setLimit(size_t limit) { limit_.store(limit, std::memory_order_relaxed); } // 0: none
+    size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+
+    // Heap bytes held by the names and the index, approximately.
+    size_t estimateBytes() const;
+
+private:
+    bool tryIntern(std::string_view name, uint32_t& slot, bool limited);
+    bool lookup(const std::string& name, uint32_t& slot) const; // requires mutex_
+
+    mutable std::shared_mutex mutex_;
+    std::atomic<size_t> limit_{0};
+    size_t nameBytes_ = 0; // heap bytes of names too long for the SSO buffer
+    std::unordered_map<std::string, uint32_t> slots_;
+    std::deque<std::string> names_; // deque keeps references stable on growth
+};
+
+// Variable values of one session. Programs name variables by the slots of
+// the SymbolTable they were compiled against, which every session shares;
+// a store maps only the slots it has assigned to dense entries of its own,
+// so its size follows the session's variables rather than the table.
+// Every entry also has a version that every write (assignment, erase,
+// clear) bumps, so readers such as ResultCache can tell whether a value
+// changed since they last looked.
+class VariableStore {
+public:
+    static constexpr uint32_t kNoEntry = UINT32_MAX;
+
+    bool has(uint32_t slot) const {
+        const uint32_t e = find(slot);
+        return e != kNoEntry && defined_[e];
+    }
+    double get(uint32_t slot) const { return values_[find(slot)]; } // requires has(slot)
+    void set(uint32_t slot, double value) { assign(entry(slot), value); }
+
+    void erase(uint32_t slot) {
+        const uint32_t e = find(slot);
+        if (e != kNoEntry) {
+            defined_[e] = 0;
+            ++versions_[e];
+        }
+    }
+    void clear();
+
+    size_t size() const { return slots_.size(); } // entries, defined or not
+    size_t count() const;                          // number of defined variables
+
+    // 0 for slots never written. Wraps after 2^32 writes of one slot.
+    uint32_t version(uint32_t slot) const {
+        const uint32_t e = find(slot);
+        return e == kNoEntry ? 0 : versions_[e];
+    }
+
+    // Calls fn(slot, value) for every defined variable, in no particular order.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t e = 0; e < slots_.size(); ++e) {
+            if (defined_[e]) fn(slots_[e], values_[e]);
+        }
+    }
+
+    // Heap bytes held by the store.
+    size_t estimateBytes() const;
+
+    // Entries, for the VM. find() returns kNoEntry for a slot the store
+    // has never seen; entry() adds it, undefined. Entries are never
+    // removed, and entry() only modifies the store for a new slot, so
+    // threads whose slots all have entries already may write them
+    // concurrently (see runScript()).
+    uint32_t find(uint32_t slot) const {
+        if (buckets_.empty()) {
+            return kNoEntry;
+        }
+        const size_t mask = buckets_.size() - 1;
+        for (size_t i = bucketOf(slot);; i = (i + 1) & mask) {
+            const Bucket& bucket = buckets_[i];
+            if (bucket.entry == kNoEntry || bucket.slot == slot) {
+                return bucket.entry;
+            }
+        }
+    }
+    uint32_t entry(uint32_t slot);
+    double value(uint32_t entry) const { return values_[entry]; }
+    bool defined(uint32_t entry) const { return defined_[entry] != 0; }
+    void assign(uint32_t entry, double value) {
+        values_[entry] = value;
+        defined_[entry] = 1;
+        ++versions_[entry];
+    }
+
+private:
+    // slot -> entry: open addressing with linear probing, a power-of-two
+    // number of buckets, at most half full. The VM looks every variable up
+    // once per run, so this has to be cheaper than a node-based map.
+    struct Bucket {
+        uint32_t slot = 0;
+        uint32_t entry = kNoEntry; // kNoEntry: empty
+    };
+    size_t bucketOf(uint32_t slot) const {
+        return static_cast<uint32_t>(slot * 0x9E3779B1u) >> shift_; // Fibonacci hashing
+    }
+    void rehash(size_t bucketCount);
+
+    std::vector<Bucket> buckets_;
+    unsigned shift_ = 32;
+    std::vector<uint32_t> slots_;     // entry -> slot
+    std::vector<double> values_;
+    std::vector<uint8_t> defined_;    // bytes, not vector<bool>, so entries can be written independently
+    std::vector<uint32_t> versions_;  // per entry, for the same reason
+};
+
+#endif // SYMBOL_TABLE_H
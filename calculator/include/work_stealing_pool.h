@@ -0,0 +1,51 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool for many small, dependent tasks. Every worker owns a deque:
+// tasks submitted from a worker go to its own deque and are taken back
+// newest first, which keeps a chain of tasks hot on one core; idle workers
+// steal the oldest task of another worker. Tasks submitted from outside
+// the pool are spread round-robin. Tasks must not throw.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~WorkStealingPool(); // runs the remaining tasks, then joins
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Task task);
+    size_t size() const { return workers_.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popLocal(size_t index, Task& task);
+    bool steal(size_t thief, Task& task);
+    void workerLoop(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_{0}; // submitted, not yet taken
+    std::atomic<size_t> idle_{0};   // workers about to sleep or asleep
+    std::atomic<size_t> nextQueue_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+#endif // WORK_STEALING_POOL_H
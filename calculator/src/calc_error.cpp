@@ -0,0 +1,47 @@
+#include "calc_error.h"
+
+std::string CalcError::message() const {
+    const std::string quoted(subject);
+    switch (code) {
+        case CalcErrc::OK:
+            return std::string();
+        case CalcErrc::INVALID_VARIABLE_NAME:
+            return "Invalid variable name: " + quoted;
+        case CalcErrc::INVALID_NUMBER:
+            return "Invalid number: " + quoted;
+        case CalcErrc::INVALID_CHARACTER:
+            return "Invalid character in expression: " + quoted;
+        case CalcErrc::MISMATCHED_PARENTHESES:
+            return "Mismatched parentheses";
+        case CalcErrc::UNEXPECTED_COMMA:
+            return "Unexpected ',' outside a function call";
+        case CalcErrc::INVALID_ARGUMENTS:
+            return "Invalid arguments in call to " + quoted;
+        case CalcErrc::MISSING_OPERANDS:
+            return "Invalid expression: not enough operands for operator '" + quoted + "'";
+        case CalcErrc::UNKNOWN_OPERATOR:
+            return "Unknown operator: " + quoted;
+        case CalcErrc::MISSING_ASSIGNMENT_OPERANDS:
+            return "Invalid assignment: not enough operands for assignment";
+        case CalcErrc::INVALID_ASSIGNMENT_TARGET:
+            return "Invalid target for assignment: " + quoted;
+        case CalcErrc::UNEXPECTED_TOKEN:
+            return "Unexpected token type in RPN evaluation: " + std::to_string(actual);
+        case CalcErrc::NOT_A_SINGLE_VALUE:
+            return "Invalid expression: result is not a single number";
+        case CalcErrc::TOO_MANY_SYMBOLS:
+            return "Too many distinct names, cannot add: " + quoted;
+        case CalcErrc::UNKNOWN_VARIABLE:
+            return "Unknown variable: " + quoted;
+        case CalcErrc::DIVISION_BY_ZERO:
+            return "Division by zero";
+        case CalcErrc::UNKNOWN_FUNCTION:
+            return "Unknown function: " + quoted;
+        case CalcErrc::ARGUMENT_COUNT:
+            return "Function " + quoted + " expects " + std::to_string(expected) + " arguments, got " +
+                   std::to_string(actual);
+        case CalcErrc::CALL_DEPTH:
+            return "Function calls nested too deeply: " + quoted;
+    }
+    return std::string();
+}
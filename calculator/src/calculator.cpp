@@ -1,12 +1,17 @@
 #include "calculator.h"
-#include <stack>
+#include "function_table.h"
+#include "optimizer.h"
+#include "request_arena.h"
+#include "script_scheduler.h"
 #include <sstream>
 #include <cmath>
 #include <cctype> // For isalpha, isalnum
+#include <charconv> // For std::from_chars
 #include <iostream>
-#include <algorithm> // For std::find_first_not_of, find_last_not_of
+#include <algorithm>
+#include <optional>
 
-bool Calculator::isValidVariableName(const std::string& name) {
+bool Calculator::isValidVariableName(const std::string& name) const {
     if (name.empty() || !isalpha(name[0])) {
         return false;
     }
@@ -18,224 +23,807 @@ bool Calculator::isValidVariableName(const std::string& name) {
     return true;
 }
 
-double Calculator::evaluate(const std::string& expression, std::map<std::string, double>& variables) {
-    std::istringstream iss(expression);
-    std::string segment;
-    double last_result = 0.0; // Store the result of the last successful evaluation
+double Calculator::evaluate(const std::string& expression, std::map<std::string, double>& variables) const {
+    return evaluate(compile(expression), variables);
+}
+
+double Calculator::evaluate(const std::string& expression, VariableStore& variables) const {
+    return evaluate(compile(expression), variables);
+}
+
+Calculator::CompiledExpression Calculator::compile(const std::string& expression) const {
+    CompiledExpression compiled;
+    CalcError error;
+    if (!tryCompile(expression, compiled, error)) {
+        throw std::runtime_error(error.message());
+    }
+    return compiled;
+}
 
-    while(std::getline(iss, segment, ';')) {
-        if (segment.empty()) continue;
+bool Calculator::tryCompile(std::string_view source, CompiledExpression& compiled, CalcError& error,
+                            UnknownNames unknown) const {
+    RequestArena::Scope arena;
+    compiled = CompiledExpression();
+    const char* const kWhitespace = " \t\n\r\f\v";
+
+    // Statements are views into the source; nothing is copied.
+    size_t start = 0;
+    while (start <= source.size()) {
+        size_t end = source.find(';', start);
+        if (end == std::string_view::npos) end = source.size();
+        std::string_view segment = source.substr(start, end - start);
+        start = end + 1;
 
         // Trim whitespace from segment
-        segment.erase(0, segment.find_first_not_of(" 	\n\r\f\v"));
-        segment.erase(segment.find_last_not_of(" 	\n\r\f\v") + 1);
+        size_t first = segment.find_first_not_of(kWhitespace);
+        if (first == std::string_view::npos) continue;
+        segment = segment.substr(first, segment.find_last_not_of(kWhitespace) - first + 1);
+        const uint32_t offset = static_cast<uint32_t>(segment.data() - source.data());
+
+        // Compile errors name a token of the segment, which locates them.
+        auto fail = [&]() {
+            error.offset = error.subject.empty() ? offset
+                                                 : static_cast<uint32_t>(error.subject.data() - source.data());
+            return false;
+        };
+
+        // The assignment logic is handled by the STORE instruction
+        TokenList tokens(RequestArena::resource());
+        TokenList rpn(RequestArena::resource());
+        Program program;
+        if (!observer_) {
+            if (!tokenize(segment, tokens, error) || !shuntingYard(tokens, rpn, error) ||
+                !compileRPN(rpn, {}, unknown, program, error)) {
+                return fail();
+            }
+            compiled.statements.push_back(optimize_ ? optimizeProgram(program) : std::move(program));
+            compiled.statements.back().offset = offset;
+            continue;
+        }
+
+        // Same steps, timed. Each stage ends where the next one starts.
+        auto t0 = StageClock::now();
+        if (!tokenize(segment, tokens, error)) return fail();
+        auto t1 = StageClock::now();
+        observer_->onStage(Stage::TOKENIZE, t1 - t0);
+        if (!shuntingYard(tokens, rpn, error)) return fail();
+        auto t2 = StageClock::now();
+        observer_->onStage(Stage::SHUNTING_YARD, t2 - t1);
+        if (!compileRPN(rpn, {}, unknown, program, error)) return fail();
+        auto t3 = StageClock::now();
+        observer_->onStage(Stage::COMPILE, t3 - t2);
+        if (optimize_) {
+            program = optimizeProgram(program);
+            observer_->onStage(Stage::OPTIMIZE, StageClock::now() - t3);
+        }
+        program.offset = offset;
+        compiled.statements.push_back(std::move(program));
+    }
+    for (const Program& program : compiled.statements) {
+        compiled.assigns = compiled.assigns || std::any_of(program.code.begin(), program.code.end(),
+            [](const Instruction& instr) { return instr.op == OpCode::STORE; });
+        compiled.calls = compiled.calls || !program.calls.empty();
+    }
+    // A called function's reads are not known here, so such scripts
+    // cannot be planned.
+    if (scriptPool_ && !compiled.calls && compiled.statements.size() >= std::max<size_t>(parallelStatements_, 2)) {
+        auto plan = std::make_shared<ScriptPlan>(buildScriptPlan(compiled));
+        if (plan->depth * 2 <= compiled.statements.size()) {
+            compiled.plan = std::move(plan);
+        }
+    }
+    return true;
+}
+
+size_t Calculator::estimateBytes(const Program& program) {
+    return sizeof(Program) + program.code.capacity() * sizeof(Instruction) +
+           program.constants.capacity() * sizeof(double) + program.symbols.capacity() * sizeof(uint32_t) +
+           program.calls.capacity() * sizeof(Call);
+}
+
+size_t Calculator::estimateBytes(const CompiledExpression& compiled) {
+    size_t bytes = sizeof(CompiledExpression);
+    for (const auto& program : compiled.statements) {
+        bytes += estimateBytes(program);
+    }
+    return bytes;
+}
+
+std::string Calculator::disassemble(const CompiledExpression& compiled) const {
+    static const char* const kNames[] = {
+        "PUSH_CONST", "LOAD_VAR", "ADD", "SUB", "MUL", "DIV", "STORE", "SAVE_TEMP", "LOAD_TEMP",
+        "CALL", "LOAD_ARG"
+    };
+
+    std::ostringstream out;
+    out.precision(15);
+    for (size_t s = 0; s < compiled.statements.size(); ++s) {
+        const Program& program = compiled.statements[s];
+        out << "statement " << s << " (stack " << program.maxStackDepth
+            << ", temps " << program.tempCount << "):\n";
+        for (size_t i = 0; i < program.code.size(); ++i) {
+            const Instruction& instr = program.code[i];
+            out << "  " << i << ": " << kNames[static_cast<int>(instr.op)];
+            switch (instr.op) {
+                case OpCode::PUSH_CONST:
+                    out << " " << program.constants[instr.operand];
+                    break;
+                case OpCode::LOAD_VAR:
+                case OpCode::STORE:
+                    out << " " << symbols_.name(program.symbols[instr.operand]);
+                    break;
+                case OpCode::SAVE_TEMP:
+                case OpCode::LOAD_TEMP:
+                    out << " t" << instr.operand;
+                    break;
+                case OpCode::CALL: {
+                    const Call& call = program.calls[instr.operand];
+                    out << " " << symbols_.name(call.function) << "/" << call.argCount;
+                    break;
+                }
+                case OpCode::LOAD_ARG:
+                    out << " a" << instr.operand;
+                    break;
+                default:
+                    break;
+            }
+            out << "\n";
+        }
+    }
+    return out.str();
+}
+
+double Calculator::evaluate(const CompiledExpression& compiled, VariableStore& variables,
+                            const FunctionScope* functions) const {
+    double result = 0.0;
+    CalcError error;
+    if (!tryEvaluate(compiled, variables, result, error, functions)) {
+        throw std::runtime_error(error.message());
+    }
+    return result;
+}
+
+bool Calculator::tryEvaluate(const CompiledExpression& compiled, VariableStore& variables, double& result,
+                             CalcError& error, const FunctionScope* functions) const {
+    auto run = [&]() {
+        if (compiled.plan && scriptPool_) {
+            return runScript(*this, compiled, *compiled.plan, variables, *scriptPool_, result, error);
+        }
+        result = 0.0; // result of the last statement
+        for (const auto& program : compiled.statements) {
+            if (!tryExecute(program, variables, result, error, functions)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (!observer_) {
+        return run();
+    }
 
-        if (segment.empty()) continue;
+    // Failed executions are timed too; they cost the server as much.
+    auto start = StageClock::now();
+    bool ok = run();
+    observer_->onStage(Stage::EXECUTE, StageClock::now() - start);
+    return ok;
+}
+
+double Calculator::evaluate(const CompiledExpression& compiled, std::map<std::string, double>& variables) const {
+    VariableStore store;
+    for (const auto& program : compiled.statements) {
+        for (uint32_t slot : program.symbols) {
+            auto it = variables.find(symbols_.name(slot));
+            if (it != variables.end()) {
+                store.set(slot, it->second);
+            }
+        }
+    }
 
-        // The assignment logic is handled by RPN evaluation now
-        std::vector<Calculator::Token> tokens = tokenize(segment);
-        std::vector<Calculator::Token> rpnTokens = shuntingYard(tokens);
-        last_result = evaluateRPN(rpnTokens, variables);
+    // Assignments made before an error are kept, as with direct evaluation.
+    auto writeBack = [&]() {
+        for (const auto& program : compiled.statements) {
+            for (uint32_t slot : program.symbols) {
+                if (store.has(slot)) {
+                    variables[symbols_.name(slot)] = store.get(slot);
+                }
+            }
+        }
+    };
+    double result = 0.0;
+    CalcError error;
+    const bool ok = tryEvaluate(compiled, store, result, error);
+    writeBack();
+    if (!ok) {
+        throw std::runtime_error(error.message());
     }
-    return last_result;
+    return result;
 }
 
-std::vector<Calculator::Token> Calculator::tokenize(const std::string& expression) {
-    std::vector<Token> tokens;
-    for (size_t i = 0; i < expression.length(); ++i) {
+Calculator::TokenList Calculator::tokenize(std::string_view expression) const {
+    TokenList tokens(RequestArena::resource());
+    CalcError error;
+    if (!tokenize(expression, tokens, error)) {
+        throw std::runtime_error(error.message());
+    }
+    return tokens;
+}
+
+Calculator::TokenList Calculator::shuntingYard(const TokenList& tokens) const {
+    TokenList rpn(RequestArena::resource());
+    CalcError error;
+    if (!shuntingYard(tokens, rpn, error)) {
+        throw std::runtime_error(error.message());
+    }
+    return rpn;
+}
+
+Calculator::Program Calculator::compileRPN(const TokenList& rpnTokens,
+                                           const std::vector<std::string>& parameters) const {
+    Program program;
+    CalcError error;
+    if (!compileRPN(rpnTokens, parameters, UnknownNames::INTERN, program, error)) {
+        throw std::runtime_error(error.message());
+    }
+    return program;
+}
+
+// On failure the stages below fill in the error's code and subject; the
+// offset is left to tryCompile(), which knows the whole source.
+bool Calculator::tokenize(std::string_view expression, TokenList& tokens, CalcError& error) const {
+    auto isDigit = [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; };
+    auto isAlnum = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) != 0; };
+
+    auto fail = [&](CalcErrc code, size_t begin, size_t end) {
+        error = CalcError();
+        error.code = code;
+        error.subject = expression.substr(begin, end - begin);
+        return false;
+    };
+
+    tokens.clear();
+    const size_t length = expression.length();
+    for (size_t i = 0; i < length; ++i) {
         char c = expression[i];
 
-        if (isspace(c)) {
+        if (std::isspace(static_cast<unsigned char>(c))) {
             continue;
         }
-        else if (isdigit(c) || (c == '.' && i + 1 < expression.length() && isdigit(expression[i+1]))) { // NUMBER
-            std::string num_str;
-            while (i < expression.length() && (isdigit(expression[i]) || expression[i] == '.')) {
-                num_str += expression[i];
-                i++;
+        else if (isDigit(c) || (c == '.' && i + 1 < length && isDigit(expression[i + 1]))) { // NUMBER
+            size_t end = i;
+            size_t dots = 0;
+            while (end < length && (isDigit(expression[end]) || expression[end] == '.')) {
+                dots += expression[end] == '.';
+                end++;
+            }
+            // "1var" is an identifier that starts with a digit, not 1 * var
+            if (end < length && isAlnum(expression[end])) {
+                while (end < length && isAlnum(expression[end])) end++;
+                return fail(CalcErrc::INVALID_VARIABLE_NAME, i, end);
             }
-            i--;
-            tokens.push_back({TokenType::NUMBER, num_str});
-        }
-        else if (isalpha(c)) { // VARIABLE
-            std::string var_name_str;
-            while (i < expression.length() && isalnum(expression[i])) {
-                var_name_str += expression[i];
-                i++;
+            std::string_view literal = expression.substr(i, end - i);
+            double value = 0.0;
+            auto parsed = std::from_chars(literal.data(), literal.data() + literal.size(), value);
+            if (dots > 1 || parsed.ec != std::errc() || parsed.ptr != literal.data() + literal.size()) {
+                return fail(CalcErrc::INVALID_NUMBER, i, end);
             }
-            i--;
-            tokens.push_back({TokenType::VARIABLE, var_name_str, -1, true, var_name_str});
+            tokens.push_back({TokenType::NUMBER, literal, value});
+            i = end - 1;
+        }
+        else if (std::isalpha(static_cast<unsigned char>(c))) { // VARIABLE or FUNCTION
+            size_t end = i;
+            while (end < length && isAlnum(expression[end])) end++;
+            size_t next = end;
+            while (next < length && std::isspace(static_cast<unsigned char>(expression[next]))) next++;
+            bool call = next < length && expression[next] == '(';
+            tokens.push_back({call ? TokenType::FUNCTION : TokenType::VARIABLE, expression.substr(i, end - i)});
+            i = end - 1;
         }
         else if (c == '=') { // ASSIGNMENT
-            tokens.push_back({TokenType::ASSIGNMENT, "=", 0, false}); // Assignment is right-associative, lowest precedence
+            tokens.push_back({TokenType::ASSIGNMENT, expression.substr(i, 1), 0.0, 0, false}); // Assignment is right-associative, lowest precedence
         }
         else if (isOperator(c)) { // OPERATOR (+-*/)
-            tokens.push_back({TokenType::OPERATOR, std::string(1, c), getPrecedence(c), isLeftAssociative(c)});
+            tokens.push_back({TokenType::OPERATOR, expression.substr(i, 1), 0.0, getPrecedence(c), isLeftAssociative(c)});
         }
         else if (c == '(') { // LEFT_PAREN
-            tokens.push_back({TokenType::LEFT_PAREN, "("});
+            tokens.push_back({TokenType::LEFT_PAREN, expression.substr(i, 1)});
         }
         else if (c == ')') { // RIGHT_PAREN
-            tokens.push_back({TokenType::RIGHT_PAREN, ")"});
+            tokens.push_back({TokenType::RIGHT_PAREN, expression.substr(i, 1)});
+        }
+        else if (c == ',') { // COMMA, between call arguments
+            tokens.push_back({TokenType::COMMA, expression.substr(i, 1)});
         }
         else {
-            throw std::runtime_error("Invalid character in expression: " + std::string(1, c));
+            return fail(CalcErrc::INVALID_CHARACTER, i, i + 1);
         }
     }
-    return tokens;
+    return true;
 }
 
-std::vector<Calculator::Token> Calculator::shuntingYard(const std::vector<Token>& tokens) {
-    std::vector<Token> output_queue;
-    std::stack<Token> operator_stack;
+bool Calculator::shuntingYard(const TokenList& tokens, TokenList& output_queue, CalcError& error) const {
+    output_queue.clear();
+    output_queue.reserve(tokens.size());
+    TokenList operator_stack(RequestArena::resource());
+
+    // Every argument of a call must leave exactly one value, so "f(1+, 2)"
+    // cannot borrow an operand from outside the call. `values` counts what
+    // the RPN emitted so far leaves on the stack; each open parenthesis
+    // remembers the count it started at and the arguments it completed.
+    struct Group {
+        size_t base;
+        uint32_t args;
+        bool call;
+    };
+    std::pmr::vector<Group> groups(RequestArena::resource());
+    size_t values = 0;
+    auto output = [&](const Token& token) {
+        switch (token.type) {
+            case TokenType::NUMBER:
+            case TokenType::VARIABLE:
+                ++values;
+                break;
+            case TokenType::FUNCTION:
+                values = values + 1 - std::min<size_t>(token.argCount, values);
+                break;
+            default: // binary operators and '='
+                values -= std::min<size_t>(1, values);
+                break;
+        }
+        output_queue.push_back(token);
+    };
+    auto fail = [&](CalcErrc code, const Token& token) {
+        error = CalcError();
+        error.code = code;
+        error.subject = token.text;
+        return false;
+    };
+    // False if there is no '(' to stop at.
+    auto popToParen = [&]() {
+        while (!operator_stack.empty() && operator_stack.back().type != TokenType::LEFT_PAREN) {
+            output(operator_stack.back());
+            operator_stack.pop_back();
+        }
+        return !operator_stack.empty();
+    };
 
     for (const auto& token : tokens) {
         switch (token.type) {
             case TokenType::NUMBER:
             case TokenType::VARIABLE:
-                output_queue.push_back(token);
+                output(token);
+                break;
+            case TokenType::FUNCTION:
+                operator_stack.push_back(token);
                 break;
             case TokenType::OPERATOR:
             case TokenType::ASSIGNMENT:
                 while (!operator_stack.empty() && 
-                       (operator_stack.top().type == TokenType::OPERATOR || operator_stack.top().type == TokenType::ASSIGNMENT) &&
-                       ((operator_stack.top().isLeftAssociative && operator_stack.top().precedence >= token.precedence) ||
-                        (!operator_stack.top().isLeftAssociative && operator_stack.top().precedence > token.precedence))) {
-                    output_queue.push_back(operator_stack.top());
-                    operator_stack.pop();
+                       (operator_stack.back().type == TokenType::OPERATOR || operator_stack.back().type == TokenType::ASSIGNMENT) &&
+                       ((operator_stack.back().isLeftAssociative && operator_stack.back().precedence >= token.precedence) ||
+                        (!operator_stack.back().isLeftAssociative && operator_stack.back().precedence > token.precedence))) {
+                    output(operator_stack.back());
+                    operator_stack.pop_back();
                 }
-                operator_stack.push(token);
+                operator_stack.push_back(token);
                 break;
             case TokenType::LEFT_PAREN:
-                operator_stack.push(token);
+                groups.push_back({values, 0,
+                                  !operator_stack.empty() && operator_stack.back().type == TokenType::FUNCTION});
+                operator_stack.push_back(token);
                 break;
-            case TokenType::RIGHT_PAREN:
-                while (!operator_stack.empty() && operator_stack.top().type != TokenType::LEFT_PAREN) {
-                    output_queue.push_back(operator_stack.top());
-                    operator_stack.pop();
+            case TokenType::COMMA: {
+                if (groups.empty() || !groups.back().call) {
+                    return fail(CalcErrc::UNEXPECTED_COMMA, token);
                 }
-                if (operator_stack.empty()) {
-                    throw std::runtime_error("Mismatched parentheses");
+                popToParen();
+                Group& group = groups.back();
+                const Token& function = operator_stack[operator_stack.size() - 2];
+                if (values != group.base + group.args + 1) {
+                    return fail(CalcErrc::INVALID_ARGUMENTS, function);
                 }
-                operator_stack.pop();
+                ++group.args;
                 break;
+            }
+            case TokenType::RIGHT_PAREN: {
+                if (!popToParen()) {
+                    return fail(CalcErrc::MISMATCHED_PARENTHESES, token);
+                }
+                operator_stack.pop_back();
+                Group group = groups.back();
+                groups.pop_back();
+                if (!group.call) {
+                    break;
+                }
+                Token function = operator_stack.back();
+                operator_stack.pop_back();
+                if (values == group.base + group.args + 1) {
+                    function.argCount = group.args + 1;
+                } else if (values == group.base && group.args == 0) {
+                    function.argCount = 0; // "f()"
+                } else {
+                    return fail(CalcErrc::INVALID_ARGUMENTS, function);
+                }
+                output(function);
+                break;
+            }
         }
     }
 
     while (!operator_stack.empty()) {
-        if (operator_stack.top().type == TokenType::LEFT_PAREN) {
-            throw std::runtime_error("Mismatched parentheses");
+        if (operator_stack.back().type == TokenType::LEFT_PAREN) {
+            return fail(CalcErrc::MISMATCHED_PARENTHESES, operator_stack.back());
         }
-        output_queue.push_back(operator_stack.top());
-        operator_stack.pop();
+        output(operator_stack.back());
+        operator_stack.pop_back();
     }
 
-    return output_queue;
+    return true;
 }
 
-double Calculator::evaluateRPN(std::vector<Token> rpnTokens, std::map<std::string, double>& variables) {
-    std::stack<Token> internal_stack; // Now stores Tokens
+bool Calculator::compileRPN(const TokenList& rpnTokens, const std::vector<std::string>& parameters,
+                            UnknownNames unknown, Program& program, CalcError& error) const {
+    // Simulates the VM stack to validate the statement and size the stack.
+    // Each entry remembers whether it is a plain variable load, since the
+    // left-hand side of '=' must not be loaded at runtime.
+    struct StackEntry {
+        bool isVariable;
+        size_t loadIndex;       // position of the LOAD_VAR instruction
+        std::string_view text;  // for error messages
+    };
+
+    // Everything is built in arena scratch space and copied into the
+    // program at its final size once the statement is known to be valid.
+    std::pmr::memory_resource* arena = RequestArena::resource();
+    program = Program();
+    std::pmr::vector<Instruction> code(arena);
+    std::pmr::vector<double> constants(arena);
+    // Names of the variables (LOAD_VAR/STORE operands index this list) and
+    // of the called functions. They are interned only once the statement
+    // is known to be valid, so rejected input never grows the symbol table.
+    std::pmr::vector<std::string_view> names(arena);
+    std::pmr::vector<bool> assigned(arena); // parallel to names
+    std::pmr::vector<std::string_view> callees(arena);
+    std::pmr::vector<StackEntry> stack(arena);
+    std::pmr::vector<bool> dropped(arena); // LOAD_VAR instructions of assignment targets
+    code.reserve(rpnTokens.size());
+    dropped.reserve(rpnTokens.size());
+
+    auto emit = [&](OpCode op, uint32_t operand) {
+        code.push_back({op, operand});
+        dropped.push_back(false);
+    };
+    auto fail = [&](CalcErrc code, std::string_view subject) {
+        error = CalcError();
+        error.code = code;
+        error.subject = subject;
+        return false;
+    };
+    auto symbolOf = [&](std::string_view name) {
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it == names.end()) {
+            names.push_back(name);
+            assigned.push_back(false);
+            return static_cast<uint32_t>(names.size() - 1);
+        }
+        return static_cast<uint32_t>(it - names.begin());
+    };
 
     for (const auto& token : rpnTokens) {
         if (token.type == TokenType::NUMBER) {
-            internal_stack.push(token);
+            constants.push_back(token.number);
+            emit(OpCode::PUSH_CONST, static_cast<uint32_t>(constants.size() - 1));
+            stack.push_back({false, 0, token.text});
         }
         else if (token.type == TokenType::VARIABLE) {
-            internal_stack.push(token); // Push variable token itself
-        }
-        else if (token.type == TokenType::OPERATOR) {
-            if (internal_stack.size() < 2) {
-                throw std::runtime_error("Invalid expression: not enough operands for operator '" + token.value + "'");
+            auto parameter = std::find(parameters.begin(), parameters.end(), token.text);
+            if (parameter != parameters.end()) {
+                emit(OpCode::LOAD_ARG, static_cast<uint32_t>(parameter - parameters.begin()));
+                stack.push_back({false, 0, token.text});
+                continue;
             }
-            // Pop right operand
-            Token right_token = internal_stack.top(); internal_stack.pop();
-            double right_val;
-            if (right_token.type == TokenType::NUMBER) {
-                right_val = std::stod(right_token.value);
-            } else if (right_token.type == TokenType::VARIABLE) {
-                if (variables.count(right_token.variableName)) {
-                    right_val = variables[right_token.variableName];
-                } else {
-                    throw std::runtime_error("Unknown variable: " + right_token.variableName);
-                }
-            } else {
-                throw std::runtime_error("Invalid operand for operator: " + right_token.value);
+            emit(OpCode::LOAD_VAR, symbolOf(token.text));
+            stack.push_back({true, code.size() - 1, token.text});
+        }
+        else if (token.type == TokenType::FUNCTION) {
+            if (stack.size() < token.argCount) {
+                return fail(CalcErrc::INVALID_ARGUMENTS, token.text);
             }
-
-            // Pop left operand
-            Token left_token = internal_stack.top(); internal_stack.pop();
-            double left_val;
-            if (left_token.type == TokenType::NUMBER) {
-                left_val = std::stod(left_token.value);
-            } else if (left_token.type == TokenType::VARIABLE) {
-                if (variables.count(left_token.variableName)) {
-                    left_val = variables[left_token.variableName];
-                } else {
-                    throw std::runtime_error("Unknown variable: " + left_token.variableName);
-                }
-            } else {
-                throw std::runtime_error("Invalid operand for operator: " + left_token.value);
+            program.calls.push_back({0, token.argCount});
+            callees.push_back(token.text);
+            emit(OpCode::CALL, static_cast<uint32_t>(program.calls.size() - 1));
+            stack.resize(stack.size() - token.argCount);
+            stack.push_back({false, 0, token.text});
+        }
+        else if (token.type == TokenType::OPERATOR) {
+            if (stack.size() < 2) {
+                return fail(CalcErrc::MISSING_OPERANDS, token.text);
             }
-
-            double result;
-            switch (token.value[0]) {
-                case '+': result = left_val + right_val; break;
-                case '-': result = left_val - right_val; break;
-                case '*': result = left_val * right_val; break;
-                case '/':
-                    if (right_val == 0) throw std::runtime_error("Division by zero");
-                    result = left_val / right_val;
-                    break;
+            switch (token.text[0]) {
+                case '+': emit(OpCode::ADD, 0); break;
+                case '-': emit(OpCode::SUB, 0); break;
+                case '*': emit(OpCode::MUL, 0); break;
+                case '/': emit(OpCode::DIV, 0); break;
                 default:
-                    throw std::runtime_error("Unknown operator: " + token.value);
+                    return fail(CalcErrc::UNKNOWN_OPERATOR, token.text);
             }
-            internal_stack.push({TokenType::NUMBER, std::to_string(result)});
+            stack.pop_back();
+            stack.back() = {false, 0, token.text};
         }
         else if (token.type == TokenType::ASSIGNMENT) {
-            if (internal_stack.size() < 2) {
-                throw std::runtime_error("Invalid assignment: not enough operands for assignment");
+            if (stack.size() < 2) {
+                return fail(CalcErrc::MISSING_ASSIGNMENT_OPERANDS, token.text);
             }
-            // Pop value to assign (RHS)
-            Token value_token = internal_stack.top(); internal_stack.pop();
-            double value_to_assign;
-            if (value_token.type == TokenType::NUMBER) {
-                value_to_assign = std::stod(value_token.value);
-            } else if (value_token.type == TokenType::VARIABLE) {
-                 if (variables.count(value_token.variableName)) {
-                    value_to_assign = variables[value_token.variableName];
-                } else {
-                    throw std::runtime_error("Unknown variable: " + value_token.variableName);
-                }
-            } else {
-                throw std::runtime_error("Invalid value for assignment: " + value_token.value);
+            StackEntry target = stack[stack.size() - 2];
+            if (!target.isVariable) {
+                return fail(CalcErrc::INVALID_ASSIGNMENT_TARGET, target.text);
             }
+            // The target's load is dropped, and STORE leaves the assigned
+            // value on the stack as the result of the assignment.
+            dropped[target.loadIndex] = true;
+            assigned[code[target.loadIndex].operand] = true;
+            emit(OpCode::STORE, code[target.loadIndex].operand);
+            stack.erase(stack.end() - 2);
+            stack.back() = {false, 0, token.text};
+        }
+        else {
+            fail(CalcErrc::UNEXPECTED_TOKEN, token.text);
+            error.actual = static_cast<uint32_t>(token.type);
+            return false;
+        }
+    }
 
-            // Pop variable token (LHS)
-            Token var_token = internal_stack.top(); internal_stack.pop();
-            if (var_token.type != TokenType::VARIABLE) {
-                throw std::runtime_error("Invalid target for assignment: " + var_token.value);
-            }
+    if (stack.size() != 1) {
+        // Points at the first value left over, if there is one.
+        return fail(CalcErrc::NOT_A_SINGLE_VALUE, stack.size() > 1 ? stack[1].text : std::string_view());
+    }
 
-            variables[var_token.variableName] = value_to_assign;
-            internal_stack.push({TokenType::NUMBER, std::to_string(value_to_assign)}); // Push the assigned value back as the result
+    // Remove the dropped loads and compute the real stack depth.
+    size_t out = 0;
+    size_t depth = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (dropped[i]) continue;
+        Instruction instr = code[i];
+        switch (instr.op) {
+            case OpCode::PUSH_CONST:
+            case OpCode::LOAD_VAR:
+            case OpCode::LOAD_ARG:
+                program.maxStackDepth = std::max(program.maxStackDepth, ++depth);
+                break;
+            case OpCode::CALL:
+                depth = depth + 1 - program.calls[instr.operand].argCount;
+                program.maxStackDepth = std::max(program.maxStackDepth, depth);
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+            case OpCode::DIV:
+                --depth;
+                break;
+            case OpCode::STORE:
+            case OpCode::SAVE_TEMP:
+            case OpCode::LOAD_TEMP: // not produced here, only by the optimizer
+                break;
         }
-        else {
-            throw std::runtime_error("Unexpected token type in RPN evaluation: " + std::to_string(static_cast<int>(token.type)));
+        code[out++] = instr;
+    }
+    program.code.assign(code.begin(), code.begin() + out);
+    program.constants.assign(constants.begin(), constants.end());
+    // A name only read here can only have a value if some statement
+    // assigned it before, which interned it.
+    auto resolve = [&](std::string_view name, bool readOnly, CalcErrc unknownCode, uint32_t& slot) {
+        if (readOnly && unknown == UnknownNames::REJECT) {
+            return symbols_.find(name, slot) || fail(unknownCode, name);
         }
+        return symbols_.tryIntern(name, slot) || fail(CalcErrc::TOO_MANY_SYMBOLS, name);
+    };
+    program.symbols.resize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!resolve(names[i], !assigned[i], CalcErrc::UNKNOWN_VARIABLE, program.symbols[i])) return false;
+    }
+    for (size_t i = 0; i < callees.size(); ++i) {
+        if (!resolve(callees[i], true, CalcErrc::UNKNOWN_FUNCTION, program.calls[i].function)) return false;
     }
+    return true;
+}
 
-    if (internal_stack.size() != 1 || internal_stack.top().type != TokenType::NUMBER) {
-        throw std::runtime_error("Invalid expression: result is not a single number");
+double Calculator::execute(const Program& program, VariableStore& variables,
+                           const FunctionScope* functions) const {
+    double result = 0.0;
+    CalcError error;
+    if (!tryExecute(program, variables, result, error, functions)) {
+        throw std::runtime_error(error.message());
     }
+    return result;
+}
 
-    return std::stod(internal_stack.top().value);
+bool Calculator::tryExecute(const Program& program, VariableStore& variables, double& result,
+                            CalcError& error, const FunctionScope* functions) const {
+    if (run(program, variables, functions, nullptr, 0, result, error)) {
+        return true;
+    }
+    // Also for errors inside a called function: the body has no source here.
+    error.offset = program.offset;
+    return false;
+}
+
+Function Calculator::compileFunction(const std::string& definition) const {
+    RequestArena::Scope arena;
+    TokenList tokens = tokenize(definition);
+
+    // "name(a, b, ...) =" and then the body.
+    auto malformed = []() {
+        return std::runtime_error("Invalid function definition: expected name(parameters) = expression");
+    };
+    if (tokens.size() < 4 || tokens[0].type != TokenType::FUNCTION) {
+        throw malformed();
+    }
+    Function function;
+    function.name = std::string(tokens[0].text);
+    size_t i = 2;
+    if (tokens[i].type != TokenType::RIGHT_PAREN) {
+        while (true) {
+            if (i + 1 >= tokens.size() || tokens[i].type != TokenType::VARIABLE) {
+                throw malformed();
+            }
+            std::string parameter(tokens[i].text);
+            if (std::find(function.parameters.begin(), function.parameters.end(), parameter) != function.parameters.end()) {
+                throw std::runtime_error("Duplicate parameter: " + parameter);
+            }
+            function.parameters.push_back(std::move(parameter));
+            if (tokens[++i].type != TokenType::COMMA) {
+                break;
+            }
+            ++i;
+        }
+    }
+    if (tokens[i].type != TokenType::RIGHT_PAREN) {
+        throw malformed();
+    }
+    if (i + 2 >= tokens.size() || tokens[i + 1].type != TokenType::ASSIGNMENT) {
+        throw malformed();
+    }
+
+    TokenList body(tokens.begin() + i + 2, tokens.end(), RequestArena::resource());
+    Program program = compileRPN(shuntingYard(body), function.parameters);
+    for (const Instruction& instr : program.code) {
+        if (instr.op == OpCode::STORE) {
+            throw std::runtime_error("Function body cannot assign variables: " + function.name);
+        }
+    }
+    function.body = optimize_ ? optimizeProgram(program) : std::move(program);
+    function.slot = symbols_.intern(function.name);
+    function.source = definition;
+    return function;
+}
+
+bool Calculator::run(const Program& program, VariableStore& variables, const FunctionScope* functions,
+                     const double* args, int depth, double& result, CalcError& error) const {
+    auto fail = [&](CalcErrc code, std::string_view subject) {
+        error = CalcError();
+        error.code = code;
+        error.subject = subject;
+        return false;
+    };
+
+    // Small programs run on a stack array; only unusually deep expressions
+    // need a larger buffer.
+    constexpr size_t kInlineStack = 64;
+    constexpr size_t kInlineTemps = 16;
+    constexpr size_t kInlineSymbols = 16;
+    double inlineStack[kInlineStack];
+    double inlineTemps[kInlineTemps];
+    uint32_t inlineEntries[kInlineSymbols];
+    double* stack = inlineStack;
+    double* temps = inlineTemps;
+    uint32_t* entries = inlineEntries;
+
+    // Oversized programs take their buffers from the request arena.
+    const size_t symbolCount = program.symbols.size();
+    std::optional<RequestArena::Scope> arena;
+    if (program.maxStackDepth > kInlineStack || program.tempCount > kInlineTemps || symbolCount > kInlineSymbols) {
+        arena.emplace();
+        std::pmr::memory_resource* resource = RequestArena::resource();
+        if (program.maxStackDepth > kInlineStack) {
+            stack = static_cast<double*>(resource->allocate(program.maxStackDepth * sizeof(double), alignof(double)));
+        }
+        if (program.tempCount > kInlineTemps) {
+            temps = static_cast<double*>(resource->allocate(program.tempCount * sizeof(double), alignof(double)));
+        }
+        if (symbolCount > kInlineSymbols) {
+            entries = static_cast<uint32_t*>(resource->allocate(symbolCount * sizeof(uint32_t), alignof(uint32_t)));
+        }
+    }
+    // The store's entries of the program's variables, looked up once per
+    // run. Variables the store has never seen get an entry when assigned.
+    for (size_t i = 0; i < symbolCount; ++i) {
+        entries[i] = variables.find(program.symbols[i]);
+    }
+
+    size_t sp = 0; // number of values on the stack
+    for (const Instruction& instr : program.code) {
+        switch (instr.op) {
+            case OpCode::PUSH_CONST:
+                stack[sp++] = program.constants[instr.operand];
+                break;
+            case OpCode::LOAD_VAR: {
+                const uint32_t entry = entries[instr.operand];
+                if (entry == VariableStore::kNoEntry || !variables.defined(entry)) {
+                    return fail(CalcErrc::UNKNOWN_VARIABLE, symbols_.name(program.symbols[instr.operand]));
+                }
+                stack[sp++] = variables.value(entry);
+                break;
+            }
+            case OpCode::ADD:
+                --sp;
+                stack[sp - 1] += stack[sp];
+                break;
+            case OpCode::SUB:
+                --sp;
+                stack[sp - 1] -= stack[sp];
+                break;
+            case OpCode::MUL:
+                --sp;
+                stack[sp - 1] *= stack[sp];
+                break;
+            case OpCode::DIV:
+                --sp;
+                if (stack[sp] == 0) return fail(CalcErrc::DIVISION_BY_ZERO, std::string_view());
+                stack[sp - 1] /= stack[sp];
+                break;
+            case OpCode::STORE: {
+                uint32_t& entry = entries[instr.operand];
+                if (entry == VariableStore::kNoEntry) {
+                    entry = variables.entry(program.symbols[instr.operand]);
+                }
+                variables.assign(entry, stack[sp - 1]);
+                break;
+            }
+            case OpCode::SAVE_TEMP:
+                temps[instr.operand] = stack[sp - 1];
+                break;
+            case OpCode::LOAD_TEMP:
+                stack[sp++] = temps[instr.operand];
+                break;
+            case OpCode::CALL: {
+                // Arguments stay where the caller pushed them; the callee
+                // reads them in place and its result replaces them.
+                const Call& call = program.calls[instr.operand];
+                const ::Function* function = functions ? functions->find(call.function) : nullptr;
+                // Messages name the function by its symbol, which outlives
+                // any table the function may be removed from.
+                if (!function) {
+                    return fail(CalcErrc::UNKNOWN_FUNCTION, symbols_.name(call.function));
+                }
+                if (function->parameters.size() != call.argCount) {
+                    fail(CalcErrc::ARGUMENT_COUNT, symbols_.name(call.function));
+                    error.expected = static_cast<uint32_t>(function->parameters.size());
+                    error.actual = call.argCount;
+                    return false;
+                }
+                if (depth >= kMaxCallDepth) {
+                    return fail(CalcErrc::CALL_DEPTH, symbols_.name(call.function));
+                }
+                sp -= call.argCount;
+                if (!run(function->body, variables, functions, stack + sp, depth + 1, stack[sp], error)) {
+                    return false;
+                }
+                ++sp;
+                break;
+            }
+            case OpCode::LOAD_ARG:
+                stack[sp++] = args[instr.operand];
+                break;
+        }
+    }
+    result = stack[0];
+    return true;
 }
 
-bool Calculator::isOperator(char c) {
+bool Calculator::isOperator(char c) const {
     return c == '+' || c == '-' || c == '*' || c == '/';
 }
 
-int Calculator::getPrecedence(char op) {
+int Calculator::getPrecedence(char op) const {
     switch (op) {
         case '+':
         case '-':
@@ -250,13 +838,13 @@ int Calculator::getPrecedence(char op) {
     }
 }
 
-bool Calculator::isLeftAssociative(char op) {
+bool Calculator::isLeftAssociative(char op) const {
     if (op == '=') {
         return false; // Assignment is right-associative
     }
     return true; // Other operators are left-associative
 }
 
-bool Calculator::isAlpha(char c) {
+bool Calculator::isAlpha(char c) const {
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
\ No newline at end of file
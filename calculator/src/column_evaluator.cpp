@@ -0,0 +1,126 @@
+#include "column_evaluator.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+ColumnEvaluator::ColumnEvaluator(const Calculator& calculator, const Calculator::Program& program)
+    : calculator_(calculator), program_(program), bindings_(program.symbols.size()) {
+    for (const auto& instr : program_.code) {
+        if (instr.op == Calculator::OpCode::STORE) {
+            throw std::runtime_error("Assignments are not supported in vectorized evaluation");
+        }
+        if (instr.op == Calculator::OpCode::CALL) {
+            throw std::runtime_error("Function calls are not supported in vectorized evaluation");
+        }
+    }
+}
+
+void ColumnEvaluator::bindColumn(const std::string& name, const double* values) {
+    if (Binding* binding = bindingFor(name)) {
+        binding->bound = true;
+        binding->column = values;
+    }
+}
+
+void ColumnEvaluator::bindScalar(const std::string& name, double value) {
+    if (Binding* binding = bindingFor(name)) {
+        binding->bound = true;
+        binding->column = nullptr;
+        binding->scalar = value;
+    }
+}
+
+ColumnEvaluator::Binding* ColumnEvaluator::bindingFor(const std::string& name) {
+    // Variables the program does not read are accepted and ignored.
+    uint32_t slot = 0;
+    if (!calculator_.symbols().find(name, slot)) {
+        return nullptr;
+    }
+    auto it = std::find(program_.symbols.begin(), program_.symbols.end(), slot);
+    return it == program_.symbols.end() ? nullptr : &bindings_[it - program_.symbols.begin()];
+}
+
+std::vector<double> ColumnEvaluator::evaluate(size_t rows) const {
+    std::vector<double> out(rows);
+    evaluate(rows, out.data());
+    return out;
+}
+
+void ColumnEvaluator::evaluate(size_t rows, double* out) const {
+    using OpCode = Calculator::OpCode;
+
+    for (size_t i = 0; i < program_.symbols.size(); ++i) {
+        if (!bindings_[i].bound) {
+            throw std::runtime_error("Unknown variable: " + calculator_.symbols().name(program_.symbols[i]));
+        }
+    }
+
+    // One block of kBlockSize values per stack entry and per temporary,
+    // allocated once.
+    std::vector<double> stack(std::max<size_t>(program_.maxStackDepth, 1) * kBlockSize);
+    std::vector<double> temps(program_.tempCount * kBlockSize);
+
+    for (size_t base = 0; base < rows; base += kBlockSize) {
+        const size_t n = std::min(kBlockSize, rows - base);
+        size_t sp = 0;
+
+        for (const auto& instr : program_.code) {
+            if (instr.op == OpCode::PUSH_CONST || instr.op == OpCode::LOAD_VAR) {
+                double* top = stack.data() + sp * kBlockSize;
+                if (instr.op == OpCode::PUSH_CONST) {
+                    std::fill(top, top + n, program_.constants[instr.operand]);
+                } else if (const double* column = bindings_[instr.operand].column) {
+                    std::memcpy(top, column + base, n * sizeof(double));
+                } else {
+                    std::fill(top, top + n, bindings_[instr.operand].scalar);
+                }
+                ++sp;
+                continue;
+            }
+            if (instr.op == OpCode::STORE) {
+                continue; // rejected in the constructor
+            }
+            if (instr.op == OpCode::SAVE_TEMP) {
+                std::memcpy(temps.data() + instr.operand * kBlockSize,
+                            stack.data() + (sp - 1) * kBlockSize, n * sizeof(double));
+                continue;
+            }
+            if (instr.op == OpCode::LOAD_TEMP) {
+                std::memcpy(stack.data() + sp * kBlockSize,
+                            temps.data() + instr.operand * kBlockSize, n * sizeof(double));
+                ++sp;
+                continue;
+            }
+
+            double* lhs = stack.data() + (sp - 2) * kBlockSize;
+            const double* rhs = lhs + kBlockSize;
+            switch (instr.op) {
+                case OpCode::ADD:
+                    for (size_t i = 0; i < n; ++i) lhs[i] += rhs[i];
+                    break;
+                case OpCode::SUB:
+                    for (size_t i = 0; i < n; ++i) lhs[i] -= rhs[i];
+                    break;
+                case OpCode::MUL:
+                    for (size_t i = 0; i < n; ++i) lhs[i] *= rhs[i];
+                    break;
+                case OpCode::DIV: {
+                    // Check the whole block first so the division loop stays
+                    // branch-free and vectorizable.
+                    bool zero = false;
+                    for (size_t i = 0; i < n; ++i) zero |= (rhs[i] == 0.0);
+                    if (zero) {
+                        size_t row = std::find(rhs, rhs + n, 0.0) - rhs;
+                        throw std::runtime_error("Division by zero in row " + std::to_string(base + row));
+                    }
+                    for (size_t i = 0; i < n; ++i) lhs[i] /= rhs[i];
+                    break;
+                }
+                default:
+                    break;
+            }
+            --sp;
+        }
+        std::memcpy(out + base, stack.data(), n * sizeof(double));
+    }
+}
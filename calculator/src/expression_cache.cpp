@@ -0,0 +1,114 @@
+#include "expression_cache.h"
+#include <functional>
+#include <stdexcept>
+
+ExpressionCache::ExpressionCache(const Calculator& calculator, size_t capacity, size_t shardCount)
+    : calculator_(calculator), shards_(shardCount == 0 ? 1 : shardCount) {
+    setCapacity(capacity);
+}
+
+ExpressionCache::CompiledPtr ExpressionCache::getOrCompile(const std::string& expression) {
+    CalcError error;
+    CompiledPtr compiled = tryGetOrCompile(expression, error);
+    if (!compiled) {
+        throw std::runtime_error(error.message());
+    }
+    return compiled;
+}
+
+ExpressionCache::CompiledPtr ExpressionCache::tryGetOrCompile(const std::string& expression, CalcError& error,
+                                                              Calculator::UnknownNames unknown) {
+    Shard& shard = shardFor(expression);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (CompiledPtr found = findLocked(shard, expression)) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return found;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+
+    // Compile without holding the shard lock; a concurrent miss on the same
+    // text may compile twice, but only one copy ends up in the cache.
+    auto compiled = std::make_shared<Calculator::CompiledExpression>();
+    if (!calculator_.tryCompile(expression, *compiled, error, unknown)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (CompiledPtr found = findLocked(shard, expression)) {
+        return found;
+    }
+    if (shard.capacity == 0) {
+        return compiled;
+    }
+    shard.lru.emplace_front(expression, compiled);
+    shard.index.emplace(expression, shard.lru.begin());
+    evictLocked(shard);
+    return compiled;
+}
+
+ExpressionCache::CompiledPtr ExpressionCache::lookup(const std::string& expression) {
+    Shard& shard = shardFor(expression);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    CompiledPtr found = findLocked(shard, expression);
+    if (found) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+void ExpressionCache::setCapacity(size_t capacity) {
+    // Spread the capacity over the shards, rounding up so the total is never
+    // smaller than requested.
+    size_t perShard = (capacity + shards_.size() - 1) / shards_.size();
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.capacity = perShard;
+        evictLocked(shard);
+    }
+}
+
+void ExpressionCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.lru.clear();
+    }
+}
+
+ExpressionCache::Stats ExpressionCache::stats() const {
+    Stats s;
+    s.hits = hits_.load(std::memory_order_relaxed);
+    s.misses = misses_.load(std::memory_order_relaxed);
+    s.evictions = evictions_.load(std::memory_order_relaxed);
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        s.size += shard.lru.size();
+        s.capacity += shard.capacity;
+    }
+    return s;
+}
+
+ExpressionCache::Shard& ExpressionCache::shardFor(const std::string& expression) {
+    return shards_[std::hash<std::string>{}(expression) % shards_.size()];
+}
+
+ExpressionCache::CompiledPtr ExpressionCache::findLocked(Shard& shard, const std::string& expression) {
+    auto it = shard.index.find(expression);
+    if (it == shard.index.end()) {
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->second;
+}
+
+void ExpressionCache::evictLocked(Shard& shard) {
+    while (shard.lru.size() > shard.capacity) {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,193 @@
+#include "formula_graph.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+
+using OpCode = Calculator::OpCode;
+
+void collectStores(const Calculator::CompiledExpression& compiled, std::vector<uint32_t>& out) {
+    for (const auto& program : compiled.statements) {
+        for (const auto& instr : program.code) {
+            if (instr.op == OpCode::STORE) out.push_back(program.symbols[instr.operand]);
+        }
+    }
+}
+
+} // namespace
+
+bool FormulaGraph::bind(const Calculator& calculator, FormulaPtr formula, std::string source, VariableStore& variables) {
+    // Exactly one statement whose last instruction is its only STORE:
+    // "y = x * 2", but not "x * (y = 2)" or "y = z = x".
+    std::vector<uint32_t> stores;
+    collectStores(*formula, stores);
+    if (formula->statements.size() != 1 || stores.size() != 1 ||
+        formula->statements.front().code.back().op != OpCode::STORE) {
+        throw std::runtime_error("Bound formula must be a single assignment: target = expression");
+    }
+    const uint32_t target = stores.front();
+    // A called function's reads are not inputs the graph could track.
+    if (formula->calls) {
+        throw std::runtime_error("Bound formula cannot call functions");
+    }
+
+    Formula entry;
+    entry.compiled = std::move(formula);
+    entry.source = std::move(source);
+    const Calculator::Program& program = entry.compiled->statements.front();
+    for (const auto& instr : program.code) {
+        if (instr.op == OpCode::LOAD_VAR) entry.inputs.push_back(program.symbols[instr.operand]);
+    }
+    std::sort(entry.inputs.begin(), entry.inputs.end());
+    entry.inputs.erase(std::unique(entry.inputs.begin(), entry.inputs.end()), entry.inputs.end());
+
+    // The new edges input -> target close a cycle iff the target already
+    // reaches one of its inputs. Search downstream of the target,
+    // remembering how each variable was reached to name the cycle.
+    std::unordered_map<uint32_t, uint32_t> reachedFrom{{target, target}};
+    std::vector<uint32_t> pending{target};
+    while (!pending.empty()) {
+        uint32_t slot = pending.back();
+        pending.pop_back();
+        if (std::binary_search(entry.inputs.begin(), entry.inputs.end(), slot)) {
+            std::vector<uint32_t> path{target};
+            for (uint32_t s = slot; s != target; s = reachedFrom[s]) path.push_back(s);
+            std::reverse(path.begin() + 1, path.end());
+            path.push_back(target);
+            std::string cycle;
+            for (uint32_t s : path) {
+                cycle += (cycle.empty() ? "" : " -> ") + calculator.symbols().name(s);
+            }
+            throw std::runtime_error("Cyclic binding: " + cycle);
+        }
+        auto dependents = dependents_.find(slot);
+        if (dependents == dependents_.end()) continue;
+        for (uint32_t next : dependents->second) {
+            if (reachedFrom.emplace(next, slot).second) pending.push_back(next);
+        }
+    }
+
+    unbind(target);
+    for (uint32_t input : entry.inputs) {
+        dependents_[input].push_back(target);
+    }
+    Formula& bound = formulas_.emplace(target, std::move(entry)).first->second;
+    recompute(calculator, target, bound, variables);
+    propagate(calculator, std::vector<uint32_t>{target}, variables);
+    return variables.has(target);
+}
+
+bool FormulaGraph::unbind(uint32_t slot) {
+    auto it = formulas_.find(slot);
+    if (it == formulas_.end()) {
+        return false;
+    }
+    unlink(slot, it->second);
+    formulas_.erase(it);
+    return true;
+}
+
+void FormulaGraph::clear() {
+    formulas_.clear();
+    dependents_.clear();
+}
+
+std::vector<FormulaGraph::Binding> FormulaGraph::bindings() const {
+    std::vector<Binding> out;
+    out.reserve(formulas_.size());
+    for (const auto& [slot, formula] : formulas_) {
+        out.push_back({slot, formula.source, formula.error});
+    }
+    std::sort(out.begin(), out.end(), [](const Binding& a, const Binding& b) { return a.slot < b.slot; });
+    return out;
+}
+
+size_t FormulaGraph::estimateBytes() const {
+    // Hash nodes carry the key, the value and a next pointer; buckets are
+    // one pointer each.
+    constexpr size_t kNode = sizeof(void*) + sizeof(size_t);
+    size_t bytes = (formulas_.bucket_count() + dependents_.bucket_count()) * sizeof(void*);
+    for (const auto& [slot, formula] : formulas_) {
+        // A formula may share its compiled code with the expression cache,
+        // but the binding keeps it alive after the cache lets go of it.
+        bytes += kNode + sizeof(slot) + sizeof(Formula) + Calculator::estimateBytes(*formula.compiled) +
+                 formula.source.capacity() + formula.error.capacity() + formula.inputs.capacity() * sizeof(uint32_t);
+    }
+    for (const auto& [input, targets] : dependents_) {
+        bytes += kNode + sizeof(input) + sizeof(targets) + targets.capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+void FormulaGraph::checkAssignments(const Calculator& calculator, const Calculator::CompiledExpression& compiled) const {
+    std::vector<uint32_t> stores;
+    collectStores(compiled, stores);
+    for (uint32_t slot : stores) {
+        if (isBound(slot)) {
+            throw std::runtime_error("Cannot assign to bound variable: " + calculator.symbols().name(slot));
+        }
+    }
+}
+
+void FormulaGraph::propagate(const Calculator& calculator, const Calculator::CompiledExpression& compiled,
+                             VariableStore& variables) {
+    std::vector<uint32_t> changed;
+    collectStores(compiled, changed);
+    propagate(calculator, changed, variables);
+}
+
+void FormulaGraph::propagate(const Calculator& calculator, const std::vector<uint32_t>& changed,
+                             VariableStore& variables) {
+    // Depth-first post-order over the formulas reachable from `changed`;
+    // reversed, it lists every formula after all the formulas it reads.
+    // Explicit stack: dependency chains can be long.
+    std::vector<uint32_t> order;
+    std::unordered_set<uint32_t> visited;
+    std::vector<std::pair<uint32_t, size_t>> stack; // slot, next dependent to visit
+    for (uint32_t root : changed) {
+        if (!visited.insert(root).second) continue;
+        stack.emplace_back(root, 0);
+        while (!stack.empty()) {
+            auto& [slot, next] = stack.back();
+            auto dependents = dependents_.find(slot);
+            if (dependents != dependents_.end() && next < dependents->second.size()) {
+                uint32_t dependent = dependents->second[next++];
+                if (visited.insert(dependent).second) stack.emplace_back(dependent, 0);
+                continue;
+            }
+            order.push_back(slot);
+            stack.pop_back();
+        }
+    }
+
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        auto formula = formulas_.find(*it);
+        // Roots are not recomputed: they are the values that just changed.
+        if (formula != formulas_.end() && std::find(changed.begin(), changed.end(), *it) == changed.end()) {
+            recompute(calculator, *it, formula->second, variables);
+        }
+    }
+}
+
+void FormulaGraph::recompute(const Calculator& calculator, uint32_t slot, Formula& formula, VariableStore& variables) {
+    double result;
+    CalcError error;
+    if (calculator.tryExecute(formula.compiled->statements.front(), variables, result, error)) {
+        formula.error.clear();
+    } else {
+        variables.erase(slot);
+        formula.error = error.message();
+    }
+}
+
+void FormulaGraph::unlink(uint32_t slot, const Formula& formula) {
+    for (uint32_t input : formula.inputs) {
+        auto it = dependents_.find(input);
+        if (it == dependents_.end()) continue;
+        auto& dependents = it->second;
+        dependents.erase(std::remove(dependents.begin(), dependents.end(), slot), dependents.end());
+        if (dependents.empty()) dependents_.erase(it);
+    }
+}
@@ -0,0 +1,50 @@
+#include "function_table.h"
+
+void FunctionTable::define(FunctionPtr function) {
+    const uint32_t slot = function->slot;
+    if (slot >= functions_.size()) {
+        functions_.resize(slot + 1);
+    }
+    if (!functions_[slot]) {
+        ++count_;
+    }
+    functions_[slot] = std::move(function);
+}
+
+bool FunctionTable::remove(uint32_t slot) {
+    if (slot >= functions_.size() || !functions_[slot]) {
+        return false;
+    }
+    functions_[slot].reset();
+    --count_;
+    return true;
+}
+
+void FunctionTable::clear() {
+    functions_.clear();
+    count_ = 0;
+}
+
+std::vector<FunctionTable::FunctionPtr> FunctionTable::functions() const {
+    std::vector<FunctionPtr> out;
+    out.reserve(count_);
+    for (const auto& function : functions_) {
+        if (function) out.push_back(function);
+    }
+    return out;
+}
+
+size_t FunctionTable::estimateBytes() const {
+    size_t bytes = functions_.capacity() * sizeof(FunctionPtr);
+    for (const auto& function : functions_) {
+        if (!function) continue;
+        // The Function with its shared_ptr control block; the body's own
+        // Program is already part of sizeof(Function).
+        bytes += sizeof(Function) + 2 * sizeof(void*) + function->name.capacity() + function->source.capacity() +
+                 Calculator::estimateBytes(function->body) - sizeof(Calculator::Program);
+        for (const auto& parameter : function->parameters) {
+            bytes += sizeof(std::string) + parameter.capacity();
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,336 @@
+#include "optimizer.h"
+#include "request_arena.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <tuple>
+
+namespace {
+
+using OpCode = Calculator::OpCode;
+
+struct Node {
+    enum class Kind { CONSTANT, VARIABLE, BINARY, STORE, ARGUMENT, CALL };
+
+    Kind kind;
+    OpCode op = OpCode::PUSH_CONST; // BINARY only
+    double value = 0.0;             // CONSTANT only
+    uint32_t slot = 0;              // VARIABLE, STORE; parameter of ARGUMENT; Program::calls index of CALL
+    int left = -1;                  // BINARY, STORE (the assigned value); CALL: first argument in callArgs
+    int right = -1;                 // BINARY; CALL: argument count
+    bool shareable = false;         // may be computed once and reused
+};
+
+using NodeKey = std::tuple<int, int, uint64_t, uint32_t, int, int>;
+
+// Builds the statement as a DAG. Structurally equal nodes are created only
+// once (hash-consing), which is what finds the common subexpressions.
+// All of its containers are request-arena scratch.
+class DagBuilder {
+public:
+    DagBuilder(const std::pmr::set<uint32_t>& assigned, std::pmr::memory_resource* arena)
+        : assigned_(assigned), nodes_(arena), callArgs_(arena), index_(arena) {}
+
+    int constant(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        Node node{Node::Kind::CONSTANT};
+        node.value = value;
+        return intern(node, bits);
+    }
+
+    int variable(uint32_t slot) {
+        Node node{Node::Kind::VARIABLE};
+        node.slot = slot;
+        return intern(node, 0);
+    }
+
+    int argument(uint32_t index) {
+        Node node{Node::Kind::ARGUMENT};
+        node.slot = index;
+        return intern(node, 0);
+    }
+
+    // Calls are never folded or shared: the function may read variables
+    // the statement assigns, or be redefined between runs.
+    int call(uint32_t callIndex, const int* args, uint32_t argCount) {
+        Node node{Node::Kind::CALL};
+        node.slot = callIndex;
+        node.left = static_cast<int>(callArgs_.size());
+        node.right = static_cast<int>(argCount);
+        callArgs_.insert(callArgs_.end(), args, args + argCount);
+        return intern(node, 0);
+    }
+
+    int store(uint32_t slot, int value) {
+        Node node{Node::Kind::STORE};
+        node.slot = slot;
+        node.left = value;
+        return intern(node, 0);
+    }
+
+    int binary(OpCode op, int left, int right) {
+        const Node& l = nodes_[left];
+        const Node& r = nodes_[right];
+        bool lConst = l.kind == Node::Kind::CONSTANT;
+        bool rConst = r.kind == Node::Kind::CONSTANT;
+
+        if (lConst && rConst) {
+            switch (op) {
+                case OpCode::ADD: return constant(l.value + r.value);
+                case OpCode::SUB: return constant(l.value - r.value);
+                case OpCode::MUL: return constant(l.value * r.value);
+                case OpCode::DIV:
+                    if (r.value != 0.0) return constant(l.value / r.value);
+                    break; // keep the runtime "Division by zero"
+                default: break;
+            }
+        }
+        // Algebraic identities
+        if (rConst && r.value == 0.0 && (op == OpCode::ADD || op == OpCode::SUB)) return left;
+        if (lConst && l.value == 0.0 && op == OpCode::ADD) return right;
+        if (rConst && r.value == 1.0 && (op == OpCode::MUL || op == OpCode::DIV)) return left;
+        if (lConst && l.value == 1.0 && op == OpCode::MUL) return right;
+
+        Node node{Node::Kind::BINARY};
+        node.op = op;
+        node.left = left;
+        node.right = right;
+        return intern(node, 0);
+    }
+
+    const std::pmr::vector<Node>& nodes() const { return nodes_; }
+    const std::pmr::vector<int>& callArgs() const { return callArgs_; }
+
+private:
+    int intern(Node node, uint64_t bits) {
+        NodeKey key(static_cast<int>(node.kind), static_cast<int>(node.op), bits,
+                    node.slot, node.left, node.right);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            return it->second;
+        }
+        switch (node.kind) {
+            case Node::Kind::CONSTANT:
+                node.shareable = true;
+                break;
+            case Node::Kind::VARIABLE:
+                node.shareable = assigned_.count(node.slot) == 0;
+                break;
+            case Node::Kind::ARGUMENT:
+                node.shareable = true;
+                break;
+            case Node::Kind::CALL:
+                node.shareable = false;
+                break;
+            case Node::Kind::BINARY:
+                node.shareable = nodes_[node.left].shareable && nodes_[node.right].shareable;
+                break;
+            case Node::Kind::STORE:
+                node.shareable = false;
+                break;
+        }
+        nodes_.push_back(node);
+        int id = static_cast<int>(nodes_.size() - 1);
+        index_.emplace(key, id);
+        return id;
+    }
+
+    const std::pmr::set<uint32_t>& assigned_;
+    std::pmr::vector<Node> nodes_;
+    std::pmr::vector<int> callArgs_; // argument node ids of CALL nodes
+    std::pmr::map<NodeKey, int> index_;
+};
+
+class Emitter {
+public:
+    Emitter(const std::pmr::vector<Node>& nodes, const std::pmr::vector<int>& callArgs, int root,
+            Calculator::Program& out)
+        : nodes_(nodes), callArgs_(callArgs), out_(out),
+          occurrences_(nodes.size(), 0, nodes.get_allocator()),
+          temps_(nodes.size(), -1, nodes.get_allocator()) {
+        // How often each node would be emitted. Children are created before
+        // their parents, so walking ids downwards visits parents first.
+        occurrences_[root] = 1;
+        for (int id = root; id >= 0; --id) {
+            if (occurrences_[id] == 0) continue;
+            const Node& node = nodes_[id];
+            int emitted = isShared(id) ? 1 : occurrences_[id];
+            if (node.kind == Node::Kind::CALL) {
+                for (int i = 0; i < node.right; ++i) occurrences_[callArgs_[node.left + i]] += emitted;
+                continue;
+            }
+            if (node.left >= 0) occurrences_[node.left] += emitted;
+            if (node.right >= 0) occurrences_[node.right] += emitted;
+        }
+    }
+
+    // Emits the subtree in post order. Statements can be long chains
+    // ("x + x + ..."), far deeper than the call stack would allow, so the
+    // walk keeps its own stack like the parser does: a node is visited
+    // once to queue its children and once more to emit its instruction.
+    void emit(int root) {
+        struct Visit {
+            int id;
+            bool childrenDone;
+        };
+        std::pmr::vector<Visit> visits(nodes_.get_allocator());
+        visits.push_back({root, false});
+        while (!visits.empty()) {
+            const Visit visit = visits.back();
+            visits.pop_back();
+            const int id = visit.id;
+            const Node& node = nodes_[id];
+            if (visit.childrenDone) {
+                finish(id);
+                continue;
+            }
+            if (isShared(id) && temps_[id] >= 0) {
+                push(OpCode::LOAD_TEMP, static_cast<uint32_t>(temps_[id]), 1);
+                continue;
+            }
+            // Children are queued in reverse, so they are emitted left to right.
+            switch (node.kind) {
+                case Node::Kind::CONSTANT:
+                    push(OpCode::PUSH_CONST, constantIndex(node.value), 1);
+                    break;
+                case Node::Kind::VARIABLE:
+                    push(OpCode::LOAD_VAR, node.slot, 1);
+                    break;
+                case Node::Kind::ARGUMENT:
+                    push(OpCode::LOAD_ARG, node.slot, 1);
+                    break;
+                case Node::Kind::BINARY:
+                    visits.push_back({id, true});
+                    visits.push_back({node.right, false});
+                    visits.push_back({node.left, false});
+                    break;
+                case Node::Kind::STORE:
+                    visits.push_back({id, true});
+                    visits.push_back({node.left, false});
+                    break;
+                case Node::Kind::CALL:
+                    visits.push_back({id, true});
+                    for (int i = node.right - 1; i >= 0; --i) visits.push_back({callArgs_[node.left + i], false});
+                    break;
+            }
+        }
+    }
+
+private:
+    // Only computed subexpressions are worth a temporary; leaves are as
+    // cheap to reload as a temporary would be.
+    // The instruction of an inner node, once its children are on the stack.
+    void finish(int id) {
+        const Node& node = nodes_[id];
+        switch (node.kind) {
+            case Node::Kind::BINARY:
+                push(node.op, 0, -1);
+                break;
+            case Node::Kind::STORE:
+                push(OpCode::STORE, node.slot, 0);
+                break;
+            case Node::Kind::CALL:
+                push(OpCode::CALL, node.slot, 1 - node.right);
+                break;
+            default:
+                break;
+        }
+        if (isShared(id)) {
+            temps_[id] = static_cast<int>(out_.tempCount++);
+            push(OpCode::SAVE_TEMP, static_cast<uint32_t>(temps_[id]), 0);
+        }
+    }
+
+    bool isShared(int id) const {
+        const Node& node = nodes_[id];
+        return node.kind == Node::Kind::BINARY && node.shareable && occurrences_[id] > 1;
+    }
+
+    void push(OpCode op, uint32_t operand, int stackEffect) {
+        out_.code.push_back({op, operand});
+        depth_ += stackEffect;
+        out_.maxStackDepth = std::max(out_.maxStackDepth, static_cast<size_t>(depth_));
+    }
+
+    uint32_t constantIndex(double value) {
+        for (size_t i = 0; i < out_.constants.size(); ++i) {
+            if (std::memcmp(&out_.constants[i], &value, sizeof(double)) == 0) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        out_.constants.push_back(value);
+        return static_cast<uint32_t>(out_.constants.size() - 1);
+    }
+
+    const std::pmr::vector<Node>& nodes_;
+    const std::pmr::vector<int>& callArgs_;
+    Calculator::Program& out_;
+    std::pmr::vector<int> occurrences_;
+    std::pmr::vector<int> temps_;
+    int depth_ = 0;
+};
+
+} // namespace
+
+Calculator::Program optimizeProgram(const Calculator::Program& program) {
+    RequestArena::Scope scope;
+    std::pmr::memory_resource* arena = RequestArena::resource();
+
+    std::pmr::set<uint32_t> assigned(arena);
+    for (const auto& instr : program.code) {
+        if (instr.op == OpCode::STORE) {
+            assigned.insert(instr.operand);
+        }
+    }
+
+    // Rebuild the expression from the stack code.
+    DagBuilder builder(assigned, arena);
+    std::pmr::vector<int> stack(arena);
+    for (const auto& instr : program.code) {
+        switch (instr.op) {
+            case OpCode::PUSH_CONST:
+                stack.push_back(builder.constant(program.constants[instr.operand]));
+                break;
+            case OpCode::LOAD_VAR:
+                stack.push_back(builder.variable(instr.operand));
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+            case OpCode::DIV: {
+                int right = stack.back();
+                stack.pop_back();
+                stack.back() = builder.binary(instr.op, stack.back(), right);
+                break;
+            }
+            case OpCode::STORE:
+                stack.back() = builder.store(instr.operand, stack.back());
+                break;
+            case OpCode::LOAD_ARG:
+                stack.push_back(builder.argument(instr.operand));
+                break;
+            case OpCode::CALL: {
+                uint32_t argCount = program.calls[instr.operand].argCount;
+                int id = builder.call(instr.operand, stack.data() + stack.size() - argCount, argCount);
+                stack.resize(stack.size() - argCount);
+                stack.push_back(id);
+                break;
+            }
+            case OpCode::SAVE_TEMP:
+            case OpCode::LOAD_TEMP:
+                return program; // already optimized
+        }
+    }
+
+    Calculator::Program optimized;
+    optimized.symbols = program.symbols;
+    optimized.calls = program.calls;
+    // Folding and sharing never make a statement longer.
+    optimized.code.reserve(program.code.size());
+    optimized.constants.reserve(program.constants.size());
+    Emitter emitter(builder.nodes(), builder.callArgs(), stack.back(), optimized);
+    emitter.emit(stack.back());
+    return optimized;
+}
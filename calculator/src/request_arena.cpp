@@ -0,0 +1,89 @@
+#include "request_arena.h"
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+// Upstream of the monotonic buffer: plain heap memory, but remembers how
+// much was needed beyond the preallocated buffer.
+class OverflowResource : public std::pmr::memory_resource {
+public:
+    size_t overflow = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        overflow += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+struct ThreadArena {
+    ThreadArena() { rebuild(RequestArena::kInitialCapacity); }
+
+    // Called when the outermost scope ends. A request that spilled over the
+    // buffer makes the next one start with enough room for both, within
+    // kMaxCapacity; a long run of requests that fit shrinks it again.
+    void reset() {
+        if (upstream.overflow == 0) {
+            if (++quietRequests < RequestArena::kShrinkAfter || capacity <= RequestArena::kInitialCapacity) {
+                resource->release();
+                return;
+            }
+            resource.reset();
+            rebuild(std::max(capacity / 2, RequestArena::kInitialCapacity));
+            return;
+        }
+        size_t needed = capacity + upstream.overflow;
+        resource.reset();
+        upstream.overflow = 0;
+        rebuild(std::min(needed * 2, RequestArena::kMaxCapacity));
+    }
+
+    void rebuild(size_t bytes) {
+        quietRequests = 0;
+        if (bytes != capacity) {
+            buffer = std::make_unique<std::byte[]>(bytes);
+        }
+        capacity = bytes;
+        resource = std::make_unique<std::pmr::monotonic_buffer_resource>(buffer.get(), capacity, &upstream);
+    }
+
+    OverflowResource upstream;
+    std::unique_ptr<std::byte[]> buffer;
+    size_t capacity = 0;
+    size_t quietRequests = 0; // outermost scopes since the last rebuild that did not overflow
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> resource;
+    int depth = 0;
+};
+
+ThreadArena& threadArena() {
+    thread_local ThreadArena arena;
+    return arena;
+}
+
+} // namespace
+
+RequestArena::Scope::Scope() {
+    ++threadArena().depth;
+}
+
+RequestArena::Scope::~Scope() {
+    ThreadArena& arena = threadArena();
+    if (--arena.depth == 0) {
+        arena.reset();
+    }
+}
+
+std::pmr::memory_resource* RequestArena::resource() {
+    return threadArena().resource.get();
+}
+
+size_t RequestArena::capacity() {
+    return threadArena().capacity;
+}
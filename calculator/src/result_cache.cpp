@@ -0,0 +1,64 @@
+#include "result_cache.h"
+#include <algorithm>
+
+std::optional<double> ResultCache::lookup(const CompiledPtr& compiled, const VariableStore& variables) {
+    auto it = index_.find(compiled.get());
+    if (it == index_.end()) {
+        return std::nullopt;
+    }
+    const Entry& entry = *it->second;
+    for (const auto& [slot, version] : entry.inputs) {
+        if (variables.version(slot) != version) {
+            return std::nullopt;
+        }
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return entry.result;
+}
+
+size_t ResultCache::insert(const CompiledPtr& compiled, const VariableStore& variables, double result,
+                           size_t maxBytes) {
+    if (!cacheable(*compiled)) {
+        return 0;
+    }
+    // A stale entry for the same expression is refreshed in place.
+    auto existing = index_.find(compiled.get());
+    if (existing != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, existing->second);
+    } else {
+        lru_.emplace_front();
+        lru_.front().compiled = compiled;
+        index_.emplace(compiled.get(), lru_.begin());
+    }
+    Entry& entry = lru_.front();
+    entry.result = result;
+    entry.inputs.clear();
+    for (const auto& program : compiled->statements) {
+        for (uint32_t slot : program.symbols) {
+            entry.inputs.emplace_back(slot, variables.version(slot));
+        }
+    }
+    std::sort(entry.inputs.begin(), entry.inputs.end());
+    entry.inputs.erase(std::unique(entry.inputs.begin(), entry.inputs.end()), entry.inputs.end());
+
+    // List node, index node and the inputs; the compiled program itself is
+    // owned by the expression cache.
+    bytes_ -= entry.bytes;
+    entry.bytes = sizeof(Entry) + 6 * sizeof(void*) + entry.inputs.capacity() * sizeof(entry.inputs[0]);
+    bytes_ += entry.bytes;
+
+    size_t evicted = 0;
+    while (bytes_ > maxBytes && !lru_.empty()) {
+        bytes_ -= lru_.back().bytes;
+        index_.erase(lru_.back().compiled.get());
+        lru_.pop_back();
+        ++evicted;
+    }
+    return evicted;
+}
+
+void ResultCache::clear() {
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
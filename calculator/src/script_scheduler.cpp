@@ -0,0 +1,209 @@
+#include "script_scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+using OpCode = Calculator::OpCode;
+
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+struct SlotHistory {
+    uint32_t lastWriter = kNone;
+    std::vector<uint32_t> readers; // since lastWriter
+};
+
+// One parallel run of a script. Lives on the caller's stack; the caller
+// waits until no task refers to it any more.
+class ScriptRun {
+public:
+    ScriptRun(const Calculator& calculator, const Calculator::CompiledExpression& compiled,
+              const ScriptPlan& plan, VariableStore& variables, WorkStealingPool& pool)
+        : calculator_(calculator), compiled_(compiled), plan_(plan), variables_(variables), pool_(pool),
+          waiting_(new std::atomic<uint32_t>[plan.dependencyCount.size()]) {
+        for (size_t i = 0; i < plan.dependencyCount.size(); ++i) {
+            waiting_[i].store(plan.dependencyCount[i], std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if a statement failed.
+    bool run() {
+        // The caller holds one reference while spawning, so the count
+        // cannot drop to zero before every root is submitted.
+        outstanding_ = 1;
+        for (uint32_t root : plan_.roots) {
+            spawn(root);
+        }
+        release();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return outstanding_ == 0; });
+        return !failed_.load(std::memory_order_relaxed);
+    }
+
+    double lastResult() const { return lastResult_; }
+
+private:
+    void spawn(uint32_t statement) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++outstanding_;
+        }
+        pool_.submit([this, statement]() {
+            runFrom(statement);
+            release();
+        });
+    }
+
+    void release() {
+        // Under the mutex: run() may return, destroying this object, as
+        // soon as it sees zero.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--outstanding_ == 0) {
+            done_.notify_all();
+        }
+    }
+
+    // Runs the statement, then follows the chain: the first dependent it
+    // made ready runs on this thread next, the others are submitted.
+    void runFrom(uint32_t statement) {
+        while (statement != kNone) {
+            if (failed_.load(std::memory_order_relaxed)) {
+                return;
+            }
+            // The error itself comes from the sequential replay.
+            double result;
+            CalcError error;
+            if (!calculator_.tryExecute(compiled_.statements[statement], variables_, result, error)) {
+                failed_.store(true, std::memory_order_relaxed);
+                return;
+            }
+            if (statement + 1 == compiled_.statements.size()) {
+                lastResult_ = result;
+            }
+
+            uint32_t next = kNone;
+            for (uint32_t dependent : plan_.dependents[statement]) {
+                // acq_rel: the dependent sees everything its dependencies wrote.
+                if (waiting_[dependent].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    continue;
+                }
+                if (next == kNone) {
+                    next = dependent;
+                } else {
+                    spawn(dependent);
+                }
+            }
+            statement = next;
+        }
+    }
+
+    const Calculator& calculator_;
+    const Calculator::CompiledExpression& compiled_;
+    const ScriptPlan& plan_;
+    VariableStore& variables_;
+    WorkStealingPool& pool_;
+    std::unique_ptr<std::atomic<uint32_t>[]> waiting_; // unfinished dependencies per statement
+    std::atomic<bool> failed_{false};
+    double lastResult_ = 0.0;
+    std::mutex mutex_;
+    std::condition_variable done_;
+    size_t outstanding_ = 0; // tasks submitted and not finished, guarded by mutex_
+};
+
+} // namespace
+
+ScriptPlan buildScriptPlan(const Calculator::CompiledExpression& compiled) {
+    const uint32_t count = static_cast<uint32_t>(compiled.statements.size());
+    ScriptPlan plan;
+    plan.dependents.resize(count);
+    plan.dependencyCount.assign(count, 0);
+
+    std::unordered_map<uint32_t, SlotHistory> history;
+    std::vector<uint32_t> linkedTo(count, kNone); // last statement that got an edge from i
+    std::vector<size_t> level(count, 1);
+    std::vector<uint32_t> reads, writes;
+
+    for (uint32_t s = 0; s < count; ++s) {
+        reads.clear();
+        writes.clear();
+        const Calculator::Program& program = compiled.statements[s];
+        for (const auto& instr : program.code) {
+            if (instr.op == OpCode::LOAD_VAR) reads.push_back(program.symbols[instr.operand]);
+            if (instr.op == OpCode::STORE) writes.push_back(program.symbols[instr.operand]);
+        }
+
+        auto dependOn = [&](uint32_t earlier) {
+            if (earlier == kNone || earlier == s || linkedTo[earlier] == s) return;
+            linkedTo[earlier] = s;
+            plan.dependents[earlier].push_back(s);
+            ++plan.dependencyCount[s];
+            level[s] = std::max(level[s], level[earlier] + 1);
+        };
+        for (uint32_t slot : reads) {
+            SlotHistory& slotHistory = history[slot];
+            dependOn(slotHistory.lastWriter);
+            slotHistory.readers.push_back(s);
+        }
+        for (uint32_t slot : writes) {
+            SlotHistory& slotHistory = history[slot];
+            dependOn(slotHistory.lastWriter);
+            for (uint32_t reader : slotHistory.readers) {
+                dependOn(reader);
+            }
+            if (slotHistory.lastWriter == kNone) {
+                plan.writes.push_back(slot);
+            }
+            slotHistory.lastWriter = s;
+            slotHistory.readers.clear();
+        }
+
+        if (plan.dependencyCount[s] == 0) {
+            plan.roots.push_back(s);
+        }
+        plan.depth = std::max(plan.depth, level[s]);
+    }
+    return plan;
+}
+
+bool runScript(const Calculator& calculator, const Calculator::CompiledExpression& compiled,
+               const ScriptPlan& plan, VariableStore& variables, WorkStealingPool& pool,
+               double& result, CalcError& error) {
+    // Workers write entries concurrently, so every variable the script
+    // assigns gets its entry up front and the store never changes shape.
+    struct Saved {
+        uint32_t entry;
+        double value;
+        bool defined;
+    };
+    std::vector<Saved> saved;
+    saved.reserve(plan.writes.size());
+    for (uint32_t slot : plan.writes) {
+        const uint32_t entry = variables.entry(slot);
+        saved.push_back({entry, variables.value(entry), variables.defined(entry)});
+    }
+
+    ScriptRun run(calculator, compiled, plan, variables, pool);
+    if (run.run()) {
+        result = run.lastResult();
+        return true;
+    }
+
+    for (size_t i = 0; i < plan.writes.size(); ++i) {
+        if (saved[i].defined) {
+            variables.assign(saved[i].entry, saved[i].value);
+        } else {
+            variables.erase(plan.writes[i]);
+        }
+    }
+    result = 0.0;
+    for (const auto& program : compiled.statements) {
+        if (!calculator.tryExecute(program, variables, result, error)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+#include "symbol_table.h"
+#include <algorithm>
+#include <mutex>
+
+bool SymbolTable::lookup(const std::string& name, uint32_t& slot) const {
+    auto it = slots_.find(name);
+    if (it == slots_.end()) {
+        return false;
+    }
+    slot = it->second;
+    return true;
+}
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    uint32_t slot = 0;
+    tryIntern(name, slot, false);
+    return slot;
+}
+
+bool SymbolTable::tryIntern(std::string_view view, uint32_t& slot, bool limited) {
+    // Variable names are short, so this copy normally stays in the SSO buffer.
+    const std::string name(view);
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (lookup(name, slot)) {
+            return true;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (lookup(name, slot)) {
+        return true;
+    }
+    const size_t limit = limit_.load(std::memory_order_relaxed);
+    if (limited && limit != 0 && names_.size() >= limit) {
+        return false;
+    }
+    slot = static_cast<uint32_t>(names_.size());
+    names_.push_back(name);
+    slots_.emplace(name, slot);
+    if (name.size() >= sizeof(std::string)) {
+        nameBytes_ += 2 * (name.size() + 1); // the deque's copy and the map key's
+    }
+    return true;
+}
+
+bool SymbolTable::find(std::string_view name, uint32_t& slot) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return lookup(std::string(name), slot);
+}
+
+const std::string& SymbolTable::name(uint32_t slot) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return names_.at(slot);
+}
+
+size_t SymbolTable::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return names_.size();
+}
+
+size_t SymbolTable::estimateBytes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    // Per name: a deque element, a hash node holding the key and slot, and
+    // a bucket pointer.
+    const size_t node = sizeof(void*) + sizeof(std::pair<const std::string, uint32_t>) + sizeof(size_t);
+    return names_.size() * (sizeof(std::string) + node) + slots_.bucket_count() * sizeof(void*) + nameBytes_;
+}
+
+uint32_t VariableStore::entry(uint32_t slot) {
+    const uint32_t existing = find(slot);
+    if (existing != kNoEntry) {
+        return existing;
+    }
+    const uint32_t e = static_cast<uint32_t>(slots_.size());
+    if (2 * (slots_.size() + 1) > buckets_.size()) {
+        rehash(std::max<size_t>(8, 2 * buckets_.size()));
+    }
+    size_t i = bucketOf(slot);
+    while (buckets_[i].entry != kNoEntry) {
+        i = (i + 1) & (buckets_.size() - 1);
+    }
+    buckets_[i] = {slot, e};
+    slots_.push_back(slot);
+    values_.push_back(0.0);
+    defined_.push_back(0);
+    versions_.push_back(0);
+    return e;
+}
+
+void VariableStore::rehash(size_t bucketCount) {
+    buckets_.assign(bucketCount, Bucket());
+    shift_ = 32;
+    for (size_t n = bucketCount; n > 1; n /= 2) {
+        --shift_;
+    }
+    for (uint32_t e = 0; e < slots_.size(); ++e) {
+        size_t i = bucketOf(slots_[e]);
+        while (buckets_[i].entry != kNoEntry) {
+            i = (i + 1) & (bucketCount - 1);
+        }
+        buckets_[i] = {slots_[e], e};
+    }
+}
+
+void VariableStore::clear() {
+    std::fill(defined_.begin(), defined_.end(), 0);
+    for (uint32_t& version : versions_) {
+        ++version;
+    }
+}
+
+size_t VariableStore::count() const {
+    return static_cast<size_t>(std::count(defined_.begin(), defined_.end(), 1));
+}
+
+size_t VariableStore::estimateBytes() const {
+    return buckets_.capacity() * sizeof(Bucket) + slots_.capacity() * sizeof(uint32_t) +
+           values_.capacity() * sizeof(double) +
+           defined_.capacity() * sizeof(uint8_t) + versions_.capacity() * sizeof(uint32_t);
+}
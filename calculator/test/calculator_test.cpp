@@ -104,4 +104,172 @@ TEST(CalculatorTest, CommandClean) {
     vars.clear(); 
     ASSERT_TRUE(vars.empty());
     ASSERT_THROW(calc.evaluate("a + 1", vars), std::runtime_error);
-}
\ No newline at end of file
+}
+
+TEST(CalculatorTest, CompileOnceEvaluateMany) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    auto compiled = calc.compile("x = x + 1; x * 10");
+    vars["x"] = 0;
+    ASSERT_DOUBLE_EQ(calc.evaluate(compiled, vars), 10.0);
+    ASSERT_DOUBLE_EQ(calc.evaluate(compiled, vars), 20.0);
+    ASSERT_DOUBLE_EQ(vars["x"], 2.0);
+}
+
+TEST(CalculatorTest, CompileRejectsBeforeRunning) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    // The whole script is parsed before the first statement is executed
+    ASSERT_THROW(calc.evaluate("a = 1; (2 + 3", vars), std::runtime_error);
+    ASSERT_TRUE(vars.empty());
+}
+
+// --- Tests for the bytecode VM ---
+
+TEST(CalculatorTest, KeepsFullPrecision) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    ASSERT_DOUBLE_EQ(calc.evaluate("1 / 3", vars), 1.0 / 3.0);
+    ASSERT_DOUBLE_EQ(calc.evaluate("x = 0.1234567891; x * 1000", vars), 123.4567891);
+}
+
+TEST(CalculatorTest, CompilesToBytecode) {
+    Calculator calc;
+    auto compiled = calc.compile("x = 2 * y");
+    ASSERT_EQ(compiled.statements.size(), 1u);
+
+    const Calculator::Program& program = compiled.statements[0];
+    using Op = Calculator::OpCode;
+    std::vector<Op> ops;
+    for (const auto& instr : program.code) {
+        ops.push_back(instr.op);
+    }
+    // The assignment target is not loaded, only stored to
+    EXPECT_EQ(ops, (std::vector<Op>{Op::PUSH_CONST, Op::LOAD_VAR, Op::MUL, Op::STORE}));
+    EXPECT_EQ(program.maxStackDepth, 2u);
+    ASSERT_EQ(program.symbols.size(), 2u);
+    EXPECT_EQ(calc.symbols().name(program.symbols[0]), "x");
+    EXPECT_EQ(calc.symbols().name(program.symbols[1]), "y");
+}
+
+TEST(CalculatorTest, ChainedAssignment) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    ASSERT_DOUBLE_EQ(calc.evaluate("a = b = 3", vars), 3.0);
+    ASSERT_DOUBLE_EQ(vars["a"], 3.0);
+    ASSERT_DOUBLE_EQ(vars["b"], 3.0);
+}
+
+TEST(CalculatorTest, BareVariableYieldsValue) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    ASSERT_DOUBLE_EQ(calc.evaluate("x = 4; x", vars), 4.0);
+}
+
+TEST(CalculatorTest, MalformedStatements) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    ASSERT_THROW(calc.evaluate("2 +", vars), std::runtime_error);
+    ASSERT_THROW(calc.evaluate("2 = 3", vars), std::runtime_error);
+    ASSERT_THROW(calc.evaluate("=", vars), std::runtime_error);
+}
+
+TEST(CalculatorTest, DeepExpressionUsesLargeStack) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    std::string expression = "1";
+    for (int i = 0; i < 100; ++i) {
+        expression = "1 + (" + expression + ")";
+    }
+    ASSERT_DOUBLE_EQ(calc.evaluate(expression, vars), 101.0);
+}
+
+TEST(CalculatorTest, MalformedNumbersRejectedWhileLexing) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    try {
+        calc.compile("1.2.3 + 1");
+        FAIL() << "expected a lexing error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Invalid number: 1.2.3");
+    }
+    try {
+        calc.compile("1var = 5");
+        FAIL() << "expected a lexing error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Invalid variable name: 1var");
+    }
+    ASSERT_THROW(calc.evaluate("2..5", vars), std::runtime_error);
+    ASSERT_DOUBLE_EQ(calc.evaluate(".5 + 1.", vars), 1.5);
+}
+
+TEST(CalculatorTest, ScriptSplittingIgnoresEmptyStatements) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    ASSERT_DOUBLE_EQ(calc.evaluate(" ;\ta = 2 ;; b = a * 3 ;\n", vars), 6.0);
+    ASSERT_DOUBLE_EQ(vars["b"], 6.0);
+}
+
+TEST(CalculatorTest, TryApiReportsCodeOffsetAndMessage) {
+    Calculator calc;
+    Calculator::CompiledExpression compiled;
+    CalcError error;
+
+    const std::string badNumber = "x = 1; y = 2 + 1.2.3";
+    ASSERT_FALSE(calc.tryCompile(badNumber, compiled, error));
+    EXPECT_EQ(error.code, CalcErrc::INVALID_NUMBER);
+    EXPECT_EQ(error.offset, 15u);
+    EXPECT_EQ(error.message(), "Invalid number: 1.2.3");
+
+    const std::string unclosed = "2 * (3 + 4";
+    ASSERT_FALSE(calc.tryCompile(unclosed, compiled, error));
+    EXPECT_EQ(error.code, CalcErrc::MISMATCHED_PARENTHESES);
+    EXPECT_EQ(error.offset, 4u);
+
+    // Runtime errors point at the failing statement.
+    const std::string script = "a = 1; b = a / 0; c = 3";
+    ASSERT_TRUE(calc.tryCompile(script, compiled, error));
+    VariableStore vars;
+    double result = 0.0;
+    ASSERT_FALSE(calc.tryEvaluate(compiled, vars, result, error));
+    EXPECT_EQ(error.code, CalcErrc::DIVISION_BY_ZERO);
+    EXPECT_EQ(error.offset, 7u);
+    EXPECT_EQ(error.message(), "Division by zero");
+    EXPECT_TRUE(vars.has(calc.intern("a")));
+
+    ASSERT_TRUE(calc.tryCompile("a + missing", compiled, error));
+    ASSERT_FALSE(calc.tryEvaluate(compiled, vars, result, error));
+    EXPECT_EQ(error.code, CalcErrc::UNKNOWN_VARIABLE);
+    EXPECT_EQ(error.message(), "Unknown variable: missing");
+
+    ASSERT_TRUE(calc.tryCompile("a * 2", compiled, error));
+    ASSERT_TRUE(calc.tryEvaluate(compiled, vars, result, error));
+    EXPECT_DOUBLE_EQ(result, 2.0);
+}
+
+TEST(CalculatorTest, TryApiMatchesThrowingMessages) {
+    Calculator calc;
+    const char* const invalid[] = {
+        "1var + 2", "2 $ 3", "(1 + 2", "1 + 2)", "1, 2", "2 +", "2 = 3", "= 3", "2 3",
+        "x + 1", "1 / 0", "f(1)",
+    };
+    for (const char* expression : invalid) {
+        std::string thrown;
+        try {
+            std::map<std::string, double> vars;
+            calc.evaluate(expression, vars);
+        } catch (const std::runtime_error& e) {
+            thrown = e.what();
+        }
+        ASSERT_FALSE(thrown.empty()) << expression;
+
+        Calculator::CompiledExpression compiled;
+        CalcError error;
+        VariableStore vars;
+        double result = 0.0;
+        bool ok = calc.tryCompile(expression, compiled, error) && calc.tryEvaluate(compiled, vars, result, error);
+        ASSERT_FALSE(ok) << expression;
+        EXPECT_EQ(error.message(), thrown) << expression;
+        EXPECT_LE(error.offset, std::string(expression).size()) << expression;
+    }
+}
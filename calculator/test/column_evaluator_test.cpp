@@ -0,0 +1,67 @@
+#include "gtest/gtest.h"
+#include "column_evaluator.h"
+#include <map>
+#include <vector>
+
+TEST(ColumnEvaluatorTest, MatchesRowByRowEvaluation) {
+    Calculator calc;
+    auto compiled = calc.compile("price * qty - fee / 2");
+
+    // More rows than one block, and not a multiple of the block size
+    const size_t rows = ColumnEvaluator::kBlockSize * 3 + 17;
+    std::vector<double> price(rows), qty(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        price[i] = 1.5 + i;
+        qty[i] = static_cast<double>(i % 7);
+    }
+
+    ColumnEvaluator evaluator(calc, compiled.statements[0]);
+    evaluator.bindColumn("price", price.data());
+    evaluator.bindColumn("qty", qty.data());
+    evaluator.bindScalar("fee", 3.0);
+    std::vector<double> out = evaluator.evaluate(rows);
+
+    ASSERT_EQ(out.size(), rows);
+    for (size_t i = 0; i < rows; ++i) {
+        std::map<std::string, double> vars{{"price", price[i]}, {"qty", qty[i]}, {"fee", 3.0}};
+        ASSERT_DOUBLE_EQ(out[i], calc.evaluate(compiled, vars)) << "row " << i;
+    }
+}
+
+TEST(ColumnEvaluatorTest, DivisionByZeroNamesRow) {
+    Calculator calc;
+    auto compiled = calc.compile("1 / x");
+    std::vector<double> x(600, 2.0);
+    x[513] = 0.0;
+
+    ColumnEvaluator evaluator(calc, compiled.statements[0]);
+    evaluator.bindColumn("x", x.data());
+    try {
+        evaluator.evaluate(x.size());
+        FAIL() << "expected division by zero";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Division by zero in row 513");
+    }
+}
+
+TEST(ColumnEvaluatorTest, UnboundVariable) {
+    Calculator calc;
+    auto compiled = calc.compile("a + b");
+    ColumnEvaluator evaluator(calc, compiled.statements[0]);
+    evaluator.bindScalar("a", 1.0);
+    ASSERT_THROW(evaluator.evaluate(4), std::runtime_error);
+}
+
+TEST(ColumnEvaluatorTest, RejectsAssignments) {
+    Calculator calc;
+    auto compiled = calc.compile("y = x * 2");
+    ASSERT_THROW(ColumnEvaluator(calc, compiled.statements[0]), std::runtime_error);
+}
+
+TEST(ColumnEvaluatorTest, ConstantExpression) {
+    Calculator calc;
+    auto compiled = calc.compile("(2 + 3) * 4");
+    ColumnEvaluator evaluator(calc, compiled.statements[0]);
+    std::vector<double> out = evaluator.evaluate(3);
+    EXPECT_EQ(out, (std::vector<double>{20.0, 20.0, 20.0}));
+}
@@ -0,0 +1,102 @@
+#include "gtest/gtest.h"
+#include "expression_cache.h"
+#include <map>
+#include <thread>
+#include <vector>
+
+TEST(ExpressionCacheTest, MissThenHit) {
+    Calculator calc;
+    ExpressionCache cache(calc, 8, 1);
+    std::map<std::string, double> vars;
+
+    auto first = cache.getOrCompile("2 + 3 * 4");
+    auto second = cache.getOrCompile("2 + 3 * 4");
+
+    EXPECT_EQ(first, second); // the same compiled program is shared
+    ASSERT_DOUBLE_EQ(calc.evaluate(*second, vars), 14.0);
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.size, 1u);
+}
+
+TEST(ExpressionCacheTest, EvictsLeastRecentlyUsed) {
+    Calculator calc;
+    ExpressionCache cache(calc, 2, 1);
+
+    cache.getOrCompile("1 + 1");
+    cache.getOrCompile("2 + 2");
+    cache.getOrCompile("1 + 1");   // "2 + 2" is now the oldest entry
+    cache.getOrCompile("3 + 3");   // evicts "2 + 2"
+
+    EXPECT_NE(cache.lookup("1 + 1"), nullptr);
+    EXPECT_NE(cache.lookup("3 + 3"), nullptr);
+    EXPECT_EQ(cache.lookup("2 + 2"), nullptr);
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_EQ(stats.size, 2u);
+}
+
+TEST(ExpressionCacheTest, ShrinkingCapacityEvicts) {
+    Calculator calc;
+    ExpressionCache cache(calc, 4, 1);
+    cache.getOrCompile("1");
+    cache.getOrCompile("2");
+    cache.getOrCompile("3");
+
+    cache.setCapacity(1);
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.size, 1u);
+    EXPECT_EQ(stats.evictions, 2u);
+    EXPECT_NE(cache.lookup("3"), nullptr);
+}
+
+TEST(ExpressionCacheTest, CompileErrorsAreNotCached) {
+    Calculator calc;
+    ExpressionCache cache(calc, 8, 1);
+
+    ASSERT_THROW(cache.getOrCompile("(2 + 3"), std::runtime_error);
+    EXPECT_EQ(cache.stats().size, 0u);
+
+    CalcError error;
+    EXPECT_EQ(cache.tryGetOrCompile("(2 + 3", error), nullptr);
+    EXPECT_EQ(error.code, CalcErrc::MISMATCHED_PARENTHESES);
+    EXPECT_EQ(cache.stats().size, 0u);
+}
+
+TEST(ExpressionCacheTest, CachedProgramUsesCallerVariables) {
+    Calculator calc;
+    ExpressionCache cache(calc);
+    std::map<std::string, double> a{{"x", 1.0}};
+    std::map<std::string, double> b{{"x", 10.0}};
+
+    auto program = cache.getOrCompile("x * 2");
+    ASSERT_DOUBLE_EQ(calc.evaluate(*program, a), 2.0);
+    ASSERT_DOUBLE_EQ(calc.evaluate(*program, b), 20.0);
+}
+
+TEST(ExpressionCacheTest, ConcurrentAccess) {
+    Calculator calc;
+    ExpressionCache cache(calc, 16);
+    const std::vector<std::string> corpus = {"1 + 2", "3 * 4", "(5 - 1) / 2", "x = 7", "8 / 4 + 1"};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 500; ++i) {
+                auto program = cache.getOrCompile(corpus[i % corpus.size()]);
+                ASSERT_NE(program, nullptr);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.hits + stats.misses, 8u * 500u);
+    EXPECT_EQ(stats.size, corpus.size());
+}
@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+#include "formula_graph.h"
+#include <memory>
+#include <string>
+
+namespace {
+
+FormulaGraph::FormulaPtr compile(const Calculator& calc, const std::string& text) {
+    return std::make_shared<const Calculator::CompiledExpression>(calc.compile(text));
+}
+
+// Runs a plain script the way the server does: reject writes to bound
+// variables, run, then recompute what depends on the assignments.
+double run(const Calculator& calc, FormulaGraph& graph, const std::string& text, VariableStore& vars) {
+    auto compiled = calc.compile(text);
+    graph.checkAssignments(calc, compiled);
+    double result = calc.evaluate(compiled, vars);
+    graph.propagate(calc, compiled, vars);
+    return result;
+}
+
+uint32_t slot(const Calculator& calc, const std::string& name) {
+    uint32_t s = 0;
+    EXPECT_TRUE(calc.symbols().find(name, s)) << name;
+    return s;
+}
+
+} // namespace
+
+TEST(FormulaGraphTest, RecomputesDownstreamInTopologicalOrder) {
+    Calculator calc;
+    FormulaGraph graph;
+    VariableStore vars;
+    run(calc, graph, "x = 1; w = 100", vars);
+
+    // Diamond: x feeds a and b, both feed c; d reads only w.
+    EXPECT_FALSE(graph.bind(calc, compile(calc, "c = a + b"), "c = a + b", vars)); // inputs not there yet
+    EXPECT_TRUE(graph.bind(calc, compile(calc, "a = x * 2"), "a = x * 2", vars));
+    EXPECT_TRUE(graph.bind(calc, compile(calc, "b = a + x + 1"), "b = a + x + 1", vars));
+    EXPECT_TRUE(graph.bind(calc, compile(calc, "d = w / 4"), "d = w / 4", vars));
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "c")), 2 + 4); // binding b updated c
+
+    run(calc, graph, "x = 10", vars);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "a")), 20);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "b")), 31);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "c")), 51);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "d")), 25);
+}
+
+TEST(FormulaGraphTest, RejectsCyclesAndKeepsGraph) {
+    Calculator calc;
+    FormulaGraph graph;
+    VariableStore vars;
+    run(calc, graph, "x = 1", vars);
+    graph.bind(calc, compile(calc, "y = x + 1"), "y = x + 1", vars);
+    graph.bind(calc, compile(calc, "z = y * 2"), "z = y * 2", vars);
+
+    try {
+        graph.bind(calc, compile(calc, "y = z + 1"), "y = z + 1", vars);
+        FAIL() << "cycle accepted";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Cyclic binding: y -> z -> y");
+    }
+    EXPECT_THROW(graph.bind(calc, compile(calc, "x = x + 1"), "x = x + 1", vars), std::runtime_error);
+
+    // The rejected binding left y = x + 1 in place.
+    run(calc, graph, "x = 5", vars);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "z")), 12);
+    EXPECT_EQ(graph.bindings().size(), 2u);
+}
+
+TEST(FormulaGraphTest, RejectsMalformedFormulasAndBoundAssignments) {
+    Calculator calc;
+    FormulaGraph graph;
+    VariableStore vars;
+    EXPECT_THROW(graph.bind(calc, compile(calc, "x + 1"), "x + 1", vars), std::runtime_error);
+    EXPECT_THROW(graph.bind(calc, compile(calc, "y = z = 1"), "y = z = 1", vars), std::runtime_error);
+    EXPECT_THROW(graph.bind(calc, compile(calc, "y = 1; z = 2"), "y = 1; z = 2", vars), std::runtime_error);
+    EXPECT_TRUE(graph.empty());
+
+    graph.bind(calc, compile(calc, "y = 2"), "y = 2", vars);
+    EXPECT_THROW(run(calc, graph, "y = 3", vars), std::runtime_error);
+    EXPECT_TRUE(graph.unbind(slot(calc, "y")));
+    EXPECT_FALSE(graph.unbind(slot(calc, "y")));
+    EXPECT_DOUBLE_EQ(run(calc, graph, "y = 3", vars), 3);
+}
+
+TEST(FormulaGraphTest, FailingFormulaLeavesDownstreamUndefined) {
+    Calculator calc;
+    FormulaGraph graph;
+    VariableStore vars;
+    run(calc, graph, "x = 2", vars);
+    graph.bind(calc, compile(calc, "inv = 1 / x"), "inv = 1 / x", vars);
+    graph.bind(calc, compile(calc, "twice = inv * 2"), "twice = inv * 2", vars);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "twice")), 1);
+
+    run(calc, graph, "x = 0", vars);
+    EXPECT_FALSE(vars.has(slot(calc, "inv")));
+    EXPECT_FALSE(vars.has(slot(calc, "twice")));
+    auto bindings = graph.bindings();
+    ASSERT_EQ(bindings.size(), 2u);
+    EXPECT_EQ(bindings[0].error, "Division by zero");
+    EXPECT_EQ(bindings[1].error, "Unknown variable: inv");
+
+    run(calc, graph, "x = 4", vars);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "twice")), 0.5);
+    EXPECT_TRUE(graph.bindings()[1].error.empty());
+}
+
+// Long chains are walked without recursion.
+TEST(FormulaGraphTest, LongChain) {
+    Calculator calc;
+    FormulaGraph graph;
+    VariableStore vars;
+    run(calc, graph, "v0 = 0", vars);
+    const int kLength = 20000;
+    for (int i = 1; i <= kLength; ++i) {
+        std::string text = "v" + std::to_string(i) + " = v" + std::to_string(i - 1) + " + 1";
+        graph.bind(calc, compile(calc, text), text, vars);
+    }
+    run(calc, graph, "v0 = 5", vars);
+    EXPECT_DOUBLE_EQ(vars.get(slot(calc, "v" + std::to_string(kLength))), 5 + kLength);
+}
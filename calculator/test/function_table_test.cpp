@@ -0,0 +1,166 @@
+#include "gtest/gtest.h"
+#include "function_table.h"
+#include "result_cache.h"
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace {
+
+FunctionTable::FunctionPtr define(const Calculator& calc, FunctionTable& table, const std::string& definition) {
+    auto function = std::make_shared<const Function>(calc.compileFunction(definition));
+    table.define(function);
+    return function;
+}
+
+double run(const Calculator& calc, const FunctionScope& scope, const std::string& text, VariableStore& vars) {
+    return calc.evaluate(calc.compile(text), vars, &scope);
+}
+
+std::string errorOf(const std::function<void()>& action) {
+    try {
+        action();
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+} // namespace
+
+TEST(FunctionTest, CompilesDefinition) {
+    Calculator calc;
+    Function f = calc.compileFunction("f(a, b) = a * b + 3");
+    EXPECT_EQ(f.name, "f");
+    EXPECT_EQ(f.parameters, (std::vector<std::string>{"a", "b"}));
+    EXPECT_EQ(f.source, "f(a, b) = a * b + 3");
+    EXPECT_TRUE(f.body.symbols.empty()); // parameters are not variables
+
+    Function g = calc.compileFunction("g() = 2 * 21");
+    EXPECT_TRUE(g.parameters.empty());
+    ASSERT_EQ(g.body.code.size(), 1u); // folded to a constant
+}
+
+TEST(FunctionTest, RejectsMalformedDefinitions) {
+    Calculator calc;
+    const std::string malformed = "Invalid function definition: expected name(parameters) = expression";
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f = 1"); }), malformed);
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(a, ) = a"); }), malformed);
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(a b) = a"); }), malformed);
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(1) = 2"); }), malformed);
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(a) ="); }), malformed);
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(a, a) = a"); }), "Duplicate parameter: a");
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(a) = x = a"); }), "Function body cannot assign variables: f");
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(a) = a = 1"); }), "Invalid target for assignment: a");
+    EXPECT_EQ(errorOf([&] { calc.compileFunction("f(a) = a +"); }),
+              "Invalid expression: not enough operands for operator '+'");
+}
+
+TEST(FunctionTest, CallsInsideExpressions) {
+    Calculator calc;
+    FunctionTable table;
+    define(calc, table, "f(a, b) = a * b + 3");
+    define(calc, table, "answer() = 42");
+    FunctionScope scope{&table, nullptr};
+    VariableStore vars;
+
+    EXPECT_DOUBLE_EQ(run(calc, scope, "f(2, 5)", vars), 13.0);
+    EXPECT_DOUBLE_EQ(run(calc, scope, "x = 4; 1 + f(2, x) * 2", vars), 23.0);
+    EXPECT_DOUBLE_EQ(run(calc, scope, "f(f(1, 2), x - 1)", vars), 18.0);
+    EXPECT_DOUBLE_EQ(run(calc, scope, "y = f (x, x)", vars), 19.0);
+    EXPECT_DOUBLE_EQ(vars.get(calc.intern("y")), 19.0);
+    EXPECT_DOUBLE_EQ(run(calc, scope, "answer() / 2", vars), 21.0);
+    EXPECT_DOUBLE_EQ(run(calc, scope, "f((1 + 1), (2))", vars), 7.0);
+}
+
+TEST(FunctionTest, ValidatesArgumentLists) {
+    Calculator calc;
+    const std::string bad = "Invalid arguments in call to f";
+    EXPECT_EQ(errorOf([&] { calc.compile("f(1,, 2)"); }), bad);
+    EXPECT_EQ(errorOf([&] { calc.compile("f(, 1)"); }), bad);
+    EXPECT_EQ(errorOf([&] { calc.compile("f(1, )"); }), bad);
+    EXPECT_EQ(errorOf([&] { calc.compile("3 * f(1 +, 2)"); }), bad);
+    EXPECT_EQ(errorOf([&] { calc.compile("(1, 2)"); }), "Unexpected ',' outside a function call");
+    EXPECT_EQ(errorOf([&] { calc.compile("1, 2"); }), "Unexpected ',' outside a function call");
+    EXPECT_EQ(errorOf([&] { calc.compile("f(1, 2"); }), "Mismatched parentheses");
+    EXPECT_EQ(errorOf([&] { calc.compile("f(1) = 2"); }), "Invalid target for assignment: f");
+}
+
+TEST(FunctionTest, ResolvesCallsWhenTheyRun) {
+    Calculator calc;
+    FunctionTable local, global;
+    VariableStore vars;
+    FunctionScope scope{&local, &global};
+    auto compiled = calc.compile("g(3)");
+
+    EXPECT_EQ(errorOf([&] { calc.evaluate(compiled, vars, &scope); }), "Unknown function: g");
+    EXPECT_EQ(errorOf([&] { calc.evaluate(compiled, vars); }), "Unknown function: g");
+
+    define(calc, global, "g(v) = v * 10");
+    EXPECT_DOUBLE_EQ(calc.evaluate(compiled, vars, &scope), 30.0);
+    define(calc, local, "g(v) = v + 1"); // shadows the global one
+    EXPECT_DOUBLE_EQ(calc.evaluate(compiled, vars, &scope), 4.0);
+    EXPECT_TRUE(local.remove(calc.intern("g")));
+    EXPECT_FALSE(local.remove(calc.intern("g")));
+    EXPECT_DOUBLE_EQ(calc.evaluate(compiled, vars, &scope), 30.0);
+
+    define(calc, global, "g(v, w) = v * w");
+    EXPECT_EQ(errorOf([&] { calc.evaluate(compiled, vars, &scope); }), "Function g expects 2 arguments, got 1");
+    EXPECT_EQ(global.size(), 1u);
+}
+
+TEST(FunctionTest, BodyReadsVariablesAtCallTime) {
+    Calculator calc;
+    FunctionTable table;
+    define(calc, table, "tax(amount) = amount * rate");
+    FunctionScope scope{&table, nullptr};
+    VariableStore vars;
+
+    EXPECT_EQ(errorOf([&] { run(calc, scope, "tax(100)", vars); }), "Unknown variable: rate");
+    EXPECT_DOUBLE_EQ(run(calc, scope, "rate = 0.25; tax(100)", vars), 25.0);
+    EXPECT_DOUBLE_EQ(run(calc, scope, "rate = 0.5; tax(100)", vars), 50.0);
+    EXPECT_EQ(errorOf([&] { run(calc, scope, "tax(1 / 0)", vars); }), "Division by zero");
+}
+
+TEST(FunctionTest, RecursionIsBounded) {
+    Calculator calc;
+    FunctionTable table;
+    define(calc, table, "loop(n) = loop(n + 1)");
+    FunctionScope scope{&table, nullptr};
+    VariableStore vars;
+    EXPECT_EQ(errorOf([&] { run(calc, scope, "loop(0)", vars); }), "Function calls nested too deeply: loop");
+}
+
+TEST(FunctionTest, OptimizerKeepsCallsAndFoldsAround) {
+    Calculator calc;
+    FunctionTable table;
+    define(calc, table, "f(a) = a * 2");
+    FunctionScope scope{&table, nullptr};
+    VariableStore vars;
+
+    // The constant argument is folded, the repeated call is not shared.
+    auto compiled = calc.compile("f(2 * 3) + f(2 * 3)");
+    std::string listing = calc.disassemble(compiled);
+    EXPECT_NE(listing.find("PUSH_CONST 6"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("CALL f/1"), std::string::npos) << listing;
+    EXPECT_EQ(listing.find("SAVE_TEMP"), std::string::npos) << listing;
+    EXPECT_DOUBLE_EQ(calc.evaluate(compiled, vars, &scope), 24.0);
+
+    // Argument reads inside a body are shared like any other leaf.
+    Function h = calc.compileFunction("h(a, b) = (a + b) * (a + b)");
+    Calculator::CompiledExpression body;
+    body.statements.push_back(h.body);
+    listing = calc.disassemble(body);
+    EXPECT_NE(listing.find("LOAD_ARG a1"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("SAVE_TEMP"), std::string::npos) << listing;
+    table.define(std::make_shared<const Function>(std::move(h)));
+    EXPECT_DOUBLE_EQ(run(calc, scope, "h(1, 2)", vars), 9.0);
+}
+
+TEST(FunctionTest, CallingExpressionsAreNotMemoized) {
+    Calculator calc;
+    auto compiled = calc.compile("f(x)");
+    EXPECT_TRUE(compiled.calls);
+    EXPECT_FALSE(ResultCache::cacheable(compiled));
+    EXPECT_TRUE(ResultCache::cacheable(calc.compile("x + 1")));
+}
@@ -0,0 +1,147 @@
+#include "gtest/gtest.h"
+#include "calculator.h"
+#include "column_evaluator.h"
+#include "optimizer.h"
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::vector<Calculator::OpCode> opsOf(const Calculator::Program& program) {
+    std::vector<Calculator::OpCode> ops;
+    for (const auto& instr : program.code) {
+        ops.push_back(instr.op);
+    }
+    return ops;
+}
+
+using Op = Calculator::OpCode;
+
+} // namespace
+
+TEST(OptimizerTest, FoldsConstantsAndSharesSubexpressions) {
+    Calculator calc;
+    auto compiled = calc.compile("(2*3600)*rate + (2*3600)*rate/10");
+    const auto& program = compiled.statements[0];
+
+    EXPECT_EQ(opsOf(program), (std::vector<Op>{
+        Op::PUSH_CONST, Op::LOAD_VAR, Op::MUL, Op::SAVE_TEMP,   // 7200 * rate
+        Op::LOAD_TEMP, Op::PUSH_CONST, Op::DIV,                 // reuse / 10
+        Op::ADD}));
+    EXPECT_EQ(program.tempCount, 1u);
+    EXPECT_DOUBLE_EQ(program.constants[0], 7200.0);
+
+    std::map<std::string, double> vars{{"rate", 2.0}};
+    ASSERT_DOUBLE_EQ(calc.evaluate(compiled, vars), 14400.0 + 1440.0);
+}
+
+TEST(OptimizerTest, AlgebraicIdentities) {
+    Calculator calc;
+    auto compiled = calc.compile("1 * (x * 1 + 0) / 1 - 0");
+    EXPECT_EQ(opsOf(compiled.statements[0]), (std::vector<Op>{Op::LOAD_VAR}));
+
+    std::map<std::string, double> vars{{"x", 3.5}};
+    ASSERT_DOUBLE_EQ(calc.evaluate(compiled, vars), 3.5);
+}
+
+TEST(OptimizerTest, KeepsErrors) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+
+    auto compiled = calc.compile("1 / (2 - 2)");
+    EXPECT_EQ(opsOf(compiled.statements[0]), (std::vector<Op>{Op::PUSH_CONST, Op::PUSH_CONST, Op::DIV}));
+    ASSERT_THROW(calc.evaluate(compiled, vars), std::runtime_error);
+
+    // Removing "* 1" must not hide the unknown variable
+    ASSERT_THROW(calc.evaluate("y * 1", vars), std::runtime_error);
+
+    // The first statement still runs before the second one fails
+    ASSERT_THROW(calc.evaluate("a = 1; 5 / 0", vars), std::runtime_error);
+    ASSERT_DOUBLE_EQ(vars["a"], 1.0);
+}
+
+TEST(OptimizerTest, DoesNotShareAcrossAssignments) {
+    Calculator calc;
+    auto compiled = calc.compile("x = (y + 1) * (y = y + 1) + (y + 1)");
+    for (const auto& instr : compiled.statements[0].code) {
+        EXPECT_NE(instr.op, Op::SAVE_TEMP);
+    }
+
+    std::map<std::string, double> vars{{"y", 1.0}};
+    // (1 + 1) * (y = 2) + (2 + 1)
+    ASSERT_DOUBLE_EQ(calc.evaluate(compiled, vars), 7.0);
+    ASSERT_DOUBLE_EQ(vars["y"], 2.0);
+}
+
+TEST(OptimizerTest, MatchesUnoptimizedResults) {
+    const std::vector<std::string> corpus = {
+        "a * b + a * b",
+        "(a + b) * (a + b) / (a + b)",
+        "c = a * b - a * b * 2 + 0",
+        "a / b / (a / b) + 1 * a",
+        "((a - 1) * (b - 1)) + ((a - 1) * (b - 1)) * ((a - 1) * (b - 1))",
+        "c = d = a + b; c * d + (a + b)",
+        "2 * 3 + 4 / 8 - 0.5",
+    };
+
+    Calculator optimized;
+    Calculator plain;
+    plain.setOptimizationEnabled(false);
+
+    for (const auto& expression : corpus) {
+        std::map<std::string, double> varsA{{"a", 3.0}, {"b", 7.0}};
+        std::map<std::string, double> varsB = varsA;
+        ASSERT_DOUBLE_EQ(optimized.evaluate(expression, varsA), plain.evaluate(expression, varsB)) << expression;
+        ASSERT_EQ(varsA, varsB) << expression;
+    }
+}
+
+// The DAG of a left-deep chain is a million levels deep; emitting it must
+// not recurse once per level.
+TEST(OptimizerTest, LongChainsDoNotExhaustTheStack) {
+    constexpr int kTerms = 1000000;
+    std::string chain = "x = 1; x";
+    chain.reserve(chain.size() + 2 * kTerms);
+    for (int i = 1; i < kTerms; ++i) {
+        chain += "+x";
+    }
+
+    // On a thread of its own, so the scratch arena it grows is not the one
+    // the other tests measure.
+    Calculator calc;
+    Calculator::CompiledExpression compiled;
+    CalcError error;
+    bool ok = false;
+    double result = 0.0;
+    std::thread([&]() {
+        VariableStore vars;
+        ok = calc.tryCompile(chain, compiled, error) && calc.tryEvaluate(compiled, vars, result, error);
+    }).join();
+    ASSERT_TRUE(ok) << error.message();
+    EXPECT_DOUBLE_EQ(result, kTerms);
+}
+
+TEST(OptimizerTest, DisassemblyShowsOptimizedProgram) {
+    Calculator calc;
+    auto compiled = calc.compile("r = (2 * 3600) * rate + (2 * 3600) * rate");
+    std::string listing = calc.disassemble(compiled);
+
+    EXPECT_NE(listing.find("PUSH_CONST 7200"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("SAVE_TEMP t0"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("LOAD_TEMP t0"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("STORE r"), std::string::npos) << listing;
+}
+
+TEST(OptimizerTest, ColumnEvaluatorRunsTemporaries) {
+    Calculator calc;
+    auto compiled = calc.compile("a * b + a * b / 4");
+    ASSERT_EQ(compiled.statements[0].tempCount, 1u);
+
+    std::vector<double> a = {1, 2, 3}, b = {4, 5, 6};
+    ColumnEvaluator evaluator(calc, compiled.statements[0]);
+    evaluator.bindColumn("a", a.data());
+    evaluator.bindColumn("b", b.data());
+    EXPECT_EQ(evaluator.evaluate(3), (std::vector<double>{5.0, 12.5, 22.5}));
+}
@@ -0,0 +1,72 @@
+#include "gtest/gtest.h"
+#include "request_arena.h"
+#include "calculator.h"
+#include <map>
+#include <vector>
+
+TEST(RequestArenaTest, ReleasedWhenOutermostScopeEnds) {
+    void* first = nullptr;
+    {
+        RequestArena::Scope outer;
+        first = RequestArena::resource()->allocate(64, alignof(double));
+        {
+            RequestArena::Scope inner;
+            void* scratch = RequestArena::resource()->allocate(64, alignof(double));
+            EXPECT_NE(scratch, first);
+        }
+        // The inner scope must not release memory the outer one still uses.
+        void* next = RequestArena::resource()->allocate(64, alignof(double));
+        EXPECT_NE(next, first);
+    }
+    RequestArena::Scope again;
+    EXPECT_EQ(RequestArena::resource()->allocate(64, alignof(double)), first);
+}
+
+TEST(RequestArenaTest, GrowsToHighWaterMark) {
+    const size_t initial = RequestArena::capacity();
+    {
+        RequestArena::Scope scope;
+        std::pmr::vector<double> big(initial / sizeof(double) * 2, 0.0, RequestArena::resource());
+    }
+    EXPECT_GT(RequestArena::capacity(), initial * 2);
+
+    const size_t grown = RequestArena::capacity();
+    {
+        RequestArena::Scope scope;
+        std::pmr::vector<double> big(initial / sizeof(double) * 2, 0.0, RequestArena::resource());
+    }
+    EXPECT_EQ(RequestArena::capacity(), grown);
+}
+
+TEST(RequestArenaTest, OutliersAreCappedAndShrinkBack) {
+    {
+        RequestArena::Scope scope;
+        std::pmr::vector<char> huge(RequestArena::kMaxCapacity * 2, 0, RequestArena::resource());
+    }
+    EXPECT_EQ(RequestArena::capacity(), RequestArena::kMaxCapacity);
+
+    // Small requests halve the buffer every kShrinkAfter scopes.
+    for (size_t i = 0; i < RequestArena::kShrinkAfter; ++i) {
+        RequestArena::Scope scope;
+        std::pmr::vector<double> small(16, 0.0, RequestArena::resource());
+    }
+    EXPECT_EQ(RequestArena::capacity(), RequestArena::kMaxCapacity / 2);
+    for (size_t i = 0; i < RequestArena::kShrinkAfter * 32; ++i) {
+        RequestArena::Scope scope;
+    }
+    EXPECT_EQ(RequestArena::capacity(), RequestArena::kInitialCapacity);
+}
+
+TEST(RequestArenaTest, DeepExpressionsUseArenaStack) {
+    Calculator calc;
+    std::map<std::string, double> vars{{"x", 1.0}};
+    std::string expression = "x";
+    for (int i = 0; i < 200; ++i) {
+        expression = "x + (" + expression + ")"; // variables keep it from folding
+    }
+    auto compiled = calc.compile(expression);
+    ASSERT_GT(compiled.statements[0].maxStackDepth, 64u);
+
+    RequestArena::Scope request;
+    ASSERT_DOUBLE_EQ(calc.evaluate(compiled, vars), 201.0);
+}
@@ -0,0 +1,74 @@
+#include "gtest/gtest.h"
+#include "result_cache.h"
+#include <memory>
+#include <string>
+
+namespace {
+
+ResultCache::CompiledPtr compile(const Calculator& calc, const std::string& text) {
+    return std::make_shared<const Calculator::CompiledExpression>(calc.compile(text));
+}
+
+} // namespace
+
+TEST(ResultCacheTest, ReusesResultWhileInputsAreUnchanged) {
+    Calculator calc;
+    VariableStore vars;
+    ResultCache cache;
+    calc.evaluate("a = 2; b = 3; c = 4", vars);
+
+    auto product = compile(calc, "a * b");
+    EXPECT_FALSE(cache.lookup(product, vars));
+    cache.insert(product, vars, calc.evaluate(*product, vars), 1 << 20);
+    EXPECT_EQ(cache.lookup(product, vars), 6.0);
+
+    calc.evaluate("c = 40", vars); // not read by a * b
+    EXPECT_EQ(cache.lookup(product, vars), 6.0);
+
+    calc.evaluate("b = 3", vars); // same value, but written
+    EXPECT_FALSE(cache.lookup(product, vars));
+    cache.insert(product, vars, calc.evaluate(*product, vars), 1 << 20);
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_EQ(cache.lookup(product, vars), 6.0);
+
+    vars.erase(calc.intern("a"));
+    EXPECT_FALSE(cache.lookup(product, vars));
+}
+
+TEST(ResultCacheTest, KeyIsTheCompiledExpression) {
+    Calculator calc;
+    VariableStore vars;
+    ResultCache cache;
+    auto first = compile(calc, "1 + 2");
+    auto second = compile(calc, "1 + 2"); // recompiled, e.g. after an expression cache eviction
+    cache.insert(first, vars, 3.0, 1 << 20);
+    EXPECT_EQ(cache.lookup(first, vars), 3.0);
+    EXPECT_FALSE(cache.lookup(second, vars));
+
+    EXPECT_FALSE(ResultCache::cacheable(*compile(calc, "x = 1; x + 1")));
+    cache.insert(compile(calc, "y = 1"), vars, 1.0, 1 << 20);
+    EXPECT_EQ(cache.size(), 1u); // assignments are never memoized
+}
+
+TEST(ResultCacheTest, EvictsLeastRecentlyUsedBeyondBudget) {
+    Calculator calc;
+    VariableStore vars;
+    ResultCache cache;
+    auto a = compile(calc, "1 + 1");
+    auto b = compile(calc, "2 + 2");
+    auto c = compile(calc, "3 + 3");
+    cache.insert(a, vars, 2.0, 1 << 20);
+    const size_t entryBytes = cache.bytes();
+
+    cache.insert(b, vars, 4.0, 2 * entryBytes);
+    cache.lookup(a, vars); // a is now the most recently used
+    EXPECT_EQ(cache.insert(c, vars, 6.0, 2 * entryBytes), 1u);
+    EXPECT_TRUE(cache.lookup(a, vars));
+    EXPECT_FALSE(cache.lookup(b, vars));
+    EXPECT_TRUE(cache.lookup(c, vars));
+    EXPECT_EQ(cache.bytes(), 2 * entryBytes);
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.bytes(), 0u);
+}
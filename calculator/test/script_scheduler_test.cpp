@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "script_scheduler.h"
+#include <map>
+#include <string>
+
+namespace {
+
+// "v3 = v1 + v7 * 0.5" style statements over a few variables, so the
+// dependency graph has both chains and independent work.
+std::string makeScript(size_t statements, size_t variables, unsigned seed) {
+    std::string script;
+    for (size_t i = 0; i < statements; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        size_t target = i < variables ? i : (seed >> 8) % variables;
+        size_t a = (seed >> 12) % variables;
+        size_t b = (seed >> 20) % variables;
+        script += "v" + std::to_string(target) + " = ";
+        if (i < variables) {
+            script += std::to_string(i + 1); // define everything first
+        } else {
+            script += "v" + std::to_string(a) + ((seed >> 28) % 2 ? " + " : " - ") + "v" +
+                      std::to_string(b) + " * 0.5";
+        }
+        script += i + 1 < statements ? "; " : "";
+    }
+    return script;
+}
+
+std::map<std::string, double> namedValues(const Calculator& calc, const VariableStore& vars) {
+    std::map<std::string, double> out;
+    vars.forEach([&](uint32_t slot, double value) { out[calc.symbols().name(slot)] = value; });
+    return out;
+}
+
+} // namespace
+
+TEST(ScriptSchedulerTest, PlanFollowsReadsAndWrites) {
+    Calculator calc;
+    // 2 reads what 0 and 1 wrote; 3 overwrites a, which 0 wrote and 2 read.
+    auto compiled = calc.compile("a = 1; b = 2; c = a + b; a = 5; d = 7");
+    ScriptPlan plan = buildScriptPlan(compiled);
+    EXPECT_EQ(plan.roots, (std::vector<uint32_t>{0, 1, 4}));
+    EXPECT_EQ(plan.dependencyCount, (std::vector<uint32_t>{0, 0, 2, 2, 0}));
+    EXPECT_EQ(plan.dependents[0], (std::vector<uint32_t>{2, 3}));
+    EXPECT_EQ(plan.dependents[2], (std::vector<uint32_t>{3}));
+    EXPECT_EQ(plan.depth, 3u);
+    EXPECT_EQ(plan.writes.size(), 4u);
+}
+
+TEST(ScriptSchedulerTest, OnlyLongScriptsWithParallelismArePlanned) {
+    WorkStealingPool pool(2);
+    Calculator calc;
+    calc.setScriptPool(&pool, 8);
+
+    EXPECT_FALSE(calc.compile("a = 1; b = 2; c = 3").plan); // below the threshold
+    EXPECT_FALSE(calc.compile("x = 1; x = x + 1; x = x + 1; x = x + 1; x = x + 1; "
+                              "x = x + 1; x = x + 1; x = x + 1").plan); // one chain
+    EXPECT_TRUE(calc.compile(makeScript(64, 16, 1)).plan);
+
+    Calculator sequential;
+    EXPECT_FALSE(sequential.compile(makeScript(64, 16, 1)).plan);
+}
+
+TEST(ScriptSchedulerTest, MatchesSequentialExecution) {
+    WorkStealingPool pool(4);
+    Calculator parallel;
+    parallel.setScriptPool(&pool, 16);
+    Calculator sequential;
+
+    for (unsigned seed = 1; seed <= 20; ++seed) {
+        std::string script = makeScript(300, 24, seed);
+        auto compiled = parallel.compile(script);
+        ASSERT_TRUE(compiled.plan) << seed;
+
+        VariableStore parallelVars, sequentialVars;
+        double parallelResult = parallel.evaluate(compiled, parallelVars);
+        double sequentialResult = sequential.evaluate(script, sequentialVars);
+        EXPECT_EQ(parallelResult, sequentialResult) << seed;
+        EXPECT_EQ(namedValues(parallel, parallelVars), namedValues(sequential, sequentialVars)) << seed;
+    }
+}
+
+TEST(ScriptSchedulerTest, ErrorsKeepSequentialSemantics) {
+    WorkStealingPool pool(4);
+    Calculator parallel;
+    parallel.setScriptPool(&pool, 16);
+    Calculator sequential;
+
+    // Statement 40 divides by zero; later statements, some of them
+    // independent of it, must leave no trace.
+    std::string script = makeScript(40, 16, 7) + "; bad = v3 / 0; " + makeScript(200, 16, 8) + "; after = 1";
+    auto compiled = parallel.compile(script);
+    ASSERT_TRUE(compiled.plan);
+
+    for (int round = 0; round < 10; ++round) {
+        VariableStore parallelVars, sequentialVars;
+        parallelVars.set(parallel.intern("v5"), 123.0); // overwritten before the error
+        parallelVars.set(parallel.intern("after"), -1.0);
+        sequentialVars.set(sequential.intern("v5"), 123.0);
+        sequentialVars.set(sequential.intern("after"), -1.0);
+
+        std::string parallelError, sequentialError;
+        try {
+            parallel.evaluate(compiled, parallelVars);
+        } catch (const std::runtime_error& e) {
+            parallelError = e.what();
+        }
+        try {
+            sequential.evaluate(script, sequentialVars);
+        } catch (const std::runtime_error& e) {
+            sequentialError = e.what();
+        }
+        EXPECT_EQ(parallelError, "Division by zero");
+        EXPECT_EQ(parallelError, sequentialError);
+        EXPECT_EQ(namedValues(parallel, parallelVars), namedValues(sequential, sequentialVars));
+        EXPECT_EQ(parallelVars.get(parallel.intern("after")), -1.0);
+    }
+}
@@ -0,0 +1,172 @@
+#include "gtest/gtest.h"
+#include "calculator.h"
+#include "symbol_table.h"
+#include <string>
+
+TEST(SymbolTableTest, InternIsStable) {
+    SymbolTable table;
+    uint32_t x = table.intern("x");
+    uint32_t y = table.intern("y");
+
+    EXPECT_NE(x, y);
+    EXPECT_EQ(table.intern("x"), x);
+    EXPECT_EQ(table.name(y), "y");
+    EXPECT_EQ(table.size(), 2u);
+
+    uint32_t slot = 0;
+    EXPECT_TRUE(table.find("y", slot));
+    EXPECT_EQ(slot, y);
+    EXPECT_FALSE(table.find("z", slot));
+}
+
+TEST(VariableStoreTest, SetGetClear) {
+    VariableStore store;
+    EXPECT_FALSE(store.has(3));
+
+    store.set(3, 1.5);
+    EXPECT_TRUE(store.has(3));
+    EXPECT_FALSE(store.has(0));
+    EXPECT_DOUBLE_EQ(store.get(3), 1.5);
+    EXPECT_EQ(store.count(), 1u);
+
+    store.clear();
+    EXPECT_FALSE(store.has(3));
+    EXPECT_EQ(store.count(), 0u);
+}
+
+TEST(VariableStoreTest, EveryWriteBumpsTheVersion) {
+    Calculator calc;
+    VariableStore store;
+    calc.evaluate("x = 1; y = 2", store);
+    uint32_t x = calc.intern("x"), y = calc.intern("y");
+    const uint32_t xVersion = store.version(x), yVersion = store.version(y);
+    EXPECT_EQ(store.version(99), 0u); // never written
+
+    calc.evaluate("x + y", store); // reads only
+    EXPECT_EQ(store.version(x), xVersion);
+    calc.evaluate("x = 1", store); // same value, still a write
+    EXPECT_NE(store.version(x), xVersion);
+    EXPECT_EQ(store.version(y), yVersion);
+
+    uint32_t before = store.version(y);
+    store.erase(y);
+    EXPECT_NE(store.version(y), before);
+    before = store.version(x);
+    store.clear();
+    EXPECT_NE(store.version(x), before);
+}
+
+TEST(VariableStoreTest, EvaluateAgainstSlots) {
+    Calculator calc;
+    VariableStore session;
+
+    ASSERT_DOUBLE_EQ(calc.evaluate("x = 10", session), 10.0);
+    ASSERT_DOUBLE_EQ(calc.evaluate("y = x * 2; y + 1", session), 21.0);
+
+    uint32_t y = 0;
+    ASSERT_TRUE(calc.symbols().find("y", y));
+    EXPECT_DOUBLE_EQ(session.get(y), 20.0);
+}
+
+TEST(VariableStoreTest, SessionsAreIndependent) {
+    Calculator calc;
+    VariableStore a;
+    VariableStore b;
+    auto program = calc.compile("x + 1");
+
+    calc.evaluate("x = 1", a);
+    ASSERT_DOUBLE_EQ(calc.evaluate(program, a), 2.0);
+    ASSERT_THROW(calc.evaluate(program, b), std::runtime_error);
+}
+
+TEST(VariableStoreTest, ManyVariables) {
+    Calculator calc;
+    VariableStore session;
+    std::string sum = "0";
+    for (int i = 0; i < 300; ++i) {
+        std::string name = "v" + std::to_string(i);
+        calc.evaluate(name + " = " + std::to_string(i), session);
+        sum += " + " + name;
+    }
+    ASSERT_DOUBLE_EQ(calc.evaluate(sum, session), 299.0 * 300.0 / 2.0);
+    EXPECT_EQ(session.count(), 300u);
+}
+
+TEST(VariableStoreTest, SizeFollowsTheSessionNotTheSymbolTable) {
+    Calculator calc;
+    for (int i = 0; i < 10000; ++i) {
+        calc.intern("v" + std::to_string(i));
+    }
+    VariableStore session;
+    calc.evaluate("v9999 = 1; v9998 = v9999 + 1", session);
+    EXPECT_EQ(session.size(), 2u);
+    EXPECT_LT(session.estimateBytes(), 1024u);
+
+    // Reading an unknown variable fails without adding an entry.
+    EXPECT_THROW(calc.evaluate("v5000 + 1", session), std::runtime_error);
+    EXPECT_EQ(session.size(), 2u);
+}
+
+TEST(SymbolTableTest, RejectedStatementsInternNothing) {
+    Calculator calc;
+    calc.compile("x = 1");
+    const size_t interned = calc.symbols().size();
+
+    for (const char* invalid : {"a + b +", "c = 2 = 3", "d e", "f(g, h) )", "1var + k"}) {
+        EXPECT_THROW(calc.compile(invalid), std::runtime_error) << invalid;
+    }
+    CalcError error;
+    Calculator::CompiledExpression compiled;
+    EXPECT_FALSE(calc.tryCompile("m * n *", compiled, error));
+    EXPECT_EQ(calc.symbols().size(), interned);
+
+    calc.compile("y = f(x, z)");
+    EXPECT_EQ(calc.symbols().size(), interned + 3);
+}
+
+TEST(SymbolTableTest, UnknownReadsAreRejectedWithoutInterning) {
+    Calculator calc;
+    calc.compile("x = 1");
+    const size_t interned = calc.symbols().size();
+
+    CalcError error;
+    Calculator::CompiledExpression compiled;
+    const std::string unknown = "x + nope";
+    EXPECT_FALSE(calc.tryCompile(unknown, compiled, error, Calculator::UnknownNames::REJECT));
+    EXPECT_EQ(error.code, CalcErrc::UNKNOWN_VARIABLE);
+    EXPECT_EQ(error.offset, 4u);
+    EXPECT_EQ(error.message(), "Unknown variable: nope");
+    EXPECT_FALSE(calc.tryCompile("g(x)", compiled, error, Calculator::UnknownNames::REJECT));
+    EXPECT_EQ(error.code, CalcErrc::UNKNOWN_FUNCTION);
+    EXPECT_EQ(calc.symbols().size(), interned);
+
+    // Assigned names are interned, also for reads in later statements.
+    EXPECT_TRUE(calc.tryCompile("y = x; y + x", compiled, error, Calculator::UnknownNames::REJECT));
+    EXPECT_EQ(calc.symbols().size(), interned + 1);
+}
+
+TEST(SymbolTableTest, LimitCapsNewNames) {
+    Calculator calc;
+    calc.setSymbolLimit(2);
+    calc.compile("a = 1; b = a");
+    EXPECT_EQ(calc.symbols().size(), 2u);
+
+    CalcError error;
+    Calculator::CompiledExpression compiled;
+    EXPECT_FALSE(calc.tryCompile("c = a + b", compiled, error));
+    EXPECT_EQ(error.code, CalcErrc::TOO_MANY_SYMBOLS);
+    EXPECT_EQ(error.message(), "Too many distinct names, cannot add: c");
+    EXPECT_TRUE(calc.tryCompile("a = a + b", compiled, error));
+
+    // Restoring state is not capped.
+    calc.intern("restored");
+    EXPECT_EQ(calc.symbols().size(), 3u);
+    EXPECT_GT(calc.symbols().estimateBytes(), 0u);
+}
+
+TEST(VariableStoreTest, MapAdapterWritesBackBeforeError) {
+    Calculator calc;
+    std::map<std::string, double> vars;
+    ASSERT_THROW(calc.evaluate("a = 1; a / 0", vars), std::runtime_error);
+    ASSERT_DOUBLE_EQ(vars["a"], 1.0);
+}
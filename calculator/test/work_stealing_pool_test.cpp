@@ -0,0 +1,41 @@
+#include "gtest/gtest.h"
+#include "work_stealing_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+TEST(WorkStealingPoolTest, RunsTasksSubmittedFromOutsideAndFromWorkers) {
+    std::atomic<int> ran{0};
+    {
+        WorkStealingPool pool(4);
+        EXPECT_EQ(pool.size(), 4u);
+        // Every outside task fans out into more tasks from its worker;
+        // idle workers have to steal them.
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&pool, &ran]() {
+                for (int j = 0; j < 10; ++j) {
+                    pool.submit([&ran]() { ran.fetch_add(1); });
+                }
+                ran.fetch_add(1);
+            });
+        }
+    } // the destructor runs what is left
+    EXPECT_EQ(ran.load(), 1100);
+}
+
+TEST(WorkStealingPoolTest, WakesSleepingWorkers) {
+    WorkStealingPool pool(2);
+    std::mutex mutex;
+    std::condition_variable cv;
+    int done = 0;
+    for (int round = 0; round < 50; ++round) {
+        pool.submit([&]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++done;
+            cv.notify_all();
+        });
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return done == round + 1; });
+    }
+    EXPECT_EQ(done, 50);
+}
@@ -1,8 +1,12 @@
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include "httplib.h"
 #include "nlohmann/json.hpp"
+#include "binary_protocol.h"
+#include "load_generator.h"
 
 // For convenience
 using json = nlohmann::json;
@@ -13,21 +17,239 @@ void print_help() {
     std::cout << "  -e <expression>  : Evaluate a mathematical expression (e.g., \"2 + 2\")" << std::endl;
     std::cout << "  -c <command>     : Execute a command (e.g., \"echo\", \"clean\")" << std::endl;
     std::cout << "  -s <address>     : Specify server address (default: http://garda_server:8080)" << std::endl;
+    std::cout << "  -b, --batch      : Send all -e expressions in one /calculate/batch request" << std::endl;
+    std::cout << "  --stream [file]  : Read expressions (or :<cmd> lines) from the file or stdin, one per line," << std::endl;
+    std::cout << "                     over one keep-alive connection; results are printed in order" << std::endl;
+    std::cout << "  --window <n>     : Stream: send up to n lines per request (default: 64)" << std::endl;
+    std::cout << "  --sid <id>       : Session for all requests (default: the server's default session)" << std::endl;
+    std::cout << "  --binary <host:port> : Use the server's binary protocol instead of HTTP (for -e, -c and --stream)" << std::endl;
+    std::cout << "  -l, --load       : Load test: send -e expressions (or --corpus) until --duration ends" << std::endl;
+    std::cout << "  --connections <n>: Load test: concurrent keep-alive connections (default: 4)" << std::endl;
+    std::cout << "  --rps <n>        : Load test: target requests per second, open loop (default: 0, closed loop)" << std::endl;
+    std::cout << "  --duration <sec> : Load test: run time in seconds (default: 10)" << std::endl;
+    std::cout << "  --corpus <file>  : Load test: expressions, one per line" << std::endl;
+    std::cout << "  --sids <n>       : Load test: spread requests over n random sessions (default: 16, 0: default session)" << std::endl;
+    std::cout << "  --report <sec>   : Load test: progress report interval (default: 1, 0: final summary only)" << std::endl;
     std::cout << "  -h, --help       : Show this help message" << std::endl;
 }
 
+// Prints one /calculate/batch response item, or a /calculate response,
+// as a single line. Returns false if it carries an error.
+bool print_result(const json& item) {
+    if (item.contains("res") && item["res"].is_number()) {
+        std::cout << item["res"].get<double>() << std::endl;
+    } else if (item.contains("res") && item["res"].is_string()) {
+        std::cout << item["res"].get<std::string>() << std::endl;
+    } else if (item.contains("err")) {
+        std::cout << "Error from server: " << item["err"].get<std::string>() << std::endl;
+        return false;
+    } else if (item.empty()) {
+        std::cout << "Operation successful (no explicit result)." << std::endl;
+    } else {
+        std::cout << item << std::endl;
+    }
+    return true;
+}
+
+// Sends every expression in one /calculate/batch request on the given
+// connection and prints one line per result, in order. Returns false if
+// the request itself failed; `item_failed` is set if any expression did.
+bool post_batch(httplib::Client& cli, const std::vector<std::string>& expressions, const std::string& sid,
+                bool& item_failed) {
+    json request_json = json::array();
+    for (const auto& expression : expressions) {
+        json item{{"exp", expression}};
+        if (!sid.empty()) item["sid"] = sid;
+        request_json.push_back(std::move(item));
+    }
+
+    auto res = cli.Post("/calculate/batch", request_json.dump(), "application/json");
+    if (!res) {
+        std::cerr << "Error connecting to server or sending request: " << res.error() << std::endl;
+        return false;
+    }
+    if (res->status != 200) {
+        std::cerr << "HTTP Error: " << res->status << " " << res->reason << std::endl;
+        std::cerr << "Response body: " << res->body << std::endl;
+        return false;
+    }
+
+    try {
+        for (const auto& item : json::parse(res->body)) {
+            if (!print_result(item)) item_failed = true;
+        }
+    } catch (const json::exception& e) {
+        std::cerr << "Error parsing server response: " << e.what() << std::endl;
+        std::cerr << "Response body: " << res->body << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Sends every expression in one request and prints one line per result,
+// in order. Returns non-zero if the request or any expression failed.
+int send_batch(const std::string& server_url, const std::vector<std::string>& expressions, const std::string& sid) {
+    httplib::Client cli(server_url.c_str());
+    bool item_failed = false;
+    if (!post_batch(cli, expressions, sid, item_failed)) {
+        return 1;
+    }
+    return item_failed ? 1 : 0;
+}
+
+// Reads one expression per line, or a command written as ":<cmd> [exp]"
+// (e.g. ":clean", ":dump x * 2"), and prints one result line per input
+// line, in order. Everything goes over a single keep-alive connection.
+// Consecutive expressions are sent as one /calculate/batch request of up
+// to `window` lines; a window is also sent early when no more input is
+// buffered, so interactive use still answers line by line. Commands are
+// sent on their own, after the expressions before them.
+int run_stream(const std::string& server_url, std::istream& input, const std::string& sid, size_t window) {
+    httplib::Client cli(server_url.c_str());
+    cli.set_keep_alive(true);
+
+    bool item_failed = false;
+    std::vector<std::string> pending;
+    auto flush = [&]() {
+        if (pending.empty()) return true;
+        bool ok = post_batch(cli, pending, sid, item_failed);
+        pending.clear();
+        return ok;
+    };
+
+    std::string line;
+    while (std::getline(input, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+        if (line[0] == ':') {
+            if (!flush()) return 1;
+            json request_json;
+            size_t space = line.find(' ');
+            request_json["cmd"] = line.substr(1, space == std::string::npos ? std::string::npos : space - 1);
+            if (space != std::string::npos) request_json["exp"] = line.substr(space + 1);
+            if (!sid.empty()) request_json["sid"] = sid;
+
+            auto res = cli.Post("/calculate", request_json.dump(), "application/json");
+            if (!res) {
+                std::cerr << "Error connecting to server or sending request: " << res.error() << std::endl;
+                return 1;
+            }
+            try {
+                if (!print_result(json::parse(res->body))) item_failed = true;
+            } catch (const json::exception& e) {
+                std::cerr << "Error parsing server response: " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+
+        pending.push_back(line);
+        if (pending.size() >= window || input.rdbuf()->in_avail() <= 0) {
+            if (!flush()) return 1;
+        }
+    }
+    if (!flush()) return 1;
+    return item_failed ? 1 : 0;
+}
+
+// Prints one binary protocol response in the same format as print_result.
+bool print_binary_result(BinaryOpcode opcode, const BinaryResponse& response) {
+    if (response.status != BinaryStatus::OK) {
+        std::cout << "Error from server: " << response.error << std::endl;
+        return false;
+    }
+    switch (opcode) {
+        case BinaryOpcode::EVAL: std::cout << response.value << std::endl; break;
+        case BinaryOpcode::ECHO: std::cout << "echo" << std::endl; break;
+        case BinaryOpcode::CLEAN: std::cout << "Operation successful (no explicit result)." << std::endl; break;
+    }
+    return true;
+}
+
+// run_stream over the binary protocol: the same input format and output,
+// but up to `window` requests are pipelined on the connection before their
+// responses are read.
+int run_binary_stream(const std::string& address, std::istream& input, const std::string& sid, size_t window) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        std::cerr << "Error: --binary expects <host>:<port>, got '" << address << "'" << std::endl;
+        return 1;
+    }
+
+    BinaryClient client;
+    std::vector<BinaryOpcode> in_flight;
+    bool item_failed = false;
+    try {
+        client.connect(address.substr(0, colon), static_cast<uint16_t>(std::stoul(address.substr(colon + 1))));
+
+        auto drain = [&]() {
+            for (BinaryOpcode opcode : in_flight) {
+                if (!print_binary_result(opcode, client.receive())) item_failed = true;
+            }
+            in_flight.clear();
+        };
+
+        std::string line;
+        while (std::getline(input, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+            BinaryRequest request;
+            request.sid = sid;
+            if (line[0] == ':') {
+                size_t space = line.find(' ');
+                std::string cmd = line.substr(1, space == std::string::npos ? std::string::npos : space - 1);
+                if (cmd == "echo") {
+                    request.opcode = BinaryOpcode::ECHO;
+                } else if (cmd == "clean") {
+                    request.opcode = BinaryOpcode::CLEAN;
+                } else {
+                    drain();
+                    std::cout << "Error: command not supported over --binary: " << cmd << std::endl;
+                    item_failed = true;
+                    continue;
+                }
+            } else {
+                request.expression = line;
+            }
+            client.send(request);
+            in_flight.push_back(request.opcode);
+            if (in_flight.size() >= window || input.rdbuf()->in_avail() <= 0) {
+                drain();
+            }
+        }
+        drain();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return item_failed ? 1 : 0;
+}
+
 int main(int argc, char* argv[]) {
     std::string server_url = "http://garda_server:8080";
     std::string endpoint = "/calculate";
     
     json request_json;
     bool valid_args = false;
+    bool batch_mode = false;
+    bool load_mode = false;
+    bool stream_mode = false;
+    std::string stream_file;  // empty: stdin
+    size_t window = 64;
+    std::string sid;
+    std::string binary_address;  // --binary host:port
+    LoadOptions load_options;
+    std::string corpus_file;
+    std::vector<std::string> expressions; // every -e, for batch and load mode
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "-e") {
             if (i + 1 < argc) {
                 request_json["exp"] = argv[++i];
+                expressions.push_back(argv[i]);
                 valid_args = true;
             } else {
                 std::cerr << "Error: -e requires an expression argument." << std::endl;
@@ -51,6 +273,62 @@ int main(int argc, char* argv[]) {
                 print_help();
                 return 1;
             }
+        } else if (arg == "-b" || arg == "--batch") {
+            batch_mode = true;
+        } else if (arg == "--stream") {
+            stream_mode = true;
+            valid_args = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                stream_file = argv[++i];
+            }
+        } else if (arg == "--binary") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --binary requires a <host>:<port> argument." << std::endl;
+                print_help();
+                return 1;
+            }
+            binary_address = argv[++i];
+        } else if (arg == "--window" || arg == "--sid") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument." << std::endl;
+                print_help();
+                return 1;
+            }
+            if (arg == "--sid") {
+                sid = argv[++i];
+                continue;
+            }
+            try {
+                window = std::stoul(argv[++i]);
+            } catch (const std::exception&) {
+                window = 0;
+            }
+            if (window == 0) {
+                std::cerr << "Error: --window expects a positive number." << std::endl;
+                return 1;
+            }
+        } else if (arg == "-l" || arg == "--load") {
+            load_mode = true;
+            valid_args = true;
+        } else if (arg == "--connections" || arg == "--rps" || arg == "--duration" ||
+                   arg == "--sids" || arg == "--report" || arg == "--corpus") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires an argument." << std::endl;
+                print_help();
+                return 1;
+            }
+            std::string value = argv[++i];
+            try {
+                if (arg == "--connections") load_options.connections = std::stoul(value);
+                else if (arg == "--rps") load_options.rps = std::stod(value);
+                else if (arg == "--duration") load_options.durationSeconds = std::stod(value);
+                else if (arg == "--sids") load_options.sidCount = std::stoul(value);
+                else if (arg == "--report") load_options.reportSeconds = std::stod(value);
+                else corpus_file = value;
+            } catch (const std::exception&) {
+                std::cerr << "Error: invalid value for " << arg << ": '" << value << "'" << std::endl;
+                return 1;
+            }
         } else if (arg == "-h" || arg == "--help") {
             print_help();
             return 0;
@@ -66,6 +344,62 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    auto stream = [&](std::istream& input) {
+        return binary_address.empty() ? run_stream(server_url, input, sid, window)
+                                      : run_binary_stream(binary_address, input, sid, window);
+    };
+    if (stream_mode) {
+        if (stream_file.empty() || stream_file == "-") {
+            // Gives std::cin its own buffer, so in_avail() sees piped input.
+            std::ios::sync_with_stdio(false);
+            return stream(std::cin);
+        }
+        std::ifstream input(stream_file);
+        if (!input) {
+            std::cerr << "Error: cannot open '" << stream_file << "'" << std::endl;
+            return 1;
+        }
+        return stream(input);
+    }
+
+    if (!binary_address.empty() && !load_mode && !batch_mode) {
+        // A single request is a one-line stream.
+        std::istringstream line(request_json.contains("cmd") ? ":" + request_json["cmd"].get<std::string>()
+                                                             : request_json["exp"].get<std::string>());
+        return stream(line);
+    }
+
+    if (load_mode) {
+        load_options.serverUrl = server_url;
+        load_options.corpus = expressions;
+        try {
+            if (!corpus_file.empty()) {
+                auto corpus = loadCorpus(corpus_file);
+                load_options.corpus.insert(load_options.corpus.end(), corpus.begin(), corpus.end());
+            }
+            if (load_options.corpus.empty()) {
+                std::cerr << "Error: --load needs -e expressions or a --corpus file." << std::endl;
+                return 1;
+            }
+            return runLoadTest(load_options, std::cout);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (batch_mode) {
+        if (expressions.empty() || request_json.contains("cmd")) {
+            std::cerr << "Error: --batch takes one or more -e expressions and no -c command." << std::endl;
+            return 1;
+        }
+        return send_batch(server_url, expressions, sid);
+    }
+
+    if (!sid.empty()) {
+        request_json["sid"] = sid;
+    }
+
     // Send POST request
     httplib::Client cli(server_url.c_str());
     if (auto res = cli.Post(endpoint.c_str(), request_json.dump(), "application/json")) {
@@ -0,0 +1,85 @@
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+unsigned bitLength(uint64_t value) {
+    unsigned bits = 0;
+    while (value) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+} // namespace
+
+// Index layout: [0, 64) holds the exact values 0..63. Above that, a value
+// with shift = bitLength - 6 keeps its top six bits m (32 <= m < 64) and
+// lands at shift * 32 + m.
+size_t LatencyHistogram::indexOf(uint64_t value) {
+    if (value < kSubBucketCount) {
+        return static_cast<size_t>(value);
+    }
+    unsigned shift = bitLength(value) - kSubBucketBits;
+    return static_cast<size_t>(shift * kHalfSubBucket + (value >> shift));
+}
+
+uint64_t LatencyHistogram::highestEquivalent(size_t index) {
+    if (index < kSubBucketCount) {
+        return index;
+    }
+    uint64_t shift = (index - kHalfSubBucket) / kHalfSubBucket;
+    uint64_t m = index - shift * kHalfSubBucket;
+    return ((m + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : buckets_(indexOf(UINT64_MAX) + 1, 0) {
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    ++buckets_[indexOf(value)];
+    ++count_;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    sum_ += value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+void LatencyHistogram::reset() {
+    std::fill(buckets_.begin(), buckets_.end(), 0);
+    count_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    sum_ = 0;
+}
+
+double LatencyHistogram::mean() const {
+    return count_ ? static_cast<double>(sum_ / count_) : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(count_)));
+    target = std::clamp<uint64_t>(target, 1, count_);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            return std::min(highestEquivalent(i), max_);
+        }
+    }
+    return max_;
+}
@@ -0,0 +1,45 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 64 are exact, larger values fall into buckets of 32 per power of two, so
+// every recorded value is reproduced to within ~3%. Memory and recording
+// cost are constant regardless of how many values are recorded.
+// Not thread-safe; the load generator keeps one per connection and merges.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+    void reset();
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const;
+
+    // Smallest value v such that at least `percentile` percent of the
+    // recorded values are <= v (up to the bucket resolution).
+    uint64_t percentile(double percentile) const;
+
+private:
+    static constexpr unsigned kSubBucketBits = 6;
+    static constexpr uint64_t kSubBucketCount = uint64_t{1} << kSubBucketBits;
+    static constexpr uint64_t kHalfSubBucket = kSubBucketCount / 2;
+
+    static size_t indexOf(uint64_t value);
+    static uint64_t highestEquivalent(size_t index);
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+    long double sum_ = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,224 @@
+#include "load_generator.h"
+#include "latency_histogram.h"
+#include "httplib.h"
+#include "nlohmann/json.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Counters {
+    uint64_t ok = 0;
+    uint64_t connectionErrors = 0; // no response at all
+    uint64_t httpErrors = 0;       // status other than 200, 429 and 503
+    uint64_t calcErrors = 0;       // 200 with an "err" field
+    uint64_t shed = 0;             // 503 or 429: rejected by admission control
+
+    uint64_t errors() const { return connectionErrors + httpErrors + calcErrors; }
+    uint64_t total() const { return ok + errors() + shed; }
+
+    void add(const Counters& other) {
+        ok += other.ok;
+        connectionErrors += other.connectionErrors;
+        httpErrors += other.httpErrors;
+        calcErrors += other.calcErrors;
+        shed += other.shed;
+    }
+};
+
+// What one connection has measured. The worker and the reporter only meet
+// on the mutex, once per request and once per report.
+struct ConnectionStats {
+    std::mutex mutex;
+    LatencyHistogram interval;
+    Counters intervalCounters;
+};
+
+void printLatency(std::ostream& out, const char* label, uint64_t micros) {
+    char buffer[48];
+    std::snprintf(buffer, sizeof(buffer), " %s %.3f ms", label, static_cast<double>(micros) / 1000.0);
+    out << buffer;
+}
+
+void runConnection(const LoadOptions& options, size_t index, Clock::time_point start,
+                   Clock::time_point end, ConnectionStats& stats) {
+    httplib::Client client(options.serverUrl.c_str());
+    client.set_keep_alive(true);
+    client.set_read_timeout(10);
+
+    std::mt19937_64 random(std::random_device{}() + index);
+    std::uniform_int_distribution<size_t> pickExpression(0, options.corpus.size() - 1);
+    std::uniform_int_distribution<size_t> pickSid(0, options.sidCount ? options.sidCount - 1 : 0);
+
+    // Open loop: every connection carries an equal share of the rate,
+    // staggered so the connections do not fire in lockstep.
+    const bool openLoop = options.rps > 0;
+    const auto period = openLoop
+        ? std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(static_cast<double>(options.connections) / options.rps))
+        : Clock::duration::zero();
+    Clock::time_point scheduled = start + period * index / options.connections;
+
+    while (true) {
+        if (openLoop) {
+            if (scheduled >= end) break;
+            std::this_thread::sleep_until(scheduled);
+        } else {
+            scheduled = Clock::now();
+            if (scheduled >= end) break;
+        }
+
+        json request{{"exp", options.corpus[pickExpression(random)]}};
+        if (options.sidCount > 0) {
+            request["sid"] = "load-" + std::to_string(pickSid(random));
+        }
+        auto res = client.Post("/calculate", request.dump(), "application/json");
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - scheduled);
+
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        if (res && (res->status == 503 || res->status == 429)) {
+            // Rejected without running; kept out of the latency figures,
+            // which describe the requests the server admitted.
+            ++stats.intervalCounters.shed;
+            scheduled += period;
+            continue;
+        }
+        if (!res) {
+            ++stats.intervalCounters.connectionErrors;
+        } else if (res->status != 200) {
+            ++stats.intervalCounters.httpErrors;
+        } else if (res->body.find("\"err\"") != std::string::npos) {
+            ++stats.intervalCounters.calcErrors;
+        } else {
+            ++stats.intervalCounters.ok;
+        }
+        stats.interval.record(static_cast<uint64_t>(latency.count()));
+        scheduled += period;
+    }
+}
+
+} // namespace
+
+std::vector<std::string> loadCorpus(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open corpus file: " + path);
+    }
+    std::vector<std::string> corpus;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        corpus.push_back(line);
+    }
+    if (corpus.empty()) {
+        throw std::runtime_error("Corpus file has no expressions: " + path);
+    }
+    return corpus;
+}
+
+int runLoadTest(const LoadOptions& options, std::ostream& out) {
+    if (options.connections == 0 || options.corpus.empty() || options.durationSeconds <= 0) {
+        throw std::runtime_error("Load test needs at least one connection, one expression and a positive duration");
+    }
+
+    out << "Load test: " << options.serverUrl << ", " << options.connections << " connections, ";
+    if (options.rps > 0) {
+        out << "open loop at " << options.rps << " req/s";
+    } else {
+        out << "closed loop";
+    }
+    out << ", " << options.durationSeconds << " s, " << options.corpus.size() << " expressions" << std::endl;
+
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::duration_cast<Clock::duration>(
+                                 std::chrono::duration<double>(options.durationSeconds));
+
+    std::vector<std::unique_ptr<ConnectionStats>> stats;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < options.connections; ++i) {
+        stats.push_back(std::make_unique<ConnectionStats>());
+        threads.emplace_back(runConnection, std::cref(options), i, start, end, std::ref(*stats[i]));
+    }
+
+    LatencyHistogram total;
+    Counters totalCounters;
+    // Moves every connection's interval data into the totals and returns
+    // the interval's share.
+    auto collect = [&](LatencyHistogram& interval, Counters& counters) {
+        for (auto& connection : stats) {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            interval.merge(connection->interval);
+            counters.add(connection->intervalCounters);
+            connection->interval.reset();
+            connection->intervalCounters = Counters();
+        }
+        total.merge(interval);
+        totalCounters.add(counters);
+    };
+
+    LatencyHistogram interval;
+    auto lastReport = start;
+    const auto reportPeriod = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.reportSeconds));
+    while (options.reportSeconds > 0 && lastReport + reportPeriod < end) {
+        std::this_thread::sleep_until(lastReport + reportPeriod);
+        auto now = Clock::now();
+        Counters counters;
+        interval.reset();
+        collect(interval, counters);
+
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        double seconds = std::chrono::duration<double>(now - lastReport).count();
+        char head[96];
+        std::snprintf(head, sizeof(head), "[%6.1fs] %9.1f req/s, %llu errors, %llu shed,", elapsed,
+                      static_cast<double>(counters.total()) / seconds,
+                      static_cast<unsigned long long>(counters.errors()),
+                      static_cast<unsigned long long>(counters.shed));
+        out << head;
+        printLatency(out, "p50", interval.percentile(50));
+        printLatency(out, "p99", interval.percentile(99));
+        printLatency(out, "p999", interval.percentile(99.9));
+        out << std::endl;
+        lastReport = now;
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    interval.reset();
+    Counters rest;
+    collect(interval, rest);
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    char line[160];
+    std::snprintf(line, sizeof(line), "Requests: %llu in %.2f s, %.1f req/s",
+                  static_cast<unsigned long long>(totalCounters.total()), elapsed,
+                  static_cast<double>(totalCounters.total()) / elapsed);
+    out << line << std::endl;
+    out << "Errors: " << totalCounters.errors() << " (connection " << totalCounters.connectionErrors
+        << ", http " << totalCounters.httpErrors << ", calculation " << totalCounters.calcErrors << ")"
+        << std::endl;
+    out << "Shed: " << totalCounters.shed << " (503/429 from admission control, not in the latency figures)"
+        << std::endl;
+    out << "Latency:";
+    printLatency(out, "min", total.min());
+    printLatency(out, "mean", static_cast<uint64_t>(total.mean()));
+    printLatency(out, "p50", total.percentile(50));
+    printLatency(out, "p90", total.percentile(90));
+    printLatency(out, "p99", total.percentile(99));
+    printLatency(out, "p999", total.percentile(99.9));
+    printLatency(out, "max", total.max());
+    out << std::endl;
+
+    return totalCounters.ok > 0 ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct LoadOptions {
+    std::string serverUrl;
+    size_t connections = 4;      // keep-alive connections, one thread each
+    double rps = 0;              // total target rate; 0 runs closed-loop
+    double durationSeconds = 10;
+    double reportSeconds = 1;    // interval of the progress lines; 0 disables them
+    size_t sidCount = 16;        // requests go to random sids load-0..N-1; 0 uses the default session
+    std::vector<std::string> corpus;
+};
+
+// Reads one expression per line; empty lines and lines starting with '#'
+// are skipped. Throws std::runtime_error if the file cannot be read or
+// has no expressions.
+std::vector<std::string> loadCorpus(const std::string& path);
+
+// Sends POST /calculate requests for the configured duration and prints
+// progress lines and a final latency/throughput summary to `out`.
+//
+// Closed loop (rps == 0): each connection sends its next request as soon
+// as the previous answer arrives. Open loop (rps > 0): requests are
+// scheduled at fixed intervals regardless of how fast the server answers,
+// and latency is measured from the scheduled send time, so a stalled
+// server shows up in the percentiles instead of just lowering the rate.
+// Requests the server sheds (503, 429) are counted separately and left
+// out of the percentiles, which then describe the admitted requests.
+//
+// Returns 0 if at least one request succeeded.
+int runLoadTest(const LoadOptions& options, std::ostream& out);
+
+#endif // LOAD_GENERATOR_H
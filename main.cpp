@@ -1,59 +1,221 @@
 #include <iostream>
-#include <map>
+#include <string>
 #include "httplib.h"
-#include "nlohmann/json.hpp"
-#include "calculator.h"
+#include "binary_server.h"
+#include "calc_service.h"
+#include "http_api.h"
+#ifdef CALC_HAVE_EPOLL
+#include "epoll_server.h"
+#endif
+#include "session_snapshot.h"
+#include <algorithm>
+#include <csignal>
+#include <filesystem>
+#include <memory>
+#include <pthread.h>
+#include <thread>
 
-using json = nlohmann::json;
+void print_help() {
+    std::cout << "Usage: http_server [OPTIONS]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --cache-capacity <n>  : Compiled expressions kept in the LRU cache" << std::endl;
+    std::cout << "  --session-shards <n>  : Lock stripes of the session store" << std::endl;
+    std::cout << "  --session-ttl <sec>   : Drop sessions idle for this long (default: 86400, 0 = never)" << std::endl;
+    std::cout << "  --max-sessions <n>    : Evict least recently used sessions above this count (default: 1000000, 0 = no cap)" << std::endl;
+    std::cout << "  --max-session-memory <MB> : Evict least recently used sessions above this estimated size (default: 1024, 0 = no cap)" << std::endl;
+    std::cout << "  --max-symbols <n>     : Distinct variable and function names the server learns (default: 1000000, 0 = no cap)" << std::endl;
+    std::cout << "  --workers <n>         : Worker threads for /calculate/batch" << std::endl;
+    std::cout << "  --script-threads <n>  : Run independent statements of long scripts in parallel on n threads (default: 0 = off)" << std::endl;
+    std::cout << "  --script-min-statements <n> : Shortest script run in parallel (default: 64)" << std::endl;
+    std::cout << "  --result-cache <KB>   : Per-session memory for memoized results of read-only expressions (default: 0 = off)" << std::endl;
+    std::cout << "  --max-in-flight <n>   : Answer 503 to requests beyond n in flight (default: 0 = no limit)" << std::endl;
+    std::cout << "  --adaptive-limit      : Adjust the in-flight limit to observed latency (capped by --max-in-flight)" << std::endl;
+    std::cout << "  --session-rate <r>    : Answer 429 to a session above r requests/s (default: 0 = no limit)" << std::endl;
+    std::cout << "  --session-burst <n>   : Requests a session may send at once above its rate (default: one second's worth)" << std::endl;
+    std::cout << "  --frontend <name>     : 'httplib' (default, all endpoints) or 'epoll' (event loop; /calculate and /metrics only)" << std::endl;
+    std::cout << "  --io-threads <n>      : I/O threads of the epoll front end (default: 1)" << std::endl;
+    std::cout << "  --idle-timeout <sec>  : Close epoll front end connections idle this long (default: 60, 0 = never)" << std::endl;
+    std::cout << "  --binary-port <port>  : Also serve the binary protocol on this port (default: off)" << std::endl;
+    std::cout << "  --binary-max-connections <n> : Binary protocol connections served at once (default: 1024, 0 = no cap)" << std::endl;
+    std::cout << "  --snapshot <file>     : Restore sessions from this file at startup and save them on shutdown" << std::endl;
+    std::cout << "  --snapshot-interval <sec> : Also save the snapshot periodically (default: 60, 0 = only on shutdown)" << std::endl;
+    std::cout << "  -h, --help            : Show this help message" << std::endl;
+}
 
-int main() {
-    httplib::Server svr;
+int main(int argc, char* argv[]) {
+    CalcService::Options options;
+    options.sessionLimits.idleTtl = std::chrono::hours(24);
+    options.sessionLimits.maxSessions = 1000000;
+    options.sessionLimits.maxBytes = size_t(1024) << 20;
+    options.maxSymbols = 1000000;
+    int binary_port = 0;
+    BinaryServer::Options binary_options;
+    std::string frontend = "httplib";
+    size_t io_threads = 1;
+    int idle_timeout = 60;
+    std::string snapshot_path;
+    int snapshot_interval = 60;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cache-capacity" && i + 1 < argc) {
+            options.cacheCapacity = std::stoul(argv[++i]);
+        } else if (arg == "--session-shards" && i + 1 < argc) {
+            options.sessionShards = std::stoul(argv[++i]);
+        } else if (arg == "--session-ttl" && i + 1 < argc) {
+            options.sessionLimits.idleTtl = std::chrono::seconds(std::stol(argv[++i]));
+        } else if (arg == "--max-sessions" && i + 1 < argc) {
+            options.sessionLimits.maxSessions = std::stoul(argv[++i]);
+        } else if (arg == "--max-session-memory" && i + 1 < argc) {
+            options.sessionLimits.maxBytes = std::stoul(argv[++i]) << 20;
+        } else if (arg == "--max-symbols" && i + 1 < argc) {
+            options.maxSymbols = std::stoul(argv[++i]);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            options.workerThreads = std::stoul(argv[++i]);
+        } else if (arg == "--script-threads" && i + 1 < argc) {
+            options.scriptThreads = std::stoul(argv[++i]);
+        } else if (arg == "--script-min-statements" && i + 1 < argc) {
+            options.parallelScriptStatements = std::stoul(argv[++i]);
+        } else if (arg == "--result-cache" && i + 1 < argc) {
+            options.resultCacheBytes = std::stoul(argv[++i]) << 10;
+        } else if (arg == "--max-in-flight" && i + 1 < argc) {
+            options.admission.maxInFlight = std::stoul(argv[++i]);
+        } else if (arg == "--adaptive-limit") {
+            options.admission.adaptive = true;
+        } else if (arg == "--session-rate" && i + 1 < argc) {
+            options.admission.sessionRate = std::stod(argv[++i]);
+        } else if (arg == "--session-burst" && i + 1 < argc) {
+            options.admission.sessionBurst = std::stod(argv[++i]);
+        } else if (arg == "--frontend" && i + 1 < argc) {
+            frontend = argv[++i];
+        } else if (arg == "--io-threads" && i + 1 < argc) {
+            io_threads = std::stoul(argv[++i]);
+        } else if (arg == "--idle-timeout" && i + 1 < argc) {
+            idle_timeout = std::stoi(argv[++i]);
+        } else if (arg == "--binary-port" && i + 1 < argc) {
+            binary_port = std::stoi(argv[++i]);
+        } else if (arg == "--binary-max-connections" && i + 1 < argc) {
+            binary_options.maxConnections = std::stoul(argv[++i]);
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (arg == "--snapshot-interval" && i + 1 < argc) {
+            snapshot_interval = std::stoi(argv[++i]);
+        } else if (arg == "-h" || arg == "--help") {
+            print_help();
+            return 0;
+        } else {
+            std::cerr << "Error: Unknown argument '" << arg << "'" << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+#ifdef CALC_HAVE_EPOLL
+    if (frontend != "httplib" && frontend != "epoll") {
+#else
+    if (frontend != "httplib") {
+#endif
+        std::cerr << "Error: Unsupported front end '" << frontend << "'" << std::endl;
+        return 1;
+    }
 
-    // ✅ STATEFUL ОБЪЕКТЫ
-    Calculator calc;
-    std::map<std::string, double> variables;
+    // SIGINT/SIGTERM are blocked here, before any thread exists, so every
+    // thread inherits the mask and only signal_thread below receives them.
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
 
-    svr.Post("/calculate", [&](const httplib::Request &req, httplib::Response &res) {
-        json response_json;
+    // ✅ STATEFUL ОБЪЕКТЫ: калькулятор, кэш выражений и сессии общие для всех потоков
+    CalcService service(options);
 
+    auto log = [](const std::string& message) { std::cout << message << std::endl; };
+    if (!snapshot_path.empty() && std::filesystem::exists(snapshot_path)) {
         try {
-            json request_json = json::parse(req.body);
-
-            // --- COMMANDS ---
-            if (request_json.contains("cmd")) {
-                std::string cmd = request_json["cmd"];
-
-                if (cmd == "echo") {
-                    response_json["res"] = "echo";
-                }
-                else if (cmd == "clean") {
-                    variables.clear();               // ✅ СБРОС СОСТОЯНИЯ
-                    response_json = json::object();  // {}
-                }
-                else {
-                    throw std::runtime_error("Unknown command: " + cmd);
-                }
-            }
-            // --- EXPRESSIONS ---
-            else if (request_json.contains("exp")) {
-                std::string expression = request_json["exp"];
-                double result = calc.evaluate(expression, variables);
-                response_json["res"] = result;
-            }
-            else {
-                throw std::runtime_error("Invalid JSON: expected 'exp' or 'cmd'");
-            }
-
-            res.status = 200;
+            SnapshotStats stats = loadSessionSnapshot(service, snapshot_path);
+            std::cout << "Restored " << stats.sessions << " sessions (" << stats.variables << " variables, "
+                      << stats.formulas << " formulas, " << stats.functions << " functions) from " << snapshot_path << " in " << stats.seconds * 1000.0 << " ms\n";
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
         }
-        catch (const std::exception& e) {
-            res.status = 400;
-            response_json["err"] = e.what();
+    }
+    std::unique_ptr<SnapshotScheduler> snapshots;
+    if (!snapshot_path.empty()) {
+        snapshots = std::make_unique<SnapshotScheduler>(
+            service, snapshot_path, std::chrono::seconds(std::max(snapshot_interval, 0)), log);
+    }
+
+    httplib::Server svr;
+    registerHttpApi(svr, service);
+
+#ifdef CALC_HAVE_EPOLL
+    // Same /calculate protocol on an event loop with a fixed worker pool
+    std::unique_ptr<EpollServer> epoll;
+    if (frontend == "epoll") {
+        EpollServer::Options epoll_options;
+        epoll_options.ioThreads = io_threads;
+        epoll_options.workerThreads = options.workerThreads;
+        epoll_options.idleTimeout = std::chrono::seconds(std::max(idle_timeout, 0));
+        epoll = std::make_unique<EpollServer>(service, epoll_options);
+        try {
+            epoll->bind("0.0.0.0", 8080);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
         }
+    }
+#endif
 
-        res.set_content(response_json.dump(), "application/json");
+    // Same service, second transport
+    BinaryServer binary(service, binary_options);
+    std::thread binary_thread;
+    if (binary_port > 0) {
+        try {
+            binary.bind("0.0.0.0", binary_port);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        binary_thread = std::thread([&binary]() { binary.listen(); });
+        std::cout << "Binary protocol on port " << binary_port << "\n";
+    }
+
+    std::thread signal_thread([&]() {
+        int signal = 0;
+        sigwait(&shutdown_signals, &signal);
+        svr.stop();
+#ifdef CALC_HAVE_EPOLL
+        if (epoll) epoll->stop();
+#endif
     });
 
-    std::cout << "Server started on http://0.0.0.0:8080\n";
-    svr.listen("0.0.0.0", 8080);
+#ifdef CALC_HAVE_EPOLL
+    if (epoll) {
+        std::cout << "Server started on http://0.0.0.0:8080 (epoll front end, " << io_threads << " I/O threads)\n";
+        epoll->listen();
+    } else
+#endif
+    {
+        std::cout << "Server started on http://0.0.0.0:8080\n";
+        svr.listen("0.0.0.0", 8080);
+    }
+
+    // listen() also returns on its own (e.g. the port is taken); wake the
+    // signal thread so it can be joined either way.
+    pthread_kill(signal_thread.native_handle(), SIGTERM);
+    signal_thread.join();
+
+    binary.stop();
+    if (binary_thread.joinable()) {
+        binary_thread.join();
+    }
+
+    // Requests have drained: the final snapshot sees every committed update.
+    if (snapshots) {
+        snapshots->stop();
+        if (!snapshots->saveNow()) {
+            return 1;
+        }
+    }
 }
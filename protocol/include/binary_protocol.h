@@ -0,0 +1,88 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Compact length-prefixed protocol of the binary listener. Every frame is
+// a little-endian uint32 payload length followed by the payload:
+//
+//   request:  uint8 opcode | uint16 sid length | sid | expression (rest)
+//   response: uint8 status | OK: float64 result   | otherwise: error message (rest)
+//
+// An empty sid means the server's default session. Responses come back
+// in request order, so a client may send several requests before reading
+// (pipelining).
+
+enum class BinaryOpcode : uint8_t { EVAL = 1, ECHO = 2, CLEAN = 3 };
+
+enum class BinaryStatus : uint8_t {
+    OK = 0,
+    ERROR = 1,        // the request was understood but failed (syntax, division by zero...)
+    BAD_REQUEST = 2,  // malformed frame or unknown opcode
+    OVERLOADED = 3,   // shed by the server's in-flight limit (HTTP 503); retry later
+    RATE_LIMITED = 4  // the session is over its request rate (HTTP 429)
+};
+
+struct BinaryRequest {
+    BinaryOpcode opcode = BinaryOpcode::EVAL;
+    std::string sid;
+    std::string expression;
+};
+
+struct BinaryResponse {
+    BinaryStatus status = BinaryStatus::OK;
+    double value = 0.0;  // OK only; 0 for ECHO and CLEAN
+    std::string error;   // anything but OK
+};
+
+constexpr size_t kBinaryLengthPrefix = 4;
+constexpr size_t kMaxBinaryFrame = 1 << 20; // payload bytes
+
+// Append one complete frame (length prefix included) to `out`.
+void appendRequestFrame(const BinaryRequest& request, std::string& out);
+void appendResponseFrame(const BinaryResponse& response, std::string& out);
+
+// Size of the complete frame at the start of `buffer`, prefix included, or
+// 0 if more bytes are needed. Throws std::runtime_error if the announced
+// payload exceeds kMaxBinaryFrame.
+size_t completeFrameSize(std::string_view buffer);
+
+// Decode a payload (without the length prefix). Throw std::runtime_error
+// if it is malformed.
+BinaryRequest parseRequest(std::string_view payload);
+BinaryResponse parseResponse(std::string_view payload);
+
+// Blocking client for one connection. Requests can be pipelined with
+// send() followed by the same number of receive() calls.
+class BinaryClient {
+public:
+    BinaryClient() = default;
+    ~BinaryClient();
+    BinaryClient(const BinaryClient&) = delete;
+    BinaryClient& operator=(const BinaryClient&) = delete;
+
+    // Throws std::runtime_error if the connection cannot be made.
+    void connect(const std::string& host, uint16_t port);
+    void close();
+
+    // Queues a request; it is written by flush() or receive().
+    void send(const BinaryRequest& request);
+    void flush();
+    BinaryResponse receive();
+
+    BinaryResponse call(const BinaryRequest& request) {
+        send(request);
+        return receive();
+    }
+
+private:
+    int fd_ = -1;
+    std::string out_;
+    std::string in_;
+    size_t inOffset_ = 0;
+};
+
+#endif // BINARY_PROTOCOL_H
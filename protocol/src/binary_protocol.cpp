@@ -0,0 +1,201 @@
+#include "binary_protocol.h"
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+void putLittleEndian(std::string& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint64_t getLittleEndian(std::string_view in, size_t offset, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[offset + i])) << (8 * i);
+    }
+    return value;
+}
+
+// Reserves the length prefix and returns its position, to be patched by
+// finishFrame() once the payload is written.
+size_t beginFrame(std::string& out) {
+    size_t start = out.size();
+    out.append(kBinaryLengthPrefix, '\0');
+    return start;
+}
+
+void finishFrame(std::string& out, size_t start) {
+    size_t payload = out.size() - start - kBinaryLengthPrefix;
+    if (payload > kMaxBinaryFrame) {
+        out.resize(start);
+        throw std::runtime_error("Binary frame too large: " + std::to_string(payload) + " bytes");
+    }
+    for (size_t i = 0; i < kBinaryLengthPrefix; ++i) {
+        out[start + i] = static_cast<char>((payload >> (8 * i)) & 0xff);
+    }
+}
+
+} // namespace
+
+void appendRequestFrame(const BinaryRequest& request, std::string& out) {
+    if (request.sid.size() > UINT16_MAX) {
+        throw std::runtime_error("Session id too long");
+    }
+    size_t start = beginFrame(out);
+    out.push_back(static_cast<char>(request.opcode));
+    putLittleEndian(out, request.sid.size(), 2);
+    out += request.sid;
+    out += request.expression;
+    finishFrame(out, start);
+}
+
+void appendResponseFrame(const BinaryResponse& response, std::string& out) {
+    size_t start = beginFrame(out);
+    out.push_back(static_cast<char>(response.status));
+    if (response.status == BinaryStatus::OK) {
+        uint64_t bits;
+        std::memcpy(&bits, &response.value, sizeof(bits));
+        putLittleEndian(out, bits, sizeof(bits));
+    } else {
+        out += response.error;
+    }
+    finishFrame(out, start);
+}
+
+size_t completeFrameSize(std::string_view buffer) {
+    if (buffer.size() < kBinaryLengthPrefix) {
+        return 0;
+    }
+    uint64_t payload = getLittleEndian(buffer, 0, kBinaryLengthPrefix);
+    if (payload > kMaxBinaryFrame) {
+        throw std::runtime_error("Binary frame too large: " + std::to_string(payload) + " bytes");
+    }
+    size_t total = kBinaryLengthPrefix + static_cast<size_t>(payload);
+    return buffer.size() >= total ? total : 0;
+}
+
+BinaryRequest parseRequest(std::string_view payload) {
+    if (payload.size() < 3) {
+        throw std::runtime_error("Truncated binary request");
+    }
+    auto opcode = static_cast<uint8_t>(payload[0]);
+    if (opcode < static_cast<uint8_t>(BinaryOpcode::EVAL) || opcode > static_cast<uint8_t>(BinaryOpcode::CLEAN)) {
+        throw std::runtime_error("Unknown opcode: " + std::to_string(opcode));
+    }
+    size_t sidLength = static_cast<size_t>(getLittleEndian(payload, 1, 2));
+    if (payload.size() < 3 + sidLength) {
+        throw std::runtime_error("Truncated binary request");
+    }
+    BinaryRequest request;
+    request.opcode = static_cast<BinaryOpcode>(opcode);
+    request.sid.assign(payload.substr(3, sidLength));
+    request.expression.assign(payload.substr(3 + sidLength));
+    return request;
+}
+
+BinaryResponse parseResponse(std::string_view payload) {
+    if (payload.empty()) {
+        throw std::runtime_error("Truncated binary response");
+    }
+    BinaryResponse response;
+    response.status = static_cast<BinaryStatus>(payload[0]);
+    if (response.status == BinaryStatus::OK) {
+        if (payload.size() != 9) {
+            throw std::runtime_error("Truncated binary response");
+        }
+        uint64_t bits = getLittleEndian(payload, 1, 8);
+        std::memcpy(&response.value, &bits, sizeof(bits));
+    } else {
+        response.error.assign(payload.substr(1));
+    }
+    return response;
+}
+
+BinaryClient::~BinaryClient() {
+    close();
+}
+
+void BinaryClient::connect(const std::string& host, uint16_t port) {
+    close();
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses);
+    if (rc != 0) {
+        throw std::runtime_error("Cannot resolve " + host + ": " + gai_strerror(rc));
+    }
+    for (addrinfo* a = addresses; a; a = a->ai_next) {
+        int fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+            fd_ = fd;
+            break;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(addresses);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot connect to " + host + ":" + std::to_string(port));
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+void BinaryClient::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    out_.clear();
+    in_.clear();
+    inOffset_ = 0;
+}
+
+void BinaryClient::send(const BinaryRequest& request) {
+    appendRequestFrame(request, out_);
+}
+
+void BinaryClient::flush() {
+    size_t written = 0;
+    while (written < out_.size()) {
+        ssize_t n = ::send(fd_, out_.data() + written, out_.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            throw std::runtime_error("Connection lost while sending");
+        }
+        written += static_cast<size_t>(n);
+    }
+    out_.clear();
+}
+
+BinaryResponse BinaryClient::receive() {
+    flush();
+    while (true) {
+        std::string_view pending(in_.data() + inOffset_, in_.size() - inOffset_);
+        if (size_t frame = completeFrameSize(pending)) {
+            BinaryResponse response = parseResponse(pending.substr(kBinaryLengthPrefix, frame - kBinaryLengthPrefix));
+            inOffset_ += frame;
+            if (inOffset_ == in_.size()) {
+                in_.clear();
+                inOffset_ = 0;
+            }
+            return response;
+        }
+        char buffer[16 * 1024];
+        ssize_t n = ::recv(fd_, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            throw std::runtime_error("Connection closed by server");
+        }
+        in_.append(buffer, static_cast<size_t>(n));
+    }
+}
@@ -0,0 +1,141 @@
+#include <benchmark/benchmark.h>
+#include "calc_service.h"
+#include "epoll_server.h"
+#include "http_api.h"
+#include "httplib.h"
+#include "nlohmann/json.hpp"
+#include <arpa/inet.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <netinet/in.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Connection scaling: N idle keep-alive connections are held open while
+// one active client sends /calculate requests. Reports the active
+// client's request rate and the process memory per idle connection, for
+// the epoll front end and for httplib (a thread per connection).
+//
+// Client and server share the process, so N connections need 2N
+// descriptors: 50k needs `ulimit -n` above 100k. Sizes that do not fit
+// are skipped.
+
+namespace {
+
+const std::string kBody = R"({"sid":"bench","exp":"x = (12.5 * 4 - 3) * 1.2"})";
+
+size_t descriptorLimit() {
+    rlimit limit{};
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    return static_cast<size_t>(limit.rlim_cur);
+}
+
+size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// Spreads connections over 127.0.0.x destinations: one address only has
+// ~28k ephemeral source ports.
+std::vector<int> openIdle(int port, size_t count) {
+    std::vector<int> fds;
+    fds.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + static_cast<uint32_t>(i / 20000));
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            if (fd >= 0) ::close(fd);
+            break;
+        }
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+template <typename Server>
+void runScaling(benchmark::State& state, Server& server, int port, const std::function<size_t()>& accepted) {
+    const size_t idleCount = static_cast<size_t>(state.range(0));
+    const size_t rssBefore = residentBytes();
+    std::vector<int> idle = openIdle(port, idleCount);
+    for (int i = 0; i < 3000 && accepted() < idle.size(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const size_t rssIdle = residentBytes();
+
+    if (idle.size() == idleCount) {
+        httplib::Client client("127.0.0.1", port);
+        client.set_keep_alive(true);
+        for (auto _ : state) {
+            auto res = client.Post("/calculate", kBody, "application/json");
+            if (!res || res->status != 200) {
+                state.SkipWithError("request failed");
+                break;
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["idle_connections"] = static_cast<double>(idle.size());
+        if (!idle.empty()) {
+            state.counters["rss_per_idle_conn"] = static_cast<double>(rssIdle - rssBefore) / idle.size();
+        }
+    } else {
+        state.SkipWithError("could not open all idle connections");
+    }
+    for (int fd : idle) ::close(fd);
+    (void)server;
+}
+
+bool enoughDescriptors(benchmark::State& state) {
+    size_t needed = 2 * static_cast<size_t>(state.range(0)) + 512;
+    if (descriptorLimit() < needed) {
+        state.SkipWithError(("needs ulimit -n >= " + std::to_string(needed)).c_str());
+        return false;
+    }
+    return true;
+}
+
+void BM_IdleConnections_Epoll(benchmark::State& state) {
+    if (!enoughDescriptors(state)) return;
+    CalcService service;
+    EpollServer server(service, EpollServer::Options{1, 1, std::chrono::milliseconds(0)}); // idle connections stay
+    int port = server.bind("0.0.0.0", 0);
+    std::thread thread([&server]() { server.listen(); });
+    runScaling(state, server, port, [&server]() { return server.connectionCount(); });
+    server.stop();
+    thread.join();
+}
+
+void BM_IdleConnections_Httplib(benchmark::State& state) {
+    if (!enoughDescriptors(state)) return;
+    CalcService service;
+    httplib::Server server;
+    registerHttpApi(server, service);
+    int port = server.bind_to_any_port("0.0.0.0");
+    std::thread thread([&server]() { server.listen_after_bind(); });
+    server.wait_until_ready();
+    // httplib does not expose its connection count; connect() returning
+    // means the kernel accepted the connection.
+    runScaling(state, server, port, [&state]() { return static_cast<size_t>(state.range(0)); });
+    server.stop();
+    thread.join();
+}
+
+} // namespace
+
+// One run per size: opening the idle connections dominates setup time.
+BENCHMARK(BM_IdleConnections_Epoll)->Arg(0)->Arg(1000)->Arg(9000)->Arg(50000)
+    ->Iterations(20000)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_IdleConnections_Httplib)->Arg(0)->Arg(1000)->Arg(9000)
+    ->Iterations(20000)->UseRealTime()->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,114 @@
+#include <benchmark/benchmark.h>
+#include "calc_service.h"
+#include "epoll_server.h"
+#include "httplib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Overload: many closed-loop clients against an epoll server with one
+// compute worker, far more concurrency than it can serve. Without
+// admission control every request is queued and latency grows with the
+// number of clients; with a fixed or adaptive in-flight limit the excess
+// is shed with 503 and admitted requests keep their latency.
+//
+// Reports the latency percentiles of admitted (200) requests, their rate,
+// and the share of requests shed. Shed clients back off for 1 ms, as a
+// well-behaved client would.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kClients = 32;
+constexpr auto kDuration = std::chrono::seconds(2);
+
+// A script long enough that the worker, not the transport, is the bottleneck.
+std::string heavyBody() {
+    std::string script = "x = 1";
+    for (int i = 0; i < 200; ++i) {
+        script += "; x = x * 1.0001 + " + std::to_string(i % 7);
+    }
+    return R"({"sid":"overload","exp":")" + script + "\"}";
+}
+
+void runOverload(benchmark::State& state, const AdmissionControl::Options& admission) {
+    CalcService::Options options;
+    options.admission = admission;
+    CalcService service(options);
+    EpollServer server(service, EpollServer::Options{1, 1});
+    const int port = server.bind("127.0.0.1", 0);
+    std::thread serverThread([&server]() { server.listen(); });
+
+    const std::string body = heavyBody();
+    std::mutex mutex;
+    std::vector<double> latencies; // microseconds, admitted requests only
+    std::atomic<uint64_t> shed{0};
+    double seconds = 0;
+
+    for (auto _ : state) {
+        const auto end = Clock::now() + kDuration;
+        std::vector<std::thread> clients;
+        for (size_t c = 0; c < kClients; ++c) {
+            clients.emplace_back([&]() {
+                httplib::Client client("127.0.0.1", port);
+                client.set_keep_alive(true);
+                std::vector<double> local;
+                while (Clock::now() < end) {
+                    auto start = Clock::now();
+                    auto res = client.Post("/calculate", body, "application/json");
+                    if (res && res->status == 503) {
+                        shed.fetch_add(1, std::memory_order_relaxed);
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    } else if (res && res->status == 200) {
+                        local.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                latencies.insert(latencies.end(), local.begin(), local.end());
+            });
+        }
+        for (auto& client : clients) client.join();
+        seconds += std::chrono::duration<double>(kDuration).count();
+    }
+
+    server.stop();
+    serverThread.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p / 100 * latencies.size()))];
+    };
+    const double admitted = static_cast<double>(latencies.size());
+    state.counters["p50_us"] = percentile(50);
+    state.counters["p99_us"] = percentile(99);
+    state.counters["admitted_per_s"] = admitted / seconds;
+    state.counters["shed_ratio"] = admitted + shed > 0 ? static_cast<double>(shed) / (admitted + shed) : 0.0;
+    state.counters["limit"] = static_cast<double>(service.admission().limit());
+}
+
+void BM_Overload_Unlimited(benchmark::State& state) {
+    runOverload(state, AdmissionControl::Options());
+}
+
+void BM_Overload_MaxInFlight(benchmark::State& state) {
+    AdmissionControl::Options admission;
+    admission.maxInFlight = 2;
+    runOverload(state, admission);
+}
+
+void BM_Overload_Adaptive(benchmark::State& state) {
+    AdmissionControl::Options admission;
+    admission.adaptive = true;
+    runOverload(state, admission);
+}
+
+} // namespace
+
+BENCHMARK(BM_Overload_Unlimited)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Overload_MaxInFlight)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Overload_Adaptive)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,35 @@
+#include <benchmark/benchmark.h>
+#include "calc_service.h"
+#include "http_api.h"
+#include <string>
+
+// The /calculate handler without a transport: request decoding,
+// evaluation of a cached expression and response encoding. One thread,
+// so items_per_second is requests per core.
+
+namespace {
+
+void BM_HandleCalculate(benchmark::State& state) {
+    CalcService service;
+    const std::string body = R"({"sid":"bench","exp":"x = (12.5 * 4 - 3) * 1.2"})";
+    std::string response;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(handleCalculate(service, body, response));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_HandleCalculateError(benchmark::State& state) {
+    CalcService service;
+    const std::string body = R"({"sid":"bench","exp":"unknown * 2"})";
+    std::string response;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(handleCalculate(service, body, response));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_HandleCalculate);
+BENCHMARK(BM_HandleCalculateError);
@@ -0,0 +1,105 @@
+#include <benchmark/benchmark.h>
+#include "binary_protocol.h"
+#include "binary_server.h"
+#include "calc_service.h"
+#include "http_api.h"
+#include "httplib.h"
+#include "nlohmann/json.hpp"
+#include <string>
+#include <thread>
+
+// One expression per request over loopback: HTTP + JSON versus the binary
+// protocol, both served by the same CalcService. The expression is cached
+// after the first request, so the numbers are dominated by the transport.
+
+namespace {
+
+using json = nlohmann::json;
+
+const char* kExpression = "x = (12.5 * 4 - 3) * 1.2";
+
+struct Servers {
+    Servers() : binary(service) {
+        registerHttpApi(http, service);
+        httpPort = http.bind_to_any_port("127.0.0.1");
+        httpThread = std::thread([this]() { http.listen_after_bind(); });
+        binaryPort = binary.bind("127.0.0.1", 0);
+        binaryThread = std::thread([this]() { binary.listen(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ~Servers() {
+        http.stop();
+        binary.stop();
+        httpThread.join();
+        binaryThread.join();
+    }
+
+    CalcService service;
+    httplib::Server http;
+    BinaryServer binary;
+    int httpPort = 0;
+    int binaryPort = 0;
+    std::thread httpThread;
+    std::thread binaryThread;
+};
+
+Servers& servers() {
+    static Servers instance;
+    return instance;
+}
+
+void BM_HttpJson(benchmark::State& state) {
+    httplib::Client client("127.0.0.1", servers().httpPort);
+    client.set_keep_alive(true);
+    const std::string body = json{{"sid", "bench"}, {"exp", kExpression}}.dump();
+
+    for (auto _ : state) {
+        auto res = client.Post("/calculate", body, "application/json");
+        if (!res || res->status != 200) {
+            state.SkipWithError("request failed");
+            break;
+        }
+        benchmark::DoNotOptimize(json::parse(res->body)["res"].get<double>());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Binary(benchmark::State& state) {
+    BinaryClient client;
+    client.connect("127.0.0.1", static_cast<uint16_t>(servers().binaryPort));
+    const BinaryRequest request{BinaryOpcode::EVAL, "bench", kExpression};
+
+    for (auto _ : state) {
+        BinaryResponse response = client.call(request);
+        if (response.status != BinaryStatus::OK) {
+            state.SkipWithError("request failed");
+            break;
+        }
+        benchmark::DoNotOptimize(response.value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// range(0) requests written before the first response is read.
+void BM_BinaryPipelined(benchmark::State& state) {
+    const auto depth = static_cast<size_t>(state.range(0));
+    BinaryClient client;
+    client.connect("127.0.0.1", static_cast<uint16_t>(servers().binaryPort));
+    const BinaryRequest request{BinaryOpcode::EVAL, "bench", kExpression};
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < depth; ++i) {
+            client.send(request);
+        }
+        for (size_t i = 0; i < depth; ++i) {
+            benchmark::DoNotOptimize(client.receive().value);
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * depth));
+}
+
+} // namespace
+
+BENCHMARK(BM_HttpJson)->UseRealTime();
+BENCHMARK(BM_Binary)->UseRealTime();
+BENCHMARK(BM_BinaryPipelined)->Arg(16)->Arg(64)->UseRealTime();
@@ -0,0 +1,131 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Per-session request budget: `rate` tokens per second, at most `burst`
+// saved up. A new bucket starts full. Has its own mutex, so checking it
+// never waits for a request of the session that is still running.
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    bool tryTake(double rate, double burst, Clock::time_point now);
+
+private:
+    std::mutex mutex_;
+    double tokens_ = 0.0;
+    Clock::time_point last_{};
+    bool started_ = false;
+};
+
+// Overload protection in front of the CalcService. Requests beyond the
+// in-flight limit are rejected at once (HTTP 503) instead of queueing
+// behind the ones already admitted, so the latency of admitted requests
+// stays bounded however much traffic arrives. A session that exceeds its
+// token bucket is rejected with 429.
+//
+// The limit is either fixed (maxInFlight) or adaptive: completed requests
+// report their latency, and every kWindowSamples samples the limit moves
+// by the gradient between the lowest latency seen (the server unloaded)
+// and the window's average, as in Netflix's concurrency-limits. Latency
+// rising past kTolerance times the baseline means requests are queueing,
+// and the limit shrinks (at most halving per window); otherwise it grows
+// by about sqrt(limit), but only while the traffic actually uses the
+// limit. maxInFlight, if set, stays the upper bound.
+class AdmissionControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t maxInFlight = 0;    // 0: no fixed limit
+        bool adaptive = false;
+        size_t minLimit = 1;       // adaptive bounds and starting point
+        size_t maxLimit = 1024;
+        size_t initialLimit = 4;   // low, so the baseline is measured before queues build
+        double sessionRate = 0.0;  // requests per second per session; 0: off
+        double sessionBurst = 0.0; // bucket size; 0: one second's worth
+    };
+
+    static constexpr size_t kWindowSamples = 64;
+    static constexpr double kTolerance = 2.0;
+    static constexpr double kSmoothing = 0.2;
+    // How fast the baseline follows latency upwards, per window, so a
+    // workload that got slower for good does not shrink the limit forever.
+    static constexpr double kBaselineDrift = 0.01;
+
+    enum class Reason { IN_FLIGHT, ADAPTIVE, SESSION_RATE };
+    static constexpr size_t kReasonCount = 3;
+
+    // Holds admitted requests in flight until released or destroyed; the
+    // time in between is the latency sample. Empty if rejected.
+    class Permit {
+    public:
+        Permit() = default;
+        Permit(Permit&& other) noexcept;
+        Permit& operator=(Permit&& other) noexcept;
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+        ~Permit() { release(); }
+
+        explicit operator bool() const { return owner_ != nullptr; }
+        void release(Clock::time_point now = Clock::now());
+
+    private:
+        friend class AdmissionControl;
+        Permit(AdmissionControl* owner, size_t weight, Clock::time_point start)
+            : owner_(owner), weight_(weight), start_(start) {}
+
+        AdmissionControl* owner_ = nullptr;
+        size_t weight_ = 0;
+        Clock::time_point start_{};
+    };
+
+    struct Stats {
+        uint64_t admitted = 0;
+        uint64_t rejected[kReasonCount] = {};
+        size_t inFlight = 0;
+        size_t limit = 0; // 0: unlimited
+    };
+
+    AdmissionControl();
+    explicit AdmissionControl(const Options& options);
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    // Admits `weight` requests at once (e.g. a pipelined batch), or returns
+    // an empty permit. With nothing in flight, a request is always admitted.
+    Permit tryAcquire(size_t weight = 1, Clock::time_point now = Clock::now());
+
+    bool limitsSessions() const { return options_.sessionRate > 0; }
+    // Takes a token from the session's bucket. False, and counted, if empty.
+    bool tryTakeToken(TokenBucket& bucket, Clock::time_point now = Clock::now());
+
+    Stats stats() const;
+    // Current in-flight limit, 0 if unlimited.
+    size_t limit() const;
+
+private:
+    void complete(size_t weight, Clock::duration latency);
+
+    const Options options_;
+    const size_t fixedLimit_; // maxInFlight, or unlimited
+    std::atomic<size_t> limit_;
+    std::atomic<size_t> inFlight_{0};
+    std::atomic<uint64_t> admitted_{0};
+    std::atomic<uint64_t> rejected_[kReasonCount] = {};
+
+    // Adaptive state, guarded by windowMutex_.
+    std::mutex windowMutex_;
+    double adaptiveLimit_ = 0.0;
+    double baselineNanos_ = 0.0;
+    double windowNanos_ = 0.0;
+    size_t windowSamples_ = 0;
+    size_t windowPeak_ = 0; // most requests in flight during the window
+};
+
+#endif // ADMISSION_CONTROL_H
@@ -0,0 +1,62 @@
+#ifndef BINARY_SERVER_H
+#define BINARY_SERVER_H
+
+#include "calc_service.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+// TCP listener for the length-prefixed protocol of binary_protocol.h,
+// served from the same CalcService (calculator, cache, sessions) as the
+// HTTP API. One thread per connection, for at most maxConnections
+// connections at a time: further clients wait in the listen backlog
+// until one closes. Requests on a connection are answered in order, and
+// responses to pipelined requests are written together. Admission control applies as on the other transports: the
+// frames received together take one in-flight permit (or are all shed
+// with OVERLOADED), and every frame takes a token from its session
+// (RATE_LIMITED when it has none).
+class BinaryServer {
+public:
+    struct Options {
+        size_t maxConnections = 1024;
+    };
+
+    // Pause before accepting again after a failed accept() or thread start,
+    // e.g. while the process is out of descriptors or threads.
+    static constexpr std::chrono::milliseconds kAcceptBackoff{50};
+
+    explicit BinaryServer(CalcService& service);
+    BinaryServer(CalcService& service, const Options& options);
+    ~BinaryServer();
+    BinaryServer(const BinaryServer&) = delete;
+    BinaryServer& operator=(const BinaryServer&) = delete;
+
+    // Binds and starts listening; port 0 picks a free port. Returns the
+    // bound port. Throws std::runtime_error.
+    int bind(const std::string& host, int port);
+
+    // Accepts connections until stop() is called. Running out of
+    // descriptors or threads only delays accepting.
+    void listen();
+
+    // Stops accepting, closes open connections and waits for their threads.
+    void stop();
+
+private:
+    void serveConnection(int fd);
+    void handleFrame(std::string_view payload, bool admitted, std::string& out);
+
+    CalcService& service_;
+    const Options options_;
+    std::atomic<int> listenFd_{-1};
+    std::atomic<bool> stopping_{false};
+
+    std::mutex mutex_;
+    std::condition_variable idle_; // a connection closed
+    std::unordered_set<int> connections_;
+};
+
+#endif // BINARY_SERVER_H
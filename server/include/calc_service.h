@@ -0,0 +1,165 @@
+#ifndef CALC_SERVICE_H
+#define CALC_SERVICE_H
+
+#include "admission_control.h"
+#include "calculator.h"
+#include "expression_cache.h"
+#include "function_table.h"
+#include "metrics.h"
+#include "session_store.h"
+#include "thread_pool.h"
+#include "work_stealing_pool.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Transport-independent core of the calculator server: one Calculator and
+// expression cache shared by all worker threads, and per-sid sessions.
+class CalcService {
+public:
+    struct Options {
+        size_t cacheCapacity = ExpressionCache::kDefaultCapacity;
+        size_t sessionShards = SessionStore::kDefaultShardCount;
+        SessionStore::Limits sessionLimits; // unbounded by default
+        size_t workerThreads = std::thread::hardware_concurrency(); // batch fan-out
+        // Parallel execution of long scripts (Calculator::setScriptPool);
+        // 0 threads keeps every script sequential.
+        size_t scriptThreads = 0;
+        size_t parallelScriptStatements = Calculator::kDefaultParallelStatements;
+        // Per-session budget for memoized results of read-only expressions
+        // (see ResultCache), in estimated bytes; 0 disables memoization.
+        size_t resultCacheBytes = 0;
+        // In-flight and per-session limits applied by the transports.
+        AdmissionControl::Options admission;
+        // Distinct variable and function names the shared symbol table may
+        // hold (Calculator::setSymbolLimit); 0 means no cap. Names are
+        // never forgotten, so this bounds what sessions leave behind.
+        size_t maxSymbols = 0;
+    };
+
+    struct BatchItem {
+        std::string sid;
+        std::string expression;
+    };
+    struct BatchResult {
+        bool ok = false;
+        double value = 0.0;
+        std::string error;
+    };
+
+    static constexpr const char* kDefaultSid = "default";
+
+    CalcService();
+    explicit CalcService(const Options& options);
+
+    // Evaluates a (possibly multi-statement) expression in the session,
+    // creating the session on first use. Throws std::runtime_error.
+    // With a result cache, read-only expressions whose inputs did not
+    // change since the last evaluation return the memoized result.
+    double calculate(const std::string& sid, const std::string& expression);
+
+    // The same without exceptions for errors in the expression: returns
+    // false and fills `error`, whose message() may quote `expression`.
+    // A name the expression only reads and no request ever assigned fails
+    // to compile ("Unknown variable"), so it does not grow the symbol
+    // table.
+    // Used by the transports, where invalid input is routine. Still
+    // throws for failures outside the expression, such as a session
+    // limit or an assignment to a bound variable.
+    bool tryCalculate(const std::string& sid, const std::string& expression, double& result, CalcError& error);
+
+    // Forgets all variables, bound formulas, functions and memoized
+    // results of the session.
+    void clean(const std::string& sid);
+
+    // Reactive variables: binds the target of "target = expression" to the
+    // expression, so it is recomputed whenever one of its inputs changes
+    // (see FormulaGraph). Returns the target's value, or nothing while an
+    // input is undefined or the formula fails. Throws std::runtime_error
+    // for malformed formulas and cycles.
+    std::optional<double> bind(const std::string& sid, const std::string& formula);
+    // Turns a bound variable back into a plain one. False if it was not bound.
+    bool unbind(const std::string& sid, const std::string& name);
+
+    struct BindingInfo {
+        std::string name;
+        std::string formula;
+        std::string error; // why the variable is currently undefined, if it is
+    };
+    std::vector<BindingInfo> bindings(const std::string& sid);
+
+    // Functions, "name(a, b) = expression", callable from expressions as
+    // name(x, 2). A session's own functions shadow global ones of the same
+    // name. Calls are resolved when they run, so redefining a function
+    // changes every expression calling it. Throws std::runtime_error for
+    // malformed definitions.
+    void defineFunction(const std::string& sid, const std::string& definition, bool global);
+    // False if no such function was defined in that scope.
+    bool undefineFunction(const std::string& sid, const std::string& name, bool global);
+
+    struct FunctionInfo {
+        std::string name;
+        std::string definition;
+        bool global = false;
+    };
+    // The functions visible to the session, shadowed globals left out.
+    std::vector<FunctionInfo> functions(const std::string& sid);
+    // The current global functions; the table is never modified.
+    std::shared_ptr<const FunctionTable> globalFunctions();
+
+    // Per-session rate limit: takes a token from the session's bucket,
+    // creating the session on first use. Always true when the limit is
+    // off; false means the request should be rejected (HTTP 429).
+    bool admitSession(const std::string& sid);
+
+    // Listing of the compiled, optimized program for the expression.
+    std::string disassemble(const std::string& expression);
+
+    // Evaluates independent items and reports a result or error for each.
+    // Items of different sessions run in parallel on the worker pool; items
+    // of the same session run one after another in their original order.
+    // Each item takes a token from its session as a single request would
+    // (admitSession()); items over the rate get "Rate limit exceeded for
+    // session: <sid>" and are not evaluated.
+    std::vector<BatchResult> calculateBatch(const std::vector<BatchItem>& items);
+
+    // Vectorized evaluation of one assignment-free expression over rows of
+    // variable values. All columns must have the same length; scalars are
+    // shared by every row. Sessions are not involved.
+    std::vector<double> calculateColumns(const std::string& expression,
+                                         const std::map<std::string, std::vector<double>>& columns,
+                                         const std::map<std::string, double>& scalars);
+
+    // Request/stage metrics plus session and cache figures, in the
+    // Prometheus text exposition format.
+    std::string renderMetrics();
+
+    const Calculator& calculator() const { return calculator_; }
+    ExpressionCache& cache() { return cache_; }
+    SessionStore& sessions() { return sessions_; }
+    Metrics& metrics() { return metrics_; }
+    AdmissionControl& admission() { return admission_; }
+
+private:
+    Metrics metrics_; // before calculator_, which reports stages to it
+    std::unique_ptr<WorkStealingPool> scriptPool_; // likewise outlives calculator_
+    Calculator calculator_;
+    ExpressionCache cache_;
+    SessionStore sessions_;
+    ThreadPool workers_;
+    AdmissionControl admission_;
+    const size_t resultCacheBytes_;
+    std::atomic<uint64_t> resultHits_{0};
+    std::atomic<uint64_t> resultMisses_{0};
+    std::atomic<uint64_t> resultEvictions_{0};
+    // Readers take a reference under the mutex and look functions up
+    // without it; a definition installs a modified copy.
+    std::shared_ptr<const FunctionTable> globalFunctions_;
+    std::mutex globalFunctionsMutex_;
+};
+
+#endif // CALC_SERVICE_H
@@ -0,0 +1,104 @@
+#ifndef EPOLL_SERVER_H
+#define EPOLL_SERVER_H
+
+#include "calc_service.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Event-loop front end for POST /calculate (and GET /metrics), as an
+// alternative to httplib's thread per connection. Linux only.
+//
+// A few I/O threads each own an epoll instance and the connections they
+// accepted; they only accept, read, parse HTTP/1.1 and write. Parsed
+// requests go to a fixed pool of compute workers. All requests a
+// connection has pipelined are handed over as one task and answered with
+// one write, and a connection has at most one task in flight, so
+// responses keep request order. Idle keep-alive connections cost a few
+// hundred bytes and no thread. Admission control (CalcService::admission())
+// is applied when a batch is handed over, so shed requests never wait in
+// the worker queue.
+//
+// Supported HTTP: Content-Length bodies (no chunked requests), keep-alive
+// and pipelining, "Expect: 100-continue" (sent in order with the other
+// responses), and half-closed connections, which get their answers
+// before they are closed.
+//
+// Connections that neither send nor receive anything for idleTimeout are
+// closed, unless a worker is answering them. When the process runs out of
+// descriptors, each I/O thread gives up a spare one it keeps open to
+// accept and immediately close the waiting connections, so clients see
+// the refusal instead of hanging in the backlog. If even that fails, it
+// stops polling the listen socket until one of its connections closes or
+// the next idle sweep.
+class EpollServer {
+public:
+    struct Options {
+        size_t ioThreads = 1;
+        size_t workerThreads = std::thread::hardware_concurrency();
+        std::chrono::milliseconds idleTimeout{60000}; // 0: never
+    };
+
+    static constexpr size_t kMaxHeaderBytes = 16 * 1024;
+    static constexpr size_t kMaxBodyBytes = 16 * 1024 * 1024;
+
+    explicit EpollServer(CalcService& service);
+    EpollServer(CalcService& service, const Options& options);
+    ~EpollServer();
+    EpollServer(const EpollServer&) = delete;
+    EpollServer& operator=(const EpollServer&) = delete;
+
+    // Binds and starts listening; port 0 picks a free port. Returns the
+    // bound port. Throws std::runtime_error.
+    int bind(const std::string& host, int port);
+
+    // Runs the I/O threads (the calling thread is one of them) until stop()
+    // is called, then closes all connections and waits for the workers.
+    // Call once.
+    void listen();
+
+    // Makes listen() return. Safe to call from any thread, and before listen().
+    void stop();
+
+    size_t connectionCount() const { return connections_.load(std::memory_order_relaxed); }
+    // Connections closed for being idle, and refused for lack of descriptors.
+    uint64_t idleClosedCount() const { return idleClosed_.load(std::memory_order_relaxed); }
+    uint64_t refusedCount() const { return refused_.load(std::memory_order_relaxed); }
+
+private:
+    struct Connection;
+    struct IoThread;
+    struct Request;
+
+    void runLoop(IoThread& io);
+    void acceptAll(IoThread& io);
+    void pauseAccepting(IoThread& io);
+    void resumeAccepting(IoThread& io);
+    void closeIdle(IoThread& io);
+    void onReadable(IoThread& io, Connection& conn);
+    void onCompletions(IoThread& io);
+    void parseRequests(Connection& conn);
+    void dispatch(IoThread& io, Connection& conn);
+    void flush(IoThread& io, Connection& conn);
+    void updateInterest(IoThread& io, Connection& conn);
+    void retire(IoThread& io, Connection& conn);
+    void closeConnection(IoThread& io, Connection& conn);
+    std::string respond(const Request& request);
+
+    CalcService& service_;
+    const Options options_;
+    int listenFd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> connections_{0};
+    std::atomic<uint64_t> idleClosed_{0};
+    std::atomic<uint64_t> refused_{0};
+    std::vector<std::unique_ptr<IoThread>> io_;
+    std::unique_ptr<ThreadPool> workers_;
+};
+
+#endif // EPOLL_SERVER_H
@@ -0,0 +1,38 @@
+#ifndef HTTP_API_H
+#define HTTP_API_H
+
+#include "httplib.h"
+#include "calc_service.h"
+#include <string>
+
+// Registers the JSON endpoints of the calculator server.
+// POST /calculate
+//   {"sid": "...", "exp": "..."}  -> {"res": <number>}
+//   {"sid": "...", "cmd": "echo"} -> {"res": "echo"}
+//   {"sid": "...", "cmd": "clean"} -> {}
+//   {"cmd": "dump", "exp": "..."} -> {"res": "<optimized bytecode listing>"}
+//   Errors are answered with status 400 and {"err": "<message>"}.
+// POST /calculate/batch
+//   [{"sid": "...", "exp": "..."}, ...] -> [{"res": <number>} | {"err": "..."}, ...]
+//   One result per item, in request order; status 400 only if the body
+//   itself is not an array.
+// POST /calculate/vector
+//   {"exp": "price * qty - fee", "vars": {"price": [..], "qty": [..], "fee": 1.5}}
+//     -> {"res": [..]}  one result per row; arrays are columns, numbers
+//   are shared by all rows. Runs without a session.
+// Requests without a string "sid" use the "default" session.
+// With admission control (CalcService::admission()), the POST endpoints
+// except /calculate/stream answer 503 {"err": "Server overloaded"} beyond
+// the in-flight limit, and /calculate answers 429 to sessions over their
+// rate limit.
+void registerHttpApi(httplib::Server& svr, CalcService& service);
+
+// Body of the 503 answer to a request shed by admission control.
+extern const char* const kOverloadedBody;
+
+// The POST /calculate protocol without the transport: evaluates a request
+// body, records metrics, stores the response body in `response` and
+// returns the HTTP status. Shared with other front ends (EpollServer).
+int handleCalculate(CalcService& service, const std::string& body, std::string& response);
+
+#endif // HTTP_API_H
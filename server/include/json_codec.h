@@ -0,0 +1,38 @@
+#ifndef JSON_CODEC_H
+#define JSON_CODEC_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Hand-written JSON for the hot /calculate path: a single-pass decoder for
+// the one request shape the endpoint sees almost always, and appenders
+// that write responses straight into a reusable buffer. Anything unusual
+// goes to nlohmann::json instead, which stays the reference behaviour.
+
+// Members of a POST /calculate body. The views point into the decoded
+// body, or into `unescaped` for strings that contained escapes.
+struct CalculateRequest {
+    std::optional<std::string_view> sid, exp, cmd, var, scope;
+    std::string unescaped[5];
+};
+
+// Decodes a flat JSON object whose members are all strings named sid,
+// exp, cmd, var or scope. Returns false for anything else (other members or
+// value types, duplicate members, \u escapes, non-ASCII text, malformed
+// JSON); the caller then parses the body with nlohmann::json, which also
+// produces the error message. Whatever this accepts nlohmann::json parses
+// to the same members.
+bool decodeCalculateRequest(std::string_view body, CalculateRequest& request);
+
+// Appends the number as nlohmann::json::dump() writes it: shortest digits
+// that round-trip (std::to_chars), "42.0" for integral values, exponent
+// notation like "1e+300" outside [1e-5, 1e15), and null for NaN and
+// infinities.
+void appendJsonNumber(std::string& out, double value);
+
+// Appends a quoted, escaped JSON string. Invalid UTF-8 is replaced by
+// U+FFFD, so error messages quoting a stray byte still make valid JSON.
+void appendJsonString(std::string& out, std::string_view text);
+
+#endif // JSON_CODEC_H
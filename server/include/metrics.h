@@ -0,0 +1,94 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "calculator.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Request counters and per-stage latency histograms of the server.
+//
+// Every thread records into its own slot, registered on the thread's first
+// use; afterwards recording is a few relaxed atomic stores with no lock
+// and no shared cache lines. Only render() walks all slots, under the
+// registry mutex, which recording threads take just once each.
+class Metrics : public Calculator::StageObserver {
+public:
+    using Clock = Calculator::StageClock;
+
+    enum class Stage {
+        JSON_PARSE,     // request body -> json
+        TOKENIZE,       // Calculator stages, reported through StageObserver
+        SHUNTING_YARD,
+        COMPILE,
+        OPTIMIZE,
+        EXECUTE,
+        SERIALIZE,      // json -> response body
+        REQUEST         // the whole handler
+    };
+    static constexpr size_t kStageCount = 8;
+
+    enum class Endpoint { CALCULATE, BATCH, VECTOR, STREAM, BINARY };
+    static constexpr size_t kEndpointCount = 5;
+
+    // BAD_REQUEST: the body is not valid JSON or has the wrong shape.
+    // ERROR: a well-formed request that failed (syntax, division by zero...).
+    // SHED: rejected by admission control (503 or 429) without running.
+    enum class Outcome { OK, ERROR, BAD_REQUEST, SHED };
+    static constexpr size_t kOutcomeCount = 4;
+
+    Metrics();
+    ~Metrics() override;
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    void recordStage(Stage stage, Clock::duration elapsed);
+    void recordRequest(Endpoint endpoint, Outcome outcome);
+    void onStage(Calculator::Stage stage, Clock::duration elapsed) override;
+
+    // Runs f() and records its duration under `stage` if it returns.
+    template <typename F>
+    auto time(Stage stage, F&& f) {
+        auto start = Clock::now();
+        auto result = f();
+        recordStage(stage, Clock::now() - start);
+        return result;
+    }
+
+    // Totals over all threads, as of now.
+    uint64_t requestCount(Endpoint endpoint, Outcome outcome) const;
+    uint64_t stageCount(Stage stage) const;
+
+    // Histograms and counters in the Prometheus text exposition format.
+    void render(std::ostream& out) const;
+
+    // Upper bounds of the histogram buckets, in nanoseconds; a final +Inf
+    // bucket catches the rest.
+    static constexpr uint64_t kBucketBounds[] = {
+        250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+        1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 1000000000
+    };
+    static constexpr size_t kBucketCount = sizeof(kBucketBounds) / sizeof(kBucketBounds[0]) + 1;
+
+private:
+    // Written only by its owning thread, read by render().
+    struct ThreadSlot {
+        std::atomic<uint64_t> buckets[kStageCount][kBucketCount]{};
+        std::atomic<uint64_t> sumNanos[kStageCount]{};
+        std::atomic<uint64_t> requests[kEndpointCount][kOutcomeCount]{};
+    };
+
+    ThreadSlot& localSlot();
+
+    const uint64_t id_; // tells this registry apart in the threads' slot caches
+    mutable std::mutex mutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadSlot>> slots_;
+};
+
+#endif // METRICS_H
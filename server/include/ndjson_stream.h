@@ -0,0 +1,86 @@
+#ifndef NDJSON_STREAM_H
+#define NDJSON_STREAM_H
+
+#include "calc_service.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append-then-read byte buffer for a streamed response. The first
+// memoryLimit bytes stay in memory; beyond that everything goes to an
+// anonymous temporary file, so a response of any size costs bounded RAM.
+// All appends must happen before the first read.
+class ResultSpool {
+public:
+    static constexpr size_t kDefaultMemoryLimit = 1 << 20;
+
+    explicit ResultSpool(size_t memoryLimit = kDefaultMemoryLimit);
+    ~ResultSpool();
+    ResultSpool(const ResultSpool&) = delete;
+    ResultSpool& operator=(const ResultSpool&) = delete;
+
+    void append(std::string_view data);
+
+    // Copies up to `size` unread bytes to `out`; returns 0 once all were read.
+    size_t read(char* out, size_t size);
+
+    size_t size() const { return size_; }
+    bool spilled() const { return file_ != nullptr; }
+
+private:
+    std::string memory_;
+    size_t memoryLimit_;
+    std::FILE* file_ = nullptr;
+    size_t size_ = 0;
+    size_t readOffset_ = 0;
+    bool reading_ = false;
+};
+
+// Incremental evaluator for newline-delimited {"sid", "exp"} records.
+// Body bytes are fed as they arrive; complete lines are collected into
+// windows of at most `window` records and evaluated through
+// CalcService::calculateBatch, so records of different sessions run in
+// parallel while each session sees its records in input order. One
+// {"res"} or {"err"} line per record, in input order, is appended to the
+// spool, followed by a summary line with the throughput. Memory use is
+// bounded by the window and the longest line, not by the input size.
+// With a session rate limit (AdmissionControl::Options::sessionRate)
+// each record takes a token from its session, and records over the rate
+// are answered with an error instead of being evaluated (see
+// CalcService::calculateBatch).
+class NdjsonStream {
+public:
+    static constexpr size_t kDefaultWindow = 256;
+    static constexpr size_t kMaxLineLength = 1 << 20;
+
+    NdjsonStream(CalcService& service, ResultSpool& out, size_t window = kDefaultWindow);
+
+    // Throws std::runtime_error if a line exceeds kMaxLineLength.
+    void feed(const char* data, size_t size);
+
+    // Evaluates the remaining records (including a last line without a
+    // newline) and appends the summary:
+    // {"records": N, "errors": E, "seconds": S, "records_per_second": R}
+    void finish();
+
+    size_t records() const { return records_; }
+    size_t errors() const { return errors_; }
+
+private:
+    void addLine(std::string_view line);
+    void flushWindow();
+
+    CalcService& service_;
+    ResultSpool& out_;
+    size_t window_;
+    std::string partial_;                        // bytes of the unfinished line
+    std::vector<CalcService::BatchItem> items_;  // well-formed records of the window
+    std::vector<std::string> malformed_;         // per window record: parse error, or empty
+    size_t records_ = 0;
+    size_t errors_ = 0;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif // NDJSON_STREAM_H
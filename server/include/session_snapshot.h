@@ -0,0 +1,98 @@
+#ifndef SESSION_SNAPSHOT_H
+#define SESSION_SNAPSHOT_H
+
+#include "calc_service.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Session snapshots: all variables, bound formulas and functions of all
+// sessions, and the global functions, in one compact binary file, so a
+// restarted server picks up where the previous one stopped.
+//
+// Layout (host byte order, little-endian on every supported target):
+//   header   magic "CALCSNAP", uint32 version, uint32 symbolCount,
+//            uint64 sessionCount, uint64 symbolOffset, uint64 fileSize
+//   sessions sessionCount x { uint32 sidLength, sid bytes,
+//                             uint32 variableCount,
+//                             variableCount x { uint32 slot, float64 value },
+//                             uint32 formulaCount,              (version 2)
+//                             formulaCount x { uint32 length, source bytes },
+//                             uint32 functionCount,             (version 3)
+//                             functionCount x { uint32 length, source bytes } }
+//   symbols  symbolCount x { uint32 nameLength, name bytes }
+//   globals  uint32 functionCount,                              (version 3)
+//            functionCount x { uint32 length, source bytes }
+// Slots index the symbols section, which is remapped onto the loading
+// Calculator's slots, so the file does not depend on interning order.
+// Formulas ("target = expression") and functions ("f(a) = expression")
+// are saved as source and compiled again on load. Version 1 and 2 files
+// still load.
+constexpr char kSnapshotMagic[8] = {'C', 'A', 'L', 'C', 'S', 'N', 'A', 'P'};
+constexpr uint32_t kSnapshotVersion = 3;
+
+struct SnapshotStats {
+    size_t sessions = 0;  // sessions with at least one variable, formula or function
+    size_t variables = 0;
+    size_t formulas = 0;
+    size_t functions = 0; // session and global
+    size_t bytes = 0;
+    double seconds = 0.0;
+};
+
+// Writes every non-empty session to `path` while requests keep running:
+// the store is walked one shard at a time, each session is copied under
+// its own mutex (so a script is either fully in or fully out), and file
+// I/O happens outside all locks. Sessions are consistent individually,
+// not with each other. The data goes to `path`.tmp, which is fsynced and
+// renamed over `path`, so a crash never leaves a torn snapshot behind.
+// Throws std::runtime_error.
+SnapshotStats saveSessionSnapshot(CalcService& service, const std::string& path);
+
+// Maps `path` with mmap and restores its sessions into the service,
+// overwriting variables, formulas and functions of the same name in
+// existing sessions and in the global scope. Throws std::runtime_error
+// for unreadable or corrupt files; nothing is restored from a file that
+// fails validation, which includes compiling every formula and function.
+SnapshotStats loadSessionSnapshot(CalcService& service, const std::string& path);
+
+// Saves a snapshot every `interval` on a background thread; a zero
+// interval only allows explicit saveNow() calls. Every save (or failure)
+// is passed to `report` as a one-line message.
+class SnapshotScheduler {
+public:
+    using Report = std::function<void(const std::string& message)>;
+
+    SnapshotScheduler(CalcService& service, std::string path,
+                      std::chrono::seconds interval, Report report = nullptr);
+    ~SnapshotScheduler();
+    SnapshotScheduler(const SnapshotScheduler&) = delete;
+    SnapshotScheduler& operator=(const SnapshotScheduler&) = delete;
+
+    // Stops the timer thread, waiting for a save in progress. Idempotent.
+    void stop();
+
+    // Saves now, on the calling thread, and reports the result.
+    // Returns false if the save failed.
+    bool saveNow();
+
+private:
+    void run();
+
+    CalcService& service_;
+    const std::string path_;
+    const std::chrono::seconds interval_;
+    const Report report_;
+
+    std::mutex saveMutex_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+#endif // SESSION_SNAPSHOT_H
@@ -0,0 +1,122 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include "admission_control.h"
+#include "formula_graph.h"
+#include "function_table.h"
+#include "result_cache.h"
+#include "symbol_table.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Variables of one client session (sid).
+struct Session {
+    // Held for a whole request, so a multi-statement script runs atomically
+    // with respect to other requests of the same session.
+    std::mutex mutex;
+    VariableStore variables;
+    FormulaGraph formulas; // variables bound to expressions
+    ResultCache results;   // memoized read-only expressions, if enabled
+    FunctionTable functions; // defined for this session only
+    TokenBucket rate;        // per-session rate limit, if enabled
+};
+
+// sid -> Session map split into lock-striped shards. A shard lock is only
+// held for the lookup itself; evaluation happens under the session's own
+// mutex, so requests for different sessions never wait on each other.
+//
+// Sessions can be bounded by idle time, count and estimated memory. Each
+// shard keeps its sessions in LRU order and enforces its share of the caps
+// whenever it is accessed, evicting a few sessions from the cold end at a
+// time, so there is never a store-wide pause. An evicted session behaves
+// like a new one; a request still holding it finishes normally.
+class SessionStore {
+public:
+    static constexpr size_t kDefaultShardCount = 64;
+    // Idle sessions expired per access; bounds the work added to a request.
+    static constexpr size_t kExpireBatch = 4;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Zero disables a limit. The caps are split evenly between the shards
+    // (rounded up) and enforced per shard.
+    struct Limits {
+        std::chrono::seconds idleTtl{0};
+        size_t maxSessions = 0;
+        size_t maxBytes = 0;
+    };
+
+    struct Stats {
+        size_t sessions = 0;
+        size_t bytes = 0; // estimate: bookkeeping, variables, functions and bound formulas
+        uint64_t evictedIdle = 0;
+        uint64_t evictedCount = 0;
+        uint64_t evictedMemory = 0;
+    };
+
+    explicit SessionStore(size_t shardCount = kDefaultShardCount);
+    SessionStore(size_t shardCount, const Limits& limits);
+
+    std::shared_ptr<Session> getOrCreate(const std::string& sid);
+    std::shared_ptr<Session> find(const std::string& sid) const;
+    // Re-estimates `session` after it gained variables or its functions or
+    // bound formulas changed, and enforces the caps. Call with
+    // session.mutex held. Does nothing if the session has been evicted in
+    // the meantime.
+    void account(const std::string& sid, const Session& session);
+    bool erase(const std::string& sid);
+    size_t size() const;
+    Stats stats() const;
+
+    // Expires every session idle for longer than the TTL as of `now`.
+    // Accesses already do this incrementally; this is a full sweep.
+    size_t expireIdle(Clock::time_point now = Clock::now());
+
+    // Copies the entries of one shard under its lock, so callers can walk
+    // the whole store (e.g. for a snapshot) while holding at most one shard
+    // lock at a time and only for the copy.
+    size_t shardCount() const { return shards_.size(); }
+    std::vector<std::pair<std::string, std::shared_ptr<Session>>> shardEntries(size_t shard) const;
+
+private:
+    struct Entry {
+        std::string sid;
+        std::shared_ptr<Session> session;
+        Clock::time_point lastUsed;
+        size_t contents = 0; // variables, functions and formulas as of the last account()
+        size_t bytes = 0; // estimate counted in Shard::bytes
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru; // most recently used at the front
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    Shard& shardFor(const std::string& sid) const;
+    static size_t estimateBytes(const Entry& entry);
+    void enforceLimitsLocked(Shard& shard, Clock::time_point now);
+    size_t expireLocked(Shard& shard, Clock::time_point now, size_t budget);
+    void evictBackLocked(Shard& shard, std::atomic<uint64_t>& counter);
+
+    mutable std::vector<Shard> shards_;
+    const std::chrono::seconds idleTtl_;
+    size_t shardMaxSessions_ = 0;
+    size_t shardMaxBytes_ = 0;
+    std::atomic<size_t> sweepCursor_{0};
+
+    std::atomic<uint64_t> evictedIdle_{0};
+    std::atomic<uint64_t> evictedCount_{0};
+    std::atomic<uint64_t> evictedMemory_{0};
+};
+
+#endif // SESSION_STORE_H
@@ -0,0 +1,134 @@
+#include "admission_control.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+} // namespace
+
+bool TokenBucket::tryTake(double rate, double burst, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) {
+        tokens_ = burst;
+        started_ = true;
+    } else if (now > last_) {
+        tokens_ = std::min(burst, tokens_ + std::chrono::duration<double>(now - last_).count() * rate);
+    }
+    last_ = std::max(last_, now);
+    if (tokens_ < 1.0) {
+        return false;
+    }
+    tokens_ -= 1.0;
+    return true;
+}
+
+AdmissionControl::Permit::Permit(Permit&& other) noexcept
+    : owner_(other.owner_), weight_(other.weight_), start_(other.start_) {
+    other.owner_ = nullptr;
+}
+
+AdmissionControl::Permit& AdmissionControl::Permit::operator=(Permit&& other) noexcept {
+    if (this != &other) {
+        release();
+        owner_ = other.owner_;
+        weight_ = other.weight_;
+        start_ = other.start_;
+        other.owner_ = nullptr;
+    }
+    return *this;
+}
+
+void AdmissionControl::Permit::release(Clock::time_point now) {
+    if (owner_) {
+        owner_->complete(weight_, now - start_);
+        owner_ = nullptr;
+    }
+}
+
+AdmissionControl::AdmissionControl() : AdmissionControl(Options()) {
+}
+
+AdmissionControl::AdmissionControl(const Options& options)
+    : options_(options),
+      fixedLimit_(options.maxInFlight > 0 ? options.maxInFlight : kUnlimited),
+      limit_(fixedLimit_) {
+    if (options_.adaptive) {
+        size_t upper = std::min(std::max(options_.maxLimit, options_.minLimit), fixedLimit_);
+        adaptiveLimit_ = static_cast<double>(std::clamp(options_.initialLimit, std::min(options_.minLimit, upper), upper));
+        limit_.store(static_cast<size_t>(adaptiveLimit_), std::memory_order_relaxed);
+    }
+}
+
+AdmissionControl::Permit AdmissionControl::tryAcquire(size_t weight, Clock::time_point now) {
+    const size_t inFlight = inFlight_.fetch_add(weight, std::memory_order_acq_rel) + weight;
+    if (inFlight > limit_.load(std::memory_order_relaxed) && inFlight > weight) {
+        inFlight_.fetch_sub(weight, std::memory_order_acq_rel);
+        Reason reason = inFlight > fixedLimit_ ? Reason::IN_FLIGHT : Reason::ADAPTIVE;
+        rejected_[static_cast<size_t>(reason)].fetch_add(weight, std::memory_order_relaxed);
+        return Permit();
+    }
+    admitted_.fetch_add(weight, std::memory_order_relaxed);
+    return Permit(this, weight, now);
+}
+
+bool AdmissionControl::tryTakeToken(TokenBucket& bucket, Clock::time_point now) {
+    const double burst = options_.sessionBurst > 0 ? options_.sessionBurst : std::max(options_.sessionRate, 1.0);
+    if (bucket.tryTake(options_.sessionRate, burst, now)) {
+        return true;
+    }
+    rejected_[static_cast<size_t>(Reason::SESSION_RATE)].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void AdmissionControl::complete(size_t weight, Clock::duration latency) {
+    const size_t inFlight = inFlight_.fetch_sub(weight, std::memory_order_acq_rel);
+    if (!options_.adaptive) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(windowMutex_);
+    windowNanos_ += static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    windowPeak_ = std::max(windowPeak_, inFlight);
+    if (++windowSamples_ < kWindowSamples) {
+        return;
+    }
+    const double sample = std::max(windowNanos_ / static_cast<double>(windowSamples_), 1.0);
+    const size_t peak = windowPeak_;
+    windowNanos_ = 0.0;
+    windowSamples_ = 0;
+    windowPeak_ = 0;
+
+    if (baselineNanos_ == 0.0 || sample < baselineNanos_) {
+        baselineNanos_ = sample;
+    } else {
+        baselineNanos_ += (sample - baselineNanos_) * kBaselineDrift;
+    }
+    const double gradient = std::clamp(kTolerance * baselineNanos_ / sample, 0.5, 1.0);
+    double target = adaptiveLimit_ * gradient + std::sqrt(adaptiveLimit_);
+    if (target > adaptiveLimit_ && static_cast<double>(peak) < adaptiveLimit_ / 2) {
+        target = adaptiveLimit_; // not using the limit: no evidence it could be higher
+    }
+    const double upper = static_cast<double>(std::min(std::max(options_.maxLimit, options_.minLimit), fixedLimit_));
+    adaptiveLimit_ = std::clamp(adaptiveLimit_ * (1.0 - kSmoothing) + target * kSmoothing,
+                                static_cast<double>(std::min(options_.minLimit, static_cast<size_t>(upper))), upper);
+    limit_.store(static_cast<size_t>(adaptiveLimit_), std::memory_order_relaxed);
+}
+
+AdmissionControl::Stats AdmissionControl::stats() const {
+    Stats stats;
+    stats.admitted = admitted_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < kReasonCount; ++i) {
+        stats.rejected[i] = rejected_[i].load(std::memory_order_relaxed);
+    }
+    stats.inFlight = inFlight_.load(std::memory_order_relaxed);
+    stats.limit = limit();
+    return stats;
+}
+
+size_t AdmissionControl::limit() const {
+    size_t limit = limit_.load(std::memory_order_relaxed);
+    return limit == kUnlimited ? 0 : limit;
+}
@@ -0,0 +1,244 @@
+#include "binary_server.h"
+#include "binary_protocol.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+bool sendAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+BinaryServer::BinaryServer(CalcService& service) : BinaryServer(service, Options()) {
+}
+
+BinaryServer::BinaryServer(CalcService& service, const Options& options) : service_(service), options_(options) {
+}
+
+BinaryServer::~BinaryServer() {
+    stop();
+}
+
+int BinaryServer::bind(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* addresses = nullptr;
+    int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses);
+    if (rc != 0) {
+        throw std::runtime_error("Cannot resolve " + host + ": " + gai_strerror(rc));
+    }
+    int fd = -1;
+    for (addrinfo* a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, a->ai_addr, a->ai_addrlen) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot listen on " + host + ":" + std::to_string(port));
+    }
+
+    sockaddr_storage bound{};
+    socklen_t length = sizeof(bound);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &length);
+    listenFd_ = fd;
+    stopping_ = false;
+    if (bound.ss_family == AF_INET6) {
+        return ntohs(reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port);
+    }
+    return ntohs(reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+}
+
+void BinaryServer::listen() {
+    while (!stopping_) {
+        {
+            // At the cap, clients stay in the listen backlog.
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this]() {
+                return stopping_ || options_.maxConnections == 0 || connections_.size() < options_.maxConnections;
+            });
+        }
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (stopping_) break; // the listening socket was shut down by stop()
+            if (errno != EINTR && errno != ECONNABORTED) {
+                // EMFILE, ENFILE, ENOBUFS, ENOMEM: wait for resources to free up.
+                std::this_thread::sleep_for(kAcceptBackoff);
+            }
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stopping_) {
+            ::close(fd);
+            break;
+        }
+        connections_.insert(fd);
+        try {
+            std::thread([this, fd]() { serveConnection(fd); }).detach();
+        } catch (const std::system_error&) {
+            // Out of threads: drop this client rather than the server.
+            connections_.erase(fd);
+            ::close(fd);
+            lock.unlock();
+            std::this_thread::sleep_for(kAcceptBackoff);
+        }
+    }
+}
+
+void BinaryServer::stop() {
+    stopping_ = true;
+    int fd = listenFd_.exchange(-1);
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+    }
+    // Wake the connection threads; each removes itself when it is done.
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (int connection : connections_) {
+        ::shutdown(connection, SHUT_RDWR);
+    }
+    idle_.notify_all(); // listen() may be waiting for a free connection
+    idle_.wait(lock, [this]() { return connections_.empty(); });
+}
+
+void BinaryServer::serveConnection(int fd) {
+    std::string in;
+    std::string out;
+    char buffer[16 * 1024];
+    bool open = true;
+
+    while (open) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        in.append(buffer, static_cast<size_t>(n));
+
+        // Answer every complete frame received so far, then write the
+        // responses in one go.
+        std::vector<std::string_view> frames;
+        std::string oversized;
+        size_t offset = 0;
+        try {
+            while (size_t frame = completeFrameSize(std::string_view(in).substr(offset))) {
+                frames.push_back(std::string_view(in).substr(offset + kBinaryLengthPrefix, frame - kBinaryLengthPrefix));
+                offset += frame;
+            }
+        } catch (const std::exception& e) {
+            // Oversized frame: the stream cannot be resynchronized.
+            oversized = e.what();
+            open = false;
+        }
+        if (!frames.empty()) {
+            AdmissionControl::Permit permit = service_.admission().tryAcquire(frames.size());
+            for (std::string_view frame : frames) {
+                handleFrame(frame, static_cast<bool>(permit), out);
+            }
+        }
+        if (!open) {
+            appendResponseFrame({BinaryStatus::BAD_REQUEST, 0.0, oversized}, out);
+        }
+        in.erase(0, offset);
+
+        if (!out.empty()) {
+            if (!sendAll(fd, out)) break;
+            out.clear();
+        }
+    }
+
+    // Unregistered before it is closed, so accept() cannot hand out the
+    // same descriptor while it is still counted.
+    // Notified under the lock: once stop() sees no connections, the
+    // server may be destroyed.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(fd);
+        idle_.notify_all();
+    }
+    ::close(fd);
+}
+
+void BinaryServer::handleFrame(std::string_view payload, bool admitted, std::string& out) {
+    Metrics& metrics = service_.metrics();
+    const auto start = Metrics::Clock::now();
+    BinaryResponse response;
+    Metrics::Outcome outcome = Metrics::Outcome::OK;
+
+    BinaryRequest request;
+    try {
+        request = parseRequest(payload);
+    } catch (const std::exception& e) {
+        response.status = BinaryStatus::BAD_REQUEST;
+        response.error = e.what();
+        outcome = Metrics::Outcome::BAD_REQUEST;
+    }
+
+    if (outcome == Metrics::Outcome::OK && !admitted) {
+        response.status = BinaryStatus::OVERLOADED;
+        response.error = "Server overloaded";
+        outcome = Metrics::Outcome::SHED;
+    }
+
+    if (outcome == Metrics::Outcome::OK) {
+        const std::string& sid = request.sid.empty() ? (request.sid = CalcService::kDefaultSid) : request.sid;
+        try {
+            if (!service_.admitSession(sid)) {
+                response.status = BinaryStatus::RATE_LIMITED;
+                response.error = "Rate limit exceeded for session: " + sid;
+                outcome = Metrics::Outcome::SHED;
+            } else {
+                switch (request.opcode) {
+                    case BinaryOpcode::EVAL: {
+                        CalcError error;
+                        if (!service_.tryCalculate(sid, request.expression, response.value, error)) {
+                            response.status = BinaryStatus::ERROR;
+                            response.error = error.message();
+                            outcome = Metrics::Outcome::ERROR;
+                        }
+                        break;
+                    }
+                    case BinaryOpcode::ECHO:
+                        break;
+                    case BinaryOpcode::CLEAN:
+                        service_.clean(sid);
+                        break;
+                }
+            }
+        } catch (const std::exception& e) {
+            response.status = BinaryStatus::ERROR;
+            response.error = e.what();
+            outcome = Metrics::Outcome::ERROR;
+        }
+    }
+
+    appendResponseFrame(response, out);
+    metrics.recordRequest(Metrics::Endpoint::BINARY, outcome);
+    metrics.recordStage(Metrics::Stage::REQUEST, Metrics::Clock::now() - start);
+}
@@ -0,0 +1,344 @@
+#include "calc_service.h"
+#include "column_evaluator.h"
+#include "request_arena.h"
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+CalcService::CalcService() : CalcService(Options()) {
+}
+
+CalcService::CalcService(const Options& options)
+    : cache_(calculator_, options.cacheCapacity),
+      sessions_(options.sessionShards, options.sessionLimits),
+      workers_(options.workerThreads),
+      admission_(options.admission),
+      resultCacheBytes_(options.resultCacheBytes),
+      globalFunctions_(std::make_shared<FunctionTable>()) {
+    calculator_.setStageObserver(&metrics_);
+    calculator_.setSymbolLimit(options.maxSymbols);
+    if (options.scriptThreads > 0) {
+        scriptPool_ = std::make_unique<WorkStealingPool>(options.scriptThreads);
+        calculator_.setScriptPool(scriptPool_.get(), options.parallelScriptStatements);
+    }
+}
+
+double CalcService::calculate(const std::string& sid, const std::string& expression) {
+    double result = 0.0;
+    CalcError error;
+    if (!tryCalculate(sid, expression, result, error)) {
+        throw std::runtime_error(error.message());
+    }
+    return result;
+}
+
+bool CalcService::tryCalculate(const std::string& sid, const std::string& expression, double& result,
+                               CalcError& error) {
+    // Scratch memory of everything below is released when the request ends.
+    RequestArena::Scope arena;
+
+    // Compile before taking the session lock: parsing does not touch
+    // session state and is usually a cache hit anyway.
+    auto compiled = cache_.tryGetOrCompile(expression, error, Calculator::UnknownNames::REJECT);
+    if (!compiled) {
+        return false;
+    }
+    auto session = sessions_.getOrCreate(sid);
+
+    // Functions are looked up only by expressions that call one.
+    std::shared_ptr<const FunctionTable> globals;
+    FunctionScope scope;
+    if (compiled->calls) {
+        std::lock_guard<std::mutex> lock(globalFunctionsMutex_);
+        globals = globalFunctions_;
+        scope.global = globals.get();
+    }
+
+    std::lock_guard<std::mutex> lock(session->mutex);
+    scope.local = &session->functions;
+    // Read-only expressions assign nothing, so bound formulas have
+    // nothing to recompute for them either.
+    if (resultCacheBytes_ > 0 && ResultCache::cacheable(*compiled)) {
+        if (auto memoized = session->results.lookup(compiled, session->variables)) {
+            resultHits_.fetch_add(1, std::memory_order_relaxed);
+            result = *memoized;
+            return true;
+        }
+        resultMisses_.fetch_add(1, std::memory_order_relaxed);
+        if (!calculator_.tryEvaluate(*compiled, session->variables, result, error)) {
+            return false;
+        }
+        size_t evicted = session->results.insert(compiled, session->variables, result, resultCacheBytes_);
+        resultEvictions_.fetch_add(evicted, std::memory_order_relaxed);
+        return true;
+    }
+    const size_t variables = session->variables.size();
+    bool ok = false;
+    if (session->formulas.empty()) {
+        ok = calculator_.tryEvaluate(*compiled, session->variables, result, error, &scope);
+    } else {
+        // Earlier statements may have assigned inputs before a later one
+        // failed, so dependents are brought up to date either way.
+        FormulaGraph& formulas = session->formulas;
+        formulas.checkAssignments(calculator_, *compiled);
+        ok = calculator_.tryEvaluate(*compiled, session->variables, result, error, &scope);
+        formulas.propagate(calculator_, *compiled, session->variables);
+    }
+    // New variables count towards the session's memory estimate.
+    if (session->variables.size() != variables) {
+        sessions_.account(sid, *session);
+    }
+    return ok;
+}
+
+void CalcService::clean(const std::string& sid) {
+    auto session = sessions_.find(sid);
+    if (!session) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->variables.clear();
+    session->formulas.clear();
+    session->results.clear();
+    session->functions.clear();
+    sessions_.account(sid, *session);
+}
+
+std::optional<double> CalcService::bind(const std::string& sid, const std::string& formula) {
+    RequestArena::Scope arena;
+    auto compiled = cache_.getOrCompile(formula);
+    auto session = sessions_.getOrCreate(sid);
+
+    std::lock_guard<std::mutex> lock(session->mutex);
+    const bool defined = session->formulas.bind(calculator_, compiled, formula, session->variables);
+    sessions_.account(sid, *session);
+    if (!defined) {
+        return std::nullopt;
+    }
+    const Calculator::Program& statement = compiled->statements.front();
+    return session->variables.get(statement.symbols[statement.code.back().operand]);
+}
+
+bool CalcService::unbind(const std::string& sid, const std::string& name) {
+    uint32_t slot = 0;
+    auto session = sessions_.find(sid);
+    if (!session || !calculator_.symbols().find(name, slot)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->formulas.unbind(slot)) {
+        return false;
+    }
+    sessions_.account(sid, *session);
+    return true;
+}
+
+std::vector<CalcService::BindingInfo> CalcService::bindings(const std::string& sid) {
+    std::vector<BindingInfo> out;
+    auto session = sessions_.find(sid);
+    if (!session) {
+        return out;
+    }
+    std::lock_guard<std::mutex> lock(session->mutex);
+    for (const auto& binding : session->formulas.bindings()) {
+        out.push_back({calculator_.symbols().name(binding.slot), binding.source, binding.error});
+    }
+    return out;
+}
+
+void CalcService::defineFunction(const std::string& sid, const std::string& definition, bool global) {
+    auto function = std::make_shared<const Function>(calculator_.compileFunction(definition));
+    if (global) {
+        std::lock_guard<std::mutex> lock(globalFunctionsMutex_);
+        auto table = std::make_shared<FunctionTable>(*globalFunctions_);
+        table->define(std::move(function));
+        globalFunctions_ = std::move(table);
+        return;
+    }
+    auto session = sessions_.getOrCreate(sid);
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->functions.define(std::move(function));
+    sessions_.account(sid, *session);
+}
+
+bool CalcService::undefineFunction(const std::string& sid, const std::string& name, bool global) {
+    uint32_t slot = 0;
+    if (!calculator_.symbols().find(name, slot)) {
+        return false;
+    }
+    if (global) {
+        std::lock_guard<std::mutex> lock(globalFunctionsMutex_);
+        if (!globalFunctions_->find(slot)) {
+            return false;
+        }
+        auto table = std::make_shared<FunctionTable>(*globalFunctions_);
+        table->remove(slot);
+        globalFunctions_ = std::move(table);
+        return true;
+    }
+    auto session = sessions_.find(sid);
+    if (!session) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->functions.remove(slot)) {
+        return false;
+    }
+    sessions_.account(sid, *session);
+    return true;
+}
+
+std::vector<CalcService::FunctionInfo> CalcService::functions(const std::string& sid) {
+    std::shared_ptr<const FunctionTable> globals = globalFunctions();
+    std::vector<FunctionInfo> out;
+    auto session = sessions_.find(sid);
+    if (session) {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        for (const auto& function : session->functions.functions()) {
+            out.push_back({function->name, function->source, false});
+        }
+    }
+    for (const auto& function : globals->functions()) {
+        bool shadowed = std::any_of(out.begin(), out.end(),
+                                    [&](const FunctionInfo& info) { return info.name == function->name; });
+        if (!shadowed) {
+            out.push_back({function->name, function->source, true});
+        }
+    }
+    return out;
+}
+
+std::shared_ptr<const FunctionTable> CalcService::globalFunctions() {
+    std::lock_guard<std::mutex> lock(globalFunctionsMutex_);
+    return globalFunctions_;
+}
+
+bool CalcService::admitSession(const std::string& sid) {
+    if (!admission_.limitsSessions()) {
+        return true;
+    }
+    return admission_.tryTakeToken(sessions_.getOrCreate(sid)->rate);
+}
+
+std::string CalcService::disassemble(const std::string& expression) {
+    return calculator_.disassemble(*cache_.getOrCompile(expression));
+}
+
+std::vector<CalcService::BatchResult> CalcService::calculateBatch(const std::vector<BatchItem>& items) {
+    std::vector<BatchResult> results(items.size());
+
+    // Item indices grouped by sid, groups in order of first appearance.
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<std::string, size_t> groupOf;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (!admitSession(items[i].sid)) {
+            results[i].error = "Rate limit exceeded for session: " + items[i].sid;
+            continue;
+        }
+        auto inserted = groupOf.emplace(items[i].sid, groups.size());
+        if (inserted.second) {
+            groups.emplace_back();
+        }
+        groups[inserted.first->second].push_back(i);
+    }
+
+    auto runGroup = [&](const std::vector<size_t>& group) {
+        for (size_t index : group) {
+            BatchResult& result = results[index];
+            try {
+                CalcError error;
+                result.ok = tryCalculate(items[index].sid, items[index].expression, result.value, error);
+                if (!result.ok) {
+                    result.error = error.message();
+                }
+            } catch (const std::exception& e) {
+                result.error = e.what();
+            }
+        }
+    };
+
+    if (groups.size() <= 1) {
+        if (!groups.empty()) runGroup(groups.front());
+        return results;
+    }
+
+    // The calling thread takes the first group itself instead of idling.
+    TaskGroup tasks(workers_);
+    for (size_t g = 1; g < groups.size(); ++g) {
+        tasks.run([&runGroup, &group = groups[g]]() { runGroup(group); });
+    }
+    runGroup(groups.front());
+    tasks.wait();
+    return results;
+}
+
+std::vector<double> CalcService::calculateColumns(const std::string& expression,
+                                                  const std::map<std::string, std::vector<double>>& columns,
+                                                  const std::map<std::string, double>& scalars) {
+    auto compiled = cache_.getOrCompile(expression);
+    if (compiled->statements.size() != 1) {
+        throw std::runtime_error("Vectorized evaluation expects exactly one statement");
+    }
+
+    size_t rows = columns.empty() ? 1 : columns.begin()->second.size();
+    ColumnEvaluator evaluator(calculator_, compiled->statements.front());
+    for (const auto& column : columns) {
+        if (column.second.size() != rows) {
+            throw std::runtime_error("Column length mismatch for variable: " + column.first);
+        }
+        evaluator.bindColumn(column.first, column.second.data());
+    }
+    for (const auto& scalar : scalars) {
+        evaluator.bindScalar(scalar.first, scalar.second);
+    }
+    return evaluator.evaluate(rows);
+}
+
+std::string CalcService::renderMetrics() {
+    std::ostringstream out;
+    metrics_.render(out);
+
+    auto cache = cache_.stats();
+    auto write = [&out](const char* name, const char* type, const char* help, uint64_t value) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+        out << name << " " << value << "\n";
+    };
+    auto sessions = sessions_.stats();
+    write("calc_sessions_active", "gauge", "Sessions currently held by the server.", sessions.sessions);
+    write("calc_session_bytes", "gauge", "Estimated memory held by sessions.", sessions.bytes);
+    out << "# HELP calc_session_evictions_total Sessions evicted by the session limits.\n";
+    out << "# TYPE calc_session_evictions_total counter\n";
+    out << "calc_session_evictions_total{reason=\"idle\"} " << sessions.evictedIdle << "\n";
+    out << "calc_session_evictions_total{reason=\"count\"} " << sessions.evictedCount << "\n";
+    out << "calc_session_evictions_total{reason=\"memory\"} " << sessions.evictedMemory << "\n";
+    const SymbolTable& symbols = calculator_.symbols();
+    write("calc_symbols", "gauge", "Distinct variable and function names interned by the calculator.", symbols.size());
+    write("calc_symbols_limit", "gauge", "Cap on interned names, 0 if unlimited.", symbols.limit());
+    write("calc_symbol_bytes", "gauge", "Estimated memory held by interned names.", symbols.estimateBytes());
+    write("calc_expression_cache_hits_total", "counter", "Expression cache lookups that found a compiled program.", cache.hits);
+    write("calc_expression_cache_misses_total", "counter", "Expression cache lookups that had to compile.", cache.misses);
+    write("calc_expression_cache_evictions_total", "counter", "Compiled programs evicted from the expression cache.", cache.evictions);
+    write("calc_expression_cache_entries", "gauge", "Compiled programs in the expression cache.", cache.size);
+    const uint64_t resultHits = resultHits_.load(std::memory_order_relaxed);
+    const uint64_t resultMisses = resultMisses_.load(std::memory_order_relaxed);
+    write("calc_result_cache_hits_total", "counter", "Read-only expressions answered from a session's memoized results.", resultHits);
+    write("calc_result_cache_misses_total", "counter", "Read-only expressions evaluated because no memoized result was valid.", resultMisses);
+    write("calc_result_cache_evictions_total", "counter", "Memoized results evicted by the per-session budget.", resultEvictions_.load(std::memory_order_relaxed));
+    out << "# HELP calc_result_cache_hit_ratio Share of read-only expressions answered from memoized results.\n";
+    out << "# TYPE calc_result_cache_hit_ratio gauge\n";
+    out << "calc_result_cache_hit_ratio "
+        << (resultHits + resultMisses > 0 ? static_cast<double>(resultHits) / (resultHits + resultMisses) : 0.0) << "\n";
+    auto admission = admission_.stats();
+    write("calc_admitted_requests_total", "counter", "Requests admitted by admission control.", admission.admitted);
+    out << "# HELP calc_shed_requests_total Requests rejected by admission control.\n";
+    out << "# TYPE calc_shed_requests_total counter\n";
+    out << "calc_shed_requests_total{reason=\"in_flight\"} " << admission.rejected[0] << "\n";
+    out << "calc_shed_requests_total{reason=\"adaptive\"} " << admission.rejected[1] << "\n";
+    out << "calc_shed_requests_total{reason=\"session_rate\"} " << admission.rejected[2] << "\n";
+    write("calc_in_flight_requests", "gauge", "Admitted requests not yet answered.", admission.inFlight);
+    write("calc_in_flight_limit", "gauge", "Current in-flight limit, 0 if unlimited.", admission.limit);
+    return out.str();
+}
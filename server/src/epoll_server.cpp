@@ -0,0 +1,645 @@
+#include "epoll_server.h"
+#include "http_api.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+// epoll_event::data.ptr of the two descriptors that are not connections.
+char kListenTag;
+char kWakeTag;
+
+constexpr size_t kReadChunk = 64 * 1024;
+// Stop reading from a connection with this much unsent output or this many
+// queued requests until the client or the workers catch up.
+constexpr size_t kMaxBufferedBytes = 4 * 1024 * 1024;
+constexpr size_t kMaxQueuedRequests = 1024;
+constexpr int kMaxEvents = 256;
+// How often idle connections are looked for, and how long accepting stays
+// paused at most after running out of descriptors.
+constexpr std::chrono::milliseconds kMinSweepInterval{10};
+constexpr std::chrono::milliseconds kMaxSweepInterval{1000};
+
+int openSpareFd() {
+    return ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+const char* const kContinue = "HTTP/1.1 100 Continue\r\n\r\n";
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+void appendResponse(std::string& out, int status, const char* contentType, const std::string& body, bool close) {
+    out += "HTTP/1.1 ";
+    out += std::to_string(status);
+    out += ' ';
+    out += statusText(status);
+    out += "\r\nContent-Type: ";
+    out += contentType;
+    out += "\r\nContent-Length: ";
+    out += std::to_string(body.size());
+    out += close ? "\r\nConnection: close\r\n\r\n" : "\r\n\r\n";
+    out += body;
+}
+
+bool headerIs(std::string_view name, const char* expected) {
+    return name.size() == std::strlen(expected) && strncasecmp(name.data(), expected, name.size()) == 0;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+} // namespace
+
+struct EpollServer::Request {
+    std::string method;
+    std::string target;
+    std::string body;
+    bool close = false;
+    int error = 0; // non-zero: answer with this status without running anything
+    bool interim = false; // only "100 Continue" for a request whose body is still to come
+};
+
+struct EpollServer::Connection {
+    int fd = -1;
+    std::string in;
+    Request pending;            // headers parsed, body still arriving
+    bool awaitingBody = false;
+    size_t headerEnd = 0;       // of `pending` in `in`
+    size_t bodyLength = 0;
+    std::vector<Request> ready; // parsed, not yet handed to a worker
+    std::string out;
+    size_t outOffset = 0;
+    bool inFlight = false;      // a worker is running this connection's requests
+    bool closing = false;       // no more input is accepted
+    bool eof = false;           // the peer shut down its side; stop polling for input
+    bool dead = false;          // close as soon as no worker refers to it
+    bool registered = true;     // still in the epoll set
+    uint32_t events = 0;
+    std::chrono::steady_clock::time_point lastActive; // of the last read, write or answer
+};
+
+struct EpollServer::IoThread {
+    int epollFd = -1;
+    int wakeFd = -1;
+    int spareFd = -1;           // given up to refuse connections when out of descriptors
+    bool acceptPaused = false;  // listen socket taken out of the epoll set
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::chrono::steady_clock::time_point now; // after the last epoll_wait
+    std::chrono::steady_clock::time_point nextSweep;
+
+    // Finished worker tasks, handed back to the owning I/O thread.
+    struct Completion {
+        Connection* conn;
+        std::string out;
+    };
+    std::mutex mutex;
+    std::vector<Completion> completions;
+
+    ~IoThread() {
+        for (auto& entry : connections) ::close(entry.first);
+        if (spareFd >= 0) ::close(spareFd);
+        if (wakeFd >= 0) ::close(wakeFd);
+        if (epollFd >= 0) ::close(epollFd);
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+};
+
+EpollServer::EpollServer(CalcService& service) : EpollServer(service, Options()) {
+}
+
+EpollServer::EpollServer(CalcService& service, const Options& options)
+    : service_(service), options_(options) {
+    size_t count = std::max<size_t>(options_.ioThreads, 1);
+    for (size_t i = 0; i < count; ++i) {
+        auto io = std::make_unique<IoThread>();
+        io->epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        io->wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        io->spareFd = openSpareFd();
+        if (io->epollFd < 0 || io->wakeFd < 0 || io->spareFd < 0) {
+            throw std::runtime_error(std::string("epoll setup failed: ") + std::strerror(errno));
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &kWakeTag;
+        ::epoll_ctl(io->epollFd, EPOLL_CTL_ADD, io->wakeFd, &ev);
+        io_.push_back(std::move(io));
+    }
+}
+
+EpollServer::~EpollServer() {
+    stop();
+    if (listenFd_ >= 0) {
+        ::close(listenFd_);
+    }
+}
+
+int EpollServer::bind(const std::string& host, int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+    }
+    int yes = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    std::string address = host == "localhost" ? "127.0.0.1" : host;
+    if (::inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        ::close(fd);
+        throw std::runtime_error("Invalid listen address: " + host);
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Cannot listen on " + host + ":" + std::to_string(port) + ": " + error);
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    listenFd_ = fd;
+
+    // Every I/O thread accepts for itself; EPOLLEXCLUSIVE wakes only one
+    // of them per incoming connection.
+    for (auto& io : io_) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &kListenTag;
+        ::epoll_ctl(io->epollFd, EPOLL_CTL_ADD, listenFd_, &ev);
+    }
+    return ntohs(addr.sin_port);
+}
+
+void EpollServer::listen() {
+    workers_ = std::make_unique<ThreadPool>(std::max<size_t>(options_.workerThreads, 1));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < io_.size(); ++i) {
+        threads.emplace_back([this, i]() { runLoop(*io_[i]); });
+    }
+    runLoop(*io_[0]);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Let running tasks finish (their completions are dropped), then
+    // close every connection.
+    workers_.reset();
+    for (auto& io : io_) {
+        for (auto& entry : io->connections) ::close(entry.first);
+        connections_.fetch_sub(io->connections.size(), std::memory_order_relaxed);
+        io->connections.clear();
+    }
+}
+
+void EpollServer::stop() {
+    stopping_ = true;
+    for (auto& io : io_) {
+        io->wake();
+    }
+}
+
+void EpollServer::runLoop(IoThread& io) {
+    epoll_event events[kMaxEvents];
+    const bool sweeping = options_.idleTimeout.count() > 0;
+    const std::chrono::milliseconds sweepInterval =
+        sweeping ? std::clamp(options_.idleTimeout / 2, kMinSweepInterval, kMaxSweepInterval) : kMaxSweepInterval;
+    io.nextSweep = std::chrono::steady_clock::now() + sweepInterval;
+    while (!stopping_) {
+        const bool timed = sweeping || io.acceptPaused;
+        int n = ::epoll_wait(io.epollFd, events, kMaxEvents, timed ? static_cast<int>(sweepInterval.count()) : -1);
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        io.now = std::chrono::steady_clock::now();
+        bool woken = false;
+        for (int i = 0; i < n && !stopping_; ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == &kListenTag) {
+                acceptAll(io);
+            } else if (tag == &kWakeTag) {
+                uint64_t count;
+                ssize_t ignored = ::read(io.wakeFd, &count, sizeof(count));
+                (void)ignored;
+                woken = true;
+            } else {
+                Connection& conn = *static_cast<Connection*>(tag);
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    conn.dead = true; // both directions are gone; nothing more can be sent
+                } else if (events[i].events & EPOLLIN) {
+                    onReadable(io, conn);
+                }
+                if (!conn.dead && (events[i].events & EPOLLOUT)) {
+                    flush(io, conn);
+                }
+                if (conn.dead) {
+                    retire(io, conn);
+                }
+            }
+        }
+        // After the batch: completions may close connections that still
+        // have events further down in `events`.
+        if (woken) {
+            onCompletions(io);
+        }
+        // Last, as it closes connections `events` may point to.
+        if ((sweeping || io.acceptPaused) && io.now >= io.nextSweep) {
+            if (sweeping) closeIdle(io);
+            if (io.acceptPaused) resumeAccepting(io);
+            io.nextSweep = io.now + sweepInterval;
+        }
+    }
+}
+
+void EpollServer::acceptAll(IoThread& io) {
+    while (true) {
+        int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            int error = errno;
+            if (error == EINTR || error == ECONNABORTED) {
+                continue;
+            }
+            // Out of descriptors, the connection stays queued and the
+            // (level-triggered) listen socket readable, which would wake
+            // this loop forever. The spare descriptor makes room to take
+            // the connection off the queue and refuse it.
+            if ((error == EMFILE || error == ENFILE) && io.spareFd >= 0) {
+                ::close(io.spareFd);
+                fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+                error = errno;
+                if (fd >= 0) ::close(fd);
+                io.spareFd = openSpareFd();
+                if (fd >= 0) {
+                    refused_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+            }
+            if (error != EAGAIN && error != EWOULDBLOCK) {
+                pauseAccepting(io);
+            }
+            return;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        conn->lastActive = io.now;
+        epoll_event ev{};
+        ev.events = conn->events;
+        ev.data.ptr = conn.get();
+        if (::epoll_ctl(io.epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            ::close(fd);
+            continue;
+        }
+        io.connections.emplace(fd, std::move(conn));
+        connections_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void EpollServer::pauseAccepting(IoThread& io) {
+    // EPOLLEXCLUSIVE registrations cannot be modified, only removed.
+    ::epoll_ctl(io.epollFd, EPOLL_CTL_DEL, listenFd_, nullptr);
+    io.acceptPaused = true;
+}
+
+void EpollServer::resumeAccepting(IoThread& io) {
+    if (io.spareFd < 0) {
+        io.spareFd = openSpareFd();
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = &kListenTag;
+    ::epoll_ctl(io.epollFd, EPOLL_CTL_ADD, listenFd_, &ev);
+    io.acceptPaused = false;
+}
+
+void EpollServer::closeIdle(IoThread& io) {
+    // Connections a worker is answering are busy, however long that takes.
+    const auto deadline = io.now - options_.idleTimeout;
+    std::vector<Connection*> idle;
+    for (auto& entry : io.connections) {
+        const Connection& conn = *entry.second;
+        if (!conn.inFlight && conn.lastActive <= deadline) {
+            idle.push_back(entry.second.get());
+        }
+    }
+    for (Connection* conn : idle) {
+        closeConnection(io, *conn);
+    }
+    idleClosed_.fetch_add(idle.size(), std::memory_order_relaxed);
+}
+
+void EpollServer::onReadable(IoThread& io, Connection& conn) {
+    // Level-triggered: one bounded read per wakeup keeps a busy
+    // connection from starving the others.
+    char buffer[kReadChunk];
+    ssize_t n = ::recv(conn.fd, buffer, sizeof(buffer), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n < 0) {
+        conn.dead = true; // reset; nothing more can be sent
+        return;
+    }
+    conn.lastActive = io.now;
+    if (n == 0) {
+        // Half-close: the client may still be waiting for the answers to
+        // what it sent. A request cut off mid-way is dropped; the rest is
+        // answered and flush() closes the connection afterwards.
+        conn.eof = true;
+        conn.closing = true;
+        conn.awaitingBody = false;
+        conn.in.clear();
+        conn.ready.erase(std::remove_if(conn.ready.begin(), conn.ready.end(),
+                                        [](const Request& request) { return request.interim; }),
+                         conn.ready.end());
+        dispatch(io, conn);
+        flush(io, conn);
+        return;
+    }
+    if (conn.closing) {
+        return; // input after a "Connection: close" request is ignored
+    }
+    conn.in.append(buffer, static_cast<size_t>(n));
+    parseRequests(conn);
+    dispatch(io, conn);
+    flush(io, conn); // e.g. "100 Continue"
+}
+
+void EpollServer::parseRequests(Connection& conn) {
+    while (!conn.closing) {
+        if (!conn.awaitingBody) {
+            size_t end = conn.in.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                if (conn.in.size() > kMaxHeaderBytes) {
+                    conn.ready.push_back({"", "", "", true, 431});
+                    conn.closing = true;
+                }
+                return;
+            }
+            conn.headerEnd = end + 4;
+            conn.bodyLength = 0;
+            conn.pending = Request();
+            Request& request = conn.pending;
+
+            // Request line and the few headers that matter here.
+            std::string_view head(conn.in.data(), end);
+            size_t lineEnd = std::min(head.find("\r\n"), head.size());
+            std::string_view line = head.substr(0, lineEnd);
+            size_t sp1 = line.find(' ');
+            size_t sp2 = line.rfind(' ');
+            if (sp1 == std::string_view::npos || sp2 == sp1) {
+                request.error = 400;
+            } else {
+                request.method.assign(line.substr(0, sp1));
+                request.target.assign(line.substr(sp1 + 1, sp2 - sp1 - 1));
+                request.close = line.substr(sp2 + 1) == "HTTP/1.0";
+            }
+            bool expectContinue = false;
+            for (size_t pos = lineEnd + 2; pos < head.size();) {
+                size_t next = std::min(head.find("\r\n", pos), head.size());
+                std::string_view header = head.substr(pos, next - pos);
+                pos = next + 2;
+                size_t colon = header.find(':');
+                if (colon == std::string_view::npos) continue;
+                std::string_view name = header.substr(0, colon);
+                std::string_view value = trim(header.substr(colon + 1));
+                if (headerIs(name, "content-length")) {
+                    conn.bodyLength = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                } else if (headerIs(name, "connection")) {
+                    if (headerIs(value, "close")) request.close = true;
+                    if (headerIs(value, "keep-alive")) request.close = false;
+                } else if (headerIs(name, "transfer-encoding")) {
+                    request.error = 501;
+                } else if (headerIs(name, "expect")) {
+                    expectContinue = headerIs(value, "100-continue");
+                }
+            }
+            if (conn.bodyLength > kMaxBodyBytes) {
+                request.error = 413;
+            }
+            if (request.error != 0) {
+                // The rest of the stream cannot be framed; answer and close.
+                request.close = true;
+                conn.ready.push_back(std::move(request));
+                conn.closing = true;
+                return;
+            }
+            conn.awaitingBody = true;
+            if (expectContinue && conn.in.size() < conn.headerEnd + conn.bodyLength) {
+                // Interim responses must not overtake the answers to
+                // earlier requests, so those queue it behind them.
+                if (conn.ready.empty() && !conn.inFlight) {
+                    conn.out += kContinue;
+                } else {
+                    Request interim;
+                    interim.interim = true;
+                    conn.ready.push_back(std::move(interim));
+                }
+            }
+        }
+
+        if (conn.in.size() < conn.headerEnd + conn.bodyLength) {
+            return;
+        }
+        conn.pending.body.assign(conn.in, conn.headerEnd, conn.bodyLength);
+        conn.in.erase(0, conn.headerEnd + conn.bodyLength);
+        conn.awaitingBody = false;
+        conn.closing = conn.pending.close;
+        conn.ready.push_back(std::move(conn.pending));
+    }
+}
+
+void EpollServer::dispatch(IoThread& io, Connection& conn) {
+    if (conn.inFlight || conn.ready.empty() || conn.dead) {
+        return;
+    }
+
+    // Admission happens here, before the batch can queue for a worker:
+    // its /calculate requests are admitted or shed together. A shed batch
+    // is answered right away (the other requests in it are cheap).
+    auto isCalculate = [](const Request& request) {
+        return request.error == 0 && request.method == "POST" && request.target == "/calculate";
+    };
+    const size_t weight = static_cast<size_t>(std::count_if(conn.ready.begin(), conn.ready.end(), isCalculate));
+    AdmissionControl::Permit permit;
+    if (weight > 0) {
+        permit = service_.admission().tryAcquire(weight);
+        if (!permit) {
+            for (const Request& request : conn.ready) {
+                if (isCalculate(request)) {
+                    appendResponse(conn.out, 503, "application/json", kOverloadedBody, request.close);
+                    service_.metrics().recordRequest(Metrics::Endpoint::CALCULATE, Metrics::Outcome::SHED);
+                } else {
+                    conn.out += respond(request);
+                }
+            }
+            conn.ready.clear();
+            return;
+        }
+    }
+
+    conn.inFlight = true;
+    struct Batch {
+        std::vector<Request> requests;
+        AdmissionControl::Permit permit;
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->requests = std::move(conn.ready);
+    batch->permit = std::move(permit);
+    conn.ready.clear();
+    Connection* target = &conn;
+    workers_->submit([this, &io, target, batch]() {
+        std::string out;
+        for (const Request& request : batch->requests) {
+            out += respond(request);
+        }
+        batch->permit.release(); // latency includes the wait for a worker
+        {
+            std::lock_guard<std::mutex> lock(io.mutex);
+            io.completions.push_back({target, std::move(out)});
+        }
+        io.wake();
+    });
+}
+
+std::string EpollServer::respond(const Request& request) {
+    std::string out;
+    if (request.interim) {
+        out = kContinue;
+    } else if (request.error != 0) {
+        appendResponse(out, request.error, "application/json",
+                       std::string("{\"err\":\"") + statusText(request.error) + "\"}", true);
+    } else if (request.method == "POST" && request.target == "/calculate") {
+        thread_local std::string body; // reused: keeps its capacity between requests
+        int status = handleCalculate(service_, request.body, body);
+        appendResponse(out, status, "application/json", body, request.close);
+    } else if (request.method == "GET" && request.target == "/metrics") {
+        appendResponse(out, 200, "text/plain; version=0.0.4", service_.renderMetrics(), request.close);
+    } else {
+        appendResponse(out, 404, "application/json", "{\"err\":\"Not Found\"}", request.close);
+    }
+    return out;
+}
+
+void EpollServer::onCompletions(IoThread& io) {
+    std::vector<IoThread::Completion> done;
+    {
+        std::lock_guard<std::mutex> lock(io.mutex);
+        done.swap(io.completions);
+    }
+    for (auto& completion : done) {
+        Connection& conn = *completion.conn;
+        conn.inFlight = false;
+        if (conn.dead) {
+            closeConnection(io, conn);
+            continue;
+        }
+        conn.lastActive = io.now;
+        conn.out += completion.out;
+        // Requests that arrived meanwhile go out as the next batch.
+        dispatch(io, conn);
+        flush(io, conn);
+        if (conn.dead) {
+            retire(io, conn);
+        }
+    }
+}
+
+void EpollServer::flush(IoThread& io, Connection& conn) {
+    while (conn.outOffset < conn.out.size()) {
+        ssize_t n = ::send(conn.fd, conn.out.data() + conn.outOffset, conn.out.size() - conn.outOffset, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            conn.dead = true;
+            return;
+        }
+        conn.outOffset += static_cast<size_t>(n);
+        conn.lastActive = io.now;
+    }
+    if (conn.outOffset == conn.out.size()) {
+        conn.out.clear();
+        conn.outOffset = 0;
+        // Everything up to the "Connection: close" request is answered.
+        if (conn.closing && !conn.inFlight && conn.ready.empty()) {
+            conn.dead = true;
+            return;
+        }
+    }
+    updateInterest(io, conn);
+}
+
+void EpollServer::updateInterest(IoThread& io, Connection& conn) {
+    uint32_t events = 0;
+    if (!conn.eof && conn.out.size() < kMaxBufferedBytes && conn.ready.size() < kMaxQueuedRequests) {
+        events |= EPOLLIN;
+    }
+    if (!conn.out.empty()) {
+        events |= EPOLLOUT;
+    }
+    if (conn.registered && events != conn.events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = &conn;
+        ::epoll_ctl(io.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+        conn.events = events;
+    }
+}
+
+void EpollServer::retire(IoThread& io, Connection& conn) {
+    if (!conn.inFlight) {
+        closeConnection(io, conn);
+    } else if (conn.registered) {
+        // A worker still refers to it: stop polling (a hung-up socket would
+        // report readable forever) and close when the task comes back.
+        ::epoll_ctl(io.epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        conn.registered = false;
+    }
+}
+
+void EpollServer::closeConnection(IoThread& io, Connection& conn) {
+    int fd = conn.fd;
+    if (conn.registered) {
+        ::epoll_ctl(io.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    ::close(fd);
+    io.connections.erase(fd); // destroys conn
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+    if (io.acceptPaused) {
+        resumeAccepting(io); // a descriptor is free again
+    }
+}
@@ -0,0 +1,447 @@
+#include "http_api.h"
+#include "json_codec.h"
+#include "ndjson_stream.h"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+const char* const kOverloadedBody = "{\"err\":\"Server overloaded\"}";
+
+namespace {
+
+// Takes an in-flight slot for the request, or answers 503 and returns an
+// empty permit.
+AdmissionControl::Permit admit(CalcService& service, Metrics::Endpoint endpoint, httplib::Response& res) {
+    AdmissionControl::Permit permit = service.admission().tryAcquire();
+    if (!permit) {
+        res.status = 503;
+        res.set_content(kOverloadedBody, "application/json");
+        service.metrics().recordRequest(endpoint, Metrics::Outcome::SHED);
+    }
+    return permit;
+}
+
+// Serializes the response and records the request's outcome and duration.
+std::string finishRequest(Metrics& metrics, Metrics::Endpoint endpoint, Metrics::Outcome outcome,
+                          Metrics::Clock::time_point start, const json& response_json) {
+    std::string body = metrics.time(Metrics::Stage::SERIALIZE, [&] { return response_json.dump(); });
+    metrics.recordRequest(endpoint, outcome);
+    metrics.recordStage(Metrics::Stage::REQUEST, Metrics::Clock::now() - start);
+    return body;
+}
+
+// What POST /calculate answers, written without building a json tree.
+struct Reply {
+    enum class Kind { EMPTY, NUMBER, TEXT, BINDINGS, FUNCTIONS, ERROR };
+    Kind kind = Kind::EMPTY; // {}
+    double number = 0.0;
+    std::string text;
+    std::vector<CalcService::BindingInfo> bindings;
+    std::vector<CalcService::FunctionInfo> functions;
+
+    void setNumber(double value) { kind = Kind::NUMBER; number = value; }
+    void setText(std::string value) { kind = Kind::TEXT; text = std::move(value); }
+    void setError(std::string message) { kind = Kind::ERROR; text = std::move(message); }
+
+    void encode(std::string& out) const {
+        switch (kind) {
+            case Kind::EMPTY:
+                out += "{}";
+                break;
+            case Kind::NUMBER:
+                out += "{\"res\":";
+                appendJsonNumber(out, number);
+                out += '}';
+                break;
+            case Kind::TEXT:
+            case Kind::ERROR:
+                out += kind == Kind::TEXT ? "{\"res\":" : "{\"err\":";
+                appendJsonString(out, text);
+                out += '}';
+                break;
+            case Kind::BINDINGS: {
+                // Sorted by name, like nlohmann's object keys.
+                std::vector<const CalcService::BindingInfo*> sorted;
+                for (const auto& binding : bindings) sorted.push_back(&binding);
+                std::sort(sorted.begin(), sorted.end(),
+                          [](const auto* a, const auto* b) { return a->name < b->name; });
+                out += "{\"res\":{";
+                for (size_t i = 0; i < sorted.size(); ++i) {
+                    if (i > 0) out += ',';
+                    appendJsonString(out, sorted[i]->name);
+                    if (!sorted[i]->error.empty()) {
+                        out += ":{\"err\":";
+                        appendJsonString(out, sorted[i]->error);
+                        out += ",\"exp\":";
+                    } else {
+                        out += ":{\"exp\":";
+                    }
+                    appendJsonString(out, sorted[i]->formula);
+                    out += '}';
+                }
+                out += "}}";
+                break;
+            }
+            case Kind::FUNCTIONS: {
+                std::vector<const CalcService::FunctionInfo*> sorted;
+                for (const auto& function : functions) sorted.push_back(&function);
+                std::sort(sorted.begin(), sorted.end(),
+                          [](const auto* a, const auto* b) { return a->name < b->name; });
+                out += "{\"res\":{";
+                for (size_t i = 0; i < sorted.size(); ++i) {
+                    if (i > 0) out += ',';
+                    appendJsonString(out, sorted[i]->name);
+                    out += ":{\"exp\":";
+                    appendJsonString(out, sorted[i]->definition);
+                    out += sorted[i]->global ? ",\"scope\":\"global\"}" : ",\"scope\":\"session\"}";
+                }
+                out += "}}";
+                break;
+            }
+        }
+    }
+};
+
+// The generic path: same members, with the type rules the handler always
+// had. A non-string "sid" is ignored; a non-string "cmd", or "exp" of an
+// expression request, is a json::type_error; commands report a missing
+// or non-string "exp"/"var" themselves.
+CalculateRequest requestFromJson(const json& request_json) {
+    CalculateRequest request;
+    auto stringMember = [&](const char* name) -> std::optional<std::string_view> {
+        auto it = request_json.find(name);
+        if (it == request_json.end() || !it->is_string()) return std::nullopt;
+        return std::string_view(it->get_ref<const std::string&>());
+    };
+    auto requiredString = [&](const char* name) {
+        const json& value = request_json[name];
+        if (!value.is_string()) {
+            value.get<std::string>(); // throws the usual type_error
+        }
+        return std::string_view(value.get_ref<const std::string&>());
+    };
+    if (request_json.contains("cmd")) {
+        request.cmd = requiredString("cmd");
+    } else if (request_json.contains("exp")) {
+        request.exp = requiredString("exp");
+    }
+    request.sid = stringMember("sid");
+    if (!request.exp) request.exp = stringMember("exp");
+    request.var = stringMember("var");
+    request.scope = stringMember("scope");
+    return request;
+}
+
+} // namespace
+
+int handleCalculate(CalcService& service, const std::string& body, std::string& response) {
+    int status = 200;
+    Metrics& metrics = service.metrics();
+    const auto start = Metrics::Clock::now();
+    Metrics::Outcome outcome = Metrics::Outcome::OK;
+    Reply reply;
+
+    try {
+        // The common {"sid", "exp"} bodies are decoded in one pass; anything
+        // else goes through nlohmann::json, which owns the strings then.
+        CalculateRequest request;
+        json request_json;
+        metrics.time(Metrics::Stage::JSON_PARSE, [&] {
+            if (!decodeCalculateRequest(body, request)) {
+                request_json = json::parse(body);
+                request = requestFromJson(request_json);
+            }
+            return true;
+        });
+
+        // --- SID handling ---
+        const std::string sid(request.sid.value_or(CalcService::kDefaultSid));
+
+        // --- RATE LIMIT ---
+        if (!service.admitSession(sid)) {
+            status = 429;
+            outcome = Metrics::Outcome::SHED;
+            reply.setError("Rate limit exceeded for session: " + sid);
+        }
+        // --- COMMANDS ---
+        else if (request.cmd) {
+            const std::string_view cmd = *request.cmd;
+
+            if (cmd == "echo") {
+                reply.setText("echo");
+            }
+            else if (cmd == "clean") {
+                service.clean(sid);
+            }
+            else if (cmd == "dump") {
+                // Optimized bytecode of "exp", for checking what the optimizer did
+                if (!request.exp) {
+                    throw std::runtime_error("Command dump expects 'exp'");
+                }
+                reply.setText(service.disassemble(std::string(*request.exp)));
+            }
+            else if (cmd == "bind") {
+                // "exp" is "target = expression"; the target then follows its inputs
+                if (!request.exp) {
+                    throw std::runtime_error("Command bind expects 'exp'");
+                }
+                if (auto value = service.bind(sid, std::string(*request.exp))) {
+                    reply.setNumber(*value);
+                }
+            }
+            else if (cmd == "unbind") {
+                if (!request.var) {
+                    throw std::runtime_error("Command unbind expects 'var'");
+                }
+                std::string name(*request.var);
+                if (!service.unbind(sid, name)) {
+                    throw std::runtime_error("Variable is not bound: " + name);
+                }
+            }
+            else if (cmd == "bindings") {
+                reply.kind = Reply::Kind::BINDINGS;
+                reply.bindings = service.bindings(sid);
+            }
+            else if (cmd == "def" || cmd == "undef") {
+                // "scope": "global" shares the function with every session
+                const std::string_view scope = request.scope.value_or("session");
+                if (scope != "session" && scope != "global") {
+                    throw std::runtime_error("Unknown scope: " + std::string(scope));
+                }
+                const bool global = scope == "global";
+                if (cmd == "def") {
+                    // "exp" is "name(a, b) = expression"
+                    if (!request.exp) {
+                        throw std::runtime_error("Command def expects 'exp'");
+                    }
+                    service.defineFunction(sid, std::string(*request.exp), global);
+                } else {
+                    if (!request.var) {
+                        throw std::runtime_error("Command undef expects 'var'");
+                    }
+                    std::string name(*request.var);
+                    if (!service.undefineFunction(sid, name, global)) {
+                        throw std::runtime_error("Function is not defined: " + name);
+                    }
+                }
+            }
+            else if (cmd == "functions") {
+                reply.kind = Reply::Kind::FUNCTIONS;
+                reply.functions = service.functions(sid);
+            }
+            else {
+                throw std::runtime_error("Unknown command: " + std::string(cmd));
+            }
+        }
+        // --- EXPRESSIONS ---
+        else if (request.exp) {
+            // Invalid expressions are routine here, so they skip the throw.
+            const std::string expression(*request.exp);
+            double value = 0.0;
+            CalcError error;
+            if (service.tryCalculate(sid, expression, value, error)) {
+                reply.setNumber(value);
+            } else {
+                status = 400;
+                outcome = Metrics::Outcome::ERROR;
+                reply.setError(error.message());
+            }
+        }
+        else {
+            throw std::runtime_error("Invalid JSON: expected 'exp' or 'cmd'");
+        }
+    }
+    catch (const json::exception& e) {
+        status = 400;
+        outcome = Metrics::Outcome::BAD_REQUEST;
+        reply.setError(e.what());
+    }
+    catch (const std::exception& e) {
+        status = 400;
+        outcome = Metrics::Outcome::ERROR;
+        reply.setError(e.what());
+    }
+
+    metrics.time(Metrics::Stage::SERIALIZE, [&] {
+        response.clear();
+        reply.encode(response);
+        return true;
+    });
+    metrics.recordRequest(Metrics::Endpoint::CALCULATE, outcome);
+    metrics.recordStage(Metrics::Stage::REQUEST, Metrics::Clock::now() - start);
+    return status;
+}
+
+void registerHttpApi(httplib::Server& svr, CalcService& service) {
+    svr.Post("/calculate", [&service](const httplib::Request& req, httplib::Response& res) {
+        auto permit = admit(service, Metrics::Endpoint::CALCULATE, res);
+        if (!permit) return;
+        std::string response;
+        res.status = handleCalculate(service, req.body, response);
+        res.set_content(response, "application/json");
+    });
+
+    svr.Post("/calculate/batch", [&service](const httplib::Request& req, httplib::Response& res) {
+        auto permit = admit(service, Metrics::Endpoint::BATCH, res);
+        if (!permit) return;
+        Metrics& metrics = service.metrics();
+        const auto start = Metrics::Clock::now();
+        Metrics::Outcome outcome = Metrics::Outcome::OK;
+        json response_json;
+
+        try {
+            json request_json = metrics.time(Metrics::Stage::JSON_PARSE, [&] { return json::parse(req.body); });
+            if (!request_json.is_array()) {
+                throw std::runtime_error("Invalid JSON: expected an array of {sid, exp} items");
+            }
+
+            // Malformed items get their error directly; the rest are evaluated.
+            std::vector<CalcService::BatchItem> items;
+            std::vector<size_t> positions;
+            response_json = json::array();
+            for (const auto& item : request_json) {
+                response_json.push_back(json::object());
+                if (!item.is_object() || !item.contains("exp") || !item["exp"].is_string()) {
+                    response_json.back()["err"] = "Invalid JSON: expected 'exp'";
+                    continue;
+                }
+                std::string sid = CalcService::kDefaultSid;
+                if (item.contains("sid") && item["sid"].is_string()) {
+                    sid = item["sid"];
+                }
+                items.push_back({sid, item["exp"]});
+                positions.push_back(response_json.size() - 1);
+            }
+
+            auto results = service.calculateBatch(items);
+            for (size_t i = 0; i < results.size(); ++i) {
+                json& out = response_json[positions[i]];
+                if (results[i].ok) {
+                    out["res"] = results[i].value;
+                } else {
+                    out["err"] = results[i].error;
+                }
+            }
+
+            res.status = 200;
+        }
+        catch (const json::exception& e) {
+            res.status = 400;
+            outcome = Metrics::Outcome::BAD_REQUEST;
+            response_json = json::object();
+            response_json["err"] = e.what();
+        }
+        catch (const std::exception& e) {
+            res.status = 400;
+            outcome = Metrics::Outcome::ERROR;
+            response_json = json::object();
+            response_json["err"] = e.what();
+        }
+
+        res.set_content(finishRequest(metrics, Metrics::Endpoint::BATCH, outcome, start, response_json),
+                        "application/json");
+    });
+
+    svr.Post("/calculate/vector", [&service](const httplib::Request& req, httplib::Response& res) {
+        auto permit = admit(service, Metrics::Endpoint::VECTOR, res);
+        if (!permit) return;
+        Metrics& metrics = service.metrics();
+        const auto start = Metrics::Clock::now();
+        Metrics::Outcome outcome = Metrics::Outcome::OK;
+        json response_json;
+
+        try {
+            json request_json = metrics.time(Metrics::Stage::JSON_PARSE, [&] { return json::parse(req.body); });
+            if (!request_json.contains("exp") || !request_json["exp"].is_string()) {
+                throw std::runtime_error("Invalid JSON: expected 'exp'");
+            }
+
+            std::map<std::string, std::vector<double>> columns;
+            std::map<std::string, double> scalars;
+            if (request_json.contains("vars")) {
+                for (const auto& var : request_json["vars"].items()) {
+                    if (var.value().is_array()) {
+                        columns[var.key()] = var.value().get<std::vector<double>>();
+                    } else if (var.value().is_number()) {
+                        scalars[var.key()] = var.value().get<double>();
+                    } else {
+                        throw std::runtime_error("Invalid value for variable: " + var.key());
+                    }
+                }
+            }
+
+            response_json["res"] = service.calculateColumns(request_json["exp"], columns, scalars);
+            res.status = 200;
+        }
+        catch (const json::exception& e) {
+            res.status = 400;
+            outcome = Metrics::Outcome::BAD_REQUEST;
+            response_json = json::object();
+            response_json["err"] = e.what();
+        }
+        catch (const std::exception& e) {
+            res.status = 400;
+            outcome = Metrics::Outcome::ERROR;
+            response_json = json::object();
+            response_json["err"] = e.what();
+        }
+
+        res.set_content(finishRequest(metrics, Metrics::Endpoint::VECTOR, outcome, start, response_json),
+                        "application/json");
+    });
+
+    // NDJSON in, NDJSON out. Records are evaluated while the body is still
+    // arriving. httplib only starts the response once the handler returns,
+    // so results are spooled (to a temporary file past 1 MB) and then
+    // streamed back as a chunked response. The stream holds one in-flight
+    // slot for its whole duration; the session rate applies per record.
+    svr.Post("/calculate/stream", [&service](const httplib::Request&, httplib::Response& res,
+                                             const httplib::ContentReader& content_reader) {
+        auto permit = admit(service, Metrics::Endpoint::STREAM, res);
+        if (!permit) {
+            content_reader([](const char*, size_t) { return true; }); // drain the body unevaluated
+            return;
+        }
+        Metrics& metrics = service.metrics();
+        const auto start = Metrics::Clock::now();
+        auto spool = std::make_shared<ResultSpool>();
+
+        try {
+            NdjsonStream stream(service, *spool);
+            content_reader([&stream](const char* data, size_t size) {
+                stream.feed(data, size);
+                return true;
+            });
+            stream.finish();
+        }
+        catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(finishRequest(metrics, Metrics::Endpoint::STREAM, Metrics::Outcome::BAD_REQUEST, start,
+                                          json{{"err", e.what()}}),
+                            "application/json");
+            return;
+        }
+
+        res.status = 200;
+        res.set_chunked_content_provider("application/x-ndjson", [spool](size_t, httplib::DataSink& sink) {
+            char buffer[16 * 1024];
+            size_t n = spool->read(buffer, sizeof(buffer));
+            if (n == 0) {
+                sink.done();
+                return true;
+            }
+            return sink.write(buffer, n);
+        });
+        metrics.recordRequest(Metrics::Endpoint::STREAM, Metrics::Outcome::OK);
+        metrics.recordStage(Metrics::Stage::REQUEST, Metrics::Clock::now() - start);
+    });
+
+    svr.Get("/metrics", [&service](const httplib::Request&, httplib::Response& res) {
+        res.set_content(service.renderMetrics(), "text/plain; version=0.0.4");
+    });
+}
@@ -0,0 +1,228 @@
+#include "json_codec.h"
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void skipSpace(std::string_view text, size_t& i) {
+    while (i < text.size() && isSpace(text[i])) ++i;
+}
+
+// Reads a string starting at the opening quote. Plain strings become views
+// into the text; escaped ones are decoded into `scratch`.
+bool readString(std::string_view text, size_t& i, std::string_view& value, std::string& scratch) {
+    if (i >= text.size() || text[i] != '"') return false;
+    const size_t begin = ++i;
+    while (i < text.size() && text[i] != '"' && text[i] != '\\') {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c < 0x20 || c >= 0x80) return false; // control characters are invalid; UTF-8 is left to nlohmann
+        ++i;
+    }
+    if (i >= text.size()) return false;
+    if (text[i] == '"') {
+        value = text.substr(begin, i - begin);
+        ++i;
+        return true;
+    }
+
+    scratch.assign(text.data() + begin, i - begin);
+    while (i < text.size() && text[i] != '"') {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c < 0x20 || c >= 0x80) return false;
+        if (c != '\\') {
+            scratch += static_cast<char>(c);
+            ++i;
+            continue;
+        }
+        if (++i >= text.size()) return false;
+        switch (text[i++]) {
+            case '"': scratch += '"'; break;
+            case '\\': scratch += '\\'; break;
+            case '/': scratch += '/'; break;
+            case 'b': scratch += '\b'; break;
+            case 'f': scratch += '\f'; break;
+            case 'n': scratch += '\n'; break;
+            case 'r': scratch += '\r'; break;
+            case 't': scratch += '\t'; break;
+            default: return false; // \u, or invalid
+        }
+    }
+    if (i >= text.size()) return false;
+    ++i;
+    value = scratch;
+    return true;
+}
+
+// Length of the valid UTF-8 sequence starting at text[i], or 0.
+size_t utf8Length(std::string_view text, size_t i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    size_t length;
+    uint32_t min;
+    if (c >= 0xC2 && c <= 0xDF) { length = 2; min = 0x80; }
+    else if (c >= 0xE0 && c <= 0xEF) { length = 3; min = 0x800; }
+    else if (c >= 0xF0 && c <= 0xF4) { length = 4; min = 0x10000; }
+    else return 0;
+    if (i + length > text.size()) return 0;
+    uint32_t code = c & (0x7F >> length);
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char next = static_cast<unsigned char>(text[i + k]);
+        if ((next & 0xC0) != 0x80) return 0;
+        code = (code << 6) | (next & 0x3F);
+    }
+    if (code < min || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) return 0;
+    return length;
+}
+
+} // namespace
+
+bool decodeCalculateRequest(std::string_view body, CalculateRequest& request) {
+    request.sid.reset();
+    request.exp.reset();
+    request.cmd.reset();
+    request.var.reset();
+    request.scope.reset();
+
+    size_t i = 0;
+    skipSpace(body, i);
+    if (i >= body.size() || body[i] != '{') return false;
+    ++i;
+    skipSpace(body, i);
+    while (i < body.size() && body[i] != '}') {
+        std::string_view key;
+        std::string keyScratch;
+        if (!readString(body, i, key, keyScratch)) return false;
+        std::optional<std::string_view>* member;
+        std::string* scratch;
+        if (key == "sid") { member = &request.sid; scratch = &request.unescaped[0]; }
+        else if (key == "exp") { member = &request.exp; scratch = &request.unescaped[1]; }
+        else if (key == "cmd") { member = &request.cmd; scratch = &request.unescaped[2]; }
+        else if (key == "var") { member = &request.var; scratch = &request.unescaped[3]; }
+        else if (key == "scope") { member = &request.scope; scratch = &request.unescaped[4]; }
+        else return false;
+        if (member->has_value()) return false; // duplicates: leave "last one wins" to nlohmann
+
+        skipSpace(body, i);
+        if (i >= body.size() || body[i] != ':') return false;
+        ++i;
+        skipSpace(body, i);
+        std::string_view value;
+        if (!readString(body, i, value, *scratch)) return false;
+        *member = value;
+        skipSpace(body, i);
+        if (i < body.size() && body[i] == ',') {
+            ++i;
+            skipSpace(body, i);
+            if (i >= body.size() || body[i] != '"') return false; // no trailing comma
+        } else if (i < body.size() && body[i] != '}') {
+            return false; // members must be separated by ','
+        }
+    }
+    if (i >= body.size()) return false;
+    ++i;
+    skipSpace(body, i);
+    return i == body.size();
+}
+
+void appendJsonNumber(std::string& out, double value) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    if (value == 0) {
+        out += std::signbit(value) ? "-0.0" : "0.0";
+        return;
+    }
+
+    // Shortest round-trip digits in scientific form, e.g. "-4.2e+01".
+    char sci[32];
+    char* end = std::to_chars(sci, sci + sizeof(sci), value, std::chars_format::scientific).ptr;
+    const char* p = sci;
+    if (*p == '-') {
+        out += '-';
+        ++p;
+    }
+    char digits[20];
+    int k = 0;
+    for (; *p != 'e'; ++p) {
+        if (*p != '.') digits[k++] = *p;
+    }
+    int exponent = 0;
+    std::from_chars(p + (p[1] == '+' ? 2 : 1), end, exponent);
+
+    // Laid out like nlohmann's format_buffer(): n is the position of the
+    // decimal point relative to the digits.
+    const int n = exponent + 1;
+    constexpr int kMinExp = -4;
+    constexpr int kMaxExp = 15;
+    if (k <= n && n <= kMaxExp) {
+        out.append(digits, k);
+        out.append(static_cast<size_t>(n - k), '0');
+        out += ".0";
+    } else if (0 < n && n <= kMaxExp) {
+        out.append(digits, n);
+        out += '.';
+        out.append(digits + n, k - n);
+    } else if (kMinExp < n && n <= 0) {
+        out += "0.";
+        out.append(static_cast<size_t>(-n), '0');
+        out.append(digits, k);
+    } else {
+        out += digits[0];
+        if (k > 1) {
+            out += '.';
+            out.append(digits + 1, k - 1);
+        }
+        int e = n - 1;
+        out += e < 0 ? "e-" : "e+";
+        e = e < 0 ? -e : e;
+        if (e < 10) out += '0';
+        char exp[4];
+        out.append(exp, std::to_chars(exp, exp + sizeof(exp), e).ptr);
+    }
+}
+
+void appendJsonString(std::string& out, std::string_view text) {
+    static const char kHex[] = "0123456789abcdef";
+    out += '"';
+    size_t plain = 0; // start of the run not yet copied
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            ++i;
+            continue;
+        }
+        if (c >= 0x80) {
+            size_t length = utf8Length(text, i);
+            if (length > 0) {
+                i += length;
+                continue;
+            }
+        }
+        out.append(text.data() + plain, i - plain);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += kHex[c >> 4];
+                    out += kHex[c & 0xF];
+                } else {
+                    out += "\xEF\xBF\xBD"; // invalid UTF-8
+                }
+        }
+        plain = ++i;
+    }
+    out.append(text.data() + plain, text.size() - plain);
+    out += '"';
+}
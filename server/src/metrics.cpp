@@ -0,0 +1,146 @@
+#include "metrics.h"
+#include <cstdio>
+
+namespace {
+
+std::atomic<uint64_t> nextRegistryId{1};
+
+const char* const kStageNames[] = {
+    "json_parse", "tokenize", "shunting_yard", "compile", "optimize", "execute", "serialize", "request"
+};
+const char* const kEndpointNames[] = {"/calculate", "/calculate/batch", "/calculate/vector", "/calculate/stream", "binary"};
+const char* const kOutcomeNames[] = {"ok", "error", "bad_request", "shed"};
+
+// Single writer per slot: a plain load + store is enough and avoids the
+// locked read-modify-write of fetch_add.
+void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+std::string seconds(uint64_t nanos) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(nanos) / 1e9);
+    return buffer;
+}
+
+} // namespace
+
+Metrics::Metrics() : id_(nextRegistryId.fetch_add(1)) {
+}
+
+Metrics::~Metrics() = default;
+
+Metrics::ThreadSlot& Metrics::localSlot() {
+    // One cached slot per thread; a thread that alternates between
+    // registries (only tests do) falls back to the map lookup.
+    struct Cache {
+        uint64_t registry = 0;
+        ThreadSlot* slot = nullptr;
+    };
+    thread_local Cache cache;
+    if (cache.registry == id_) {
+        return *cache.slot;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = slots_[std::this_thread::get_id()];
+    if (!slot) {
+        slot = std::make_unique<ThreadSlot>();
+    }
+    cache = {id_, slot.get()};
+    return *slot;
+}
+
+void Metrics::recordStage(Stage stage, Clock::duration elapsed) {
+    auto nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    size_t bucket = 0;
+    while (bucket < kBucketCount - 1 && nanos > kBucketBounds[bucket]) {
+        ++bucket;
+    }
+    ThreadSlot& slot = localSlot();
+    auto s = static_cast<size_t>(stage);
+    bump(slot.buckets[s][bucket]);
+    bump(slot.sumNanos[s], nanos);
+}
+
+void Metrics::recordRequest(Endpoint endpoint, Outcome outcome) {
+    bump(localSlot().requests[static_cast<size_t>(endpoint)][static_cast<size_t>(outcome)]);
+}
+
+void Metrics::onStage(Calculator::Stage stage, Clock::duration elapsed) {
+    switch (stage) {
+        case Calculator::Stage::TOKENIZE: recordStage(Stage::TOKENIZE, elapsed); break;
+        case Calculator::Stage::SHUNTING_YARD: recordStage(Stage::SHUNTING_YARD, elapsed); break;
+        case Calculator::Stage::COMPILE: recordStage(Stage::COMPILE, elapsed); break;
+        case Calculator::Stage::OPTIMIZE: recordStage(Stage::OPTIMIZE, elapsed); break;
+        case Calculator::Stage::EXECUTE: recordStage(Stage::EXECUTE, elapsed); break;
+    }
+}
+
+uint64_t Metrics::requestCount(Endpoint endpoint, Outcome outcome) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t total = 0;
+    for (const auto& entry : slots_) {
+        total += entry.second->requests[static_cast<size_t>(endpoint)][static_cast<size_t>(outcome)]
+                     .load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t Metrics::stageCount(Stage stage) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t total = 0;
+    for (const auto& entry : slots_) {
+        for (const auto& bucket : entry.second->buckets[static_cast<size_t>(stage)]) {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+void Metrics::render(std::ostream& out) const {
+    // Sum the slots first, so the output is written without the lock.
+    uint64_t buckets[kStageCount][kBucketCount] = {};
+    uint64_t sums[kStageCount] = {};
+    uint64_t requests[kEndpointCount][kOutcomeCount] = {};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : slots_) {
+            const ThreadSlot& slot = *entry.second;
+            for (size_t s = 0; s < kStageCount; ++s) {
+                for (size_t b = 0; b < kBucketCount; ++b) {
+                    buckets[s][b] += slot.buckets[s][b].load(std::memory_order_relaxed);
+                }
+                sums[s] += slot.sumNanos[s].load(std::memory_order_relaxed);
+            }
+            for (size_t e = 0; e < kEndpointCount; ++e) {
+                for (size_t o = 0; o < kOutcomeCount; ++o) {
+                    requests[e][o] += slot.requests[e][o].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    out << "# HELP calc_requests_total Requests by endpoint and outcome.\n";
+    out << "# TYPE calc_requests_total counter\n";
+    for (size_t e = 0; e < kEndpointCount; ++e) {
+        for (size_t o = 0; o < kOutcomeCount; ++o) {
+            out << "calc_requests_total{endpoint=\"" << kEndpointNames[e] << "\",outcome=\""
+                << kOutcomeNames[o] << "\"} " << requests[e][o] << "\n";
+        }
+    }
+
+    out << "# HELP calc_stage_duration_seconds Time spent in each stage of request processing.\n";
+    out << "# TYPE calc_stage_duration_seconds histogram\n";
+    for (size_t s = 0; s < kStageCount; ++s) {
+        const std::string label = std::string("stage=\"") + kStageNames[s] + "\"";
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < kBucketCount; ++b) {
+            cumulative += buckets[s][b];
+            out << "calc_stage_duration_seconds_bucket{" << label << ",le=\""
+                << (b + 1 < kBucketCount ? seconds(kBucketBounds[b]) : "+Inf") << "\"} " << cumulative << "\n";
+        }
+        out << "calc_stage_duration_seconds_sum{" << label << "} " << seconds(sums[s]) << "\n";
+        out << "calc_stage_duration_seconds_count{" << label << "} " << cumulative << "\n";
+    }
+}
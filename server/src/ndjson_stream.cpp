@@ -0,0 +1,153 @@
+#include "ndjson_stream.h"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+ResultSpool::ResultSpool(size_t memoryLimit) : memoryLimit_(memoryLimit) {
+}
+
+ResultSpool::~ResultSpool() {
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+void ResultSpool::append(std::string_view data) {
+    size_ += data.size();
+    if (!file_ && memory_.size() + data.size() <= memoryLimit_) {
+        memory_.append(data);
+        return;
+    }
+    if (!file_) {
+        file_ = std::tmpfile();
+        if (!file_) {
+            throw std::runtime_error("Cannot create a temporary file for the stream results");
+        }
+    }
+    if (std::fwrite(data.data(), 1, data.size(), file_) != data.size()) {
+        throw std::runtime_error("Cannot write stream results to the temporary file");
+    }
+}
+
+size_t ResultSpool::read(char* out, size_t size) {
+    // Memory holds the first bytes, the file the rest.
+    if (readOffset_ < memory_.size()) {
+        size_t n = std::min(size, memory_.size() - readOffset_);
+        std::copy_n(memory_.data() + readOffset_, n, out);
+        readOffset_ += n;
+        return n;
+    }
+    if (!file_) {
+        return 0;
+    }
+    if (!reading_) {
+        std::fflush(file_);
+        std::rewind(file_);
+        reading_ = true;
+    }
+    size_t n = std::fread(out, 1, size, file_);
+    readOffset_ += n;
+    return n;
+}
+
+NdjsonStream::NdjsonStream(CalcService& service, ResultSpool& out, size_t window)
+    : service_(service), out_(out), window_(window == 0 ? 1 : window), start_(std::chrono::steady_clock::now()) {
+    items_.reserve(window_);
+    malformed_.reserve(window_);
+}
+
+void NdjsonStream::feed(const char* data, size_t size) {
+    std::string_view chunk(data, size);
+    while (!chunk.empty()) {
+        size_t newline = chunk.find('\n');
+        if (newline == std::string_view::npos) {
+            if (partial_.size() + chunk.size() > kMaxLineLength) {
+                throw std::runtime_error("Stream record longer than " + std::to_string(kMaxLineLength) + " bytes");
+            }
+            partial_.append(chunk);
+            return;
+        }
+        if (partial_.empty()) {
+            addLine(chunk.substr(0, newline));
+        } else {
+            partial_.append(chunk.substr(0, newline));
+            addLine(partial_);
+            partial_.clear();
+        }
+        chunk.remove_prefix(newline + 1);
+    }
+}
+
+void NdjsonStream::finish() {
+    if (!partial_.empty()) {
+        addLine(partial_);
+        partial_.clear();
+    }
+    flushWindow();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    json summary{{"records", records_},
+                 {"errors", errors_},
+                 {"seconds", seconds},
+                 {"records_per_second", seconds > 0 ? static_cast<double>(records_) / seconds : 0.0}};
+    out_.append(summary.dump());
+    out_.append("\n");
+}
+
+void NdjsonStream::addLine(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (line.find_first_not_of(" \t") == std::string_view::npos) {
+        return; // blank lines are not records
+    }
+
+    std::string error;
+    try {
+        json record = json::parse(line);
+        if (!record.is_object() || !record.contains("exp") || !record["exp"].is_string()) {
+            error = "Invalid JSON: expected 'exp'";
+        } else {
+            std::string sid = CalcService::kDefaultSid;
+            if (record.contains("sid") && record["sid"].is_string()) {
+                sid = record["sid"];
+            }
+            items_.push_back({std::move(sid), record["exp"]});
+        }
+    } catch (const json::exception& e) {
+        error = e.what();
+    }
+    malformed_.push_back(std::move(error));
+
+    if (malformed_.size() >= window_) {
+        flushWindow();
+    }
+}
+
+void NdjsonStream::flushWindow() {
+    if (malformed_.empty()) {
+        return;
+    }
+    auto results = service_.calculateBatch(items_);
+
+    std::string lines;
+    size_t next = 0;
+    for (const auto& error : malformed_) {
+        json out;
+        if (!error.empty()) {
+            out["err"] = error;
+        } else if (results[next].ok) {
+            out["res"] = results[next++].value;
+        } else {
+            out["err"] = results[next++].error;
+        }
+        if (out.contains("err")) ++errors_;
+        lines += out.dump();
+        lines += '\n';
+    }
+    out_.append(lines);
+
+    records_ += malformed_.size();
+    items_.clear();
+    malformed_.clear();
+}
@@ -0,0 +1,438 @@
+#include "session_snapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t symbolCount;
+    uint64_t sessionCount;
+    uint64_t symbolOffset;
+    uint64_t fileSize;
+};
+static_assert(sizeof(SnapshotHeader) == 40, "snapshot header must not be padded");
+
+std::string systemError(const std::string& what, const std::string& path) {
+    return what + " '" + path + "': " + std::strerror(errno);
+}
+
+// Buffered writer on a raw descriptor, so every error (including the
+// final fsync) surfaces as an exception instead of a lost fclose result.
+class FileWriter {
+public:
+    static constexpr size_t kBufferSize = 1 << 20;
+
+    explicit FileWriter(const std::string& path) : path_(path) {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error(systemError("Cannot create snapshot", path));
+        }
+        buffer_.reserve(kBufferSize);
+    }
+    ~FileWriter() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    void put(const void* data, size_t size) {
+        if (buffer_.size() + size > kBufferSize) flush();
+        buffer_.append(static_cast<const char*>(data), size);
+        written_ += size;
+    }
+    template <typename T>
+    void put(T value) { put(&value, sizeof(value)); }
+    void putString(const std::string& s) {
+        put(static_cast<uint32_t>(s.size()));
+        put(s.data(), s.size());
+    }
+
+    void pwriteAt(const void* data, size_t size, uint64_t offset) {
+        flush();
+        if (::pwrite(fd_, data, size, static_cast<off_t>(offset)) != static_cast<ssize_t>(size)) {
+            throw std::runtime_error(systemError("Cannot write snapshot", path_));
+        }
+    }
+
+    void close() {
+        flush();
+        if (::fsync(fd_) != 0) {
+            throw std::runtime_error(systemError("Cannot sync snapshot", path_));
+        }
+        int fd = fd_;
+        fd_ = -1;
+        if (::close(fd) != 0) {
+            throw std::runtime_error(systemError("Cannot close snapshot", path_));
+        }
+    }
+
+    uint64_t written() const { return written_; }
+
+private:
+    void flush() {
+        size_t done = 0;
+        while (done < buffer_.size()) {
+            ssize_t n = ::write(fd_, buffer_.data() + done, buffer_.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error(systemError("Cannot write snapshot", path_));
+            done += static_cast<size_t>(n);
+        }
+        buffer_.clear();
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    std::string buffer_;
+    uint64_t written_ = 0;
+};
+
+// Read-only mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error(systemError("Cannot open snapshot", path));
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error(systemError("Cannot stat snapshot", path));
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error(systemError("Cannot map snapshot", path));
+            }
+            // One front-to-back pass: let the kernel read ahead aggressively.
+            ::madvise(data, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(data);
+        }
+        ::close(fd); // the mapping stays valid
+    }
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Bounds-checked cursor over a mapped range. Fields are unaligned, so
+// they are read with memcpy.
+class Reader {
+public:
+    Reader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+    std::string_view getString() {
+        uint32_t length = get<uint32_t>();
+        return {take(length), length};
+    }
+    bool done() const { return p_ == end_; }
+
+private:
+    const char* take(size_t size) {
+        if (static_cast<size_t>(end_ - p_) < size) {
+            throw std::runtime_error("Corrupt session snapshot: truncated record");
+        }
+        const char* at = p_;
+        p_ += size;
+        return at;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+SnapshotStats saveSessionSnapshot(CalcService& service, const std::string& path) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::string tmpPath = path + ".tmp";
+    SnapshotStats stats;
+    uint32_t symbolCount = 0;
+    {
+        FileWriter out(tmpPath);
+        SnapshotHeader header{};
+        out.put(&header, sizeof(header)); // patched once the counts are known
+
+        SessionStore& store = service.sessions();
+        std::vector<std::pair<uint32_t, double>> variables;
+        std::vector<FormulaGraph::Binding> formulas;
+        std::vector<FunctionTable::FunctionPtr> functions;
+        for (size_t shard = 0; shard < store.shardCount(); ++shard) {
+            for (const auto& [sid, session] : store.shardEntries(shard)) {
+                variables.clear();
+                {
+                    std::lock_guard<std::mutex> lock(session->mutex);
+                    session->variables.forEach(
+                        [&](uint32_t slot, double value) { variables.emplace_back(slot, value); });
+                    formulas = session->formulas.bindings();
+                    functions = session->functions.functions();
+                }
+                if (variables.empty() && formulas.empty() && functions.empty()) continue;
+                std::sort(variables.begin(), variables.end());
+
+                out.putString(sid);
+                out.put(static_cast<uint32_t>(variables.size()));
+                for (const auto& [slot, value] : variables) {
+                    out.put(slot);
+                    out.put(value);
+                }
+                out.put(static_cast<uint32_t>(formulas.size()));
+                for (const auto& formula : formulas) {
+                    out.putString(formula.source);
+                }
+                out.put(static_cast<uint32_t>(functions.size()));
+                for (const auto& function : functions) {
+                    out.putString(function->source);
+                }
+                if (!variables.empty()) {
+                    symbolCount = std::max(symbolCount, variables.back().first + 1);
+                }
+                ++stats.sessions;
+                stats.variables += variables.size();
+                stats.formulas += formulas.size();
+                stats.functions += functions.size();
+            }
+        }
+
+        // Only the names the saved sessions can refer to.
+        const uint64_t symbolOffset = out.written();
+        const SymbolTable& symbols = service.calculator().symbols();
+        for (uint32_t slot = 0; slot < symbolCount; ++slot) {
+            out.putString(symbols.name(slot));
+        }
+        const auto globals = service.globalFunctions()->functions();
+        out.put(static_cast<uint32_t>(globals.size()));
+        for (const auto& function : globals) {
+            out.putString(function->source);
+        }
+        stats.functions += globals.size();
+
+        std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+        header.version = kSnapshotVersion;
+        header.symbolCount = symbolCount;
+        header.sessionCount = stats.sessions;
+        header.symbolOffset = symbolOffset;
+        header.fileSize = out.written();
+        stats.bytes = static_cast<size_t>(out.written());
+        out.pwriteAt(&header, sizeof(header), 0);
+        out.close();
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error(systemError("Cannot replace snapshot", path));
+    }
+    stats.seconds = secondsSince(start);
+    return stats;
+}
+
+SnapshotStats loadSessionSnapshot(CalcService& service, const std::string& path) {
+    const auto start = std::chrono::steady_clock::now();
+    MappedFile file(path);
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    SnapshotHeader header;
+    if (file.size() < sizeof(header)) {
+        throw std::runtime_error("Corrupt session snapshot: file too small");
+    }
+    std::memcpy(&header, begin, sizeof(header));
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a session snapshot: " + path);
+    }
+    if (header.version < 1 || header.version > kSnapshotVersion) {
+        throw std::runtime_error("Unsupported session snapshot version " + std::to_string(header.version));
+    }
+    if (header.fileSize != file.size() || header.symbolOffset < sizeof(header) ||
+        header.symbolOffset > file.size()) {
+        throw std::runtime_error("Corrupt session snapshot: size mismatch");
+    }
+
+    // Validate the whole file before touching any session, so a bad
+    // snapshot restores nothing rather than half of it.
+    const bool hasFormulas = header.version >= 2;
+    const bool hasFunctions = header.version >= 3;
+    auto checkFunction = [&](std::string_view source) {
+        try {
+            service.calculator().compileFunction(std::string(source));
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error(std::string("Corrupt session snapshot: bad function: ") + e.what());
+        }
+    };
+    const char* symbolsBegin = begin + header.symbolOffset;
+    Reader symbolReader(symbolsBegin, end);
+    std::vector<std::string_view> names(header.symbolCount);
+    for (auto& name : names) {
+        name = symbolReader.getString();
+    }
+    std::vector<std::string_view> globals(hasFunctions ? symbolReader.get<uint32_t>() : 0);
+    for (auto& global : globals) {
+        global = symbolReader.getString();
+        checkFunction(global);
+    }
+    if (!symbolReader.done()) {
+        throw std::runtime_error("Corrupt session snapshot: trailing data");
+    }
+    Reader sessionReader(begin + sizeof(header), symbolsBegin);
+    for (uint64_t i = 0; i < header.sessionCount; ++i) {
+        sessionReader.getString();
+        uint32_t count = sessionReader.get<uint32_t>();
+        for (uint32_t v = 0; v < count; ++v) {
+            if (sessionReader.get<uint32_t>() >= header.symbolCount) {
+                throw std::runtime_error("Corrupt session snapshot: unknown variable slot");
+            }
+            sessionReader.get<double>();
+        }
+        uint32_t formulas = hasFormulas ? sessionReader.get<uint32_t>() : 0;
+        for (uint32_t f = 0; f < formulas; ++f) {
+            std::string_view source = sessionReader.getString();
+            // Compiled and cached now, so binding it below cannot fail to parse.
+            ExpressionCache::CompiledPtr compiled;
+            try {
+                compiled = service.cache().getOrCompile(std::string(source));
+            } catch (const std::runtime_error& e) {
+                throw std::runtime_error(std::string("Corrupt session snapshot: bad formula: ") + e.what());
+            }
+            if (compiled->statements.size() != 1 ||
+                compiled->statements.front().code.back().op != Calculator::OpCode::STORE) {
+                throw std::runtime_error("Corrupt session snapshot: bad formula: " + std::string(source));
+            }
+        }
+        uint32_t functions = hasFunctions ? sessionReader.get<uint32_t>() : 0;
+        for (uint32_t f = 0; f < functions; ++f) {
+            checkFunction(sessionReader.getString());
+        }
+    }
+    if (!sessionReader.done()) {
+        throw std::runtime_error("Corrupt session snapshot: trailing session data");
+    }
+
+    std::vector<uint32_t> slots(header.symbolCount);
+    for (uint32_t i = 0; i < header.symbolCount; ++i) {
+        slots[i] = service.calculator().intern(names[i]);
+    }
+
+    SnapshotStats stats;
+    for (std::string_view global : globals) {
+        service.defineFunction(CalcService::kDefaultSid, std::string(global), true);
+    }
+    stats.functions = globals.size();
+    Reader reader(begin + sizeof(header), symbolsBegin);
+    std::string sid;
+    std::vector<std::pair<uint32_t, double>> variables;
+    for (uint64_t i = 0; i < header.sessionCount; ++i) {
+        sid.assign(reader.getString());
+        uint32_t count = reader.get<uint32_t>();
+        variables.clear();
+        for (uint32_t v = 0; v < count; ++v) {
+            uint32_t slot = slots[reader.get<uint32_t>()];
+            variables.emplace_back(slot, reader.get<double>());
+        }
+        {
+            auto session = service.sessions().getOrCreate(sid);
+            std::lock_guard<std::mutex> lock(session->mutex);
+            for (const auto& [slot, value] : variables) {
+                session->variables.set(slot, value);
+            }
+            service.sessions().account(sid, *session);
+        }
+        // After the variables, so each formula starts from the saved
+        // values of its inputs. Binding recomputes its target.
+        uint32_t formulas = hasFormulas ? reader.get<uint32_t>() : 0;
+        for (uint32_t f = 0; f < formulas; ++f) {
+            service.bind(sid, std::string(reader.getString()));
+        }
+        uint32_t functions = hasFunctions ? reader.get<uint32_t>() : 0;
+        for (uint32_t f = 0; f < functions; ++f) {
+            service.defineFunction(sid, std::string(reader.getString()), false);
+        }
+        ++stats.sessions;
+        stats.variables += count;
+        stats.formulas += formulas;
+        stats.functions += functions;
+    }
+    stats.bytes = file.size();
+    stats.seconds = secondsSince(start);
+    return stats;
+}
+
+SnapshotScheduler::SnapshotScheduler(CalcService& service, std::string path,
+                                     std::chrono::seconds interval, Report report)
+    : service_(service), path_(std::move(path)), interval_(interval), report_(std::move(report)) {
+    if (interval_.count() > 0) {
+        thread_ = std::thread([this]() { run(); });
+    }
+}
+
+SnapshotScheduler::~SnapshotScheduler() {
+    stop();
+}
+
+void SnapshotScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool SnapshotScheduler::saveNow() {
+    std::lock_guard<std::mutex> saving(saveMutex_); // both would write path.tmp
+    std::ostringstream message;
+    bool ok = true;
+    try {
+        SnapshotStats stats = saveSessionSnapshot(service_, path_);
+        message << "Snapshot " << path_ << ": " << stats.sessions << " sessions, "
+                << stats.variables << " variables, " << stats.formulas << " formulas, "
+                << stats.functions << " functions, " << stats.bytes << " bytes in "
+                << stats.seconds * 1000.0 << " ms";
+    } catch (const std::exception& e) {
+        message << "Snapshot failed: " << e.what();
+        ok = false;
+    }
+    if (report_) {
+        report_(message.str());
+    }
+    return ok;
+}
+
+void SnapshotScheduler::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wakeup_.wait_for(lock, interval_, [this]() { return stopping_; })) {
+        lock.unlock();
+        saveNow();
+        lock.lock();
+    }
+}
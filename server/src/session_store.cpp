@@ -0,0 +1,180 @@
+#include "session_store.h"
+#include <functional>
+
+SessionStore::SessionStore(size_t shardCount) : SessionStore(shardCount, Limits()) {
+}
+
+SessionStore::SessionStore(size_t shardCount, const Limits& limits)
+    : shards_(shardCount == 0 ? 1 : shardCount), idleTtl_(limits.idleTtl) {
+    // Round up so the total is never smaller than requested.
+    auto perShard = [this](size_t total) { return (total + shards_.size() - 1) / shards_.size(); };
+    shardMaxSessions_ = perShard(limits.maxSessions);
+    shardMaxBytes_ = perShard(limits.maxBytes);
+}
+
+std::shared_ptr<Session> SessionStore::getOrCreate(const std::string& sid) {
+    const Clock::time_point now = idleTtl_.count() > 0 ? Clock::now() : Clock::time_point();
+    Shard& shard = shardFor(sid);
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(sid);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        } else {
+            shard.lru.push_front(Entry{sid, std::make_shared<Session>(), now, 0, 0});
+            shard.index.emplace(sid, shard.lru.begin());
+            shard.lru.front().bytes = estimateBytes(shard.lru.front());
+            shard.bytes += shard.lru.front().bytes;
+        }
+        Entry& entry = shard.lru.front();
+        entry.lastUsed = now;
+        session = entry.session;
+        enforceLimitsLocked(shard, now);
+    }
+
+    // Shards that are rarely accessed still get their idle sessions
+    // expired: every access also sweeps the cold end of one other shard,
+    // round robin. Skipped if that shard is busy.
+    if (idleTtl_.count() > 0) {
+        Shard& other = shards_[sweepCursor_.fetch_add(1, std::memory_order_relaxed) % shards_.size()];
+        if (&other != &shard && other.mutex.try_lock()) {
+            std::lock_guard<std::mutex> lock(other.mutex, std::adopt_lock);
+            expireLocked(other, now, kExpireBatch);
+        }
+    }
+    return session;
+}
+
+std::shared_ptr<Session> SessionStore::find(const std::string& sid) const {
+    Shard& shard = shardFor(sid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(sid);
+    return it == shard.index.end() ? nullptr : it->second->session;
+}
+
+void SessionStore::account(const std::string& sid, const Session& session) {
+    const size_t contents =
+        session.variables.estimateBytes() + session.functions.estimateBytes() + session.formulas.estimateBytes();
+    const Clock::time_point now = idleTtl_.count() > 0 ? Clock::now() : Clock::time_point();
+    Shard& shard = shardFor(sid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(sid);
+    if (it == shard.index.end() || it->second->session.get() != &session) {
+        return;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    Entry& entry = shard.lru.front();
+    entry.lastUsed = now;
+    entry.contents = contents;
+    size_t bytes = estimateBytes(entry);
+    shard.bytes += bytes - entry.bytes;
+    entry.bytes = bytes;
+    enforceLimitsLocked(shard, now);
+}
+
+bool SessionStore::erase(const std::string& sid) {
+    Shard& shard = shardFor(sid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(sid);
+    if (it == shard.index.end()) {
+        return false;
+    }
+    shard.bytes -= it->second->bytes;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+    return true;
+}
+
+size_t SessionStore::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.index.size();
+    }
+    return total;
+}
+
+SessionStore::Stats SessionStore::stats() const {
+    Stats s;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        s.sessions += shard.index.size();
+        s.bytes += shard.bytes;
+    }
+    s.evictedIdle = evictedIdle_.load(std::memory_order_relaxed);
+    s.evictedCount = evictedCount_.load(std::memory_order_relaxed);
+    s.evictedMemory = evictedMemory_.load(std::memory_order_relaxed);
+    return s;
+}
+
+size_t SessionStore::expireIdle(Clock::time_point now) {
+    if (idleTtl_.count() <= 0) {
+        return 0;
+    }
+    size_t expired = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        expired += expireLocked(shard, now, shard.lru.size());
+    }
+    return expired;
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<Session>>>
+SessionStore::shardEntries(size_t shard) const {
+    const Shard& s = shards_.at(shard);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::vector<std::pair<std::string, std::shared_ptr<Session>>> entries;
+    entries.reserve(s.lru.size());
+    for (const Entry& entry : s.lru) {
+        entries.emplace_back(entry.sid, entry.session);
+    }
+    return entries;
+}
+
+SessionStore::Shard& SessionStore::shardFor(const std::string& sid) const {
+    return shards_[std::hash<std::string>{}(sid) % shards_.size()];
+}
+
+size_t SessionStore::estimateBytes(const Entry& entry) {
+    // List node and index node with their copies of the sid, the Session
+    // itself, and what its variables, functions and bound formulas hold on
+    // the heap. Memoized results are bounded separately
+    // (CalcService::Options).
+    constexpr size_t kFixed = sizeof(Entry) + sizeof(Session) + 2 * sizeof(void*)
+                            + sizeof(std::string) + sizeof(std::list<Entry>::iterator) + 2 * sizeof(void*);
+    return kFixed + 2 * entry.sid.capacity() + entry.contents;
+}
+
+void SessionStore::enforceLimitsLocked(Shard& shard, Clock::time_point now) {
+    expireLocked(shard, now, kExpireBatch);
+    // The front entry is the one just used by the caller; it is never evicted.
+    while (shardMaxSessions_ > 0 && shard.lru.size() > shardMaxSessions_ && shard.lru.size() > 1) {
+        evictBackLocked(shard, evictedCount_);
+    }
+    while (shardMaxBytes_ > 0 && shard.bytes > shardMaxBytes_ && shard.lru.size() > 1) {
+        evictBackLocked(shard, evictedMemory_);
+    }
+}
+
+size_t SessionStore::expireLocked(Shard& shard, Clock::time_point now, size_t budget) {
+    if (idleTtl_.count() <= 0) {
+        return 0;
+    }
+    // LRU order is also lastUsed order, so expired sessions are all at the
+    // back. A caller's own session was just stamped with `now` and stays.
+    size_t expired = 0;
+    while (expired < budget && !shard.lru.empty() && now - shard.lru.back().lastUsed > idleTtl_) {
+        evictBackLocked(shard, evictedIdle_);
+        ++expired;
+    }
+    return expired;
+}
+
+void SessionStore::evictBackLocked(Shard& shard, std::atomic<uint64_t>& counter) {
+    Entry& victim = shard.lru.back();
+    shard.bytes -= victim.bytes;
+    shard.index.erase(victim.sid);
+    shard.lru.pop_back();
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,128 @@
+#include "gtest/gtest.h"
+#include "admission_control.h"
+#include "calc_service.h"
+#include "http_api.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Runs `windows` full windows in which `concurrency` requests are in
+// flight at once and each takes `latency`.
+void runWindows(AdmissionControl& admission, AdmissionControl::Clock::time_point& now,
+                size_t windows, size_t concurrency, std::chrono::microseconds latency) {
+    size_t samples = 0;
+    while (samples < windows * AdmissionControl::kWindowSamples) {
+        std::vector<AdmissionControl::Permit> permits;
+        for (size_t i = 0; i < concurrency; ++i) {
+            auto permit = admission.tryAcquire(1, now);
+            if (permit) permits.push_back(std::move(permit));
+        }
+        now += latency;
+        for (auto& permit : permits) {
+            permit.release(now);
+        }
+        samples += permits.size();
+    }
+}
+
+} // namespace
+
+TEST(AdmissionControlTest, FixedLimitShedsBeyondInFlight) {
+    AdmissionControl::Options options;
+    options.maxInFlight = 2;
+    AdmissionControl admission(options);
+
+    auto first = admission.tryAcquire();
+    auto second = admission.tryAcquire();
+    EXPECT_TRUE(first && second);
+    EXPECT_FALSE(admission.tryAcquire());
+    first.release();
+    EXPECT_TRUE(admission.tryAcquire());
+
+    auto stats = admission.stats();
+    EXPECT_EQ(stats.admitted, 3u);
+    EXPECT_EQ(stats.rejected[static_cast<size_t>(AdmissionControl::Reason::IN_FLIGHT)], 1u);
+    EXPECT_EQ(stats.inFlight, 1u); // the temporary above was released
+    EXPECT_EQ(stats.limit, 2u);
+}
+
+TEST(AdmissionControlTest, IdleServerAdmitsOversizedBatch) {
+    AdmissionControl::Options options;
+    options.maxInFlight = 2;
+    AdmissionControl admission(options);
+    auto batch = admission.tryAcquire(5);
+    EXPECT_TRUE(batch);
+    EXPECT_FALSE(admission.tryAcquire());
+    batch.release();
+    EXPECT_EQ(admission.stats().inFlight, 0u);
+
+    AdmissionControl unlimited;
+    EXPECT_EQ(unlimited.limit(), 0u);
+    std::vector<AdmissionControl::Permit> permits;
+    for (int i = 0; i < 1000; ++i) permits.push_back(unlimited.tryAcquire());
+    EXPECT_EQ(unlimited.stats().inFlight, 1000u);
+}
+
+TEST(AdmissionControlTest, AdaptiveLimitFollowsLatency) {
+    AdmissionControl::Options options;
+    options.adaptive = true;
+    options.minLimit = 2;
+    options.maxLimit = 64;
+    AdmissionControl admission(options);
+    auto now = AdmissionControl::Clock::time_point() + 1h;
+    EXPECT_EQ(admission.limit(), options.initialLimit);
+
+    // Flat latency while the limit is used: it grows.
+    for (int i = 0; i < 20; ++i) {
+        runWindows(admission, now, 1, admission.limit(), 100us);
+    }
+    const size_t grown = admission.limit();
+    EXPECT_GT(grown, options.initialLimit);
+
+    // Used at a fraction of the limit: no reason to grow further.
+    runWindows(admission, now, 5, 1, 100us);
+    EXPECT_EQ(admission.limit(), grown);
+
+    // Latency far above the baseline (requests queueing): it shrinks.
+    for (int i = 0; i < 20; ++i) {
+        runWindows(admission, now, 1, admission.limit(), 2000us);
+    }
+    EXPECT_LT(admission.limit(), grown);
+    EXPECT_GE(admission.limit(), options.minLimit);
+    EXPECT_GT(admission.stats().rejected[static_cast<size_t>(AdmissionControl::Reason::ADAPTIVE)], 0u);
+}
+
+TEST(AdmissionControlTest, TokenBucketRefillsAtRate) {
+    TokenBucket bucket;
+    auto now = TokenBucket::Clock::time_point() + 1h;
+    EXPECT_TRUE(bucket.tryTake(10.0, 2.0, now)); // starts full
+    EXPECT_TRUE(bucket.tryTake(10.0, 2.0, now));
+    EXPECT_FALSE(bucket.tryTake(10.0, 2.0, now));
+    EXPECT_TRUE(bucket.tryTake(10.0, 2.0, now + 100ms));
+    EXPECT_FALSE(bucket.tryTake(10.0, 2.0, now + 100ms));
+    EXPECT_TRUE(bucket.tryTake(10.0, 2.0, now + 10s)); // refilled, capped at the burst
+    EXPECT_TRUE(bucket.tryTake(10.0, 2.0, now + 10s));
+    EXPECT_FALSE(bucket.tryTake(10.0, 2.0, now + 10s));
+}
+
+TEST(AdmissionControlTest, SessionsOverTheirRateGet429) {
+    CalcService::Options options;
+    options.admission.sessionRate = 0.001; // no refill during the test
+    options.admission.sessionBurst = 2;
+    CalcService service(options);
+
+    std::string response;
+    EXPECT_EQ(handleCalculate(service, R"({"sid":"A","exp":"1 + 1"})", response), 200);
+    EXPECT_EQ(handleCalculate(service, R"({"sid":"A","exp":"1 + 1"})", response), 200);
+    EXPECT_EQ(handleCalculate(service, R"({"sid":"A","exp":"1 + 1"})", response), 429);
+    EXPECT_EQ(response, R"({"err":"Rate limit exceeded for session: A"})");
+    EXPECT_EQ(handleCalculate(service, R"({"sid":"B","exp":"1 + 1"})", response), 200);
+
+    std::string metrics = service.renderMetrics();
+    EXPECT_NE(metrics.find("calc_shed_requests_total{reason=\"session_rate\"} 1\n"), std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("calc_requests_total{endpoint=\"/calculate\",outcome=\"shed\"} 1\n"), std::string::npos);
+}
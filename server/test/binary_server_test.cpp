@@ -0,0 +1,186 @@
+#include "gtest/gtest.h"
+#include "binary_protocol.h"
+#include "binary_server.h"
+#include "calc_service.h"
+#include <arpa/inet.h>
+#include <future>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+class BinaryServerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        port = server.bind("127.0.0.1", 0);
+        thread = std::thread([this]() { server.listen(); });
+        client.connect("127.0.0.1", static_cast<uint16_t>(port));
+    }
+
+    void TearDown() override {
+        client.close();
+        server.stop();
+        thread.join();
+    }
+
+    CalcService service;
+    BinaryServer server{service};
+    std::thread thread;
+    int port = 0;
+    BinaryClient client;
+};
+
+TEST(BinaryProtocolTest, FramesRoundTrip) {
+    std::string wire;
+    appendRequestFrame({BinaryOpcode::EVAL, "sid-1", "x = 2 * 3"}, wire);
+    appendResponseFrame({BinaryStatus::OK, 0.1, ""}, wire);
+
+    size_t first = completeFrameSize(wire);
+    ASSERT_EQ(first, kBinaryLengthPrefix + 1 + 2 + 5 + 9);
+    EXPECT_EQ(completeFrameSize(std::string_view(wire).substr(0, first - 1)), 0u);
+
+    BinaryRequest request = parseRequest(std::string_view(wire).substr(kBinaryLengthPrefix, first - kBinaryLengthPrefix));
+    EXPECT_EQ(request.opcode, BinaryOpcode::EVAL);
+    EXPECT_EQ(request.sid, "sid-1");
+    EXPECT_EQ(request.expression, "x = 2 * 3");
+
+    std::string_view rest = std::string_view(wire).substr(first);
+    BinaryResponse response = parseResponse(rest.substr(kBinaryLengthPrefix));
+    EXPECT_EQ(response.status, BinaryStatus::OK);
+    EXPECT_EQ(response.value, 0.1); // bit-exact
+}
+
+TEST(BinaryProtocolTest, RejectsOversizedFrames) {
+    std::string wire("\xff\xff\xff\x7f", 4);
+    EXPECT_THROW(completeFrameSize(wire), std::runtime_error);
+}
+
+TEST_F(BinaryServerTest, EvaluatesInSessions) {
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "A", "x = 2 + 3"}).value, 5.0);
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "B", "x = 10"}).value, 10.0);
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "A", "x * 2"}).value, 10.0);
+
+    BinaryResponse error = client.call({BinaryOpcode::EVAL, "A", "1 / 0"});
+    EXPECT_EQ(error.status, BinaryStatus::ERROR);
+    EXPECT_EQ(error.error, "Division by zero");
+
+    EXPECT_EQ(client.call({BinaryOpcode::ECHO, "", ""}).status, BinaryStatus::OK);
+    EXPECT_EQ(client.call({BinaryOpcode::CLEAN, "A", ""}).status, BinaryStatus::OK);
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "A", "x"}).status, BinaryStatus::ERROR);
+}
+
+TEST_F(BinaryServerTest, SharesSessionsWithOtherTransports) {
+    service.calculate(CalcService::kDefaultSid, "rate = 4");
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "", "rate * 2"}).value, 8.0);
+}
+
+TEST_F(BinaryServerTest, PipelinedRequestsAnswerInOrder) {
+    for (int i = 0; i < 500; ++i) {
+        client.send({BinaryOpcode::EVAL, "P", "n = " + std::to_string(i) + " + 1"});
+    }
+    for (int i = 0; i < 500; ++i) {
+        BinaryResponse response = client.receive();
+        ASSERT_EQ(response.status, BinaryStatus::OK);
+        ASSERT_EQ(response.value, i + 1.0);
+    }
+}
+
+TEST_F(BinaryServerTest, UnknownOpcodeKeepsConnection) {
+    std::string wire;
+    appendRequestFrame({BinaryOpcode::EVAL, "", "1 + 1"}, wire);
+    wire[kBinaryLengthPrefix] = 42; // patch the opcode byte
+    appendRequestFrame({BinaryOpcode::EVAL, "", "1 + 1"}, wire);
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(::send(fd, wire.data(), wire.size(), 0), static_cast<ssize_t>(wire.size()));
+
+    std::string in;
+    std::vector<BinaryResponse> responses;
+    char buffer[256];
+    while (responses.size() < 2) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        ASSERT_GT(n, 0);
+        in.append(buffer, static_cast<size_t>(n));
+        while (size_t frame = completeFrameSize(in)) {
+            responses.push_back(parseResponse(std::string_view(in).substr(kBinaryLengthPrefix, frame - kBinaryLengthPrefix)));
+            in.erase(0, frame);
+        }
+    }
+    ::close(fd);
+
+    EXPECT_EQ(responses[0].status, BinaryStatus::BAD_REQUEST);
+    EXPECT_EQ(responses[0].error, "Unknown opcode: 42");
+    EXPECT_EQ(responses[1].value, 2.0);
+}
+
+// Frames go through the same admission control as HTTP requests.
+TEST(BinaryServerAdmissionTest, ShedFramesGetTheirOwnStatus) {
+    CalcService::Options options;
+    options.admission.maxInFlight = 1;
+    options.admission.sessionRate = 0.001; // no refill during the test
+    options.admission.sessionBurst = 2;
+    CalcService service(options);
+    BinaryServer server(service);
+    int port = server.bind("127.0.0.1", 0);
+    std::thread thread([&server]() { server.listen(); });
+    BinaryClient client;
+    client.connect("127.0.0.1", static_cast<uint16_t>(port));
+
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "A", "1 + 1"}).status, BinaryStatus::OK);
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "A", "1 + 1"}).status, BinaryStatus::OK);
+    BinaryResponse limited = client.call({BinaryOpcode::EVAL, "A", "1 + 1"});
+    EXPECT_EQ(limited.status, BinaryStatus::RATE_LIMITED);
+    EXPECT_EQ(limited.error, "Rate limit exceeded for session: A");
+
+    {
+        // Another request holds the only in-flight slot.
+        AdmissionControl::Permit busy = service.admission().tryAcquire();
+        ASSERT_TRUE(busy);
+        BinaryResponse shed = client.call({BinaryOpcode::EVAL, "B", "1 + 1"});
+        EXPECT_EQ(shed.status, BinaryStatus::OVERLOADED);
+        EXPECT_EQ(shed.error, "Server overloaded");
+    }
+    EXPECT_EQ(client.call({BinaryOpcode::EVAL, "B", "2 + 2"}).value, 4.0);
+
+    std::string metrics = service.renderMetrics();
+    EXPECT_NE(metrics.find("calc_requests_total{endpoint=\"binary\",outcome=\"shed\"} 2\n"), std::string::npos)
+        << metrics;
+
+    client.close();
+    server.stop();
+    thread.join();
+}
+
+// Clients beyond the cap wait in the backlog until a connection closes.
+TEST(BinaryServerLimitsTest, ConnectionsBeyondTheCapWaitForAFreeOne) {
+    CalcService service;
+    BinaryServer::Options options;
+    options.maxConnections = 1;
+    BinaryServer server(service, options);
+    int port = server.bind("127.0.0.1", 0);
+    std::thread thread([&server]() { server.listen(); });
+
+    BinaryClient first;
+    first.connect("127.0.0.1", static_cast<uint16_t>(port));
+    EXPECT_EQ(first.call({BinaryOpcode::EVAL, "A", "1 + 1"}).value, 2.0);
+
+    BinaryClient second;
+    second.connect("127.0.0.1", static_cast<uint16_t>(port)); // lands in the backlog
+    auto answer = std::async(std::launch::async,
+                             [&second]() { return second.call({BinaryOpcode::EVAL, "A", "2 + 2"}); });
+    EXPECT_EQ(answer.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+
+    first.close();
+    ASSERT_EQ(answer.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(answer.get().value, 4.0);
+
+    second.close();
+    server.stop();
+    thread.join();
+}
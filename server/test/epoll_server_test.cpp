@@ -0,0 +1,316 @@
+#include "gtest/gtest.h"
+#include "calc_service.h"
+#include "epoll_server.h"
+#include "httplib.h"
+#include "nlohmann/json.hpp"
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+
+int connectTo(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::string post(const std::string& body) {
+    return "POST /calculate HTTP/1.1\r\nHost: x\r\nContent-Type: application/json\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Reads until the peer closes or `responses` complete responses arrived.
+std::vector<std::string> readResponses(int fd, size_t responses) {
+    std::string data;
+    std::vector<std::string> bodies;
+    char buffer[4096];
+    while (bodies.size() < responses) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        data.append(buffer, static_cast<size_t>(n));
+        while (true) {
+            size_t headerEnd = data.find("\r\n\r\n");
+            if (headerEnd == std::string::npos) break;
+            size_t lengthAt = data.find("Content-Length: ");
+            size_t length = std::stoul(data.substr(lengthAt + 16));
+            if (data.size() < headerEnd + 4 + length) break;
+            bodies.push_back(data.substr(0, 12) + data.substr(headerEnd + 4, length)); // "HTTP/1.1 200" + body
+            data.erase(0, headerEnd + 4 + length);
+        }
+    }
+    return bodies;
+}
+
+// True if the peer closes `fd` within a few seconds.
+bool closedByPeer(int fd) {
+    timeval timeout{3, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char byte;
+    return ::recv(fd, &byte, 1, 0) == 0;
+}
+
+} // namespace
+
+class EpollServerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        port = server.bind("127.0.0.1", 0);
+        thread = std::thread([this]() { server.listen(); });
+    }
+
+    void TearDown() override {
+        server.stop();
+        thread.join();
+    }
+
+    CalcService service;
+    EpollServer server{service, EpollServer::Options{2, 2}};
+    std::thread thread;
+    int port = 0;
+};
+
+TEST_F(EpollServerTest, KeepAliveSessions) {
+    httplib::Client cli("127.0.0.1", port);
+    cli.set_keep_alive(true);
+    auto res = cli.Post("/calculate", R"({"sid":"A","exp":"x = 20 / 4"})", "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_EQ(json::parse(res->body)["res"], 5.0);
+
+    res = cli.Post("/calculate", R"({"sid":"A","exp":"x * 2"})", "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(json::parse(res->body)["res"], 10.0);
+
+    res = cli.Post("/calculate", R"({"sid":"B","exp":"x"})", "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 400);
+    EXPECT_EQ(json::parse(res->body)["err"], "Unknown variable: x");
+
+    res = cli.Get("/metrics");
+    ASSERT_TRUE(res);
+    EXPECT_NE(res->body.find("calc_sessions_active 2"), std::string::npos);
+}
+
+// Pipelined requests in one write are answered in order.
+TEST_F(EpollServerTest, PipelinedRequestsKeepOrder) {
+    int fd = connectTo(port);
+    ASSERT_GE(fd, 0);
+    std::string wire;
+    const int kRequests = 200;
+    for (int i = 0; i < kRequests; ++i) {
+        wire += post(json{{"sid", "P"}, {"exp", "n = " + std::to_string(i)}}.dump());
+    }
+    ASSERT_EQ(::send(fd, wire.data(), wire.size(), 0), static_cast<ssize_t>(wire.size()));
+
+    auto responses = readResponses(fd, kRequests);
+    ASSERT_EQ(responses.size(), static_cast<size_t>(kRequests));
+    for (int i = 0; i < kRequests; ++i) {
+        EXPECT_EQ(responses[i], "HTTP/1.1 200" + json({{"res", double(i)}}).dump()) << i;
+    }
+    ::close(fd);
+}
+
+TEST_F(EpollServerTest, ProtocolErrors) {
+    int fd = connectTo(port);
+    std::string wire = "GET /nowhere HTTP/1.1\r\nHost: x\r\n\r\n" + post(R"({"exp":"1+"})");
+    ::send(fd, wire.data(), wire.size(), 0);
+    auto responses = readResponses(fd, 2);
+    ASSERT_EQ(responses.size(), 2u);
+    EXPECT_EQ(responses[0].substr(0, 12), "HTTP/1.1 404");
+    EXPECT_EQ(responses[1].substr(0, 12), "HTTP/1.1 400");
+    ::close(fd);
+
+    // Chunked bodies are not supported: answered, then the connection closes.
+    fd = connectTo(port);
+    wire = "POST /calculate HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n";
+    ::send(fd, wire.data(), wire.size(), 0);
+    responses = readResponses(fd, 2);
+    ASSERT_EQ(responses.size(), 1u);
+    EXPECT_EQ(responses[0].substr(0, 12), "HTTP/1.1 501");
+    ::close(fd);
+}
+
+TEST_F(EpollServerTest, ConnectionCloseAndExpectContinue) {
+    int fd = connectTo(port);
+    std::string body = R"({"exp":"6 * 7"})";
+    std::string head = "POST /calculate HTTP/1.1\r\nExpect: 100-continue\r\nConnection: close\r\nContent-Length: " +
+                       std::to_string(body.size()) + "\r\n\r\n";
+    ::send(fd, head.data(), head.size(), 0);
+
+    char buffer[256];
+    ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+    ASSERT_GT(n, 0);
+    EXPECT_EQ(std::string(buffer, static_cast<size_t>(n)), "HTTP/1.1 100 Continue\r\n\r\n");
+
+    ::send(fd, body.data(), body.size(), 0);
+    auto responses = readResponses(fd, 2); // stops at EOF
+    ASSERT_EQ(responses.size(), 1u);
+    EXPECT_EQ(responses[0], "HTTP/1.1 200{\"res\":42.0}");
+    ::close(fd);
+}
+
+// A client that pipelines requests and then shuts down its sending side
+// still gets every answer before the server closes.
+TEST_F(EpollServerTest, HalfCloseStillAnswered) {
+    int fd = connectTo(port);
+    ASSERT_GE(fd, 0);
+    std::string wire;
+    for (int i = 0; i < 20; ++i) {
+        wire += post(json{{"sid", "H"}, {"exp", "n = " + std::to_string(i)}}.dump());
+    }
+    ASSERT_EQ(::send(fd, wire.data(), wire.size(), 0), static_cast<ssize_t>(wire.size()));
+    ::shutdown(fd, SHUT_WR);
+
+    auto responses = readResponses(fd, 21); // stops at EOF
+    ASSERT_EQ(responses.size(), 20u);
+    EXPECT_EQ(responses.back(), "HTTP/1.1 200{\"res\":19.0}");
+    ::close(fd);
+}
+
+// "100 Continue" for a request does not overtake the answer to the one
+// pipelined before it.
+TEST_F(EpollServerTest, ContinueKeepsResponseOrder) {
+    int fd = connectTo(port);
+    std::string body = R"({"exp":"6 * 7"})";
+    std::string wire = post(R"({"exp":"1 + 1"})") +
+                       "POST /calculate HTTP/1.1\r\nExpect: 100-continue\r\nConnection: close\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    ::send(fd, wire.data(), wire.size(), 0);
+
+    std::string received;
+    char buffer[4096];
+    while (received.find("100 Continue") == std::string::npos) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        ASSERT_GT(n, 0);
+        received.append(buffer, static_cast<size_t>(n));
+    }
+    EXPECT_LT(received.find("{\"res\":2.0}"), received.find("100 Continue"));
+
+    ::send(fd, body.data(), body.size(), 0);
+    while (true) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        received.append(buffer, static_cast<size_t>(n));
+    }
+    EXPECT_NE(received.find("{\"res\":42.0}"), std::string::npos);
+    ::close(fd);
+}
+
+// Idle connections hold no thread; a new client is still served at once.
+TEST_F(EpollServerTest, ManyIdleConnections) {
+    std::vector<int> idle;
+    for (int i = 0; i < 1000; ++i) {
+        int fd = connectTo(port);
+        ASSERT_GE(fd, 0);
+        idle.push_back(fd);
+    }
+    for (int i = 0; i < 200 && server.connectionCount() < idle.size(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.connectionCount(), idle.size());
+
+    httplib::Client cli("127.0.0.1", port);
+    auto res = cli.Post("/calculate", R"({"exp":"1 + 1"})", "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(json::parse(res->body)["res"], 2.0);
+
+    for (int fd : idle) ::close(fd);
+    for (int i = 0; i < 200 && server.connectionCount() > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.connectionCount(), 0u);
+}
+
+TEST(EpollServerLimitsTest, IdleConnectionsAreClosed) {
+    CalcService service;
+    EpollServer server(service, EpollServer::Options{1, 1, std::chrono::milliseconds(400)});
+    int port = server.bind("127.0.0.1", 0);
+    std::thread thread([&server]() { server.listen(); });
+
+    int idle = connectTo(port);
+    int active = connectTo(port);
+    ASSERT_GE(idle, 0);
+    ASSERT_GE(active, 0);
+    for (int i = 0; i < 6; ++i) {
+        std::string request = post(R"({"exp":"1 + 1"})");
+        ASSERT_EQ(::send(active, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+        ASSERT_EQ(readResponses(active, 1).size(), 1u);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    EXPECT_TRUE(closedByPeer(idle));
+    EXPECT_EQ(server.idleClosedCount(), 1u);
+    EXPECT_TRUE(closedByPeer(active)); // once it goes quiet too
+
+    ::close(idle);
+    ::close(active);
+    server.stop();
+    thread.join();
+}
+
+// Out of descriptors, waiting connections are refused rather than left in
+// the backlog with the listen socket waking the loop over and over.
+TEST(EpollServerLimitsTest, RefusesConnectionsWhenOutOfDescriptors) {
+    CalcService service;
+    EpollServer server(service, EpollServer::Options{1, 1, std::chrono::milliseconds(0)});
+    int port = server.bind("127.0.0.1", 0);
+    std::thread thread([&server]() { server.listen(); });
+
+    // Client sockets exist before the limit drops; connecting them needs
+    // no new descriptor, accepting them does.
+    std::vector<int> clients;
+    for (int i = 0; i < 4; ++i) {
+        clients.push_back(::socket(AF_INET, SOCK_STREAM, 0));
+        ASSERT_GE(clients.back(), 0);
+    }
+    int lowestFree = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(lowestFree, 0);
+    ::close(lowestFree);
+    rlimit saved{};
+    ASSERT_EQ(::getrlimit(RLIMIT_NOFILE, &saved), 0);
+    rlimit lowered = saved;
+    lowered.rlim_cur = static_cast<rlim_t>(lowestFree);
+    ASSERT_EQ(::setrlimit(RLIMIT_NOFILE, &lowered), 0);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::vector<bool> refused;
+    for (int fd : clients) {
+        EXPECT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        refused.push_back(closedByPeer(fd));
+    }
+    ::setrlimit(RLIMIT_NOFILE, &saved);
+
+    for (bool closed : refused) {
+        EXPECT_TRUE(closed);
+    }
+    EXPECT_EQ(server.refusedCount(), clients.size());
+    EXPECT_EQ(server.connectionCount(), 0u);
+    for (int fd : clients) ::close(fd);
+
+    // With descriptors back, connections are served again.
+    httplib::Client cli("127.0.0.1", port);
+    auto res = cli.Post("/calculate", R"({"exp":"1 + 1"})", "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(json::parse(res->body)["res"], 2.0);
+
+    server.stop();
+    thread.join();
+}
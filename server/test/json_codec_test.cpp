@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+#include "json_codec.h"
+#include "nlohmann/json.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+
+using json = nlohmann::json;
+
+namespace {
+
+std::string number(double value) {
+    std::string out;
+    appendJsonNumber(out, value);
+    return out;
+}
+
+std::string encodedString(std::string_view text) {
+    std::string out;
+    appendJsonString(out, text);
+    return out;
+}
+
+} // namespace
+
+TEST(JsonCodecTest, DecodesTheCommonShapes) {
+    CalculateRequest request;
+    ASSERT_TRUE(decodeCalculateRequest(R"({"sid":"A","exp":"x = 2 * 3"})", request));
+    EXPECT_EQ(request.sid, "A");
+    EXPECT_EQ(request.exp, "x = 2 * 3");
+    EXPECT_FALSE(request.cmd);
+    EXPECT_FALSE(request.var);
+
+    ASSERT_TRUE(decodeCalculateRequest(" {\n \"cmd\" : \"unbind\",\t\"var\":\"y\" } \r\n", request));
+    EXPECT_FALSE(request.sid);
+    EXPECT_EQ(request.cmd, "unbind");
+    EXPECT_EQ(request.var, "y");
+
+    ASSERT_TRUE(decodeCalculateRequest(R"({})", request));
+    EXPECT_FALSE(request.exp);
+
+    // Escapes are decoded; everything nlohmann::json reads the same way.
+    const std::string escaped = R"({"exp":"a = \"q\\\/\" ; b\n\t"})";
+    ASSERT_TRUE(decodeCalculateRequest(escaped, request));
+    EXPECT_EQ(request.exp, json::parse(escaped)["exp"].get<std::string>());
+}
+
+TEST(JsonCodecTest, LeavesEverythingElseToTheGenericParser) {
+    CalculateRequest request;
+    for (const char* body : {
+             R"({"exp":"1","extra":"x"})",   // unknown member
+             R"({"exp":1})",                 // not a string
+             R"({"sid":null,"exp":"1"})",
+             R"({"exp":"1","exp":"2"})",     // duplicate
+             R"({"exp":"\u0031"})",         // \u escape
+             "{\"exp\":\"\xC3\xA9\"}",       // non-ASCII
+             "{\"exp\":\"a\tb\"}",           // raw control character
+             R"({"exp":"1",})",              // trailing comma
+             R"({"exp":"1"} x)",             // trailing garbage
+             R"({"exp":"1")",                // truncated
+             R"({"exp" "1"})",
+             R"({"sid":"a" "exp":"1"})",     // missing comma
+             R"(["exp","1"])",
+             "",
+         }) {
+        EXPECT_FALSE(decodeCalculateRequest(body, request)) << body;
+    }
+}
+
+TEST(JsonCodecTest, NumbersMatchNlohmann) {
+    const double values[] = {
+        0.0, -0.0, 1.0, -1.0, 42.0, 5.0, 0.1, 0.3, 1.0 / 3.0, -2.5, 123456.789, 1e15, 1e16, 123456789012345.0,
+        1234567890123456.0, 1e-4, 1e-5, 0.000123, 1.5e-7, 1e300, -1e-300, 5e-324, 2.2250738585072014e-308,
+        std::numeric_limits<double>::max(), 9007199254740993.0, 18.84, 100.0, 0.5, 1e21,
+    };
+    for (double value : values) {
+        EXPECT_EQ(number(value), json(value).dump()) << value;
+    }
+    EXPECT_EQ(number(std::nan("")), "null");
+    EXPECT_EQ(number(std::numeric_limits<double>::infinity()), "null");
+
+    // Arbitrary bit patterns: always the shortest text that reads back as
+    // the same double (nlohmann's Grisu2 is not always the shortest).
+    std::mt19937_64 random(42);
+    for (int i = 0; i < 100000; ++i) {
+        uint64_t bits = random();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        if (!std::isfinite(value)) continue;
+        std::string text = number(value);
+        EXPECT_EQ(std::strtod(text.c_str(), nullptr), value) << text;
+        EXPECT_LE(text.size(), json(value).dump().size()) << text;
+    }
+}
+
+TEST(JsonCodecTest, StringsAreEscapedLikeNlohmann) {
+    for (std::string text : {std::string("plain"), std::string("quote \" and \\ slash /"),
+                             std::string("tab\tnew\nline\r\b\f"), std::string("\x01\x1f\x7f"),
+                             std::string("caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80"), std::string()}) {
+        EXPECT_EQ(encodedString(text), json(text).dump()) << text;
+    }
+    // Where nlohmann would throw, invalid bytes become U+FFFD.
+    EXPECT_EQ(encodedString("Invalid character in expression: \xC3"), "\"Invalid character in expression: \xEF\xBF\xBD\"");
+    EXPECT_EQ(encodedString("\xED\xA0\x80x"), "\"\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBDx\""); // surrogate
+}
@@ -0,0 +1,59 @@
+#include "gtest/gtest.h"
+#include "calc_service.h"
+#include "metrics.h"
+#include <sstream>
+#include <thread>
+#include <vector>
+
+TEST(MetricsTest, CountsRequestsPerThreadWithoutLosingAny) {
+    Metrics metrics;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&metrics]() {
+            for (int i = 0; i < 1000; ++i) {
+                metrics.recordRequest(Metrics::Endpoint::CALCULATE, Metrics::Outcome::OK);
+                metrics.recordStage(Metrics::Stage::REQUEST, std::chrono::microseconds(3));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(metrics.requestCount(Metrics::Endpoint::CALCULATE, Metrics::Outcome::OK), 8000u);
+    EXPECT_EQ(metrics.stageCount(Metrics::Stage::REQUEST), 8000u);
+}
+
+TEST(MetricsTest, RendersCumulativeHistogramBuckets) {
+    Metrics metrics;
+    metrics.recordStage(Metrics::Stage::TOKENIZE, std::chrono::nanoseconds(100));     // <= 250ns
+    metrics.recordStage(Metrics::Stage::TOKENIZE, std::chrono::microseconds(20));     // <= 25us
+    metrics.recordStage(Metrics::Stage::TOKENIZE, std::chrono::seconds(5));           // +Inf
+
+    std::ostringstream out;
+    metrics.render(out);
+    std::string text = out.str();
+    EXPECT_NE(text.find("# TYPE calc_stage_duration_seconds histogram"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_bucket{stage=\"tokenize\",le=\"2.5e-07\"} 1\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("calc_stage_duration_seconds_bucket{stage=\"tokenize\",le=\"2.5e-05\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_bucket{stage=\"tokenize\",le=\"+Inf\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_count{stage=\"tokenize\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_sum{stage=\"tokenize\"} 5.0000201\n"), std::string::npos);
+}
+
+TEST(MetricsTest, ServiceReportsCalculatorStagesAndGauges) {
+    CalcService service;
+    service.calculate("a", "x = 2 * 3");
+    service.calculate("b", "x = 2 * 3"); // cache hit: only EXECUTE runs again
+    EXPECT_THROW(service.calculate("a", "1 / 0"), std::runtime_error);
+
+    Metrics& metrics = service.metrics();
+    EXPECT_EQ(metrics.stageCount(Metrics::Stage::TOKENIZE), 2u);
+    EXPECT_EQ(metrics.stageCount(Metrics::Stage::SHUNTING_YARD), 2u);
+    EXPECT_EQ(metrics.stageCount(Metrics::Stage::COMPILE), 2u);
+    EXPECT_EQ(metrics.stageCount(Metrics::Stage::EXECUTE), 3u);
+
+    std::string text = service.renderMetrics();
+    EXPECT_NE(text.find("calc_sessions_active 2\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("calc_expression_cache_hits_total 1\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_expression_cache_misses_total 2\n"), std::string::npos);
+}
@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+#include "ndjson_stream.h"
+#include "nlohmann/json.hpp"
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+
+std::vector<json> readAll(ResultSpool& spool) {
+    std::string text;
+    char buffer[7]; // small on purpose: reads must resume mid-line
+    while (size_t n = spool.read(buffer, sizeof(buffer))) {
+        text.append(buffer, n);
+    }
+    std::vector<json> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        lines.push_back(json::parse(text.substr(start, end - start)));
+        start = end + 1;
+    }
+    return lines;
+}
+
+} // namespace
+
+TEST(ResultSpoolTest, SpillsToFileBeyondMemoryLimit) {
+    ResultSpool spool(10);
+    spool.append("0123456789");
+    EXPECT_FALSE(spool.spilled());
+    spool.append("abcdef");
+    EXPECT_TRUE(spool.spilled());
+    EXPECT_EQ(spool.size(), 16u);
+
+    std::string text;
+    char buffer[4];
+    while (size_t n = spool.read(buffer, sizeof(buffer))) {
+        text.append(buffer, n);
+    }
+    EXPECT_EQ(text, "0123456789abcdef");
+}
+
+TEST(NdjsonStreamTest, RecordsSplitAcrossChunksKeepOrder) {
+    CalcService service;
+    ResultSpool spool;
+    NdjsonStream stream(service, spool, 2);
+    const std::string body =
+        "{\"sid\":\"a\",\"exp\":\"x = 2\"}\n"
+        "{\"sid\":\"b\",\"exp\":\"x = 10\"}\n"
+        "not json\n"
+        "\n"
+        "{\"sid\":\"a\",\"exp\":\"x * 3\"}\r\n"
+        "{\"sid\":\"b\",\"exp\":\"x / 0\"}\n"
+        "{\"exp\":\"1 + 1\"}";  // last line without a newline
+
+    // Feed byte by byte: every record is split across chunks.
+    for (char c : body) {
+        stream.feed(&c, 1);
+    }
+    stream.finish();
+
+    auto lines = readAll(spool);
+    ASSERT_EQ(lines.size(), 7u);
+    EXPECT_EQ(lines[0]["res"], 2.0);
+    EXPECT_EQ(lines[1]["res"], 10.0);
+    EXPECT_TRUE(lines[2].contains("err"));
+    EXPECT_EQ(lines[3]["res"], 6.0);
+    EXPECT_EQ(lines[4]["err"], "Division by zero");
+    EXPECT_EQ(lines[5]["res"], 2.0);
+    EXPECT_EQ(lines[6]["records"], 6);
+    EXPECT_EQ(lines[6]["errors"], 2);
+    EXPECT_TRUE(lines[6].contains("records_per_second"));
+}
+
+TEST(NdjsonStreamTest, RecordsOverTheSessionRateAreNotEvaluated) {
+    CalcService::Options options;
+    options.admission.sessionRate = 0.001; // no refill during the test
+    options.admission.sessionBurst = 2;
+    CalcService service(options);
+    ResultSpool spool;
+    NdjsonStream stream(service, spool);
+    const std::string body =
+        "{\"sid\":\"a\",\"exp\":\"x = 1\"}\n"
+        "{\"sid\":\"a\",\"exp\":\"x = x + 1\"}\n"
+        "{\"sid\":\"b\",\"exp\":\"7\"}\n"
+        "{\"sid\":\"a\",\"exp\":\"x = x + 1\"}\n";
+    stream.feed(body.data(), body.size());
+    stream.finish();
+
+    auto lines = readAll(spool);
+    ASSERT_EQ(lines.size(), 5u);
+    EXPECT_EQ(lines[1]["res"], 2.0);
+    EXPECT_EQ(lines[2]["res"], 7.0);
+    EXPECT_EQ(lines[3]["err"], "Rate limit exceeded for session: a");
+    EXPECT_EQ(service.calculate("a", "x"), 2.0);
+    EXPECT_EQ(service.admission().stats().rejected[static_cast<size_t>(AdmissionControl::Reason::SESSION_RATE)], 1u);
+}
+
+TEST(NdjsonStreamTest, RejectsOverlongRecords) {
+    CalcService service;
+    ResultSpool spool;
+    NdjsonStream stream(service, spool);
+    std::string chunk(64 * 1024, ' ');
+    EXPECT_THROW({
+        for (size_t sent = 0; sent <= NdjsonStream::kMaxLineLength; sent += chunk.size()) {
+            stream.feed(chunk.data(), chunk.size());
+        }
+    }, std::runtime_error);
+}
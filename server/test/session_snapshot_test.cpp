@@ -0,0 +1,184 @@
+#include "gtest/gtest.h"
+#include "calc_service.h"
+#include "session_snapshot.h"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+std::string tempSnapshotPath(const std::string& name) {
+    return "/tmp/" + name + "_" + std::to_string(::getpid()) + ".snap";
+}
+
+} // namespace
+
+TEST(SessionSnapshotTest, RoundTripIntoFreshService) {
+    const std::string path = tempSnapshotPath("roundtrip");
+    {
+        CalcService service;
+        service.calculate("A", "x = 5; rate = 0.25");
+        service.calculate("B", "y = 0 - 1234.5678");
+        service.calculate("C", "z = 1");
+        service.clean("C"); // empty sessions are not saved
+
+        SnapshotStats stats = saveSessionSnapshot(service, path);
+        EXPECT_EQ(stats.sessions, 2u);
+        EXPECT_EQ(stats.variables, 3u);
+    }
+
+    CalcService restored;
+    // Different interning order than the saving process: slots are remapped.
+    restored.calculate("other", "rate = 1; y = 2");
+
+    SnapshotStats stats = loadSessionSnapshot(restored, path);
+    EXPECT_EQ(stats.sessions, 2u);
+    EXPECT_EQ(stats.variables, 3u);
+    EXPECT_DOUBLE_EQ(restored.calculate("A", "x + rate"), 5.25);
+    EXPECT_DOUBLE_EQ(restored.calculate("B", "y"), -1234.5678);
+    EXPECT_THROW(restored.calculate("B", "x"), std::runtime_error);
+    EXPECT_THROW(restored.calculate("C", "z"), std::runtime_error);
+    EXPECT_DOUBLE_EQ(restored.calculate("other", "rate + y"), 3.0);
+    std::remove(path.c_str());
+}
+
+TEST(SessionSnapshotTest, BoundFormulasStayBound) {
+    const std::string path = tempSnapshotPath("formulas");
+    {
+        CalcService service;
+        service.calculate("A", "price = 10; qty = 3");
+        service.bind("A", "total = price * qty");
+        service.bind("A", "taxed = total * 2");
+        service.bind("B", "y = missing + 1"); // no value yet, saved anyway
+
+        SnapshotStats stats = saveSessionSnapshot(service, path);
+        EXPECT_EQ(stats.sessions, 2u);
+        EXPECT_EQ(stats.formulas, 3u);
+    }
+
+    CalcService restored;
+    SnapshotStats stats = loadSessionSnapshot(restored, path);
+    EXPECT_EQ(stats.formulas, 3u);
+    EXPECT_EQ(restored.bindings("A").size(), 2u);
+    EXPECT_DOUBLE_EQ(restored.calculate("A", "taxed"), 60.0);
+    restored.calculate("A", "qty = 4");
+    EXPECT_DOUBLE_EQ(restored.calculate("A", "taxed"), 80.0);
+    EXPECT_THROW(restored.calculate("A", "total = 1"), std::runtime_error);
+    restored.calculate("B", "missing = 1");
+    EXPECT_DOUBLE_EQ(restored.calculate("B", "y"), 2.0);
+    std::remove(path.c_str());
+}
+
+TEST(SessionSnapshotTest, FunctionsAreRestored) {
+    const std::string path = tempSnapshotPath("functions");
+    {
+        CalcService service;
+        service.defineFunction("A", "area(w, h) = w * h", false);
+        service.defineFunction("", "double(x) = 2 * x", true);
+        service.defineFunction("", "area(w, h) = 0", true); // shadowed in A
+
+        SnapshotStats stats = saveSessionSnapshot(service, path);
+        EXPECT_EQ(stats.sessions, 1u);
+        EXPECT_EQ(stats.functions, 3u);
+    }
+
+    CalcService restored;
+    SnapshotStats stats = loadSessionSnapshot(restored, path);
+    EXPECT_EQ(stats.functions, 3u);
+    EXPECT_DOUBLE_EQ(restored.calculate("A", "area(2, 3) + double(1)"), 8.0);
+    EXPECT_DOUBLE_EQ(restored.calculate("B", "area(2, 3) + double(1)"), 2.0);
+    std::remove(path.c_str());
+}
+
+// Requests keep running while snapshots are taken. Every script updates x
+// and y together, so any snapshot of a torn script restores x != y.
+TEST(SessionSnapshotTest, SaveWhileRequestsRun) {
+    const std::string path = tempSnapshotPath("concurrent");
+    CalcService service;
+    const int kSessions = 32;
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; !stop; ++i) {
+                std::string sid = "s" + std::to_string((i * 4 + t) % kSessions);
+                service.calculate(sid, "x = " + std::to_string(i) + "; y = x");
+            }
+        });
+    }
+    for (int i = 0; i < 20; ++i) {
+        saveSessionSnapshot(service, path);
+    }
+    stop = true;
+    for (auto& writer : writers) writer.join();
+
+    CalcService restored;
+    SnapshotStats stats = loadSessionSnapshot(restored, path);
+    EXPECT_GT(stats.sessions, 0u);
+    for (int s = 0; s < kSessions; ++s) {
+        std::string sid = "s" + std::to_string(s);
+        if (restored.sessions().find(sid)) {
+            EXPECT_DOUBLE_EQ(restored.calculate(sid, "x - y"), 0.0) << sid;
+        }
+    }
+    std::remove(path.c_str());
+}
+
+TEST(SessionSnapshotTest, CorruptFilesRestoreNothing) {
+    const std::string path = tempSnapshotPath("corrupt");
+    {
+        CalcService service;
+        service.calculate("A", "x = 1");
+        service.calculate("B", "y = 2");
+        saveSessionSnapshot(service, path);
+    }
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    auto write = [&](const std::string& content) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << content;
+    };
+
+    CalcService restored;
+    write(bytes.substr(0, bytes.size() - 3));
+    EXPECT_THROW(loadSessionSnapshot(restored, path), std::runtime_error);
+    write("not a snapshot at all, but long enough for a header");
+    EXPECT_THROW(loadSessionSnapshot(restored, path), std::runtime_error);
+    std::string badSlot = bytes;
+    badSlot[40 + 4 + 1 + 4] = 0x7f; // first variable slot of the first session
+    write(badSlot);
+    EXPECT_THROW(loadSessionSnapshot(restored, path), std::runtime_error);
+    EXPECT_EQ(restored.sessions().size(), 0u);
+
+    std::remove(path.c_str());
+    EXPECT_THROW(loadSessionSnapshot(restored, path), std::runtime_error);
+}
+
+TEST(SessionSnapshotTest, SchedulerSavesPeriodically) {
+    const std::string path = tempSnapshotPath("scheduler");
+    std::remove(path.c_str());
+    CalcService service;
+    service.calculate("A", "x = 42");
+
+    std::atomic<int> reports{0};
+    SnapshotScheduler scheduler(service, path, std::chrono::seconds(1),
+                                [&](const std::string&) { ++reports; });
+    for (int i = 0; i < 300 && reports == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    scheduler.stop();
+    EXPECT_GE(reports.load(), 1);
+
+    CalcService restored;
+    loadSessionSnapshot(restored, path);
+    EXPECT_DOUBLE_EQ(restored.calculate("A", "x"), 42.0);
+    std::remove(path.c_str());
+}
@@ -0,0 +1,316 @@
+#include "gtest/gtest.h"
+#include "calc_service.h"
+#include "session_store.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(SessionStoreTest, GetOrCreateReturnsSameSession) {
+    SessionStore store(4);
+    auto a = store.getOrCreate("A");
+    auto again = store.getOrCreate("A");
+    auto b = store.getOrCreate("B");
+
+    EXPECT_EQ(a, again);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(store.size(), 2u);
+    EXPECT_EQ(store.find("C"), nullptr);
+
+    EXPECT_TRUE(store.erase("A"));
+    EXPECT_FALSE(store.erase("A"));
+    EXPECT_EQ(store.size(), 1u);
+}
+
+TEST(SessionStoreTest, IdleSessionsExpire) {
+    SessionStore::Limits limits;
+    limits.idleTtl = std::chrono::seconds(60);
+    SessionStore store(4, limits);
+    store.getOrCreate("A");
+    store.getOrCreate("B");
+
+    EXPECT_EQ(store.expireIdle(), 0u);
+    EXPECT_EQ(store.expireIdle(SessionStore::Clock::now() + std::chrono::seconds(61)), 2u);
+    EXPECT_EQ(store.size(), 0u);
+    EXPECT_EQ(store.stats().evictedIdle, 2u);
+    EXPECT_EQ(store.stats().bytes, 0u);
+}
+
+// Accesses expire only a bounded number of idle sessions each.
+TEST(SessionStoreTest, IdleExpiryIsIncremental) {
+    SessionStore::Limits limits;
+    limits.idleTtl = std::chrono::seconds(1);
+    SessionStore store(1, limits);
+    for (int i = 0; i < 10; ++i) {
+        store.getOrCreate("s" + std::to_string(i));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    store.getOrCreate("fresh");
+    EXPECT_EQ(store.size(), 10 - SessionStore::kExpireBatch + 1);
+    store.getOrCreate("fresh");
+    store.getOrCreate("fresh");
+    EXPECT_EQ(store.size(), 1u);
+    EXPECT_NE(store.find("fresh"), nullptr);
+}
+
+TEST(SessionStoreTest, CountCapEvictsLeastRecentlyUsed) {
+    SessionStore::Limits limits;
+    limits.maxSessions = 3;
+    SessionStore store(1, limits);
+    auto a = store.getOrCreate("A");
+    store.getOrCreate("B");
+    store.getOrCreate("C");
+    EXPECT_EQ(store.getOrCreate("A"), a); // A is now the most recent
+    store.getOrCreate("D");
+
+    EXPECT_EQ(store.size(), 3u);
+    EXPECT_EQ(store.find("B"), nullptr);
+    EXPECT_EQ(store.find("A"), a);
+    EXPECT_EQ(store.stats().evictedCount, 1u);
+}
+
+TEST(SessionStoreTest, MemoryCapEvictsLeastRecentlyUsed) {
+    auto fill = [](SessionStore& store, const std::string& sid, uint32_t variables) {
+        auto session = store.getOrCreate(sid);
+        std::lock_guard<std::mutex> lock(session->mutex);
+        for (uint32_t slot = 0; slot < variables; ++slot) {
+            session->variables.set(slot, slot);
+        }
+        store.account(sid, *session);
+    };
+    SessionStore unlimited(1);
+    fill(unlimited, "A", 1000);
+    const size_t perSession = unlimited.stats().bytes;
+
+    // Room for two such sessions, not three.
+    SessionStore::Limits limits;
+    limits.maxBytes = perSession * 5 / 2;
+    SessionStore store(1, limits);
+    fill(store, "A", 1000);
+    fill(store, "B", 1000);
+    EXPECT_EQ(store.stats().evictedMemory, 0u);
+    fill(store, "C", 1000);
+
+    auto stats = store.stats();
+    EXPECT_EQ(stats.evictedMemory, 1u);
+    EXPECT_EQ(stats.sessions, 2u);
+    EXPECT_LE(stats.bytes, limits.maxBytes);
+    EXPECT_EQ(store.find("A"), nullptr);
+
+    // Growing an existing session is accounted as well.
+    fill(store, "B", 2000);
+    EXPECT_EQ(store.find("C"), nullptr);
+    EXPECT_EQ(store.stats().evictedMemory, 2u);
+}
+
+TEST(CalcServiceTest, EvictedSessionStartsOver) {
+    CalcService::Options options;
+    options.sessionShards = 1;
+    options.sessionLimits.maxSessions = 2;
+    CalcService service(options);
+    service.calculate("A", "x = 1");
+    service.calculate("B", "x = 2");
+    service.calculate("C", "x = 3");
+
+    EXPECT_THROW(service.calculate("A", "x"), std::runtime_error);
+    EXPECT_DOUBLE_EQ(service.calculate("C", "x"), 3.0);
+    std::string metrics = service.renderMetrics();
+    EXPECT_NE(metrics.find("calc_session_evictions_total{reason=\"count\"} 2\n"), std::string::npos) << metrics;
+}
+
+TEST(CalcServiceTest, FunctionsAndFormulasCountTowardsSessionMemory) {
+    CalcService::Options options;
+    options.sessionShards = 1;
+    CalcService service(options);
+    service.calculate("A", "x = 1");
+    const size_t plain = service.sessions().stats().bytes;
+
+    service.defineFunction("A", "f(a, b) = a * b + 3 * a - b / 2", false);
+    const size_t withFunction = service.sessions().stats().bytes;
+    EXPECT_GT(withFunction, plain);
+    service.bind("A", "y = x * 2 + 1");
+    const size_t withFormula = service.sessions().stats().bytes;
+    EXPECT_GT(withFormula, withFunction);
+
+    EXPECT_TRUE(service.unbind("A", "y"));
+    EXPECT_TRUE(service.undefineFunction("A", "f", false));
+    EXPECT_LT(service.sessions().stats().bytes, withFunction);
+
+    // Code alone pushes a session store over its memory cap.
+    CalcService::Options capped = options;
+    capped.sessionLimits.maxBytes = 8 * withFormula;
+    CalcService bounded(capped);
+    bounded.calculate("B", "x = 1");
+    for (int i = 0; i < 64; ++i) {
+        bounded.defineFunction("A", "f" + std::to_string(i) + "(a) = a * 2 + 1", false);
+    }
+    EXPECT_EQ(bounded.sessions().find("B"), nullptr);
+    EXPECT_EQ(bounded.sessions().stats().evictedMemory, 1u);
+}
+
+TEST(CalcServiceTest, SessionsAreIsolated) {
+    CalcService service;
+    service.calculate("A", "x = 5");
+    ASSERT_THROW(service.calculate("B", "x + 1"), std::runtime_error);
+    ASSERT_DOUBLE_EQ(service.calculate("A", "x + 1"), 6.0);
+
+    service.clean("A");
+    ASSERT_THROW(service.calculate("A", "x + 1"), std::runtime_error);
+}
+
+TEST(CalcServiceTest, MemoizesReadOnlyExpressionsUntilInputsChange) {
+    CalcService::Options options;
+    options.resultCacheBytes = 64 * 1024;
+    CalcService service(options);
+    service.calculate("A", "x = 2; y = 3; z = 100");
+
+    EXPECT_DOUBLE_EQ(service.calculate("A", "x * y"), 6.0);  // miss
+    EXPECT_DOUBLE_EQ(service.calculate("A", "x * y"), 6.0);  // hit
+    service.calculate("A", "z = 5");                          // not an input
+    EXPECT_DOUBLE_EQ(service.calculate("A", "x * y"), 6.0);  // hit
+    service.calculate("A", "y = 4");
+    EXPECT_DOUBLE_EQ(service.calculate("A", "x * y"), 8.0);  // miss
+    EXPECT_DOUBLE_EQ(service.calculate("B", "2 * 2"), 4.0);   // miss: other session
+
+    service.clean("A");
+    EXPECT_THROW(service.calculate("A", "x * y"), std::runtime_error);
+
+    std::string metrics = service.renderMetrics();
+    EXPECT_NE(metrics.find("calc_result_cache_hits_total 2\n"), std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("calc_result_cache_misses_total 4\n"), std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("calc_result_cache_hit_ratio 0.333"), std::string::npos) << metrics;
+}
+
+TEST(CalcServiceTest, SessionFunctionsShadowGlobalOnes) {
+    CalcService service;
+    service.defineFunction("A", "sq(v) = v * v", true);
+    service.defineFunction("A", "f(a, b) = a * b + 3", false);
+    EXPECT_DOUBLE_EQ(service.calculate("A", "x = 4; f(2, x) + sq(3)"), 20.0);
+    EXPECT_DOUBLE_EQ(service.calculate("B", "sq(5)"), 25.0);
+    EXPECT_THROW(service.calculate("B", "f(1, 2)"), std::runtime_error);
+
+    service.defineFunction("B", "sq(v) = 0 - v", false);
+    EXPECT_DOUBLE_EQ(service.calculate("B", "sq(5)"), -5.0);
+    auto functions = service.functions("B");
+    ASSERT_EQ(functions.size(), 1u);
+    EXPECT_FALSE(functions[0].global);
+
+    EXPECT_FALSE(service.undefineFunction("A", "sq", false));
+    EXPECT_TRUE(service.undefineFunction("A", "sq", true));
+    EXPECT_THROW(service.calculate("A", "sq(2)"), std::runtime_error);
+    EXPECT_DOUBLE_EQ(service.calculate("B", "sq(5)"), -5.0);
+
+    service.clean("B");
+    EXPECT_TRUE(service.functions("B").empty());
+    EXPECT_EQ(service.functions("A").size(), 1u);
+}
+
+// Many threads hammer many sids, several threads sharing each sid. Every
+// script reads and writes the same variable twice, so a lost update or a
+// torn script shows up as a wrong final count.
+TEST(CalcServiceTest, StressManySessionsManyThreads) {
+    CalcService service;
+    const int kSessions = 64;
+    const int kThreads = 16;
+    const int kIterations = 400;
+
+    for (int s = 0; s < kSessions; ++s) {
+        service.calculate("sid" + std::to_string(s), "n = 0; m = 0");
+    }
+
+    std::atomic<int> errors{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < kIterations; ++i) {
+                std::string sid = "sid" + std::to_string((t * 7 + i) % kSessions);
+                try {
+                    // m must always equal n after the script; checked below
+                    double diff = service.calculate(sid, "n = n + 1; m = m + 1; n - m");
+                    if (diff != 0.0) errors++;
+                } catch (const std::exception&) {
+                    errors++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(errors.load(), 0);
+    double total = 0;
+    for (int s = 0; s < kSessions; ++s) {
+        total += service.calculate("sid" + std::to_string(s), "n");
+    }
+    EXPECT_DOUBLE_EQ(total, static_cast<double>(kThreads) * kIterations);
+    EXPECT_EQ(service.sessions().size(), static_cast<size_t>(kSessions));
+}
+
+TEST(CalcServiceTest, BatchFansOutAcrossSessions) {
+    CalcService::Options options;
+    options.workerThreads = 4;
+    CalcService service(options);
+
+    std::vector<CalcService::BatchItem> items;
+    for (int i = 0; i < 100; ++i) {
+        std::string sid = "s" + std::to_string(i % 10);
+        items.push_back({sid, i < 10 ? "n = 1" : "n = n + 1"});
+    }
+    items.push_back({"s0", "n / 0"});
+
+    auto results = service.calculateBatch(items);
+    ASSERT_EQ(results.size(), items.size());
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(results[i].ok) << results[i].error;
+        // The i-th item is the (i / 10 + 1)-th update of its session
+        EXPECT_DOUBLE_EQ(results[i].value, i / 10 + 1);
+    }
+    EXPECT_FALSE(results.back().ok);
+    EXPECT_EQ(results.back().error, "Division by zero");
+}
+
+// A batch cannot get around --session-rate: every item pays for itself.
+TEST(CalcServiceTest, BatchItemsTakeSessionTokens) {
+    CalcService::Options options;
+    options.admission.sessionRate = 0.001; // no refill during the test
+    options.admission.sessionBurst = 2;
+    CalcService service(options);
+
+    auto results = service.calculateBatch(
+        {{"a", "x = 1"}, {"a", "x = x + 1"}, {"b", "7"}, {"a", "x = x + 1"}, {"a", "x = x + 1"}});
+    ASSERT_EQ(results.size(), 5u);
+    EXPECT_DOUBLE_EQ(results[1].value, 2.0);
+    EXPECT_DOUBLE_EQ(results[2].value, 7.0);
+    for (size_t i : {3, 4}) {
+        EXPECT_FALSE(results[i].ok);
+        EXPECT_EQ(results[i].error, "Rate limit exceeded for session: a");
+    }
+    EXPECT_DOUBLE_EQ(service.calculate("a", "x"), 2.0);
+    EXPECT_EQ(service.admission().stats().rejected[static_cast<size_t>(AdmissionControl::Reason::SESSION_RATE)], 2u);
+}
+
+// Requests cannot grow the shared symbol table by reading made-up names.
+TEST(CalcServiceTest, UnknownReadsDoNotGrowTheSymbolTable) {
+    CalcService::Options options;
+    options.maxSymbols = 3;
+    CalcService service(options);
+    service.calculate("a", "x = 1");
+    const size_t interned = service.calculator().symbols().size();
+
+    for (int i = 0; i < 100; ++i) {
+        const std::string expression = "x + unknown" + std::to_string(i);
+        double result = 0.0;
+        CalcError error;
+        EXPECT_FALSE(service.tryCalculate("a", expression, result, error));
+        EXPECT_EQ(error.message(), "Unknown variable: unknown" + std::to_string(i));
+    }
+    EXPECT_EQ(service.calculator().symbols().size(), interned);
+    // Known in another session, so only undefined in this one.
+    EXPECT_THROW(service.calculate("b", "x"), std::runtime_error);
+
+    service.calculate("a", "y = 2; z = 3");
+    EXPECT_THROW(service.calculate("a", "w = 4"), std::runtime_error);
+    EXPECT_NE(service.renderMetrics().find("calc_symbols 3\n"), std::string::npos);
+}
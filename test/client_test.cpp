@@ -6,6 +6,7 @@
 #include <array>   // For std::array
 #include <cstdio>  // For popen, pclose
 #include <memory>  // For std::unique_ptr
+#include <fstream> // For stream input files
 
 // Helper function to execute a command and capture its output
 std::string exec(const std::string& cmd) {
@@ -58,3 +59,51 @@ TEST(ClientCLITests, InvalidExpression) {
     // Expected error from server
     EXPECT_TRUE(output.find("Error from server: Invalid expression") != std::string::npos);
 }
+
+TEST(ClientCLITests, BatchExpressions) {
+    std::string command = CALC_CLIENT_PATH + " -s " + MOCK_SERVER_URL +
+                          " -b -e \"2 + 2\" -e \"invalid expression\" -e \"3 * 3\"";
+    std::string output = exec(command);
+    // One line per expression, in request order
+    EXPECT_EQ(output, "4\nError from server: Invalid expression\n9\n");
+}
+
+TEST(ClientCLITests, LoadTestClosedLoop) {
+    std::string command = CALC_CLIENT_PATH + " -s " + MOCK_SERVER_URL +
+                          " -l -e \"2 + 2\" --connections 2 --duration 1 --report 0.5";
+    std::string output = exec(command);
+    EXPECT_NE(output.find("closed loop"), std::string::npos) << output;
+    EXPECT_NE(output.find("Errors: 0 "), std::string::npos) << output;
+    EXPECT_NE(output.find("p999"), std::string::npos) << output;
+    EXPECT_NE(output.find("[   0.5s]"), std::string::npos) << output; // periodic report
+}
+
+TEST(ClientCLITests, LoadTestOpenLoopCountsErrors) {
+    std::string command = CALC_CLIENT_PATH + " -s " + MOCK_SERVER_URL +
+                          " -l -e \"2 + 2\" -e \"invalid expression\" --rps 200 --duration 1 --report 0";
+    std::string output = exec(command);
+    EXPECT_NE(output.find("open loop at 200 req/s"), std::string::npos) << output;
+    // Roughly 200 requests, about half of them answered with "err"
+    EXPECT_NE(output.find("Requests: 200 "), std::string::npos) << output;
+    EXPECT_EQ(output.find("Errors: 0 "), std::string::npos) << output;
+    EXPECT_NE(output.find("calculation "), std::string::npos) << output;
+}
+
+TEST(ClientCLITests, StreamFromStdinKeepsOrder) {
+    std::string command = "printf '2 + 2\\n:echo\\n\\n3 * 3\\ninvalid expression\\n2 + 2\\n' | " + CALC_CLIENT_PATH +
+                          " -s " + MOCK_SERVER_URL + " --stream --window 2 --sid s1";
+    std::string output = exec(command);
+    // One line per non-empty input line, commands in between expressions
+    EXPECT_EQ(output, "4\necho\n9\nError from server: Invalid expression\n4\n");
+}
+
+TEST(ClientCLITests, StreamFromFile) {
+    const std::string path = "stream_input.txt";
+    {
+        std::ofstream file(path);
+        file << "3 * 3\n2 + 2\n";
+    }
+    std::string output = exec(CALC_CLIENT_PATH + " -s " + MOCK_SERVER_URL + " --stream " + path);
+    std::remove(path.c_str());
+    EXPECT_EQ(output, "9\n4\n");
+}
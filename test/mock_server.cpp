@@ -29,6 +29,26 @@ int main() {
         }
     });
 
+    svr.Post("/calculate/batch", [](const httplib::Request& req, httplib::Response& res) {
+        try {
+            json response_json = json::array();
+            for (const auto& item : json::parse(req.body)) {
+                std::string exp = item.value("exp", "");
+                if (exp == "2 + 2") {
+                    response_json.push_back({{"res", 4}});
+                } else if (exp == "3 * 3") {
+                    response_json.push_back({{"res", 9}});
+                } else {
+                    response_json.push_back({{"err", "Invalid expression"}});
+                }
+            }
+            res.set_content(response_json.dump(), "application/json");
+        } catch (const json::exception& e) {
+            res.status = 400;
+            res.set_content(json{{"err", "Invalid JSON in request body"}}.dump(), "application/json");
+        }
+    });
+
     std::cout << "Mock server listening on port 8081" << std::endl;
     svr.listen("0.0.0.0", 8081); // Listen on a different port than the main server (8080)
 
@@ -1,7 +1,8 @@
 #include "gtest/gtest.h"
 #include "httplib.h"
 #include "nlohmann/json.hpp"
-#include "calculator.h"
+#include "calc_service.h"
+#include "http_api.h"
 #include <thread>
 #include <chrono>
 #include <map> // Include for std::map
@@ -15,65 +16,10 @@ protected:
     void SetUp() override {
         port = svr.bind_to_any_port("localhost");
 
-        server_thread = std::thread([this]() {
-            Calculator calculator;
-
-            // 🔥 LEVEL 11: sessions storage
-            std::unordered_map<
-                std::string,
-                std::map<std::string, double>
-            > sessions;
-
-            svr.Post("/calculate", [&](const httplib::Request &req,
-                                    httplib::Response &res) {
-                json res_json;
-
-                try {
-                    json req_json = json::parse(req.body);
-
-                    // --- SID handling ---
-                    std::string sid = "default";
-                    if (req_json.contains("sid") && req_json["sid"].is_string()) {
-                        sid = req_json["sid"];
-                    }
-
-                    // get session variables (auto-create)
-                    auto& vars = sessions[sid];
-
-                    // --- command ---
-                    if (req_json.contains("cmd")) {
-                        std::string cmd = req_json["cmd"];
-
-                        if (cmd == "echo") {
-                            res_json["res"] = "echo";
-                        }
-                        else if (cmd == "clean") {
-                            vars.clear();
-                            res_json = json::object();
-                        }
-                        else {
-                            throw std::runtime_error("Unknown command: " + cmd);
-                        }
-                    }
-                    // --- expression ---
-                    else if (req_json.contains("exp")) {
-                        double result = calculator.evaluate(req_json["exp"], vars);
-                        res_json["res"] = result;
-                    }
-                    else {
-                        throw std::runtime_error("Invalid JSON format");
-                    }
-
-                    res.status = 200;
-                }
-                catch (const std::exception& e) {
-                    res.status = 400;
-                    res_json["err"] = e.what();
-                }
-
-                res.set_content(res_json.dump(), "application/json");
-            });
+        // 🔥 LEVEL 11: sessions storage — the same handlers as http_server
+        registerHttpApi(svr, service);
 
+        server_thread = std::thread([this]() {
             svr.listen_after_bind();
         });
 
@@ -90,8 +36,8 @@ protected:
         }
     }
 
+    CalcService service;
     httplib::Server svr;
-    // Calculator calc; // This is now created inside the thread
     std::thread server_thread;
     int port;
 };
@@ -312,3 +258,222 @@ TEST_F(ServerIntegrationTest, CleanClearsOnlyOneSession) {
     json j = json::parse(resB->body);
     EXPECT_DOUBLE_EQ(j["res"], 10.0);
 }
+
+TEST_F(ServerIntegrationTest, ConcurrentSessions) {
+    const int kThreads = 8;
+    const int kRequests = 50;
+
+    std::vector<std::thread> clients;
+    for (int t = 0; t < kThreads; ++t) {
+        clients.emplace_back([this, t]() {
+            httplib::Client cli("localhost", port);
+            std::string sid = "S" + std::to_string(t);
+            cli.Post("/calculate", json{{"sid", sid}, {"exp", "n = 0"}}.dump(), "application/json");
+            for (int i = 0; i < kRequests; ++i) {
+                cli.Post("/calculate", json{{"sid", sid}, {"exp", "n = n + 1"}}.dump(), "application/json");
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    httplib::Client cli("localhost", port);
+    for (int t = 0; t < kThreads; ++t) {
+        auto res = cli.Post("/calculate",
+                            json{{"sid", "S" + std::to_string(t)}, {"exp", "n"}}.dump(),
+                            "application/json");
+        ASSERT_TRUE(res);
+        ASSERT_EQ(res->status, 200);
+        EXPECT_DOUBLE_EQ(json::parse(res->body)["res"].get<double>(), kRequests);
+    }
+}
+
+TEST_F(ServerIntegrationTest, BatchKeepsOrderWithinSession) {
+    httplib::Client cli("localhost", port);
+    json batch = json::array({
+        {{"sid", "A"}, {"exp", "x = 1"}},
+        {{"sid", "B"}, {"exp", "x = 100"}},
+        {{"sid", "A"}, {"exp", "x = x + 1"}},
+        {{"sid", "B"}, {"exp", "x / 0"}},
+        {{"sid", "A"}, {"exp", "x * 10"}},
+        {{"exp", "2 + 2"}},
+        {{"sid", "A"}},
+    });
+
+    auto res = cli.Post("/calculate/batch", batch.dump(), "application/json");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+
+    json j = json::parse(res->body);
+    ASSERT_EQ(j.size(), 7u);
+    EXPECT_DOUBLE_EQ(j[0]["res"], 1.0);
+    EXPECT_DOUBLE_EQ(j[1]["res"], 100.0);
+    EXPECT_DOUBLE_EQ(j[2]["res"], 2.0);
+    EXPECT_EQ(j[3]["err"], "Division by zero");
+    EXPECT_DOUBLE_EQ(j[4]["res"], 20.0);
+    EXPECT_DOUBLE_EQ(j[5]["res"], 4.0);
+    EXPECT_TRUE(j[6].contains("err"));
+
+    // Batch items run in the same sessions as single requests
+    auto single = cli.Post("/calculate", R"({"sid":"A","exp":"x"})", "application/json");
+    ASSERT_TRUE(single);
+    EXPECT_DOUBLE_EQ(json::parse(single->body)["res"], 2.0);
+}
+
+TEST_F(ServerIntegrationTest, BatchRejectsNonArray) {
+    httplib::Client cli("localhost", port);
+    auto res = cli.Post("/calculate/batch", R"({"exp":"1+1"})", "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 400);
+    EXPECT_TRUE(json::parse(res->body).contains("err"));
+}
+
+TEST_F(ServerIntegrationTest, VectorEvaluation) {
+    httplib::Client cli("localhost", port);
+    json req_json = {
+        {"exp", "price * qty - fee"},
+        {"vars", {{"price", {10.0, 20.0, 30.0}}, {"qty", {1, 2, 3}}, {"fee", 0.5}}},
+    };
+    auto res = cli.Post("/calculate/vector", req_json.dump(), "application/json");
+
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    json j = json::parse(res->body);
+    ASSERT_EQ(j["res"].size(), 3u);
+    EXPECT_DOUBLE_EQ(j["res"][0], 9.5);
+    EXPECT_DOUBLE_EQ(j["res"][1], 39.5);
+    EXPECT_DOUBLE_EQ(j["res"][2], 89.5);
+}
+
+TEST_F(ServerIntegrationTest, VectorEvaluationErrors) {
+    httplib::Client cli("localhost", port);
+    auto mismatch = cli.Post("/calculate/vector",
+                             R"({"exp":"a + b","vars":{"a":[1,2],"b":[1]}})",
+                             "application/json");
+    ASSERT_TRUE(mismatch);
+    EXPECT_EQ(mismatch->status, 400);
+
+    auto zero = cli.Post("/calculate/vector",
+                         R"({"exp":"1 / a","vars":{"a":[1,0]}})",
+                         "application/json");
+    ASSERT_TRUE(zero);
+    EXPECT_EQ(zero->status, 400);
+    EXPECT_EQ(json::parse(zero->body)["err"], "Division by zero in row 1");
+}
+
+TEST_F(ServerIntegrationTest, DumpShowsOptimizedProgram) {
+    httplib::Client cli("localhost", port);
+    auto res = cli.Post("/calculate", R"({"cmd":"dump","exp":"(2*3600)*rate + (2*3600)*rate/10"})",
+                        "application/json");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    std::string listing = json::parse(res->body)["res"];
+    EXPECT_NE(listing.find("PUSH_CONST 7200"), std::string::npos) << listing;
+    EXPECT_NE(listing.find("LOAD_TEMP"), std::string::npos) << listing;
+}
+
+// /metrics exposes request outcomes and stage timings in text format
+TEST_F(ServerIntegrationTest, MetricsEndpoint) {
+    httplib::Client cli("localhost", port);
+    cli.Post("/calculate", json{{"exp", "2 + 3"}}.dump(), "application/json");
+    cli.Post("/calculate", json{{"exp", "1 / 0"}}.dump(), "application/json");
+    cli.Post("/calculate", "{not json", "application/json");
+
+    auto res = cli.Get("/metrics");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    const std::string& text = res->body;
+    EXPECT_NE(text.find("calc_requests_total{endpoint=\"/calculate\",outcome=\"ok\"} 1\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("calc_requests_total{endpoint=\"/calculate\",outcome=\"error\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_requests_total{endpoint=\"/calculate\",outcome=\"bad_request\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_count{stage=\"json_parse\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_count{stage=\"serialize\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_count{stage=\"request\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_stage_duration_seconds_count{stage=\"tokenize\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("calc_sessions_active 1\n"), std::string::npos);
+}
+
+TEST_F(ServerIntegrationTest, BoundFormulaFollowsInputs) {
+    httplib::Client cli("localhost", port);
+    auto post = [&](const json& body) {
+        auto res = cli.Post("/calculate", body.dump(), "application/json");
+        EXPECT_TRUE(res);
+        return json::parse(res->body);
+    };
+
+    post({{"sid", "R"}, {"exp", "price = 10; qty = 3"}});
+    EXPECT_EQ(post({{"sid", "R"}, {"cmd", "bind"}, {"exp", "total = price * qty"}})["res"], 30.0);
+    EXPECT_EQ(post({{"sid", "R"}, {"cmd", "bind"}, {"exp", "net = total - fee"}}), json::object()); // fee unknown yet
+
+    post({{"sid", "R"}, {"exp", "qty = 4; fee = 5"}});
+    EXPECT_EQ(post({{"sid", "R"}, {"exp", "net"}})["res"], 35.0);
+
+    EXPECT_EQ(post({{"sid", "R"}, {"exp", "total = 1"}})["err"], "Cannot assign to bound variable: total");
+    EXPECT_EQ(post({{"sid", "R"}, {"cmd", "bind"}, {"exp", "price = net"}})["err"],
+              "Cyclic binding: price -> total -> net -> price");
+
+    json bindings = post({{"sid", "R"}, {"cmd", "bindings"}})["res"];
+    EXPECT_EQ(bindings["total"]["exp"], "total = price * qty");
+    EXPECT_EQ(bindings.size(), 2u);
+
+    EXPECT_EQ(post({{"sid", "R"}, {"cmd", "unbind"}, {"var", "total"}}), json::object());
+    post({{"sid", "R"}, {"exp", "price = 0"}});
+    EXPECT_EQ(post({{"sid", "R"}, {"exp", "total"}})["res"], 40.0); // no longer follows price
+    EXPECT_EQ(post({{"sid", "R"}, {"cmd", "unbind"}, {"var", "total"}})["err"], "Variable is not bound: total");
+}
+
+TEST_F(ServerIntegrationTest, FunctionCommands) {
+    httplib::Client cli("localhost", port);
+    auto post = [&](const json& body) {
+        auto res = cli.Post("/calculate", body.dump(), "application/json");
+        EXPECT_TRUE(res);
+        return json::parse(res->body);
+    };
+
+    EXPECT_EQ(post({{"sid", "F"}, {"cmd", "def"}, {"exp", "f(a, b) = a * b + 3"}}), json::object());
+    EXPECT_EQ(post({{"cmd", "def"}, {"exp", "sq(v) = v * v"}, {"scope", "global"}}), json::object());
+    EXPECT_EQ(post({{"sid", "F"}, {"exp", "x = 4; f(2, x) + sq(3)"}})["res"], 20.0);
+    EXPECT_EQ(post({{"sid", "G"}, {"exp", "f(2, 3)"}})["err"], "Unknown function: f");
+    EXPECT_EQ(post({{"sid", "F"}, {"exp", "f(1)"}})["err"], "Function f expects 2 arguments, got 1");
+    EXPECT_EQ(post({{"sid", "F"}, {"cmd", "def"}, {"exp", "f(a, a) = a"}})["err"], "Duplicate parameter: a");
+    EXPECT_EQ(post({{"cmd", "def"}, {"exp", "g() = 1"}, {"scope", "everywhere"}})["err"], "Unknown scope: everywhere");
+
+    json functions = post({{"sid", "F"}, {"cmd", "functions"}})["res"];
+    EXPECT_EQ(functions["f"]["exp"], "f(a, b) = a * b + 3");
+    EXPECT_EQ(functions["f"]["scope"], "session");
+    EXPECT_EQ(functions["sq"]["scope"], "global");
+
+    EXPECT_EQ(post({{"sid", "F"}, {"cmd", "undef"}, {"var", "f"}}), json::object());
+    EXPECT_EQ(post({{"sid", "F"}, {"cmd", "undef"}, {"var", "f"}})["err"], "Function is not defined: f");
+    EXPECT_EQ(post({{"cmd", "undef"}, {"var", "sq"}, {"scope", "global"}}), json::object());
+    EXPECT_EQ(post({{"sid", "F"}, {"cmd", "functions"}})["res"], json::object());
+}
+
+// NDJSON stream: one result line per record, in order, then a summary
+TEST_F(ServerIntegrationTest, StreamNdjson) {
+    httplib::Client cli("localhost", port);
+    std::string body;
+    for (int i = 1; i <= 1000; ++i) {
+        body += json{{"sid", "s" + std::to_string(i % 3)}, {"exp", "x = " + std::to_string(i)}}.dump() + "\n";
+    }
+    body += "{\"sid\":\"s1\",\"exp\":\"x * 2\"}\n";
+
+    auto res = cli.Post("/calculate/stream", body, "application/x-ndjson");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+
+    std::vector<json> lines;
+    size_t start = 0;
+    while (start < res->body.size()) {
+        size_t end = res->body.find('\n', start);
+        lines.push_back(json::parse(res->body.substr(start, end - start)));
+        start = end + 1;
+    }
+    ASSERT_EQ(lines.size(), 1002u);
+    EXPECT_EQ(lines[0]["res"], 1.0);
+    EXPECT_EQ(lines[999]["res"], 1000.0);
+    EXPECT_EQ(lines[1000]["res"], 2000.0); // s1 last assigned x = 1000
+    EXPECT_EQ(lines[1001]["records"], 1001);
+    EXPECT_EQ(lines[1001]["errors"], 0);
+}